@@ -19,8 +19,18 @@
 #include "mse/engine.h"
 #include "mse/sound.h"
 
+#include "mse/utils/scheduling.h"
+
 #include "coreapp.h"
 
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+
 #if __has_include(<quazip5/quazipfile.h>)
     #include <quazip5/quazipfile.h>
 #else
@@ -28,6 +38,40 @@
 #endif
 
 static MSE_Engine* instance = nullptr;
+static const int pluginCacheFormat = 1; // layout of the plugin manifest cache, bump it on changes
+
+static QJsonObject pluginInfoToJson(const MSE_EnginePluginInfo& info)
+{
+    QJsonArray formats;
+    foreach(const MSE_EnginePluginFormat& fmt, info.formats)
+    {
+        QJsonObject format;
+        format.insert(QStringLiteral("description"), fmt.description);
+        format.insert(QStringLiteral("extensions"), QJsonArray::fromStringList(fmt.extensions));
+        formats.append(format);
+    }
+    QJsonObject manifest;
+    manifest.insert(QStringLiteral("version"), static_cast<qint64>(info.version.asDword()));
+    manifest.insert(QStringLiteral("formats"), formats);
+    return manifest;
+}
+
+static MSE_EnginePluginInfo pluginInfoFromJson(const QString& filename, const QJsonObject& manifest)
+{
+    MSE_EnginePluginInfo info;
+    info.filename = filename;
+    info.version.setDword(static_cast<DWORD>(manifest.value(QStringLiteral("version")).toDouble()));
+    foreach(const QJsonValue& formatValue, manifest.value(QStringLiteral("formats")).toArray())
+    {
+        QJsonObject format = formatValue.toObject();
+        MSE_EnginePluginFormat fmt;
+        fmt.description = format.value(QStringLiteral("description")).toString();
+        foreach(const QJsonValue& ext, format.value(QStringLiteral("extensions")).toArray())
+            fmt.extensions.append(ext.toString());
+        info.formats.append(fmt);
+    }
+    return info;
+}
 
 /*!
  * Constructs MSE_Engine instance.
@@ -37,12 +81,22 @@ static MSE_Engine* instance = nullptr;
  */
 MSE_Engine::MSE_Engine(QObject *parent) : MSE_Object(parent)
 {
+    isFloatSupported = false;
+    is3DSupported = false;
+    featuresProbed = false;
+    masterVolumeAvailable = false;
+    masterVolumeInited = false;
+    recordingInited = false;
 #ifdef Q_OS_WIN
     mvCoInited = false;
 #endif
 #ifdef Q_OS_LINUX
     mvMixerHandle = nullptr;
     mvSelemId = nullptr;
+    mvVolume = -1;
+#endif
+#ifdef MSE_MODULE_SOURCE_URL
+    remoteCache = nullptr;
 #endif
 }
 
@@ -66,12 +120,18 @@ MSE_Engine* MSE_Engine::getInstance()
  */
 MSE_Engine::~MSE_Engine()
 {
+    ioPool.waitForDone(MSE_WorkerPool::shutdownTimeout);
+    workerPool.waitForDone(MSE_WorkerPool::shutdownTimeout);
+#ifdef MSE_MODULE_SOURCE_URL
+    delete remoteCache;
+#endif
     unloadAllPlugins();
 #ifdef Q_OS_WIN
     if(mvCoInited)
         CoUninitialize();
 #endif
 #ifdef Q_OS_LINUX
+    qDeleteAll(mvNotifiers);
     if(mvMixerHandle)
         snd_mixer_close(mvMixerHandle);
 #endif
@@ -85,26 +145,71 @@ MSE_Engine::~MSE_Engine()
  *
  * Refer to MSE_EngineInitParams for the information about initialization parameters.
  *
+ * The time spent on each phase is available via getInitTimings.
+ *
  * \sa getDefaultInitParams
  */
 bool MSE_Engine::init(const MSE_EngineInitParams& params)
 {
+    QElapsedTimer timer;
+    timer.start();
     initParams = params;
+    initTimings = MSE_EngineInitTimings();
 
     if(initParams.userAgent.isEmpty())
         initParams.userAgent = getDefaultUA();
     else
         initParams.userAgent = initParams.userAgent.simplified();
 
+    workerPool.setMaxThreads(initParams.workerThreads);
+    workerPool.setThreadsCpus(initParams.workerThreadsCpus);
+    ioPool.setMaxThreads(initParams.ioThreads);
+    ioPool.setThreadsCpus(initParams.workerThreadsCpus);
+
     if(!postInit())
         return false;
+#ifdef MSE_MODULE_SOURCE_URL
+    if(!initRemoteCache())
+        return false;
+#endif
 
     initParams.useDefaultDevice = (BASS_GetConfig(BASS_CONFIG_DEV_DEFAULT) != 0);
     refreshVolume();
-    masterVolumeAvailable = initMasterVolumeControl();
+    if(!initParams.deferredInit)
+        initMasterVolume();
+    initTimings.total = timer.nsecsElapsed() / 1000;
     return true;
 }
 
+#ifdef MSE_MODULE_SOURCE_URL
+/*!
+ * Creates the shared cache for remote resources if MSE_EngineInitParams::remoteCacheSize is set.
+ * There must be only one cache per directory, because it removes all files it doesn't know about.
+ */
+bool MSE_Engine::initRemoteCache()
+{
+    delete remoteCache;
+    remoteCache = nullptr;
+    if(initParams.remoteCacheSize <= 0)
+        return true;
+
+    if(initParams.remoteCacheDir.isEmpty())
+        initParams.remoteCacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation)+"/remote";
+    remoteCache = new MSE_RemoteCache(this);
+    if(!remoteCache->init(
+        initParams.remoteCacheDir,
+        initParams.remoteCacheSize,
+        &workerPool,
+        initParams.userAgent.toUtf8()))
+    {
+        delete remoteCache;
+        remoteCache = nullptr;
+        return false;
+    }
+    return true;
+}
+#endif
+
 /*!
  * Snap a given sound volume value to a grid with a *gridStep* step.
  * If the volume is greater than or equals the maximum then return this maximum.
@@ -150,13 +255,19 @@ bool MSE_Engine::postInit()
 
     //BASS_SetConfig(BASS_CONFIG_FLOATDSP, 1);
 
+    // BASS has no API for its threads, so they are found by comparing the thread lists
+    QList<qint64> threadsBefore = MSE_Scheduling::getThreadIds();
+    QElapsedTimer timer;
+    timer.start();
     CHECK(BASS_Init(initParams.device, initParams.outputFrequency, flags, nullptr, nullptr), MSE_Object::Err::initFail);
+    initTimings.bassInit = timer.nsecsElapsed() / 1000;
 
-    if(initParams.recordingDevice >= -1)
-        CHECK(!BASS_RecordInit(initParams.recordingDevice), MSE_Object::Err::recordInitFail);
-
-    isFloatSupported = checkForFeature(BASS_SAMPLE_FLOAT, initParams);
-    is3DSupported = checkForFeature(BASS_DEVICE_3D, initParams);
+    if(!initParams.deferredInit)
+    {
+        if((initParams.recordingDevice >= -1) && !initRecordingDevice())
+            return false;
+        probeFeatures();
+    }
 
     uaString = initParams.userAgent.toUtf8();
     BASS_SetConfigPtr(BASS_CONFIG_NET_AGENT, uaString.constData());
@@ -169,10 +280,57 @@ bool MSE_Engine::postInit()
     if(nThreads <= 0)
         nThreads = 1;
     BASS_SetConfig(BASS_CONFIG_UPDATETHREADS, nThreads);
+    applyScheduling(threadsBefore);
+
+    bufferTuner.stop();
+    if(initParams.adaptiveBuffer)
+        if(!bufferTuner.start(initParams.bufferLength, initParams.updatePeriod, initParams.bufferTuning))
+            return false;
 
     return true;
 }
 
+/*!
+ * Applies the scheduling options to the threads of BASS and fills the scheduling status.
+ *
+ * BASS has no API for its threads. They are the threads that didn't exist before the initialization
+ * and that have the same name as the calling thread: BASS doesn't name its threads, so they inherit the name,
+ * while Qt names every QThread (including the pooled ones, e.g. of MSE_Engine::getWorkerPool)
+ * that other threads of the application could have started in the meantime.
+ * An unnamed thread started by the application from this thread can't be told apart.
+ */
+void MSE_Engine::applyScheduling(const QList<qint64> &threadsBefore)
+{
+    schedulingStatus = MSE_EngineSchedulingStatus();
+    schedulingStatus.workerThreadsAffinity = MSE_Scheduling::isCpuSetAvailable(initParams.workerThreadsCpus);
+
+    QList<qint64> threads = MSE_Scheduling::getThreadIds();
+    foreach(qint64 id, threadsBefore)
+        threads.removeOne(id);
+    QString ownName = MSE_Scheduling::getThreadName(0);
+    QMutableListIterator<qint64> i(threads);
+    while(i.hasNext())
+    {
+        if(MSE_Scheduling::getThreadName(i.next()) != ownName)
+            i.remove();
+    }
+    schedulingStatus.updateThreads = threads.size();
+    if(threads.isEmpty())
+        return;
+
+    bool policyOk = initParams.updateThreadsPolicy != mse_tpDefault;
+    bool affinityOk = !initParams.updateThreadsCpus.isEmpty();
+    foreach(qint64 id, threads)
+    {
+        if(policyOk && !MSE_Scheduling::setThreadPolicy(id, initParams.updateThreadsPolicy, initParams.updateThreadsPriority))
+            policyOk = false;
+        if(affinityOk && !MSE_Scheduling::setThreadAffinity(id, initParams.updateThreadsCpus))
+            affinityOk = false;
+    }
+    schedulingStatus.updateThreadsPolicy = policyOk;
+    schedulingStatus.updateThreadsAffinity = affinityOk;
+}
+
 /*!
  * Check whether a certain flag combination is acceptable for creating a sound stream.
  */
@@ -185,6 +343,94 @@ bool MSE_Engine::checkForFeature(DWORD flags, const MSE_EngineInitParams &params
     return true;
 }
 
+/*!
+ * Probes for the floating-point and 3D support, unless it's already done.
+ */
+void MSE_Engine::probeFeatures() const
+{
+    if(featuresProbed)
+        return;
+    featuresProbed = true;
+    QElapsedTimer timer;
+    timer.start();
+    isFloatSupported = checkForFeature(BASS_SAMPLE_FLOAT, initParams);
+    is3DSupported = checkForFeature(BASS_DEVICE_3D, initParams);
+    initTimings.featureProbes = timer.nsecsElapsed() / 1000;
+}
+
+/*!
+ * Initializes the recording device specified by MSE_EngineInitParams::recordingDevice,
+ * unless it's already done.
+ * With MSE_EngineInitParams::deferredInit it's called by MSE_Sound::startRecord.
+ */
+bool MSE_Engine::initRecordingDevice()
+{
+    if(recordingInited)
+        return true;
+    CHECK(initParams.recordingDevice >= -1, MSE_Object::Err::recordInitFail);
+    QElapsedTimer timer;
+    timer.start();
+    CHECK(BASS_RecordInit(initParams.recordingDevice), MSE_Object::Err::recordInitFail);
+    recordingInited = true;
+    initTimings.recordingDevice = timer.nsecsElapsed() / 1000;
+    return true;
+}
+
+/*!
+ * Initializes the master volume controls on the first call.
+ * Returns true if the master volume can be controlled.
+ * It's const like probeFeatures, because opening the controls
+ * doesn't change the observable state of the engine.
+ */
+bool MSE_Engine::initMasterVolume() const
+{
+    if(!masterVolumeInited)
+    {
+        masterVolumeInited = true;
+        MSE_Engine* self = const_cast<MSE_Engine*>(this);
+        QElapsedTimer timer;
+        timer.start();
+        masterVolumeAvailable = self->initMasterVolumeControl();
+        initTimings.masterVolume = timer.nsecsElapsed() / 1000;
+#ifdef Q_OS_LINUX
+        if(masterVolumeAvailable && initParams.watchMasterVolume)
+            self->watchMasterVolume();
+#endif
+    }
+    return masterVolumeAvailable;
+}
+
+#ifdef Q_OS_LINUX
+/*!
+ * Starts watching the poll descriptors of the ALSA mixer,
+ * so the master volume is only read when the mixer reports a change.
+ */
+void MSE_Engine::watchMasterVolume()
+{
+    int n = snd_mixer_poll_descriptors_count(mvMixerHandle);
+    if(n <= 0)
+        return;
+    QVector<struct pollfd> fds(n);
+    n = snd_mixer_poll_descriptors(mvMixerHandle, fds.data(), static_cast<unsigned int>(n));
+    for(int a=0; a<n; a++)
+    {
+        QSocketNotifier* notifier = new QSocketNotifier(fds.at(a).fd, QSocketNotifier::Read);
+        connect(notifier, &QSocketNotifier::activated, this, &MSE_Engine::onMasterVolumeEvent);
+        mvNotifiers.append(notifier);
+    }
+    mvVolume = queryMasterVolume();
+}
+
+void MSE_Engine::onMasterVolumeEvent()
+{
+    float vol = queryMasterVolume();
+    if((vol < 0) || (vol == mvVolume))
+        return;
+    mvVolume = vol;
+    emit onMasterVolumeChange(vol);
+}
+#endif
+
 /*!
  * Tries to initialize the master volume controls.
  *
@@ -290,11 +536,27 @@ bool MSE_Engine::loadPlugin(const QString &filename)
     CHECK(!fullFilename.isEmpty(), MSE_Object::Err::cannotGetCanonicalPath, filename);
 
     HPLUGIN plug;
+    MSE_EnginePluginInfo info;
+    if(!openPlugin(fullFilename, plug, info))
+        return false;
+
+    pluginHandles.append(plug);
+    plugins.append(info);
+
+    return true;
+}
+
+/*!
+ * Calls BASS_PluginLoad for a plugin with a full canonical *filename* and fetches its information.
+ */
+bool MSE_Engine::openPlugin(const QString &filename, HPLUGIN &handle, MSE_EnginePluginInfo &info)
+{
+    HPLUGIN plug;
 
 #ifdef Q_OS_WIN
-    plug = BASS_PluginLoad((char*)(fullFilename.utf16()), BASS_UNICODE);
+    plug = BASS_PluginLoad((char*)(filename.utf16()), BASS_UNICODE);
 #else
-    plug = BASS_PluginLoad(fullFilename.toUtf8().constData(), 0);
+    plug = BASS_PluginLoad(filename.toUtf8().constData(), 0);
 #endif
 
     if(!plug)
@@ -329,13 +591,14 @@ bool MSE_Engine::loadPlugin(const QString &filename)
     }
 
     MSE_EnginePluginFormat fmt;
-    MSE_EnginePluginInfo info;
     const BASS_PLUGINFORM* format;
     QString exts;
     QStringList extList;
 
-    info.filename = fullFilename;
+    info = MSE_EnginePluginInfo();
+    info.filename = filename;
     info.version.setDword(plugInfo->version);
+    info.isLoaded = true;
     quint32 n = plugInfo->formatc;
 
     for(quint32 a=0; a<n; a++)
@@ -350,9 +613,7 @@ bool MSE_Engine::loadPlugin(const QString &filename)
         info.formats.append(fmt);
     }
 
-    pluginHandles.append(plug);
-    plugins.append(info);
-
+    handle = plug;
     return true;
 }
 
@@ -368,6 +629,10 @@ bool MSE_Engine::loadPlugin(const QString &filename)
  *  Linux   | libbass?*.so
  *  OSX     | libbass?*.dylib
  *
+ * With MSE_EngineInitParams::lazyPlugins the plugins that are found in the manifest cache
+ * are only registered (see MSE_EnginePluginInfo::isLoaded),
+ * the rest are loaded to get their manifests, which are then saved to the cache.
+ *
  * Returns true if ALL plugins were successfully loaded.
  *
  * \note OSX libraries must be located in the application directory.
@@ -392,12 +657,148 @@ bool MSE_Engine::loadPluginsFromDirectory(const QString &dirname)
 #endif
     QStringList entries = dir.entryList(nameFilters, QDir::Files, {});
     bool ok = true;
+
+    if(!initParams.lazyPlugins)
+    {
+        foreach(QString entry, entries)
+            if(!loadPlugin(fullDirname + entry))
+                ok = false;
+        return ok;
+    }
+
+    QString cacheFilename = getPluginCacheFile();
+    QJsonObject cache;
+    QFile cacheFile(cacheFilename);
+    if(cacheFile.open(QIODevice::ReadOnly))
+    {
+        cache = QJsonDocument::fromJson(cacheFile.readAll()).object();
+        cacheFile.close();
+    }
+    double bassVersion = BASS_GetVersion();
+    // the plugins may refuse to load with another BASS version, so the manifests are worthless
+    if((cache.value(QStringLiteral("format")).toInt() != pluginCacheFormat)
+            || (cache.value(QStringLiteral("bass")).toDouble() != bassVersion))
+        cache = QJsonObject();
+    QJsonObject manifests = cache.value(QStringLiteral("plugins")).toObject();
+    bool changed = false;
+
+    QStringList filenames;
     foreach(QString entry, entries)
-        if(!loadPlugin(fullDirname + entry))
+    {
+        QFileInfo fi(fullDirname + entry);
+        QString filename = fi.canonicalFilePath();
+        if(filename.isEmpty())
+        {
+            // let loadPlugin report the error
+            if(!loadPlugin(fi.filePath()))
+                ok = false;
+            continue;
+        }
+        filenames.append(filename);
+
+        double size = fi.size();
+        double mtime = fi.lastModified().toMSecsSinceEpoch();
+        QJsonObject manifest = manifests.value(filename).toObject();
+        if((manifest.value(QStringLiteral("size")).toDouble(-1) == size)
+                && (manifest.value(QStringLiteral("mtime")).toDouble(-1) == mtime))
+        {
+            plugins.append(pluginInfoFromJson(filename, manifest));
+            pluginHandles.append(0);
+            continue;
+        }
+
+        changed = true;
+        if(!loadPlugin(filename))
+        {
+            manifests.remove(filename);
             ok = false;
+            continue;
+        }
+        manifest = pluginInfoToJson(plugins.last());
+        manifest.insert(QStringLiteral("size"), size);
+        manifest.insert(QStringLiteral("mtime"), mtime);
+        manifests.insert(filename, manifest);
+    }
+
+    // forget the plugins that are gone from this directory
+    foreach(const QString& filename, manifests.keys())
+    {
+        if(filename.startsWith(fullDirname) && !filenames.contains(filename))
+        {
+            manifests.remove(filename);
+            changed = true;
+        }
+    }
+
+    if(changed)
+    {
+        cache.insert(QStringLiteral("format"), pluginCacheFormat);
+        cache.insert(QStringLiteral("bass"), bassVersion);
+        cache.insert(QStringLiteral("plugins"), manifests);
+        // it's only a cache, so the plugins are fine even if it can't be saved
+        QDir().mkpath(QFileInfo(cacheFilename).absolutePath());
+        QSaveFile saveFile(cacheFilename);
+        if(saveFile.open(QIODevice::WriteOnly))
+        {
+            saveFile.write(QJsonDocument(cache).toJson(QJsonDocument::Compact));
+            saveFile.commit();
+        }
+    }
+
+    return ok;
+}
+
+/*!
+ * Loads a plugin that was registered from the manifest cache.
+ * If the plugin cannot be loaded, then its formats are dropped,
+ * so typeByUri doesn't try it again.
+ */
+bool MSE_Engine::loadPendingPlugin(int index)
+{
+    CHECK((index>=0) && (index<plugins.size()), MSE_Object::Err::outOfRange);
+    if(pluginHandles.at(index))
+        return true;
+
+    HPLUGIN plug;
+    MSE_EnginePluginInfo info;
+    if(!openPlugin(plugins.at(index).filename, plug, info))
+    {
+        plugins[index].formats.clear();
+        return false;
+    }
+    pluginHandles[index] = plug;
+    plugins[index] = info;
+    return true;
+}
+
+/*!
+ * Loads all plugins that are registered from the manifest cache but not loaded yet.
+ * Call it before creating a stream that BASS has to probe with all plugins,
+ * e.g. a network stream without a file extension.
+ *
+ * Returns true if ALL pending plugins were successfully loaded.
+ *
+ * \sa MSE_EngineInitParams::lazyPlugins
+ */
+bool MSE_Engine::loadPendingPlugins()
+{
+    bool ok = true;
+    int n = plugins.size();
+    for(int a=0; a<n; a++)
+    {
+        if(!loadPendingPlugin(a))
+            ok = false;
+    }
     return ok;
 }
 
+QString MSE_Engine::getPluginCacheFile() const
+{
+    if(!initParams.pluginCacheFile.isEmpty())
+        return initParams.pluginCacheFile;
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation)+"/plugins.json";
+}
+
 /*!
  * Unloads a plugin with a specified index.
  * To get an index of a particular plugin you may use getPluginsCount and getPluginInfo.
@@ -409,7 +810,7 @@ bool MSE_Engine::loadPluginsFromDirectory(const QString &dirname)
 bool MSE_Engine::unloadPlugin(int index)
 {
     CHECK((index>=0) && (index<plugins.size()), MSE_Object::Err::outOfRange);
-    if(!BASS_PluginFree(pluginHandles[index]))
+    if(pluginHandles[index] && !BASS_PluginFree(pluginHandles[index]))
         return false;
     plugins.removeAt(index);
     pluginHandles.removeAt(index);
@@ -454,6 +855,8 @@ bool MSE_Engine::unzipFile(const QString &filename, QByteArray& arr) const
 
 /*!
  * Returns a type of a sound file by its URI.
+ * If the file is routed to a plugin that is not loaded yet
+ * (see MSE_EngineInitParams::lazyPlugins), then the plugin is loaded here.
  */
 MSE_SoundChannelType MSE_Engine::typeByUri(const QString &uri) const
 {
@@ -472,10 +875,20 @@ MSE_SoundChannelType MSE_Engine::typeByUri(const QString &uri) const
     int n = getPluginsCount();
     for(int a=0; a<n; a++)
     {
-        MSE_EnginePluginInfo pluginInfo = getPluginInfo(a);
-        foreach(MSE_EnginePluginFormat format, pluginInfo.formats)
+        bool supported = false;
+        foreach(const MSE_EnginePluginFormat& format, plugins.at(a).formats)
+        {
             if(format.extensions.contains(ext))
-                return mse_sctPlugin;
+            {
+                supported = true;
+                break;
+            }
+        }
+        if(!supported)
+            continue;
+        // a lazy plugin is loaded the first time a file is routed to it
+        if(pluginHandles.at(a) || const_cast<MSE_Engine*>(this)->loadPendingPlugin(a))
+            return mse_sctPlugin;
     }
 
     if((ext == "mp3")||(ext == "mp2")||(ext == "mp1")||(ext == "ogg")||(ext == "wav")||(ext == "aiff"))
@@ -600,7 +1013,20 @@ bool MSE_Engine::changeVolume(float diff, bool snapToGrid)
  */
 float MSE_Engine::getMasterVolume()
 {
-    CHECKN(masterVolumeAvailable, MSE_Object::Err::masterVolumeNotAvailable);
+    CHECKN(initMasterVolume(), MSE_Object::Err::masterVolumeNotAvailable);
+#ifdef Q_OS_LINUX
+    if(!mvNotifiers.isEmpty())
+        return mvVolume;
+#endif
+    return queryMasterVolume();
+}
+
+/*!
+ * Reads the master volume from the system.
+ * Returns -1 if a sound level cannot be retrieved.
+ */
+float MSE_Engine::queryMasterVolume()
+{
     float vol;
 
 #ifdef Q_OS_WIN
@@ -621,7 +1047,7 @@ float MSE_Engine::getMasterVolume()
                mvMixerElem,
                SND_MIXER_SCHN_MONO,
                &_vol), MSE_Object::Err::unableGetMasterVolume);
-    vol = (_vol+mvMin)/mvRange;
+    vol = (_vol-mvMin)/mvRange;
 #endif
 
     if(vol < 0)
@@ -637,7 +1063,7 @@ float MSE_Engine::getMasterVolume()
  */
 bool MSE_Engine::setMasterVolume(float val)
 {
-    CHECK(masterVolumeAvailable, MSE_Object::Err::masterVolumeNotAvailable);
+    CHECK(initMasterVolume(), MSE_Object::Err::masterVolumeNotAvailable);
 
     if(val > 1)
         val = 1;
@@ -689,6 +1115,8 @@ bool MSE_Engine::setMasterVolume(float val)
 
     CHECK(!setVolResult, MSE_Object::Err::unableSetMasterVolume);
 
+    if(!mvNotifiers.isEmpty())
+        onMasterVolumeEvent();
     return true;
 #endif
     return false;
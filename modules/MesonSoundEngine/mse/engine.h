@@ -20,11 +20,21 @@
 
 #include "mse/object.h"
 #include "mse/sound.h"
+#include "mse/utils/buffer_tuner.h"
+#include "mse/utils/worker_pool.h"
+
+#ifdef MSE_MODULE_SOURCE_URL
+    #include "mse/utils/remote_cache.h"
+#endif
 
 #ifdef QT_NETWORK_LIB
     #include <QtNetwork/QNetworkProxy>
 #endif
 
+#ifdef Q_OS_LINUX
+    #include <QSocketNotifier>
+#endif
+
 /*!
  * Parameters for MSE_Engine initialization.
  */
@@ -122,6 +132,43 @@ struct MSE_EngineInitParams {
     **Valid values**: 10..5000, but not lower than MSE_EngineInitParams::updatePeriod.
 
     **Default**: 500
+*/
+#ifdef MSE_MODULE_SOURCE_URL
+    qint64 remoteCacheSize = 0; /*!<
+    Maximum size (in bytes) of the on-disk cache for finite remote resources,
+    e.g. podcast episodes added with MSE_Playlist::addUrl().
+    A resource is cached once it has been downloaded completely,
+    and the next time it's played from the local file even when offline.
+    The cached files are validated with ETag/Last-Modified in the background.
+    Internet-radio streams are never cached.
+    The cache is shared by all MSE_Sound objects.
+
+    Set to zero to disable the cache.
+
+    **Default**: 0
+
+    \sa remoteCacheDir, MSE_Engine::getRemoteCache
+*/
+    QString remoteCacheDir; /*!<
+    Directory for the on-disk cache of remote resources.
+
+    **Default**: &lt;empty&gt; (i.e. "remote" subdirectory of QStandardPaths::CacheLocation)
+
+    \sa remoteCacheSize
+*/
+#endif
+    bool adaptiveBuffer = false; /*!<
+    Adjust MSE_EngineInitParams::bufferLength and MSE_EngineInitParams::updatePeriod
+    to the underruns of the playing channels, within the bounds of MSE_EngineInitParams::bufferTuning.
+
+    **Default**: false
+
+    \sa MSE_Engine::getBufferTuner
+*/
+    MSE_BufferTuningParams bufferTuning; /*!<
+    Bounds and hysteresis of MSE_EngineInitParams::adaptiveBuffer.
+
+    **Default**: see MSE_BufferTuningParams
 */
     int updateThreads = -1;/*!<
     How many channel playback buffers can be updated in parallel.
@@ -129,6 +176,123 @@ struct MSE_EngineInitParams {
     **Valid values**: any positive integer or -1 for a system default.
 
     **Default**: -1
+*/
+    int workerThreads = -1;/*!<
+    Maximum number of threads in the shared worker pool
+    that runs short blocking jobs, e.g. file copies and image scaling.
+
+    **Valid values**: any positive integer or -1 for QThread::idealThreadCount().
+
+    **Default**: -1
+
+    \sa MSE_Engine::getWorkerPool
+*/
+    int ioThreads = 16;/*!<
+    Maximum number of threads in the pool for the jobs that wait for the network,
+    e.g. creating the streams for network sources.
+    A stalled server holds a thread for as long as it stalls
+    (see MSE_SoundInitParams::remoteReadTimeout),
+    so these jobs are kept apart from MSE_EngineInitParams::workerThreads.
+
+    **Valid values**: any positive integer or -1 for QThread::idealThreadCount().
+
+    **Default**: 16
+
+    \sa MSE_Engine::getIoPool
+*/
+    MSE_ThreadPolicy updateThreadsPolicy = mse_tpDefault; /*!<
+    Scheduling policy for the threads that BASS creates for the output and the playback buffer updates.
+    Only for Linux. Raising the priority needs privileges (e.g. RLIMIT_RTPRIO or CAP_SYS_NICE),
+    without them the threads keep the normal scheduling.
+    The threads are found among the ones that appear during MSE_Engine::init
+    by their name, so the named threads (e.g. any QThread) are never touched.
+
+    **Default**: mse_tpDefault
+
+    \sa MSE_Engine::getSchedulingStatus
+*/
+    int updateThreadsPriority = 0; /*!<
+    Nice value (-20..19) for mse_tpNice
+    or real-time priority (1..99) for mse_tpFifo and mse_tpRoundRobin,
+    see MSE_EngineInitParams::updateThreadsPolicy.
+
+    **Default**: 0
+*/
+    QList<int> updateThreadsCpus; /*!<
+    Zero-based numbers of CPUs to pin the BASS threads to
+    (see MSE_EngineInitParams::updateThreadsPolicy). Only for Linux.
+
+    **Default**: &lt;empty&gt; (no pinning)
+*/
+    QList<int> workerThreadsCpus; /*!<
+    Zero-based numbers of CPUs to pin the threads of MSE itself to:
+    the worker pools (see MSE_Engine::getWorkerPool and MSE_Engine::getIoPool) and MSE_Encoder.
+    Use it to keep them away from MSE_EngineInitParams::updateThreadsCpus.
+    Only for Linux and Windows.
+
+    **Default**: &lt;empty&gt; (no pinning)
+*/
+    bool deferredInit = false; /*!<
+    MSE_Engine::init only initializes the output device.
+    The pieces that are not needed to start playing are done on the first use:
+    the master volume control (e.g. ALSA mixer discovery) on the first master volume call,
+    the recording device on MSE_Sound::startRecord
+    and the feature probes on MSE_Engine::getIsFloatSupported/MSE_Engine::getIs3DSupported.
+
+    **Default**: false
+
+    \sa MSE_Engine::getInitTimings
+*/
+    bool watchMasterVolume = false; /*!<
+    Watch the master volume control for the changes instead of querying it on every call.
+    MSE_Engine::getMasterVolume returns the cached value
+    and MSE_Engine::onMasterVolumeChange is emitted when the volume actually changes,
+    no matter who has changed it. Only for Linux (the ALSA mixer events are used).
+
+    **Default**: false
+*/
+    bool lazyPlugins = false; /*!<
+    MSE_Engine::loadPluginsFromDirectory doesn't load the plugins
+    that are already described in the manifest cache (see MSE_EngineInitParams::pluginCacheFile).
+    Such a plugin is loaded the first time MSE_Engine::typeByUri returns mse_sctPlugin for its extension.
+    The remote streams are probed by all plugins, so they load all pending plugins.
+
+    **Default**: false
+
+    \sa MSE_Engine::loadPendingPlugins
+*/
+    QString pluginCacheFile; /*!<
+    The file with the manifests (formats and extensions) of the plugins.
+    An entry is reused while the path, the size and the modification time
+    of the plugin file (and the version of BASS) stay the same.
+    Only used with MSE_EngineInitParams::lazyPlugins.
+
+    **Default**: &lt;empty&gt; (i.e. "plugins.json" inside QStandardPaths::CacheLocation)
+*/
+};
+
+/*!
+ * Time spent on the phases of MSE_Engine initialization, in microseconds.
+ * A phase that has not run yet (e.g. deferred with MSE_EngineInitParams::deferredInit) is -1.
+ */
+struct MSE_EngineInitTimings {
+    qint64 bassInit = -1; /*!< BASS_Init. */
+    qint64 recordingDevice = -1; /*!< BASS_RecordInit. */
+    qint64 featureProbes = -1; /*!< Probing for the floating-point and 3D support. */
+    qint64 masterVolume = -1; /*!< Discovery of the master volume control. */
+    qint64 total = -1; /*!< The whole MSE_Engine::init call, i.e. time-to-ready. */
+};
+
+/*!
+ * Shows which scheduling options of MSE_EngineInitParams have actually taken effect.
+ */
+struct MSE_EngineSchedulingStatus {
+    int updateThreads = 0; /*!< Number of threads created by BASS during the initialization. */
+    bool updateThreadsPolicy = false; /*!< MSE_EngineInitParams::updateThreadsPolicy is applied to all BASS threads. */
+    bool updateThreadsAffinity = false; /*!< MSE_EngineInitParams::updateThreadsCpus is applied to all BASS threads. */
+    bool workerThreadsAffinity = false; /*!<
+    MSE_EngineInitParams::workerThreadsCpus is valid for this process,
+    so the worker threads are pinned when they pick up the jobs.
 */
 };
 
@@ -150,12 +314,12 @@ public:
     /*!
      * Returns true if floating point samples are supported.
      */
-    inline bool getIsFloatSupported() const {return isFloatSupported;}
+    inline bool getIsFloatSupported() const {probeFeatures(); return isFloatSupported;}
 
     /*!
      * Returns true if a 3D sound positioning and effects are supported.
      */
-    inline bool getIs3DSupported() const {return is3DSupported;}
+    inline bool getIs3DSupported() const {probeFeatures(); return is3DSupported;}
 
     /*!
      * Returns parameters the engine was initialized with.
@@ -164,6 +328,18 @@ public:
      */
     inline const MSE_EngineInitParams& getInitParams() const {return initParams;}
 
+    /*!
+     * Returns the time spent on the initialization phases.
+     * The deferred phases are filled in when they run.
+     */
+    inline const MSE_EngineInitTimings& getInitTimings() const {return initTimings;}
+
+    /*!
+     * Returns which scheduling options have taken effect.
+     * All options that were not requested are false.
+     */
+    inline const MSE_EngineSchedulingStatus& getSchedulingStatus() const {return schedulingStatus;}
+
     static float snapVolumeToGrid(float val, float gridStep);
 
     /*!
@@ -190,14 +366,17 @@ public:
      *
      * \sa getMasterVolume, setMasterVolume, changeMasterVolume
      */
-    inline bool isMasterVolumeAvailable() const {return masterVolumeAvailable;}
+    inline bool isMasterVolumeAvailable() const {return initMasterVolume();}
 
     float getMasterVolume();
     bool setMasterVolume(float val);
     bool changeMasterVolume(float diff, bool snapToGrid = false);
 
+    bool initRecordingDevice();
+
     bool loadPlugin(const QString& filename);
     bool loadPluginsFromDirectory(const QString& dirname);
+    bool loadPendingPlugins();
     bool unloadPlugin(int index);
     bool unloadAllPlugins();
 
@@ -214,24 +393,73 @@ public:
 
     /*!
      * Returns a plugin information.
+     * With MSE_EngineInitParams::lazyPlugins the plugin may be not loaded yet,
+     * see MSE_EnginePluginInfo::isLoaded.
      */
     inline const MSE_EnginePluginInfo& getPluginInfo(int index) const {return plugins.at(index);}
 
+    /*!
+     * Returns the shared pool for blocking background jobs.
+     */
+    inline MSE_WorkerPool* getWorkerPool() {return &workerPool;}
+
+    /*!
+     * Returns the pool for the jobs that wait for the network.
+     */
+    inline MSE_WorkerPool* getIoPool() {return &ioPool;}
+
+    /*!
+     * Returns the tuner of the playback buffer.
+     * It holds the current buffer settings and the history of their changes
+     * and is only running with MSE_EngineInitParams::adaptiveBuffer.
+     */
+    inline MSE_BufferTuner* getBufferTuner() {return &bufferTuner;}
+
+#ifdef MSE_MODULE_SOURCE_URL
+    /*!
+     * Returns the on-disk cache for remote resources that is shared by all sounds
+     * or nullptr if the cache is disabled.
+     *
+     * \sa MSE_EngineInitParams::remoteCacheSize
+     */
+    inline MSE_RemoteCache* getRemoteCache() const {return remoteCache;}
+#endif
+
     static int getRealOutputDeviceIndex();
 
     static QString getDefaultUA(const QString& appName = "", const QString& appVersion = "");
 
+signals:
+    /*!
+     * Emitted when the master volume has changed.
+     * Only emitted if MSE_EngineInitParams::watchMasterVolume is set.
+     */
+    void onMasterVolumeChange(float volume);
+
 protected:
     MSE_VersionInfo libVersion; /*!< BASS library version information. */
-    bool isFloatSupported; /*!< True, if floating point samples are supported. */
-    bool is3DSupported; /*!< True, if 3D functionality can be applied to streams. */
+    mutable bool isFloatSupported; /*!< True, if floating point samples are supported. */
+    mutable bool is3DSupported; /*!< True, if 3D functionality can be applied to streams. */
+    mutable bool featuresProbed; /*!< True, if isFloatSupported and is3DSupported are known. */
     MSE_EngineInitParams initParams; /*!< Initialization parameters. */
+    mutable MSE_EngineInitTimings initTimings; /*!< Time spent on the initialization phases. */
+    MSE_EngineSchedulingStatus schedulingStatus; /*!< Scheduling options that have taken effect. */
     QList<MSE_EnginePluginInfo> plugins; /*!< Information about loaded plugin. */
-    QList<HPLUGIN> pluginHandles; /*!< List of plugin handles. It matches plugins list. */
+    QList<HPLUGIN> pluginHandles; /*!< List of plugin handles. It matches plugins list. Zero for a pending lazy plugin. */
     float volume; /*!< Current MSE volume in range [0;1]. */
     QByteArray uaString; /*!< UA string in UTF-8. */
+    MSE_WorkerPool workerPool; /*!< Shared pool for blocking background jobs. */
+    MSE_WorkerPool ioPool; /*!< Pool for the jobs that wait for the network. */
+    MSE_BufferTuner bufferTuner; /*!< Tuner of the playback buffer settings. */
+#ifdef MSE_MODULE_SOURCE_URL
+    MSE_RemoteCache* remoteCache; /*!< Shared cache for remote resources, nullptr if disabled. */
 
-    bool masterVolumeAvailable; /*!< True if OS master volume can be controlled by MSE. */
+    bool initRemoteCache();
+#endif
+
+    mutable bool masterVolumeAvailable; /*!< True if OS master volume can be controlled by MSE. */
+    mutable bool masterVolumeInited; /*!< True if initMasterVolumeControl has been called. */
+    bool recordingInited; /*!< True if the recording device is initialized. */
 #ifdef Q_OS_WIN
     bool mvCoInited;
     GUID mvGuid;
@@ -250,10 +478,22 @@ protected:
     snd_mixer_selem_id_t* mvSelemId;
     snd_mixer_t* mvMixerHandle;
     snd_mixer_elem_t* mvMixerElem;
+    QList<QSocketNotifier*> mvNotifiers; /*!< Watchers of the mixer poll descriptors. */
+    float mvVolume; /*!< Cached master volume when it's watched. */
+
+    void watchMasterVolume();
+    void onMasterVolumeEvent();
 #endif
 
     explicit MSE_Engine(QObject *parent = 0);
     bool postInit();
     bool checkForFeature(DWORD flags, const MSE_EngineInitParams &params) const;
+    void probeFeatures() const;
+    void applyScheduling(const QList<qint64>& threadsBefore);
+    bool initMasterVolume() const;
     bool initMasterVolumeControl();
+    float queryMasterVolume();
+    bool openPlugin(const QString& filename, HPLUGIN& handle, MSE_EnginePluginInfo& info);
+    bool loadPendingPlugin(int index);
+    QString getPluginCacheFile() const;
 };
@@ -170,7 +170,7 @@ bool MSE_Playlist::insertIntoQueue(int index, int pos)
  */
 bool MSE_Playlist::removeFromQueue(int index)
 {
-    CHECK((index >= 0) && (index < playlist.size()), MSE_Object::Err::outOfRange);
+    CHECK((index >= 0) && (index < queue.size()), MSE_Object::Err::outOfRange);
     queue.removeAt(index);
     return true;
 }
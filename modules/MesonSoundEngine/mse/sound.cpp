@@ -210,6 +210,20 @@ bool MSE_Sound::init(const MSE_SoundInitParams& params)
     return true;
 }
 
+#ifdef MSE_MODULE_SOURCE_URL
+/*!
+ * Returns the on-disk cache for remote resources
+ * or nullptr if the cache is disabled.
+ * The cache is shared by all sounds.
+ *
+ * \sa MSE_Engine::getRemoteCache
+ */
+MSE_RemoteCache* MSE_Sound::getRemoteCache() const
+{
+    return engine->getRemoteCache();
+}
+#endif
+
 /*!
  * Loads a sound file.
  * The file cannot be a playlist.
@@ -302,6 +316,7 @@ bool MSE_Sound::close()
     currentSource = nullptr;
     hSyncEnd = 0;
     endBytePos = 0;
+    engine->getBufferTuner()->removeChannel(handle);
     handle = 0;
     sourceTags.clear();
     trackFilename.clear();
@@ -429,6 +444,19 @@ int MSE_Sound::getData(void *buffer, int length)
     return BASS_ChannelGetData(handle, buffer, length);
 }
 
+/*!
+ * Retrieves the cover art of a current sound source.
+ * Embedded pictures are preferred over the image files in the source directory.
+ * Returns false if there's no current source or no cover art was found.
+ */
+bool MSE_Sound::getCoverArt(MSE_SourceCoverArt &coverArt)
+{
+    coverArt.clear();
+    if(!currentSource)
+        return false;
+    return currentSource->fillCoverArt(coverArt);
+}
+
 /*!
  * Returns the position of a current track in seconds.
  * Returns negative value, if no source loaded.
@@ -487,6 +515,17 @@ bool MSE_Sound::setPosition(double secs)
         if(secs > getTrackDuration())
             secs = getTrackDuration();
     }
+    if((channelType == mse_sctRemote) && currentSource->isSeekable())
+    {
+        // the source seeks within its own stream while the output keeps going,
+        // so the shift between the output position and the track position changes
+        if(!currentSource->setPosition(secs))
+            return false;
+        remoteStreamShift = getRealPosition() - secs;
+        setPosSyncs(currentSource);
+        emit onPositionChange();
+        return true;
+    }
     if(currentSource->cueSheetTrack)
     {
         secs = secs + currentSource->cueSheetTrack->startPos;
@@ -1136,7 +1175,10 @@ bool MSE_Sound::setPosSyncs(const MSE_Source *source)
     if(positionCallbacks.children().isEmpty())
         return true;
     double duration, fullDuration;
-    getChannelDurations(handle, source, duration, fullDuration);
+    if(source->type == mse_sctRemote)
+        duration = source->getDuration();
+    else
+        getChannelDurations(handle, source, duration, fullDuration);
     bool result = true;
     foreach(QObject* callback, positionCallbacks.children())
         if(!setPosSync(source, static_cast<MSE_SoundPositionCallback*>(callback), duration))
@@ -1263,8 +1305,8 @@ void MSE_Sound::fillTrackInfo()
     }
     else
     {
-        trackDuration = -1;
-        fullTrackDuration = -1;
+        trackDuration = currentSource->getDuration();
+        fullTrackDuration = trackDuration;
     }
 
     currentSource->fillTags(sourceTags);
@@ -1381,6 +1423,8 @@ bool MSE_Sound::open(MSE_Source* source)
             return false;
 
     handle = newHandle;
+    if(!initParams.decodeOnly)
+        engine->getBufferTuner()->addChannel(handle);
 
     switch(source->type)
     {
@@ -1494,6 +1538,9 @@ void MSE_Sound::onMeta()
 
 bool MSE_Sound::startRecord()
 {
+    if(!engine->initRecordingDevice())
+        return false;
+
     HCHANNEL newHandle = BASS_RecordStart(
                 engine->getInitParams().outputFrequency,
                 2,
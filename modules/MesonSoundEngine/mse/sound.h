@@ -29,6 +29,7 @@
 #endif
 
 class MSE_SoundPositionCallback;
+class MSE_RemoteCache;
 typedef void (*MSE_SoundPositionCallbackFunc)(MSE_SoundPositionCallback*);
 
 /*!
@@ -98,6 +99,15 @@ public:
      */
     inline MSE_Playlist* getPlaylist() const {return playlist;}
 
+    /*!
+     * Returns the source that is currently opened or nullptr.
+     */
+    inline MSE_Source* getCurrentSource() const {return currentSource;}
+
+#ifdef MSE_MODULE_SOURCE_URL
+    MSE_RemoteCache* getRemoteCache() const;
+#endif
+
     /*!
      * Returns a channel type of a current sound source.
      */
@@ -168,6 +178,8 @@ public:
      */
     inline const MSE_SourceTags& getTags() const {return sourceTags;}
 
+    bool getCoverArt(MSE_SourceCoverArt& coverArt);
+
     /*!
      * Returns true if artist info was retreived from tags.
      */
@@ -22,6 +22,7 @@
 #include "qiodevicehelper.h"
 
 #include <QSharedPointer>
+#include <QtEndian>
 
 
 MSE_Source::MSE_Source(MSE_Playlist *parent):MSE_Object(parent)
@@ -58,37 +59,152 @@ bool MSE_Source::getTags(MSE_SourceTags &tags)
     return false;
 }
 
+static inline bool chunkedKeyEquals(const char* key, const char* upperKey, int len)
+{
+    for(int a=0; a<len; a++)
+    {
+        char c = key[a];
+        if((c >= 'a') && (c <= 'z'))
+            c -= 'a' - 'A';
+        if(c != upperKey[a])
+            return false;
+    }
+    return true;
+}
+
+/*!
+ * Returns MSE_SourceChunkedTagKey for a tag key of *len* bytes
+ * or -1 if the key is not used.
+ * The key is matched case-insensitively in place.
+ */
+int MSE_Source::chunkedTagKey(const char *key, int len)
+{
+    switch(len)
+    {
+        case 4:
+            if(chunkedKeyEquals(key, "DATE", 4))
+                return mse_sctkDate;
+            if(chunkedKeyEquals(key, "DISC", 4))
+                return mse_sctkDisc;
+            break;
+
+        case 5:
+            switch(key[0] | 0x20)
+            {
+                case 'a':
+                    if(chunkedKeyEquals(key, "ALBUM", 5))
+                        return mse_sctkAlbum;
+                    break;
+                case 'g':
+                    if(chunkedKeyEquals(key, "GENRE", 5))
+                        return mse_sctkGenre;
+                    break;
+                case 't':
+                    if(chunkedKeyEquals(key, "TITLE", 5))
+                        return mse_sctkTitle;
+                    if(chunkedKeyEquals(key, "TRACK", 5))
+                        return mse_sctkTrack;
+                    break;
+            }
+            break;
+
+        case 6:
+            if(chunkedKeyEquals(key, "ARTIST", 6))
+                return mse_sctkArtist;
+            if(chunkedKeyEquals(key, "AUTHOR", 6))
+                return mse_sctkAuthor;
+            break;
+
+        case 9:
+            if(chunkedKeyEquals(key, "DISCTOTAL", 9))
+                return mse_sctkDiscTotal;
+            break;
+
+        case 10:
+            switch(key[0] | 0x20)
+            {
+                case 'd':
+                    if(chunkedKeyEquals(key, "DISCNUMBER", 10))
+                        return mse_sctkDiscNumber;
+                    break;
+                case 't':
+                    if(chunkedKeyEquals(key, "TRACKTOTAL", 10))
+                        return mse_sctkTrackTotal;
+                    if(chunkedKeyEquals(key, "TOTALDISCS", 10))
+                        return mse_sctkTotalDiscs;
+                    break;
+            }
+            break;
+
+        case 11:
+            switch(key[0] | 0x20)
+            {
+                case 'a':
+                    if(chunkedKeyEquals(key, "ALBUMARTIST", 11))
+                        return mse_sctkAlbumArtist;
+                    break;
+                case 't':
+                    if(chunkedKeyEquals(key, "TRACKNUMBER", 11))
+                        return mse_sctkTrackNumber;
+                    if(chunkedKeyEquals(key, "TOTALTRACKS", 11))
+                        return mse_sctkTotalTracks;
+                    break;
+            }
+            break;
+    }
+    return -1;
+}
+
 /*!
  * Processes OGG-like data in "key=value\0" format.
+ * Only the values of the keys listed in MSE_SourceChunkedTagKey are decoded.
+ * Returns true if at least one of such keys was found.
  */
-MSE_SourceAssocTags MSE_Source::processChunkedData(const char* data)
+bool MSE_Source::processChunkedData(const char* data, MSE_SourceChunkedTags& values)
 {
-    MSE_SourceAssocTags result;
     if(!data)
-        return result;
+        return false;
 
-    quint64 p = 0;
-    quint64 chunkBlockStart;
-    QString chunkKey;
-    int i;
+    bool found = false;
+    const char* p = data;
+    const char* entryStart;
+    const char* sep;
+    const char* keyEnd;
+    int key;
 
-    while(data[p])
+    while(*p)
     {
-        chunkBlockStart = p;
-        while(data[p])
+        entryStart = p;
+        sep = nullptr;
+        while(*p)
+        {
+            if(!sep && (*p == '='))
+                sep = p;
             p++;
-        cpTr.addEntry(&data[chunkBlockStart], p - chunkBlockStart, [&](const QString& s){
-            i = s.indexOf('=');
-            if(i < 0)
-                return;
-            chunkKey = s.mid(0, i).trimmed().toUpper();
-            result[chunkKey] = s.mid(i+1);
-        });
+        }
+
+        if(sep)
+        {
+            while((entryStart < sep) && isspace(static_cast<unsigned char>(*entryStart)))
+                entryStart++;
+            keyEnd = sep;
+            while((keyEnd > entryStart) && isspace(static_cast<unsigned char>(keyEnd[-1])))
+                keyEnd--;
+
+            key = chunkedTagKey(entryStart, keyEnd - entryStart);
+            if(key >= 0)
+            {
+                QString* value = &values[key];
+                cpTr.addRawEntry(sep + 1, p - sep - 1, [value](const QString& s){*value = s;});
+                found = true;
+            }
+        }
         p++;
     }
 
-    cpTr.processEntries(getTrReference());
-    return result;
+    if(found)
+        cpTr.processEntries(getTrReference());
+    return found;
 }
 
 QString MSE_Source::getTrReference()
@@ -109,29 +225,29 @@ bool MSE_Source::parseTagsOGG(HCHANNEL channel, MSE_SourceTags &tags, DWORD tags
     const char* tagsData = BASS_ChannelGetTags(channel, tagsType);
     if(!tagsData)
         return false;
-    MSE_SourceAssocTags theTags = processChunkedData(tagsData);
-    if(theTags.isEmpty())
+    MSE_SourceChunkedTags theTags;
+    if(!processChunkedData(tagsData, theTags))
         return false;
 
-    tags.trackArtist = theTags["ALBUMARTIST"];
+    tags.trackArtist = theTags[mse_sctkAlbumArtist];
     if(tags.trackArtist.isEmpty())
     {
-        tags.trackArtist = theTags["ARTIST"];
+        tags.trackArtist = theTags[mse_sctkArtist];
         if(tags.trackArtist.isEmpty())
-            tags.trackArtist = theTags["AUTHOR"];
+            tags.trackArtist = theTags[mse_sctkAuthor];
     }
-    tags.trackTitle = theTags["TITLE"];
+    tags.trackTitle = theTags[mse_sctkTitle];
     if(tags.trackArtist.isEmpty() && tags.trackTitle.isEmpty())
         return false;
 
-    tags.trackAlbum = theTags["ALBUM"];
-    tags.trackDate = theTags["DATE"];
-    tags.genre = theTags["GENRE"];
+    tags.trackAlbum = theTags[mse_sctkAlbum];
+    tags.trackDate = theTags[mse_sctkDate];
+    tags.genre = theTags[mse_sctkGenre];
 
-    tags.trackIndex = theTags["TRACKNUMBER"];
+    tags.trackIndex = theTags[mse_sctkTrackNumber];
     if(tags.trackIndex.isEmpty())
     {
-        tags.trackIndex = theTags["TRACK"];
+        tags.trackIndex = theTags[mse_sctkTrack];
         int p = tags.trackIndex.indexOf('/');
         if(p >= 0)
         {
@@ -140,13 +256,13 @@ bool MSE_Source::parseTagsOGG(HCHANNEL channel, MSE_SourceTags &tags, DWORD tags
         }
     }
     if(tags.nTracks.isEmpty())
-        tags.nTracks = theTags["TRACKTOTAL"];
+        tags.nTracks = theTags[mse_sctkTrackTotal];
     if(tags.nTracks.isEmpty())
-        tags.nTracks = theTags["TOTALTRACKS"];
+        tags.nTracks = theTags[mse_sctkTotalTracks];
 
-    tags.discIndex = theTags["DISCNUMBER"];
+    tags.discIndex = theTags[mse_sctkDiscNumber];
     if(tags.discIndex.isEmpty())
-        tags.discIndex = theTags["DISC"];
+        tags.discIndex = theTags[mse_sctkDisc];
     int p = tags.discIndex.indexOf('/');
     if(p >= 0)
     {
@@ -154,13 +270,191 @@ bool MSE_Source::parseTagsOGG(HCHANNEL channel, MSE_SourceTags &tags, DWORD tags
         tags.discIndex = tags.discIndex.mid(0, p);
     }
     if(tags.nDiscs.isEmpty())
-        tags.nDiscs = theTags["DISCTOTAL"];
+        tags.nDiscs = theTags[mse_sctkDiscTotal];
     if(tags.nDiscs.isEmpty())
-        tags.nDiscs = theTags["TOTALDISCS"];
+        tags.nDiscs = theTags[mse_sctkTotalDiscs];
 
     return true;
 }
 
+bool MSE_Source::fillCoverArt(MSE_SourceCoverArt &coverArt)
+{
+    coverArt.clear();
+    if(getCoverArt(coverArt))
+        return true;
+    coverArt.clear();
+    return getCoverArtFromDir(coverArt);
+}
+
+/*!
+ * Returns true if the source manages its own position.
+ * Only remote sources may do that,
+ * local sources are always seeked by MSE_Sound directly.
+ */
+bool MSE_Source::isSeekable() const
+{
+    return false;
+}
+
+/*!
+ * Returns the duration in seconds of a seekable remote source
+ * or -1 if the duration is unknown.
+ *
+ * \sa isSeekable
+ */
+double MSE_Source::getDuration() const
+{
+    return -1;
+}
+
+/*!
+ * Sets the position in seconds of a seekable remote source.
+ *
+ * \sa isSeekable
+ */
+bool MSE_Source::setPosition(double secs)
+{
+    Q_UNUSED(secs);
+    return false;
+}
+
+/*!
+ * Returns the embedded cover art.
+ * Depends on implementation in child classes.
+ */
+bool MSE_Source::getCoverArt(MSE_SourceCoverArt &coverArt)
+{
+    Q_UNUSED(coverArt);
+    return false;
+}
+
+/*!
+ * Looks for folder.*, cover.*, front.* or album.* image in the directory of the data source.
+ */
+bool MSE_Source::getCoverArtFromDir(MSE_SourceCoverArt &coverArt)
+{
+    if(type == mse_sctRemote)
+        return false;
+
+    QFileInfo f(getDataSourceFilename());
+    QDir dir = f.dir();
+    if(!dir.exists())
+        return false;
+
+    static const char* const baseNames[] = {"folder", "cover", "front", "album"};
+    QStringList files = dir.entryList(QDir::Files | QDir::Readable, QDir::Name);
+    QString ext;
+    foreach(const char* baseName, baseNames)
+    {
+        foreach(const QString& file, files)
+        {
+            int p = file.lastIndexOf('.');
+            if(p <= 0)
+                continue;
+            if(file.leftRef(p).compare(QLatin1String(baseName), Qt::CaseInsensitive))
+                continue;
+            ext = file.mid(p+1);
+            coverArt.mimeType = MSE_SourceCoverArt::mimeTypeFromExtension(ext);
+            if(coverArt.mimeType.isEmpty())
+                continue;
+
+            QFile imgFile(dir.filePath(file));
+            if(!imgFile.open(QIODevice::ReadOnly))
+                continue;
+            coverArt.data = imgFile.readAll();
+            if(coverArt.data.isEmpty())
+                continue;
+            coverArt.filename = imgFile.fileName();
+            return true;
+        }
+    }
+
+    coverArt.clear();
+    return false;
+}
+
+/*!
+ * Parses a FLAC METADATA_BLOCK_PICTURE (without the metadata block header).
+ * Only the image data is copied.
+ * If *onlyFrontCover* is true then the pictures other than a front cover are ignored.
+ */
+bool MSE_Source::parsePictureBlockFLAC(const char *data, int len, MSE_SourceCoverArt &coverArt, bool onlyFrontCover)
+{
+    const uchar* p = reinterpret_cast<const uchar*>(data);
+    const uchar* end = p + len;
+
+    if(end - p < 8)
+        return false;
+    quint32 picType = qFromBigEndian<quint32>(p);
+    if(onlyFrontCover && (picType != 3))
+        return false;
+    p += 4;
+
+    quint32 mimeLen = qFromBigEndian<quint32>(p);
+    p += 4;
+    if(static_cast<quint64>(end - p) < static_cast<quint64>(mimeLen) + 4)
+        return false;
+    QString mimeType = QString::fromLatin1(reinterpret_cast<const char*>(p), mimeLen);
+    p += mimeLen;
+
+    quint32 descLen = qFromBigEndian<quint32>(p);
+    p += 4;
+    if(static_cast<quint64>(end - p) < static_cast<quint64>(descLen) + 20)
+        return false;
+    p += descLen + 16; // description, width, height, depth, colors
+
+    quint32 dataLen = qFromBigEndian<quint32>(p);
+    p += 4;
+    if(!dataLen || (static_cast<quint32>(end - p) < dataLen))
+        return false;
+
+    coverArt.data = QByteArray(reinterpret_cast<const char*>(p), dataLen);
+    coverArt.mimeType = mimeType;
+    return true;
+}
+
+/*!
+ * Looks for METADATA_BLOCK_PICTURE in OGG-like tags.
+ * *tagsType* must be one of BASS_TAG_*
+ */
+bool MSE_Source::parsePictureOGG(HCHANNEL channel, MSE_SourceCoverArt &coverArt, DWORD tagsType)
+{
+    const char* p = BASS_ChannelGetTags(channel, tagsType);
+    if(!p)
+        return false;
+
+    static const char key[] = "METADATA_BLOCK_PICTURE";
+    static const int keyLen = sizeof(key) - 1;
+    QByteArray fallbackPicture;
+    const char* entryStart;
+    int entryLen;
+
+    while(*p)
+    {
+        entryStart = p;
+        while(*p)
+            p++;
+        entryLen = p - entryStart;
+        p++;
+
+        if((entryLen <= keyLen) || (entryStart[keyLen] != '='))
+            continue;
+        if(!chunkedKeyEquals(entryStart, key, keyLen))
+            continue;
+
+        QByteArray block = QByteArray::fromBase64(
+            QByteArray::fromRawData(entryStart + keyLen + 1, entryLen - keyLen - 1));
+        if(parsePictureBlockFLAC(block.constData(), block.size(), coverArt, true))
+            return true;
+        if(fallbackPicture.isEmpty())
+            fallbackPicture = block;
+    }
+
+    if(fallbackPicture.isEmpty())
+        return false;
+    return parsePictureBlockFLAC(fallbackPicture.constData(), fallbackPicture.size(), coverArt);
+}
+
 /*!
  * If a source is a part of a CUE sheet,
  * then this function returns the full file path to .cue file
@@ -181,15 +475,22 @@ const QString& MSE_Source::getPlaylistUri() const
     return entry.uri;
 }
 
+/*!
+ * Returns the full file path to the actual audio file.
+ * For CUE sheet tracks it's the file that is referenced by the CUE sheet.
+ */
+const QString &MSE_Source::getDataSourceFilename() const
+{
+    if(cueSheetTrack)
+        return cueSheetTrack->sheet->dataSourceFilename;
+    return entry.filename;
+}
+
 const char *MSE_Source::getDataSourceUtfFilename()
 {
     if(!utfFilename)
     {
-        QString dataSourceFilename;
-        if(cueSheetTrack)
-            dataSourceFilename = cueSheetTrack->sheet->dataSourceFilename;
-        else
-            dataSourceFilename = entry.filename;
+        const QString& dataSourceFilename = getDataSourceFilename();
 
 #ifdef Q_OS_WIN
         utfFilename = (char*)(dataSourceFilename.utf16());
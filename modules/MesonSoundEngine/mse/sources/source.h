@@ -22,8 +22,11 @@
 #include "mse/utils/utils.h"
 
 #include "types/source_tags.h"
+#include "types/source_cover_art.h"
 #include "mse/utils/codepage_translator.h"
 
+#include <array>
+
 struct MSE_CueSheet;
 
 /*!
@@ -66,7 +69,33 @@ struct MSE_CueSheet {
 typedef QList<MSE_CueSheet*> MSE_CueSheets;
 
 
-typedef QHash<QString, QString> MSE_SourceAssocTags;
+/*!
+ * Keys of OGG-like "key=value" tags that are used by MSE_Source::parseTagsOGG().
+ */
+enum MSE_SourceChunkedTagKey {
+    mse_sctkAlbumArtist,
+    mse_sctkArtist,
+    mse_sctkAuthor,
+    mse_sctkTitle,
+    mse_sctkAlbum,
+    mse_sctkDate,
+    mse_sctkGenre,
+    mse_sctkTrackNumber,
+    mse_sctkTrack,
+    mse_sctkTrackTotal,
+    mse_sctkTotalTracks,
+    mse_sctkDiscNumber,
+    mse_sctkDisc,
+    mse_sctkDiscTotal,
+    mse_sctkTotalDiscs,
+    mse_sctkCount
+};
+
+/*!
+ * Values of OGG-like tags indexed by MSE_SourceChunkedTagKey.
+ * Values of the keys that were not found remain null.
+ */
+typedef std::array<QString, mse_sctkCount> MSE_SourceChunkedTags;
 
 
 /*!
@@ -162,6 +191,17 @@ public:
 
     bool parseTagsOGG(HCHANNEL channel, MSE_SourceTags &tags, DWORD tagsType = BASS_TAG_OGG);
 
+    /*!
+     * Clears MSE_SourceCoverArt struct and fills it with the embedded picture.
+     * If there's no embedded picture then an image file from the source directory is used.
+     * Returns true if a cover art was found.
+     */
+    bool fillCoverArt(MSE_SourceCoverArt& coverArt);
+
+    virtual bool isSeekable() const;
+    virtual double getDuration() const;
+    virtual bool setPosition(double secs);
+
     int index; /*!< Source index */
     MSE_PlaylistEntry entry; /*!< Info about playlist entry. */
     QByteArray filenameData; /*!< Character data for a filename */
@@ -181,11 +221,17 @@ public:
 protected:
     const char *getDataSourceUtfFilename();
     virtual bool getTags(MSE_SourceTags& tags);
+    virtual bool getCoverArt(MSE_SourceCoverArt& coverArt);
+    bool getCoverArtFromDir(MSE_SourceCoverArt& coverArt);
+    bool parsePictureOGG(HCHANNEL channel, MSE_SourceCoverArt& coverArt, DWORD tagsType = BASS_TAG_OGG);
+    static bool parsePictureBlockFLAC(const char* data, int len, MSE_SourceCoverArt& coverArt, bool onlyFrontCover = false);
+    const QString& getDataSourceFilename() const;
 
     MSE_Sound* sound;
     MSE_CodepageTranslator cpTr;
 
-    MSE_SourceAssocTags processChunkedData(const char *data);
+    bool processChunkedData(const char *data, MSE_SourceChunkedTags& values);
+    static int chunkedTagKey(const char* key, int len);
     QString getTrReference();
 private:
     const char* utfFilename;
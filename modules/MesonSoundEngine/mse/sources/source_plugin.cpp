@@ -19,6 +19,8 @@
 #include "mse/sources/source_plugin.h"
 #include "mse/sound.h"
 
+#include <QtEndian>
+
 MSE_SourcePlugin::MSE_SourcePlugin(MSE_Playlist *parent) : MSE_SourceStream(parent)
 {
     type = mse_sctPlugin;
@@ -36,3 +38,142 @@ bool MSE_SourcePlugin::getTags(MSE_SourceTags &tags)
 
     return true;
 }
+
+/*!
+ * Reads the pictures that BASSFLAC plugin provides.
+ * A front cover is preferred, otherwise the first picture is used.
+ */
+bool MSE_SourcePlugin::parsePictureFLAC(MSE_SourceCoverArt &coverArt)
+{
+    const TAG_FLAC_PICTURE* best = nullptr;
+    const TAG_FLAC_PICTURE* pic;
+    for(DWORD a=0; ; a++)
+    {
+        pic = reinterpret_cast<const TAG_FLAC_PICTURE*>(BASS_ChannelGetTags(stream, BASS_TAG_FLAC_PICTURE + a));
+        if(!pic)
+            break;
+        if(!pic->data || !pic->length)
+            continue;
+        if(!best || (pic->apic == 3))
+            best = pic;
+        if(pic->apic == 3)
+            break;
+    }
+
+    if(!best)
+        return false;
+
+    coverArt.data = QByteArray(static_cast<const char*>(best->data), best->length);
+    coverArt.mimeType = QString::fromLatin1(best->mime);
+    return true;
+}
+
+/*!
+ * Looks for an atom with the specified *name* among the sibling atoms
+ * starting at the current position of *dev* and ending at *end*.
+ * Returns the position of the atom payload or -1 if the atom is not found.
+ * *atomEnd* receives the position right after the atom.
+ */
+qint64 MSE_SourcePlugin::findAtomMP4(QIODevice &dev, qint64 end, const char *name, qint64 &atomEnd)
+{
+    char header[16];
+    qint64 pos = dev.pos();
+    qint64 size;
+    int headerSize;
+
+    while(pos + 8 <= end)
+    {
+        if(!dev.seek(pos) || (dev.read(header, 8) != 8))
+            return -1;
+        size = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(header));
+        headerSize = 8;
+        if(size == 1)
+        {
+            // 64-bit size
+            if(dev.read(header + 8, 8) != 8)
+                return -1;
+            size = qFromBigEndian<qint64>(reinterpret_cast<const uchar*>(header + 8));
+            headerSize = 16;
+        }
+        else
+        {
+            if(size == 0)
+                size = end - pos; // the atom extends to the end
+        }
+        if((size < headerSize) || (pos + size > end))
+            return -1;
+
+        if(!memcmp(header + 4, name, 4))
+        {
+            atomEnd = pos + size;
+            return pos + headerSize;
+        }
+        pos += size;
+    }
+    return -1;
+}
+
+/*!
+ * Walks moov/udta/meta/ilst/covr atoms of an MP4 file.
+ * Only the atom headers and the image data are read from the file.
+ */
+bool MSE_SourcePlugin::parsePictureMP4(MSE_SourceCoverArt &coverArt)
+{
+    QFile f(getDataSourceFilename());
+    if(!f.open(QIODevice::ReadOnly))
+        return false;
+
+    static const char* const path[] = {"moov", "udta", "meta", "ilst", "covr", "data"};
+    qint64 end = f.size();
+    qint64 payload = 0;
+    qint64 atomEnd;
+    foreach(const char* name, path)
+    {
+        if(!f.seek(payload))
+            return false;
+        payload = findAtomMP4(f, end, name, atomEnd);
+        if(payload < 0)
+            return false;
+        end = atomEnd;
+        if(!strcmp(name, "meta"))
+            payload += 4; // version and flags
+    }
+
+    // data atom: 4 bytes of type indicator, 4 bytes of locale
+    char dataHeader[8];
+    if(!f.seek(payload) || (f.read(dataHeader, 8) != 8))
+        return false;
+    qint64 len = end - payload - 8;
+    if(len <= 0)
+        return false;
+
+    switch(qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(dataHeader)) & 0xFFFFFF)
+    {
+        case 13:
+            coverArt.mimeType = QStringLiteral("image/jpeg");
+            break;
+        case 14:
+            coverArt.mimeType = QStringLiteral("image/png");
+            break;
+        case 27:
+            coverArt.mimeType = QStringLiteral("image/bmp");
+            break;
+    }
+
+    coverArt.data = f.read(len);
+    return coverArt.data.size() == len;
+}
+
+bool MSE_SourcePlugin::getCoverArt(MSE_SourceCoverArt &coverArt)
+{
+    if(MSE_SourceStream::getCoverArt(coverArt))
+        return true;
+
+    if(parsePictureFLAC(coverArt))
+        return true;
+
+    if(BASS_ChannelGetTags(stream, BASS_TAG_MP4))
+        return parsePictureMP4(coverArt);
+
+    return false;
+}
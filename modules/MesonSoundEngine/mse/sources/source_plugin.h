@@ -30,4 +30,9 @@ protected:
     bool parseTagsAPE(MSE_SourceTags &tags);
     bool parseTagsMP4(MSE_SourceTags &tags);
     bool parseTagsWMA(MSE_SourceTags &tags);
+
+    virtual bool getCoverArt(MSE_SourceCoverArt& coverArt);
+    bool parsePictureFLAC(MSE_SourceCoverArt& coverArt);
+    bool parsePictureMP4(MSE_SourceCoverArt& coverArt);
+    static qint64 findAtomMP4(QIODevice& dev, qint64 end, const char* name, qint64& atomEnd);
 };
@@ -190,6 +190,151 @@ bool MSE_SourceStream::parseTagsID3v2(MSE_SourceTags &tags)
     return true;
 }
 
+/*!
+ * Returns the offset of the image data in APIC (v2.3, v2.4) or PIC (v2.2) frame value
+ * or -1 if the frame is malformed.
+ * *data* points right after the encoding byte.
+ */
+int MSE_SourceStream::pictureFrameImageOffset(const char *data, int len, quint8 encoding, bool isV22, quint8 &picType, QString &mimeType)
+{
+    int p;
+    if(isV22)
+    {
+        // 3-char image format, e.g. "JPG" or "PNG"
+        if(len < 4)
+            return -1;
+        mimeType = MSE_SourceCoverArt::mimeTypeFromExtension(QString::fromLatin1(data, 3));
+        p = 3;
+    }
+    else
+    {
+        const char* mimeEnd = static_cast<const char*>(memchr(data, 0, len));
+        if(!mimeEnd)
+            return -1;
+        mimeType = QString::fromLatin1(data, mimeEnd - data);
+        p = mimeEnd - data + 1;
+    }
+
+    if(p >= len)
+        return -1;
+    picType = static_cast<quint8>(data[p]);
+    p++;
+
+    // skip description
+    if((encoding == 1) || (encoding == 2))
+    {
+        // UTF-16, terminated with $00 00
+        while(p + 1 < len)
+        {
+            if(!data[p] && !data[p+1])
+                break;
+            p += 2;
+        }
+        p += 2;
+    }
+    else
+    {
+        while((p < len) && data[p])
+            p++;
+        p++;
+    }
+
+    if(p >= len)
+        return -1;
+    return p;
+}
+
+/*!
+ * Looks for APIC (v2.3, v2.4) or PIC (v2.2) frames.
+ * A front cover is preferred, otherwise the first picture is used.
+ * Only the image data of the chosen picture is copied.
+ */
+bool MSE_SourceStream::parsePictureID3v2(MSE_SourceCoverArt &coverArt)
+{
+    const char* tagStart = BASS_ChannelGetTags(stream, BASS_TAG_ID3V2);
+    if(!tagStart)
+        return false;
+    const MSE_TagInfoID3v2Header* tagh = reinterpret_cast<const MSE_TagInfoID3v2Header*>(tagStart);
+
+    const char* tagp = tagStart + sizeof(MSE_TagInfoID3v2Header);
+    const char* tagpMax = tagp + tagh->byteSize();
+    bool isV22 = tagh->version == 2;
+    int headerSize = isV22 ? sizeof(MSE_TagInfoID3v22) : sizeof(MSE_TagInfoID3v2);
+
+    const char* bestData = nullptr;
+    int bestLen = 0;
+    QString bestMimeType;
+    quint32 tagLen;
+    quint8 encoding;
+    bool isPicture;
+    quint8 picType;
+    QString mimeType;
+    int offset;
+
+    forever{
+        if(tagp + headerSize > tagpMax)
+            break;
+        if(isV22)
+        {
+            const MSE_TagInfoID3v22* tag22 = reinterpret_cast<const MSE_TagInfoID3v22*>(tagp);
+            if(
+                !isLetterOrDigit(tag22->name[0]) ||
+                !isLetterOrDigit(tag22->name[1]) ||
+                !isLetterOrDigit(tag22->name[2])
+            )
+            {
+                break;
+            }
+            tagLen = tag22->byteSize() - 1;
+            encoding = tag22->encoding;
+            isPicture = !memcmp(tag22->name, "PIC", 3);
+        }
+        else
+        {
+            const MSE_TagInfoID3v2* tag2 = reinterpret_cast<const MSE_TagInfoID3v2*>(tagp);
+            if(!(
+                isLetterOrDigit(tag2->name[0])&&
+                isLetterOrDigit(tag2->name[1])&&
+                isLetterOrDigit(tag2->name[2])&&
+                isLetterOrDigit(tag2->name[3]))
+            )
+            {
+                break;
+            }
+            tagLen = tag2->byteSize(tagh->version) - 1;
+            encoding = tag2->encoding;
+            isPicture = !memcmp(tag2->name, "APIC", 4);
+        }
+        tagp += headerSize;
+        if(tagLen > static_cast<quint32>(tagpMax - tagp))
+            break;
+
+        if(isPicture)
+        {
+            offset = pictureFrameImageOffset(tagp, tagLen, encoding, isV22, picType, mimeType);
+            if(offset >= 0)
+            {
+                if(!bestData || (picType == 3))
+                {
+                    bestData = tagp + offset;
+                    bestLen = tagLen - offset;
+                    bestMimeType = mimeType;
+                }
+                if(picType == 3)
+                    break;
+            }
+        }
+        tagp += tagLen;
+    }
+
+    if(!bestData)
+        return false;
+
+    coverArt.data = QByteArray(bestData, bestLen);
+    coverArt.mimeType = bestMimeType;
+    return true;
+}
+
 bool MSE_SourceStream::parseTagsID3(MSE_SourceTags &tags)
 {
     const TAG_ID3* tagsData = reinterpret_cast<const TAG_ID3*>(BASS_ChannelGetTags(stream, BASS_TAG_ID3));
@@ -218,3 +363,10 @@ bool MSE_SourceStream::getTags(MSE_SourceTags& tags)
 
     return true;
 }
+
+bool MSE_SourceStream::getCoverArt(MSE_SourceCoverArt &coverArt)
+{
+    if(parsePictureID3v2(coverArt))
+        return true;
+    return parsePictureOGG(stream, coverArt, BASS_TAG_OGG);
+}
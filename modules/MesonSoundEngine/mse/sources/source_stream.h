@@ -29,10 +29,13 @@ public:
 
 protected:
     virtual bool getTags(MSE_SourceTags &tags);
+    virtual bool getCoverArt(MSE_SourceCoverArt& coverArt);
     static bool isLetterOrDigit(char c);
 
     bool parseTagsID3v2(MSE_SourceTags& tags);
     bool parseTagsID3(MSE_SourceTags &tags);
+    bool parsePictureID3v2(MSE_SourceCoverArt& coverArt);
+    static int pictureFrameImageOffset(const char* data, int len, quint8 encoding, bool isV22, quint8& picType, QString& mimeType);
 
     HSTREAM stream;
 };
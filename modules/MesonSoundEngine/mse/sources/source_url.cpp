@@ -22,11 +22,16 @@
 #include "coreapp.h"
 
 const int MSE_SourceUrl::maxRedirects = 5; // including redirects from playlists
-const int MSE_SourceUrl::preloadSecs = 0; // create a stream when this amount of seconds available
 const int MSE_SourceUrl::timeoutInterval = 10*1000; // timeout for every single network operation
 const int MSE_SourceUrl::maxBufferCapacity = 10*1024*1024; // once network buffer is full, the connection is closed
 const int MSE_SourceUrl::retryInterval = 10*1000; // wait for this amount of time before reconnect
 const int MSE_SourceUrl::maxRetries = 5; // retry this many times
+const int MSE_SourceUrl::healthInterval = 1000; // measure network and decoder rates this often
+const int MSE_SourceUrl::stableInterval = 30*1000; // shrink the preload after this long without underruns
+const int MSE_SourceUrl::spliceRetryInterval = 500; // back-off step between the seamless reconnect attempts
+const int MSE_SourceUrl::receiveChunkSize = 64*1024; // read this much at once when splitting the stream into frames
+const int MSE_SourceUrl::replyBufferSize = 1024*1024; // a file is held back by the server once this much waits for the ring buffer
+const int MSE_SourceUrl::drainInterval = 50; // check this often whether the reader has made room for the held back data
 
 void CALLBACK MSE_SourceUrl::startProc(HSYNC handle, DWORD channel, DWORD data, void *user)
 {
@@ -35,52 +40,143 @@ void CALLBACK MSE_SourceUrl::startProc(HSYNC handle, DWORD channel, DWORD data,
     static_cast<MSE_SourceUrl*>(user)->onMixerStart(channel);
 }
 
-void MSE_SourceUrl::fileCloseProc(void *user)
+UrlStreamSession::UrlStreamSession(MSE_SourceUrl *source) : QObject()
+  ,source(source)
 {
-    static_cast<MSE_SourceUrl*>(user)->urlStreamIsClosed = true;
+    fileProcTable.close = fileCloseProc;
+    fileProcTable.length = fileLenProc;
+    fileProcTable.seek = fileSeekProc;
+    fileProcTable.read = fileReadProcNoMeta;
+}
+
+UrlStreamSession::~UrlStreamSession()
+{
+    // the stream was created after the session had been abandoned
+    HSTREAM stream = createdStream.exchange(0);
+    if(stream)
+        BASS_StreamFree(stream);
+}
+
+/*!
+ * Releases the reader and detaches the session from its source.
+ * After this call the session never touches the source again.
+ */
+void UrlStreamSession::close()
+{
+    isClosed = true;
+    buffer.interrupt();
+    if(remoteFile)
+        remoteFile->close();
+    QMutexLocker locker(&sourceMutex);
+    source = nullptr;
+}
+
+void UrlStreamSession::parseMeta(const char *data, int len)
+{
+    QMutexLocker locker(&sourceMutex);
+    if(source)
+        source->parseMeta(data, len);
+}
+
+/*!
+ * Queues the metadata that was taken out of the stream by the producer.
+ * It's parsed once the reader gets past *offset* bytes of the buffer,
+ * so the title changes in time with the audio.
+ */
+void UrlStreamSession::queueMeta(quint64 offset, const char *data, int len)
+{
+    QMutexLocker locker(&metaMutex);
+    metaQueue.append(qMakePair(offset, QByteArray(data, len)));
+    hasQueuedMeta = true;
+}
+
+void UrlStreamSession::deliverMeta()
+{
+    quint64 totalRead = buffer.getStats().totalRead;
+    QList<QByteArray> ready;
+    {
+        QMutexLocker locker(&metaMutex);
+        while(!metaQueue.isEmpty() && (metaQueue.first().first <= totalRead))
+            ready.append(metaQueue.takeFirst().second);
+        hasQueuedMeta = !metaQueue.isEmpty();
+    }
+    foreach(const QByteArray& meta, ready)
+        parseMeta(meta.constData(), meta.size());
 }
 
-QWORD MSE_SourceUrl::fileLenProc(void *user)
+void UrlStreamSession::fileCloseProc(void *user)
+{
+    static_cast<UrlStreamSession*>(user)->isClosed = true;
+}
+
+QWORD UrlStreamSession::fileLenProc(void *user)
 {
     Q_UNUSED(user);
     return 0;
 }
 
-DWORD MSE_SourceUrl::fileReadProc(void *buffer, DWORD length, void *user)
+DWORD UrlStreamSession::fileReadProc(void *buffer, DWORD length, void *user)
 {
-    return static_cast<MSE_SourceUrl*>(user)->onFileRead(buffer, length);
+    return static_cast<UrlStreamSession*>(user)->onFileRead(buffer, length);
 }
 
-DWORD MSE_SourceUrl::fileReadProcNoMeta(void *buffer, DWORD length, void *user)
+DWORD UrlStreamSession::fileReadProcNoMeta(void *buffer, DWORD length, void *user)
 {
-    return static_cast<MSE_SourceUrl*>(user)->onFileReadNoMeta(buffer, length);
+    return static_cast<UrlStreamSession*>(user)->onFileReadNoMeta(buffer, length);
 }
 
-BOOL MSE_SourceUrl::fileSeekProc(QWORD offset, void *user)
+BOOL UrlStreamSession::fileSeekProc(QWORD offset, void *user)
 {
     Q_UNUSED(offset);
     Q_UNUSED(user);
     return false;
 }
 
-DWORD MSE_SourceUrl::onFileRead(void *buffer, DWORD length)
+QWORD UrlStreamSession::fileLenProcRemote(void *user)
+{
+    return static_cast<UrlStreamSession*>(user)->remoteFile->getLength();
+}
+
+DWORD UrlStreamSession::fileReadProcRemote(void *buffer, DWORD length, void *user)
+{
+    UrlStreamSession* session = static_cast<UrlStreamSession*>(user);
+    qint64 n = session->remoteFile->read(session->filePos, static_cast<char*>(buffer), length, session->readTimeout);
+    session->filePos += n;
+    return n;
+}
+
+BOOL UrlStreamSession::fileSeekProcRemote(QWORD offset, void *user)
 {
-    char* p = static_cast<char*>(buffer);
+    UrlStreamSession* session = static_cast<UrlStreamSession*>(user);
+    if(offset > static_cast<QWORD>(session->remoteFile->getLength()))
+        return false;
+    session->filePos = offset;
+    return true;
+}
+
+DWORD UrlStreamSession::onFileRead(void *dest, DWORD length)
+{
+    char* p = static_cast<char*>(dest);
     DWORD n = 0;
 
     forever
     {
+        if(isRebuffering && !waitForFill(1))
+            return 0;
+
         forever
         {
-            if(urlStreamIsClosed)
+            if(isClosed)
                 return n;
 
             if(metaLen == 0) // waiting for meta byte
             {
-                if(urlStreamBuffer.bytesAvailable() < 1)
+                qint64 spanLen;
+                const char* span = buffer.readSpan(spanLen);
+                if(spanLen < 1)
                     break;
-                quint8 metaByte;
-                urlStreamBuffer.read(reinterpret_cast<char*>(&metaByte), 1);
+                quint8 metaByte = static_cast<quint8>(*span);
+                buffer.commitRead(1);
                 if(!metaByte)
                 {
                     metaLen = -1;
@@ -94,21 +190,31 @@ DWORD MSE_SourceUrl::onFileRead(void *buffer, DWORD length)
 
             if(metaLen > 0)
             {
-                if(urlStreamBuffer.bytesAvailable() < metaLen)
+                if(buffer.bytesAvailable() < metaLen)
                     break;
-                QByteArray metaData;
-                metaData.resize(metaLen);
-                urlStreamBuffer.read(metaData.data(), metaLen);
-                parseMeta(metaData);
+                const char* metaData = buffer.peekSpan(metaLen);
+                if(metaData)
+                {
+                    parseMeta(metaData, metaLen);
+                    buffer.commitRead(metaLen);
+                }
+                else
+                {
+                    // the meta block wraps around the end of the buffer
+                    QByteArray metaCopy;
+                    metaCopy.resize(metaLen);
+                    buffer.read(metaCopy.data(), metaLen);
+                    parseMeta(metaCopy.constData(), metaLen);
+                }
                 metaLen = -1;
                 chunkPos = 0;
             }
 
-            qint64 nToRead = qMin(urlStreamBuffer.bytesAvailable(), static_cast<qint64>(length - n));
+            qint64 nToRead = qMin(buffer.bytesAvailable(), static_cast<qint64>(length - n));
             nToRead = qMin(static_cast<qint64>(chunkLen - chunkPos), nToRead);
             if(!nToRead)
                 break;
-            urlStreamBuffer.read(p, nToRead);
+            buffer.read(p, nToRead);
             p += nToRead;
             n += nToRead;
             chunkPos += nToRead;
@@ -120,22 +226,77 @@ DWORD MSE_SourceUrl::onFileRead(void *buffer, DWORD length)
         if(n)
             return n;
 
-        QThread::msleep(100);
+        if(!waitForFill(metaLen > 0 ? metaLen : 1))
+            return 0;
     }
 }
 
-DWORD MSE_SourceUrl::onFileReadNoMeta(void *buffer, DWORD length)
+DWORD UrlStreamSession::onFileReadNoMeta(void *dest, DWORD length)
 {
     forever
     {
-        if(urlStreamIsClosed)
+        if(isClosed)
+            return 0;
+
+        if(!isRebuffering && buffer.bytesAvailable())
+        {
+            DWORD n = buffer.read(static_cast<char*>(dest), length);
+            if(hasQueuedMeta)
+                deliverMeta();
+            return n;
+        }
+
+        if(!waitForFill(1))
             return 0;
+    }
+}
+
+/*!
+ * Tells the reader that no more data is coming,
+ * so the rest of the buffer is read out and then the stream ends.
+ */
+void UrlStreamSession::finishDownload()
+{
+    isDownloadDone = true;
+    buffer.interrupt();
+}
+
+/*!
+ * Waits until at least *minBytes* are available.
+ * If the buffer has run dry, this counts as an underrun
+ * and the reader waits until the buffer is filled up to the preload target.
+ * After finishDownload() an empty buffer is the end of the stream, not an underrun.
+ */
+bool UrlStreamSession::waitForFill(qint64 minBytes)
+{
+    if(isClosed)
+        return false;
+
+    if(isDownloadDone)
+    {
+        isRebuffering = false;
+        return buffer.bytesAvailable() >= minBytes;
+    }
 
-        if(urlStreamBuffer.bytesAvailable())
-            return urlStreamBuffer.read((char*)buffer, length);
+    if(!isRebuffering)
+    {
+        if(buffer.bytesAvailable() >= minBytes)
+            return true;
+        underruns++;
+        isRebuffering = true;
+    }
 
-        QThread::msleep(100);
+    qint64 target = qMin(targetFill.load(), buffer.getCapacity() / 2);
+    if(!buffer.waitForData(qMax(minBytes, target), readTimeout))
+    {
+        // finishDownload() interrupts the wait, but what has been received still has to be played
+        if(isClosed || !isDownloadDone)
+            return false;
+        isRebuffering = false;
+        return buffer.bytesAvailable() >= minBytes;
     }
+    isRebuffering = false;
+    return true;
 }
 
 void MSE_SourceUrl::onMixerStart(DWORD channel)
@@ -144,44 +305,26 @@ void MSE_SourceUrl::onMixerStart(DWORD channel)
         tryRestartUrl(true);
 }
 
-void MSE_SourceUrl::parseMeta(QByteArray &data)
+void MSE_SourceUrl::parseMeta(const char *data, int len)
 {
     if(sound->getInitParams().icuUseForRemoteSources)
     {
-        cpTr.addEntry(data.constData(), data.size(), [&](const QString& icyString){
+        cpTr.addEntry(data, len, [&](const QString& icyString){
             setIcyString(icyString);
         });
         cpTr.processEntries(getTrReference());
         return;
     }
 
-    QString icyString = QString::fromUtf8(data);
+    QString icyString = QString::fromUtf8(data, qstrnlen(data, len));
     setIcyString(icyString);
 }
 
 void MSE_SourceUrl::setIcyString(const QString& icyString)
 {
-    static QRegularExpression rx(
-        "StreamTitle\\=\\'(.*?)\\'\\;",
-        QRegularExpression::CaseInsensitiveOption);
-
-    QRegularExpressionMatch match = rx.match(icyString);
     QString trackArtist;
     QString trackTitle;
-    if(match.hasMatch())
-    {
-        const QString& cap = match.captured(1);
-        int p = cap.indexOf(QStringLiteral(" - "));
-        if(p >= 0)
-        {
-            trackArtist = cap.left(p).trimmed();
-            trackTitle = cap.mid(p+3).trimmed();
-        }
-        else
-        {
-            trackTitle = cap.trimmed();
-        }
-    }
+    MSE_IcyParser::parseStreamTitle(icyString, trackArtist, trackTitle);
 
     if((trackArtist != curTrackArtist) || (trackTitle != curTrackTitle))
     {
@@ -195,6 +338,12 @@ void MSE_SourceUrl::tryRestartUrl(bool initialStart)
 {
     if(state != mse_sus_WaitingForStart)
     {
+        if(!initialStart && (isSplicing || canSplice()))
+        {
+            reconnectSeamless();
+            return;
+        }
+
         state = mse_sus_WaitingForStart;
         if(initialStart)
             QTimer::singleShot(0, this, SLOT(openUrl()));
@@ -203,6 +352,114 @@ void MSE_SourceUrl::tryRestartUrl(bool initialStart)
     }
 }
 
+/*!
+ * Returns true if the current connection can be replaced
+ * without recreating the decoder, see MSE_SoundInitParams::remoteSeamlessReconnect.
+ */
+bool MSE_SourceUrl::canSplice() const
+{
+    return isSpliceable
+        && (state == mse_sus_ReceivingStream)
+        && session
+        && urlStream
+        && (frameSync.getFormat() != mse_ffUnknown)
+        && (BASS_ChannelIsActive(urlStream) != BASS_ACTIVE_STOPPED);
+}
+
+/*!
+ * Reconnects while the decoder keeps playing what's left in the buffer
+ * (or waits for more data in the rebuffering state).
+ * The first attempt is made right away, the next ones back off.
+ */
+void MSE_SourceUrl::reconnectSeamless()
+{
+    isSplicing = true;
+    closeReply();
+    state = mse_sus_WaitingForStart;
+    // the rest of the interrupted frame will never arrive
+    frameSync.resync();
+
+    retriesLeft--;
+    if(!retriesLeft)
+    {
+        closeSock();
+        SETERROR(MSE_Object::Err::noRetriesLeft);
+        return;
+    }
+
+    retryTimer = new QTimer;
+    retryTimer->setSingleShot(true);
+    retryTimer->setInterval(qMin(retryInterval, spliceRetryInterval * (maxRetries - retriesLeft - 1)));
+    connect(retryTimer, &QTimer::timeout, [this](){
+        if(!openUrl(entry, maxRedirects))
+            closeSock();
+    });
+    retryTimer->start();
+}
+
+/*!
+ * Continues the current session with the data of the new connection.
+ * Returns false if it's not possible and the stream needs a full restart.
+ */
+bool MSE_SourceUrl::resumeSession()
+{
+    isSplicing = false;
+    if(!session || !urlStream || (BASS_ChannelIsActive(urlStream) == BASS_ACTIVE_STOPPED))
+        return false;
+    if(!isLiveStream())
+        return false;
+
+    bool ok;
+    int metaInt = QString::fromUtf8(netReply->rawHeader("icy-metaint")).toInt(&ok);
+    icyParser.reset(ok ? metaInt : 0);
+    frameSync.resync();
+    retriesLeft = maxRetries;
+    state = mse_sus_ReceivingStream;
+    return true;
+}
+
+/*!
+ * Moves the received data into the ring buffer in the seamless reconnect mode.
+ * The ICY metadata is taken out here and queued until the reader gets to it,
+ * and only whole frames get into the buffer, so the data of the next connection
+ * can be appended to the same buffer.
+ */
+void MSE_SourceUrl::receiveFrames()
+{
+    forever
+    {
+        // the frames that are held back will also go into the buffer
+        qint64 nFree = session->buffer.bytesFree() - frameSync.getPendingBytes();
+        qint64 nBytes = qMin(netReply->bytesAvailable(), qMin(nFree, static_cast<qint64>(receiveChunkSize)));
+        if(nBytes <= 0)
+            break;
+        if(receiveBuffer.size() < nBytes)
+            receiveBuffer.resize(nBytes);
+        nBytes = netReply->read(receiveBuffer.data(), nBytes);
+        if(nBytes <= 0)
+            break;
+
+        bool isSynced = true;
+        icyParser.feed(receiveBuffer.constData(), nBytes,
+            [this, &isSynced](const char* data, qint64 len){
+                isSynced = frameSync.feed(data, len, [this](const char* frames, qint64 framesLen){
+                    session->buffer.write(frames, framesLen);
+                }) && isSynced;
+            },
+            [this](const char* data, int len){
+                quint64 offset = session->buffer.getStats().totalWritten + frameSync.getPendingBytes();
+                session->queueMeta(offset, data, len);
+            });
+
+        if(!isSynced)
+        {
+            // e.g. the station has switched to another format or bitrate
+            tryRestartUrl(true);
+            return;
+        }
+    }
+}
+
 void MSE_SourceUrl::onSockHeaders()
 {
     QString url = netReply->attribute(QNetworkRequest::RedirectionTargetAttribute).toString();
@@ -212,17 +469,37 @@ void MSE_SourceUrl::onSockHeaders()
 
 void MSE_SourceUrl::closeSock()
 {
-    if(urlStreamCreatorThread.isRunning())
+    isSplicing = false;
+    isSpliceable = false;
+    // abandon the stream creation that may still be in progress
+    // and release the reader that may be waiting for the data;
+    // the session object will free everything it still owns
+    if(createToken)
     {
-        urlStreamIsClosed = true;
-        urlStreamCreatorThread.quit();
-        urlStreamCreatorThread.wait();
+        createToken->cancel();
+        createToken.reset();
     }
+    if(session)
+        session->close();
+    healthTimer.stop();
+    discardCacheWriter();
+
     if(urlStream)
     {
         BASS_StreamFree(urlStream);
         urlStream = 0;
     }
+    session.reset();
+    closeReply();
+    state = mse_sus_Idle;
+}
+
+/*!
+ * Closes the network connection and its timers, but not the session.
+ */
+void MSE_SourceUrl::closeReply()
+{
+    drainTimer.stop();
     if(netReply)
     {
         netReply->disconnect();
@@ -248,12 +525,32 @@ void MSE_SourceUrl::closeSock()
         timeoutTimer->deleteLater();
         timeoutTimer = nullptr;
     }
-    urlStreamBuffer.clear();
-    state = mse_sus_Idle;
 }
 
 void MSE_SourceUrl::onSockDone()
 {
+    if(state == mse_sus_ReceivingStream)
+    {
+        // the server has closed a live stream
+        if(canSplice())
+        {
+            finishCacheWriter();
+            tryRestartUrl();
+            return;
+        }
+        timeoutTimer->stop();
+        if(session && !isSpliceable)
+        {
+            // the data that didn't fit into the ring buffer is still in netReply
+            receiveData();
+            return;
+        }
+        finishCacheWriter();
+        if(session && (netReply->error() == QNetworkReply::NoError))
+            session->finishDownload();
+        return;
+    }
+
     if(state != mse_sus_ReceivingPlaylist)
         return;
 
@@ -295,6 +592,13 @@ void MSE_SourceUrl::onSockDone()
 
 void MSE_SourceUrl::onSockError(QNetworkReply::NetworkError err)
 {
+    if(isSplicing || canSplice())
+    {
+        // the decoder is still alive, so any failure is worth another attempt
+        tryRestartUrl();
+        return;
+    }
+
     closeSock();
     switch(err)
     {
@@ -320,9 +624,120 @@ void MSE_SourceUrl::onSockError(QNetworkReply::NetworkError err)
 
 void MSE_SourceUrl::openUrl()
 {
+    if(openFromCache())
+        return;
     openUrl(entry, maxRedirects);
 }
 
+/*!
+ * Plays the resource from MSE_RemoteCache if it's there,
+ * and checks in the background whether it's still up to date.
+ * The cached file is played through the same mixer as the network stream.
+ */
+bool MSE_SourceUrl::openFromCache()
+{
+    MSE_RemoteCache* cache = sound->getRemoteCache();
+    if(!cache)
+        return false;
+    MSE_RemoteCacheEntry cacheEntry;
+    if(!cache->lookup(entry.filename, cacheEntry))
+        return false;
+
+    closeSock();
+    sound->getEngine()->loadPendingPlugins();
+#ifdef Q_OS_WIN
+    const void* file = cacheEntry.filename.utf16();
+#else
+    QByteArray fileData = cacheEntry.filename.toUtf8();
+    const void* file = fileData.constData();
+#endif
+    urlStream = BASS_StreamCreateFile(
+        false, file, 0, 0,
+        (sound->getDefaultStreamFlags() &~ BASS_SAMPLE_3D) | BASS_STREAM_DECODE);
+    if(!urlStream)
+    {
+        // the cached data is broken, download it again
+        cache->remove(entry.filename);
+        return false;
+    }
+    if(!BASS_Mixer_StreamAddChannel(mixerStream, urlStream, BASS_MIXER_DOWNMIX))
+    {
+        SETERROR(MSE_Object::Err::mixerAttach, cacheEntry.filename);
+        BASS_StreamFree(urlStream);
+        urlStream = 0;
+        return false;
+    }
+
+    BASS_ChannelFlags(mixerStream, BASS_MIXER_END, BASS_MIXER_END | BASS_MIXER_NONSTOP);
+    state = mse_sus_PlayingCache;
+    retriesLeft = maxRetries;
+    cache->revalidate(entry.filename);
+    emit onMeta();
+    return true;
+}
+
+/*!
+ * Starts writing the received stream into MSE_RemoteCache
+ * if the current reply is a finite resource.
+ */
+void MSE_SourceUrl::startCacheWriter()
+{
+    discardCacheWriter();
+    MSE_RemoteCache* cache = sound->getRemoteCache();
+    if(!cache || !cache->isCacheable(netReply))
+        return;
+
+    cacheLength = netReply->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+    cacheEtag = netReply->rawHeader("ETag");
+    cacheLastModified = netReply->rawHeader("Last-Modified");
+    cacheWriter.reset(cache->createPartFile());
+}
+
+/*!
+ * Passes the written file to MSE_RemoteCache if the whole resource has been received.
+ */
+void MSE_SourceUrl::finishCacheWriter()
+{
+    if(!cacheWriter)
+        return;
+
+    bool isComplete = (netReply->error() == QNetworkReply::NoError)
+        && cacheWriter->flush()
+        && (cacheWriter->size() == cacheLength);
+    if(!isComplete)
+    {
+        discardCacheWriter();
+        return;
+    }
+
+    QString filename = cacheWriter->fileName();
+    cacheWriter->close();
+    cacheWriter.reset();
+    sound->getRemoteCache()->store(entry.filename, filename, cacheEtag, cacheLastModified, true);
+}
+
+void MSE_SourceUrl::discardCacheWriter()
+{
+    if(!cacheWriter)
+        return;
+    cacheWriter->remove();
+    cacheWriter.reset();
+}
+
+/*!
+ * Copies the completely downloaded remote file into MSE_RemoteCache.
+ */
+void MSE_SourceUrl::onRemoteFileComplete()
+{
+    if(!cacheRemoteFile || !session || !session->remoteFile || (sender() != session->remoteFile.data()))
+        return;
+    MSE_RemoteCache* cache = sound->getRemoteCache();
+    if(!cache)
+        return;
+    cacheRemoteFile = false;
+    cache->store(entry.filename, session->remoteFile->getDiskFilename(), cacheEtag, cacheLastModified, false);
+}
+
 void MSE_SourceUrl::retryUrl()
 {
     closeSock();
@@ -344,8 +759,8 @@ void MSE_SourceUrl::retryUrl()
 
 void MSE_SourceUrl::onSockData()
 {
-    if(netReply->bytesAvailable() > maxBufferCapacity
-        || urlStreamBuffer.bytesAvailable() > maxBufferCapacity)
+    // a file is held back by the read buffer size of the reply, so only a live stream can overflow
+    if(!netReply->readBufferSize() && (netReply->bytesAvailable() > maxBufferCapacity))
     {
         if(sound->getState() != mse_scsPlaying)
             sound->close();
@@ -378,63 +793,53 @@ void MSE_SourceUrl::onSockData()
             }
             else
             {
+                if(!isSplicing && isRangeSeekable())
+                {
+                    if(!startRemoteFile())
+                        closeSock();
+                    return;
+                }
+
                 bool ok;
-                int bitrate = QString::fromUtf8(netReply->rawHeader("icy-br")).toInt(&ok);
-                if(!ok)
-                    bitrate = 256;
-                preloadLength = bitrate / 8 * 1024 * preloadSecs;
+                icyBitrate = QString::fromUtf8(netReply->rawHeader("icy-br")).toInt(&ok);
+                if(!ok || (icyBitrate < 0))
+                    icyBitrate = 0;
                 state = mse_sus_WaitingStreamHeader;
             }
             break;
 
         case mse_sus_WaitingStreamHeader:
-            nBytes = netReply->bytesAvailable();
-            if(nBytes < preloadLength)
+            if(isSplicing)
+            {
+                if(!resumeSession())
+                    tryRestartUrl(true);
                 return;
-
-            bool ok;
-            chunkLen = QString::fromUtf8(netReply->rawHeader("icy-metaint")).toInt(&ok);
-            if(!ok)
-                chunkLen = 0;
-            if(chunkLen)
-                fileProcTable.read = fileReadProc;
-            else
-                fileProcTable.read = fileReadProcNoMeta;
-            chunkPos = 0;
-            metaLen = -1;
+            }
 
             if(urlStream)
+            {
                 BASS_StreamFree(urlStream);
+                urlStream = 0;
+            }
+
+            if(!startSession())
+            {
+                closeSock();
+                return;
+            }
 
             retriesLeft = maxRetries;
             state = mse_sus_ReceivingStream;
-            urlStreamIsClosed = false;
-
-            urlStreamCreator = new UrlStreamCreator;
-            urlStreamCreator->moveToThread(&urlStreamCreatorThread);
-            connect(
-                &urlStreamCreatorThread, &QThread::finished,
-                urlStreamCreator, &QObject::deleteLater
-            );
-            connect(
-                this, &MSE_SourceUrl::onUrlStreamCreate,
-                urlStreamCreator, &UrlStreamCreator::create
-            );
-            connect(
-                urlStreamCreator, &UrlStreamCreator::resultReady,
-                this, &MSE_SourceUrl::onUrlStreamReady
-            );
-            urlStreamCreatorThread.start();
-            emit onUrlStreamCreate(
-                (sound->getDefaultStreamFlags() &~ BASS_SAMPLE_3D)
-                    | BASS_STREAM_RESTRATE | BASS_STREAM_BLOCK | BASS_STREAM_DECODE,
-                &fileProcTable,
-                this
-            );
             break;
 
         case mse_sus_ReceivingStream:
-            urlStreamBuffer.write(netReply->readAll());
+            if(isSpliceable)
+            {
+                receiveFrames();
+                break;
+            }
+
+            receiveData();
             break;
 
         default:
@@ -442,18 +847,200 @@ void MSE_SourceUrl::onSockData()
     }
 }
 
-void MSE_SourceUrl::onUrlStreamReady(HSTREAM newUrlStream)
+/*!
+ * Reads the received data of a non-spliceable stream straight into the ring buffer.
+ * If the buffer is full, the rest stays in netReply and is picked up by drainTimer
+ * when the reader has made room. Meanwhile the server waits for us, so the network timeout is off.
+ * Once the reply is finished and all its data is in the buffer, the download is over.
+ */
+void MSE_SourceUrl::receiveData()
 {
-    if(urlStreamCreatorThread.isRunning())
+    forever
+    {
+        qint64 spanLen;
+        char* span = session->buffer.writeSpan(spanLen);
+        if(!spanLen)
+            break;
+        qint64 nBytes = netReply->read(span, spanLen);
+        if(nBytes <= 0)
+            break;
+        session->buffer.commitWrite(nBytes);
+        if(cacheWriter && (cacheWriter->write(span, nBytes) != nBytes))
+            discardCacheWriter();
+        if(nBytes < spanLen)
+            break;
+    }
+
+    if(netReply->bytesAvailable())
     {
-        urlStreamCreatorThread.quit();
-        urlStreamCreatorThread.wait();
+        timeoutTimer->stop();
+        drainTimer.start();
+        return;
     }
 
-    if(urlStreamIsClosed)
+    drainTimer.stop();
+    if(!netReply->isFinished())
+    {
+        timeoutTimer->start();
         return;
+    }
+    finishCacheWriter();
+    if(netReply->error() == QNetworkReply::NoError)
+        session->finishDownload();
+}
+
+void MSE_SourceUrl::createSession()
+{
+    session = QSharedPointer<UrlStreamSession>(new UrlStreamSession(this), &QObject::deleteLater);
+    session->generation = ++sessionGeneration;
+    session->readTimeout = sound->getInitParams().remoteReadTimeout;
+    if(session->readTimeout <= 0)
+        session->readTimeout = -1;
+    connect(session.data(), &UrlStreamSession::streamCreated, this, &MSE_SourceUrl::onUrlStreamReady);
+}
 
-    urlStream = newUrlStream;
+/*!
+ * Starts creating the stream for the current session in the engine's I/O pool.
+ * BASS reads the stream header there, so the job may wait for the network for a long time.
+ */
+void MSE_SourceUrl::startStreamCreation(DWORD system)
+{
+    DWORD flags = (sound->getDefaultStreamFlags() &~ BASS_SAMPLE_3D)
+        | BASS_STREAM_RESTRATE | BASS_STREAM_BLOCK | BASS_STREAM_DECODE;
+    if(system == STREAMFILE_NOBUFFER)
+        flags &= ~BASS_STREAM_BLOCK;
+    // BASS probes the stream with every plugin
+    sound->getEngine()->loadPendingPlugins();
+    QSharedPointer<UrlStreamSession> jobSession = session;
+    createToken = sound->getEngine()->getIoPool()->start([jobSession, system, flags](const MSE_CancelToken& token){
+        HSTREAM stream = BASS_StreamCreateFileUser(
+            system, flags, &jobSession->fileProcTable, jobSession.data());
+        // if nobody claims the stream, the session frees it on destruction
+        jobSession->createdStream = stream;
+        if(!token.isCancelled())
+            emit jobSession->streamCreated(jobSession->generation);
+    });
+}
+
+/*!
+ * Creates a new session for the current reply
+ * and starts creating the stream in the engine's I/O pool.
+ */
+bool MSE_SourceUrl::startSession()
+{
+    createSession();
+    if(!session->buffer.setCapacity(maxBufferCapacity))
+    {
+        SETERROR(MSE_Object::Err::memoryError);
+        return false;
+    }
+
+    bool ok;
+    session->chunkLen = QString::fromUtf8(netReply->rawHeader("icy-metaint")).toInt(&ok);
+    if(!ok)
+        session->chunkLen = 0;
+    isSpliceable = sound->getInitParams().remoteSeamlessReconnect && isLiveStream();
+    // let the server wait instead of piling up the whole file in memory
+    if(!isLiveStream())
+        netReply->setReadBufferSize(replyBufferSize);
+    if(isSpliceable)
+    {
+        // the metadata is taken out by the producer (see receiveFrames())
+        icyParser.reset(session->chunkLen);
+        frameSync.reset();
+        session->chunkLen = 0;
+    }
+    if(session->chunkLen)
+        session->fileProcTable.read = UrlStreamSession::fileReadProc;
+    else
+        session->fileProcTable.read = UrlStreamSession::fileReadProcNoMeta;
+    session->chunkPos = 0;
+    session->metaLen = -1;
+    startCacheWriter();
+
+    // the new connection starts with the preload, keeping the target learned so far
+    resetHealth();
+    updateTargetFill();
+    healthTimer.start();
+
+    startStreamCreation(STREAMFILE_BUFFER);
+    return true;
+}
+
+/*!
+ * Returns true if the current reply is an Internet-radio stream
+ * or some other resource of unknown length.
+ */
+bool MSE_SourceUrl::isLiveStream() const
+{
+    foreach(const QByteArray& header, netReply->rawHeaderList())
+        if(header.startsWith("icy-") || header.startsWith("ice-"))
+            return true;
+    return netReply->header(QNetworkRequest::ContentLengthHeader).toLongLong() <= 0;
+}
+
+/*!
+ * Returns true if the current reply is a plain file (not an Internet-radio stream)
+ * of a known length, and the server accepts Range requests.
+ */
+bool MSE_SourceUrl::isRangeSeekable() const
+{
+    if(isLiveStream())
+        return false;
+    return netReply->rawHeader("Accept-Ranges").toLower().contains("bytes");
+}
+
+/*!
+ * Switches to the seekable remote file mode.
+ * The current reply is dropped and the data is fetched with Range requests
+ * on demand of the decoder.
+ */
+bool MSE_SourceUrl::startRemoteFile()
+{
+    QUrl fileUrl = netReply->url();
+    qint64 fileLength = netReply->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+    MSE_RemoteCache* cache = sound->getRemoteCache();
+    cacheRemoteFile = cache && cache->isCacheable(netReply);
+    cacheEtag = netReply->rawHeader("ETag");
+    cacheLastModified = netReply->rawHeader("Last-Modified");
+
+    netReply->disconnect();
+    netReply->abort();
+    netReply->deleteLater();
+    netReply = nullptr;
+    if(timeoutTimer)
+        timeoutTimer->stop();
+
+    createSession();
+    MSE_RemoteFileCacheParams cacheParams;
+    cacheParams.memoryCacheSize = sound->getInitParams().remoteFileCacheSize;
+    // the cache needs the whole file, so keep every block of it
+    cacheParams.useDiskCache = sound->getInitParams().remoteFileDiskCache || cacheRemoteFile;
+    session->remoteFile.reset(new MSE_RemoteFile(
+        fileUrl,
+        fileLength,
+        sound->getEngine()->getInitParams().userAgent.toUtf8(),
+        cacheParams));
+    session->fileProcTable.length = UrlStreamSession::fileLenProcRemote;
+    session->fileProcTable.read = UrlStreamSession::fileReadProcRemote;
+    session->fileProcTable.seek = UrlStreamSession::fileSeekProcRemote;
+    if(cacheRemoteFile)
+        connect(session->remoteFile.data(), &MSE_RemoteFile::onDiskComplete, this, &MSE_SourceUrl::onRemoteFileComplete);
+
+    retriesLeft = maxRetries;
+    state = mse_sus_ReceivingFile;
+    startStreamCreation(STREAMFILE_NOBUFFER);
+    return true;
+}
+
+void MSE_SourceUrl::onUrlStreamReady(quint64 generation)
+{
+    // a new session may have got the address of the abandoned one, so the pointers can't be compared
+    if(!session || (generation != session->generation))
+        return; // the stream of an abandoned session
+
+    createToken.reset();
+    urlStream = session->createdStream.exchange(0);
 
     if(!urlStream)
     {
@@ -467,6 +1054,41 @@ void MSE_SourceUrl::onUrlStreamReady(HSTREAM newUrlStream)
         closeSock();
         return;
     }
+
+    if(session->remoteFile)
+    {
+        // a finite file: let the mixer end with it, so the next track starts
+        BASS_ChannelFlags(mixerStream, BASS_MIXER_END, BASS_MIXER_END | BASS_MIXER_NONSTOP);
+        // the duration is known now
+        emit onMeta();
+    }
+}
+
+bool MSE_SourceUrl::isSeekable() const
+{
+    if(!urlStream)
+        return false;
+    return (state == mse_sus_PlayingCache) || (session && session->remoteFile);
+}
+
+double MSE_SourceUrl::getDuration() const
+{
+    if(!isSeekable())
+        return -1;
+    QWORD len = BASS_ChannelGetLength(urlStream, BASS_POS_BYTE);
+    if(len == 0xFFFFFFFFFFFFFFFF)
+        return -1;
+    return BASS_ChannelBytes2Seconds(urlStream, len);
+}
+
+bool MSE_SourceUrl::setPosition(double secs)
+{
+    if(!isSeekable())
+        return false;
+    QWORD bytes = BASS_ChannelSeconds2Bytes(urlStream, secs);
+    if(bytes == 0xFFFFFFFFFFFFFFFF)
+        return false;
+    return BASS_Mixer_ChannelSetPosition(urlStream, bytes, BASS_POS_BYTE | BASS_POS_MIXER_RESET);
 }
 
 MSE_SourceUrl::MSE_SourceUrl(MSE_Playlist *parent) : MSE_Source(parent)
@@ -477,11 +1099,146 @@ MSE_SourceUrl::MSE_SourceUrl(MSE_Playlist *parent) : MSE_Source(parent)
   ,retriesLeft(0)
   ,mixerStream(0)
   ,urlStream(0)
+  ,icyBitrate(0)
+  ,targetSecs(0)
+  ,arrivalRate(0)
+  ,consumptionRate(0)
+  ,lastWritten(0)
+  ,lastRead(0)
+  ,lastUnderruns(0)
+  ,cacheLength(0)
+  ,cacheRemoteFile(false)
+  ,isSpliceable(false)
+  ,isSplicing(false)
+  ,sessionGeneration(0)
 {
     type = mse_sctRemote;
-    fileProcTable.close = fileCloseProc;
-    fileProcTable.length = fileLenProc;
-    fileProcTable.seek = fileSeekProc;
+    setPreloadRange(sound->getInitParams().remotePreloadMin, sound->getInitParams().remotePreloadMax);
+    healthTimer.setInterval(healthInterval);
+    connect(&healthTimer, &QTimer::timeout, this, &MSE_SourceUrl::onHealthTimer);
+    drainTimer.setInterval(drainInterval);
+    connect(&drainTimer, &QTimer::timeout, this, [this](){
+        if((state == mse_sus_ReceivingStream) && session && netReply)
+            receiveData();
+    });
+}
+
+/*!
+ * Sets the range (in milliseconds) for the adaptive preload of this source.
+ * The playback starts (or resumes after an underrun) when the buffer holds
+ * at least this much audio. The actual amount grows after underruns
+ * and shrinks back after a long period of stable playback.
+ */
+void MSE_SourceUrl::setPreloadRange(int minMsecs, int maxMsecs)
+{
+    preloadMin = qMax(0, minMsecs);
+    preloadMax = qMax(preloadMin, maxMsecs);
+    targetSecs = qBound(preloadMin / 1000.0, targetSecs, preloadMax / 1000.0);
+    updateTargetFill();
+}
+
+/*!
+ * Returns the current state of the network buffer.
+ */
+MSE_SourceUrlBufferHealth MSE_SourceUrl::getBufferHealth() const
+{
+    MSE_SourceUrlBufferHealth health;
+    health.bufferedBytes = session ? session->buffer.bytesAvailable() : 0;
+    health.bufferedSecs = health.bufferedBytes / byteRate();
+    health.targetSecs = targetSecs;
+    health.arrivalRate = arrivalRate;
+    health.consumptionRate = consumptionRate;
+    health.underruns = session ? session->underruns.load() : lastUnderruns;
+    health.isRebuffering = session ? session->isRebuffering.load() : false;
+    return health;
+}
+
+/*!
+ * Returns the estimated stream byte rate.
+ */
+double MSE_SourceUrl::byteRate() const
+{
+    if(icyBitrate > 0)
+        return icyBitrate * 125.0;
+    if(consumptionRate > 0)
+        return consumptionRate;
+    return 256 * 125.0;
+}
+
+void MSE_SourceUrl::resetHealth()
+{
+    lastWritten = 0;
+    lastRead = 0;
+    lastUnderruns = 0;
+    arrivalRate = 0;
+    consumptionRate = 0;
+    healthClock.start();
+    stableClock.start();
+}
+
+void MSE_SourceUrl::updateTargetFill()
+{
+    if(session)
+        session->targetFill = static_cast<qint64>(targetSecs * byteRate());
+}
+
+/*!
+ * Measures the network and decoder rates and adapts the preload target.
+ */
+void MSE_SourceUrl::onHealthTimer()
+{
+    // the rates mean nothing once the whole resource has been received
+    if(!session || session->isDownloadDone)
+        return;
+
+    double dt = healthClock.restart() / 1000.0;
+    if(dt <= 0)
+        return;
+
+    MSE_RingBuffer::Stats stats = session->buffer.getStats();
+    double arrival = (stats.totalWritten - lastWritten) / dt;
+    double consumption = (stats.totalRead - lastRead) / dt;
+    lastWritten = stats.totalWritten;
+    lastRead = stats.totalRead;
+
+    static const double alpha = 0.3;
+    arrivalRate = arrivalRate ? (arrivalRate + alpha * (arrival - arrivalRate)) : arrival;
+    bool isRebuffering = session->isRebuffering;
+    if(!isRebuffering && consumption > 0)
+        consumptionRate = consumptionRate ? (consumptionRate + alpha * (consumption - consumptionRate)) : consumption;
+
+    double minSecs = preloadMin / 1000.0;
+    double maxSecs = preloadMax / 1000.0;
+    quint64 underruns = session->underruns;
+    if(underruns != lastUnderruns)
+    {
+        // the buffer has run dry: preload more next time
+        lastUnderruns = underruns;
+        targetSecs = qMin(maxSecs, qMax(targetSecs * 1.5, targetSecs + 1));
+        stableClock.restart();
+        updateTargetFill();
+        emit onBufferUnderrun(underruns);
+        return;
+    }
+
+    if(isRebuffering)
+        return;
+
+    if(consumptionRate > 0 && arrivalRate < consumptionRate * 0.95)
+    {
+        // the network can't keep up, the next underrun is only a matter of time
+        targetSecs = qMin(maxSecs, targetSecs * 1.05 + 0.05);
+        stableClock.restart();
+    }
+    else
+    {
+        if(stableClock.elapsed() >= stableInterval)
+        {
+            targetSecs = qMax(minSecs, targetSecs * 0.8);
+            stableClock.restart();
+        }
+    }
+    updateTargetFill();
 }
 
 MSE_SourceUrl::~MSE_SourceUrl()
@@ -542,7 +1299,11 @@ bool MSE_SourceUrl::getTags(MSE_SourceTags &tags)
 
 bool MSE_SourceUrl::openUrl(const MSE_PlaylistEntry &urlEntry, int redirectsLeft)
 {
-    closeSock();
+    // a seamless reconnect keeps the session
+    if(isSplicing)
+        closeReply();
+    else
+        closeSock();
     _url = urlEntry;
     _redirectsLeft = redirectsLeft;
     if(!_redirectsLeft)
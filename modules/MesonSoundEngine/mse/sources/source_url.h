@@ -21,66 +21,92 @@
 #include "mse/sources/source.h"
 #include "mse/playlist.h"
 #include "mse/bass/bassmix.h"
+#include "mse/utils/ring_buffer.h"
+#include "mse/utils/worker_pool.h"
+#include "mse/utils/remote_file.h"
+#include "mse/utils/icy_parser.h"
+#include "mse/utils/frame_sync.h"
 
 #include <QtNetwork/QNetworkAccessManager>
 #include <QtNetwork/QNetworkReply>
+#include <QElapsedTimer>
 
-class UrlStreamCreator : public QObject
+class MSE_SourceUrl;
+
+/*!
+ * Network buffer health of MSE_SourceUrl.
+ */
+struct MSE_SourceUrlBufferHealth {
+    qint64 bufferedBytes; /*!< Number of bytes waiting in the buffer. */
+    double bufferedSecs; /*!< Approximate duration of the buffered audio in seconds. */
+    double targetSecs; /*!< Current preload target in seconds. */
+    double arrivalRate; /*!< Average network arrival rate in bytes per second. */
+    double consumptionRate; /*!< Average decoder consumption rate in bytes per second. */
+    quint64 underruns; /*!< Number of times the decoder has drained the buffer. */
+    bool isRebuffering; /*!< True if the playback waits for the buffer to fill up to the target. */
+};
+
+/*!
+ * State of a single connection of MSE_SourceUrl.
+ *
+ * It's the *user* pointer for the BASS file procedures,
+ * so it stays alive while the stream is being created in MSE_WorkerPool,
+ * even if the source has already moved on to another connection.
+ */
+class UrlStreamSession : public QObject
 {
     Q_OBJECT
 
 public:
-    UrlStreamCreator()
-    {
-        qRegisterMetaType<DWORD>("DWORD");
-        qRegisterMetaType<HSTREAM>("HSTREAM");
-    }
-
-public slots:
-    void create(DWORD flags, BASS_FILEPROCS *procs, void *user)
-    {
-        HSTREAM urlStream = BASS_StreamCreateFileUser(STREAMFILE_BUFFER, flags, procs, user);
-        emit resultReady(urlStream);
-    }
+    explicit UrlStreamSession(MSE_SourceUrl* source);
+    ~UrlStreamSession();
 
-signals:
-    void resultReady(HSTREAM urlStream);
-};
+    void close();
+
+    static void CALLBACK fileCloseProc(void *user);
+    static QWORD CALLBACK fileLenProc(void *user);
+    static DWORD CALLBACK fileReadProc(void *buffer, DWORD length, void *user);
+    static DWORD CALLBACK fileReadProcNoMeta(void *buffer, DWORD length, void *user);
+    static BOOL CALLBACK fileSeekProc(QWORD offset, void *user);
+    static QWORD CALLBACK fileLenProcRemote(void *user);
+    static DWORD CALLBACK fileReadProcRemote(void *buffer, DWORD length, void *user);
+    static BOOL CALLBACK fileSeekProcRemote(QWORD offset, void *user);
 
+    MSE_RingBuffer buffer;
+    QScopedPointer<MSE_RemoteFile> remoteFile;
+    std::atomic<qint64> filePos {0};
+    BASS_FILEPROCS fileProcTable;
+    std::atomic<bool> isClosed {false};
+    std::atomic<HSTREAM> createdStream {0};
+    quint64 generation = 0;
+    int chunkLen = 0;
+    int chunkPos = 0;
+    int metaLen = -1;
+    int readTimeout = -1;
+    std::atomic<qint64> targetFill {0};
+    std::atomic<bool> isRebuffering {true};
+    std::atomic<quint64> underruns {0};
+    std::atomic<bool> isDownloadDone {false};
 
-class UrlStreamBuffer : public QObject
-{
-    Q_OBJECT
-    QByteArray data;
-    mutable QMutex mutex;
+    void finishDownload();
+    void queueMeta(quint64 offset, const char* data, int len);
 
-public:
-    qint64 bytesAvailable() const
-    {
-        QMutexLocker locker(&mutex);
-        return data.size();
-    }
-
-    qint64 read(char *dest, qint64 maxSize)
-    {
-        QMutexLocker locker(&mutex);
-        qint64 size = qMin(maxSize, static_cast<qint64>(data.size()));
-        memcpy(dest, data.constData(), size);
-        data.remove(0, size);
-        return size;
-    }
-
-    void write(QByteArray newData)
-    {
-        QMutexLocker locker(&mutex);
-        data.append(newData);
-    }
-
-    void clear()
-    {
-        QMutexLocker locker(&mutex);
-        data.clear();
-    }
+protected:
+    DWORD onFileRead(void *dest, DWORD length);
+    DWORD onFileReadNoMeta(void *dest, DWORD length);
+    bool waitForFill(qint64 minBytes);
+    void parseMeta(const char* data, int len);
+    void deliverMeta();
+
+    QMutex sourceMutex;
+    MSE_SourceUrl* source;
+
+    QMutex metaMutex;
+    QList<QPair<quint64, QByteArray>> metaQueue;
+    std::atomic<bool> hasQueuedMeta {false};
+
+signals:
+    void streamCreated(quint64 generation);
 };
 
 
@@ -93,6 +119,28 @@ public:
     virtual HCHANNEL open();
     virtual bool close();
 
+    virtual bool isSeekable() const;
+    virtual double getDuration() const;
+    virtual bool setPosition(double secs);
+
+    /*!
+     * Returns the occupancy statistics of the network buffer.
+     */
+    inline MSE_RingBuffer::Stats getBufferStats() const {return session ? session->buffer.getStats() : MSE_RingBuffer::Stats();}
+
+    MSE_SourceUrlBufferHealth getBufferHealth() const;
+    void setPreloadRange(int minMsecs, int maxMsecs);
+
+    /*!
+     * Returns the minimum preload in milliseconds.
+     */
+    inline int getPreloadMin() const {return preloadMin;}
+
+    /*!
+     * Returns the maximum preload in milliseconds.
+     */
+    inline int getPreloadMax() const {return preloadMax;}
+
 protected:
     virtual bool getTags(MSE_SourceTags &tags);
     bool openUrl(const MSE_PlaylistEntry& urlEntry, int redirectsLeft);
@@ -116,48 +164,87 @@ protected:
         mse_sus_WaitingPlaylistHeader,
         mse_sus_ReceivingPlaylist,
         mse_sus_WaitingStreamHeader,
-        mse_sus_ReceivingStream
+        mse_sus_ReceivingStream,
+        mse_sus_ReceivingFile,
+        mse_sus_PlayingCache
     } state;
-    int chunkLen;
-    int chunkPos;
-    int metaLen;
-    int preloadLength;
+    int icyBitrate;
     bool isMono;
 
     MSE_PlaylistEntry _url;
     int _redirectsLeft;
 
     static const int maxRedirects;
-    static const int preloadSecs;
+    static const int healthInterval;
+    static const int stableInterval;
     static const int timeoutInterval;
     static const int maxBufferCapacity;
     static const int retryInterval;
     static const int maxRetries;
+    static const int spliceRetryInterval;
+    static const int receiveChunkSize;
+    static const int replyBufferSize;
+    static const int drainInterval;
 
-    static void CALLBACK fileCloseProc(void *user);
-    static QWORD CALLBACK fileLenProc(void *user);
-    static DWORD CALLBACK fileReadProc(void *buffer, DWORD length, void *user);
-    static DWORD CALLBACK fileReadProcNoMeta(void *buffer, DWORD length, void *user);
-    static BOOL CALLBACK fileSeekProc(QWORD offset, void *user);
     static void CALLBACK startProc(HSYNC handle, DWORD channel, DWORD data, void *user);
 
-    BASS_FILEPROCS fileProcTable;
-
-    void onFileClose();
-    DWORD onFileRead(void *buffer, DWORD length);
-    DWORD onFileReadNoMeta(void *buffer, DWORD length);
     void onMixerStart(DWORD channel);
 
-    void parseMeta(QByteArray &data);
+    void parseMeta(const char* data, int len);
     void setIcyString(const QString& icyString);
 
     void tryRestartUrl(bool initialStart = false);
+    bool startSession();
+    bool isLiveStream() const;
+    bool isRangeSeekable() const;
+    bool startRemoteFile();
+    void createSession();
+    void startStreamCreation(DWORD system);
+    bool openFromCache();
+    void startCacheWriter();
+    void finishCacheWriter();
+    void discardCacheWriter();
+    void closeReply();
+    bool canSplice() const;
+    void reconnectSeamless();
+    bool resumeSession();
+    void receiveFrames();
+    void receiveData();
+
+    QSharedPointer<UrlStreamSession> session;
+    MSE_CancelTokenPtr createToken;
+
+    QScopedPointer<QFile> cacheWriter;
+    qint64 cacheLength;
+    bool cacheRemoteFile;
+    QByteArray cacheEtag;
+    QByteArray cacheLastModified;
+
+    bool isSpliceable;
+    bool isSplicing;
+    quint64 sessionGeneration;
+    MSE_IcyParser icyParser;
+    MSE_FrameSync frameSync;
+    QByteArray receiveBuffer;
+
+    int preloadMin;
+    int preloadMax;
+    double targetSecs;
+    double arrivalRate;
+    double consumptionRate;
+    quint64 lastWritten;
+    quint64 lastRead;
+    quint64 lastUnderruns;
+    QTimer healthTimer;
+    QTimer drainTimer;
+    QElapsedTimer healthClock;
+    QElapsedTimer stableClock;
 
-    bool urlStreamIsClosed = true;
-    QThread urlStreamCreatorThread;
-    UrlStreamCreator *urlStreamCreator;
+    double byteRate() const;
+    void resetHealth();
+    void updateTargetFill();
 
-    UrlStreamBuffer urlStreamBuffer;
+    friend class UrlStreamSession;
 
 protected slots:
     void onSockHeaders();
@@ -167,8 +254,14 @@ protected slots:
     void closeSock();
     void openUrl();
     void retryUrl();
-    void onUrlStreamReady(HSTREAM urlStream);
+    void onUrlStreamReady(quint64 generation);
+    void onHealthTimer();
+    void onRemoteFileComplete();
 
 signals:
-    void onUrlStreamCreate(DWORD flags, BASS_FILEPROCS *procs, void *user);
+    /*!
+     * Emitted when the decoder has drained the network buffer.
+     * The playback resumes once the buffer is filled up to the new preload target.
+     */
+    void onBufferUnderrun(quint64 underruns);
 };
@@ -0,0 +1,28 @@
+#include "source_cover_art.h"
+
+void MSE_SourceCoverArt::clear()
+{
+    data.clear();
+    mimeType.clear();
+    filename.clear();
+}
+
+/*!
+ * Returns MIME type for an image file extension (without a leading dot)
+ * or an empty string if the extension is not a supported image.
+ */
+QString MSE_SourceCoverArt::mimeTypeFromExtension(const QString &ext)
+{
+    QString e = ext.toLower();
+    if((e == "jpg") || (e == "jpeg"))
+        return QStringLiteral("image/jpeg");
+    if(e == "png")
+        return QStringLiteral("image/png");
+    if(e == "gif")
+        return QStringLiteral("image/gif");
+    if(e == "bmp")
+        return QStringLiteral("image/bmp");
+    if(e == "webp")
+        return QStringLiteral("image/webp");
+    return QString();
+}
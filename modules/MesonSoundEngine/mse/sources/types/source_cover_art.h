@@ -0,0 +1,14 @@
+#pragma once
+
+#include <QString>
+#include <QByteArray>
+
+struct MSE_SourceCoverArt {
+    QByteArray data; /*!< Encoded image data (JPEG, PNG, ...). */
+    QString mimeType; /*!< MIME type of the image if known. */
+    QString filename; /*!< Full path to the image file if the cover art was found in the source directory. */
+
+    void clear();
+    bool isEmpty() const {return data.isEmpty();}
+    static QString mimeTypeFromExtension(const QString& ext);
+};
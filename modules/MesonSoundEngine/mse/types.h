@@ -75,6 +75,16 @@ struct MSE_VersionInfo {
         memcpy(reinterpret_cast<DWORD*>(this), &x, sizeof(x));
     }
 
+    /*!
+     * Returns the version as a DWORD, i.e. the reverse of setDword.
+     */
+    inline DWORD asDword() const
+    {
+        DWORD x;
+        memcpy(&x, this, sizeof(x));
+        return x;
+    }
+
     /*!
      * Returns a string reprentation including major and minor version numbers (i.e. "3.2").
      */
@@ -110,6 +120,10 @@ struct MSE_EnginePluginInfo {
     QString filename; /*!< Full canonical path to a plugin file. */
     MSE_VersionInfo version; /*! Version information. */
     QList<MSE_EnginePluginFormat> formats; /*! Supported formats. */
+    bool isLoaded = false; /*!<
+    False if the information comes from the manifest cache
+    and the plugin is not loaded yet (see MSE_EngineInitParams::lazyPlugins).
+*/
 };
 
 /*!
@@ -307,6 +321,64 @@ struct MSE_SoundInitParams {
 
     **Default**: false
 */
+
+    int remoteReadTimeout = 0; /*!<
+    Maximum time (in milliseconds) that a remote stream read waits for the network data.
+    The reader is woken up as soon as the data arrives or the stream is closed,
+    so this value only limits how long the decoder may stall.
+    If the time is out, the read returns no data and the decoder treats it as the end of stream.
+
+    Set to zero to wait until the data arrives or the stream is closed.
+
+    **Default**: 0
+*/
+
+    int remotePreloadMin = 0; /*!<
+    Minimum amount of audio (in milliseconds) that a remote stream buffers
+    before the playback starts or resumes after an underrun.
+    The actual amount adapts to the network conditions between
+    ::remotePreloadMin and ::remotePreloadMax.
+    It can be changed per source with MSE_SourceUrl::setPreloadRange().
+
+    **Default**: 0
+*/
+
+    int remotePreloadMax = 10000; /*!<
+    Maximum amount of audio (in milliseconds) that a remote stream buffers
+    before the playback starts or resumes after an underrun.
+
+    **Default**: 10000
+
+    \sa remotePreloadMin
+*/
+
+    bool remoteSeamlessReconnect = false; /*!<
+    Reconnect dropped Internet-radio streams without restarting the decoder.
+    The stream is split into whole MP3/AAC (ADTS)/Ogg frames as it arrives,
+    and after a reconnect the new data continues the same buffer from the next frame boundary.
+    The decoder plays what's left in the buffer meanwhile, so a short outage
+    causes at most a short glitch, and the playback position keeps counting.
+    A full restart is still done if the new connection delivers a different format.
+    Streams of other formats are always restarted.
+
+    **Default**: false
+*/
+
+    int remoteFileCacheSize = 8*1024*1024; /*!<
+    Size of the in-memory block cache (in bytes) for seekable remote files.
+    Remote files are HTTP resources that are not Internet-radio streams
+    and that support Range requests. They have a known duration and can be seeked.
+
+    **Default**: 8 MB
+*/
+
+    bool remoteFileDiskCache = false; /*!<
+    Also keep all downloaded blocks of a seekable remote file in a temporary file.
+
+    **Default**: false
+
+    \sa remoteFileCacheSize
+*/
 };
 
 /*!
@@ -399,6 +471,16 @@ enum MSE_SoundChannelState {
     mse_scsPaused /*!< The channel is paused */
 };
 
+/*!
+ * Scheduling policy for the audio threads.
+ */
+enum MSE_ThreadPolicy {
+    mse_tpDefault, /*!< Leave the scheduling as is */
+    mse_tpNice, /*!< Normal scheduling with a nice value */
+    mse_tpFifo, /*!< Real-time first-in first-out scheduling (SCHED_FIFO) */
+    mse_tpRoundRobin /*!< Real-time round-robin scheduling (SCHED_RR) */
+};
+
 /*!
  * Process priority for MSE_Encoder
  */
@@ -417,63 +499,74 @@ enum MSE_EncoderProcessPriority {
  * Refer to the documentation of the used encoder class for details.
  */
 struct MSE_EncoderInitParams {
-    quint16 outputBitrate; /*!<
+    quint16 outputBitrate = 128; /*!<
     Output bitrate in kbps.
+
+    **Default**: 128
 */
-    quint32 outputFrequency; /*!<
+    quint32 outputFrequency = 0; /*!<
     Output sample rate in Hz.
     To eleminate possible resampling, this value should be equal to
     MSE_Mixer::outputFrequency from the corresponding mixer object (default).
+    Zero means the same value as MSE_MixerInitParams::outputFrequency.
 
     **Valid values**: depends on encoder
 
     **Default**: MSE_Mixer::outputFrequency
     (from the MSE_Mixer object which is used in constructor)
 */
-    MSE_EncoderProcessPriority processPriority; /*!<
+    MSE_EncoderProcessPriority processPriority = mse_eppNormal; /*!<
     Encoder process priority.
+    It's also applied to the mixing and encoding threads of MSE_Encoder.
 
     **Default**: ::mse_eppNormal
 
     \sa MSE_EncoderProcessPriority
 */
-    quint8 outputQuality; /*!<
+    quint8 outputQuality = 100; /*!<
     Encoding quality in percents.
 
     **Valid values**: 0..100
 
     **Default**: 100
 */
-    quint8 chunkDuration; /*!<
+    quint8 chunkDuration = 5; /*!<
     Number of seconds for encoder to process at a time.
 
     **Valid values**: 1..255
 
     **Default**: 5
+*/
+    bool realTime = false; /*!<
+    Mix a decode-only mixer (see MSE_MixerInitParams::decodeOnly) no faster than the real time,
+    as if it was played. Use it for live streaming from a headless server without a sound card.
+    Has no effect for a playing mixer, which is already paced by the output device.
+
+    **Default**: false
 */
 };
 
 /*!
- * Parameters for MSE_Encoder initialization.
+ * Parameters for MSE_Transmitter initialization.
  */
 struct MSE_TransmitterInitParams {
-    quint8 pollInterval; /*!<
+    quint8 pollInterval = 0; /*!<
     Polling interval in seconds after which the encoder will process each new chunk.
     Discarded when MSE_TransmitterInitParams::useAccurateSendIntervals = true.
 
     **Valid values**: 1..255
 
     **Default**: Default value is calculated from a corresponding MSE_Encoder object
-    as MSE_EncoderInitParams::chunkDuration minus 1
+    as MSE_EncoderInitParams::chunkDuration minus 1 (zero means this default)
 */
-    quint16 port; /*!<
+    quint16 port = 8000; /*!<
     Station port. You must specify different ports for a different stations.
 
     **Valid values**: any valid port number in range of 1..65535
 
     **Default**: 8000
 */
-    quint16 maxListeners; /*!<
+    quint16 maxListeners = 0; /*!<
     Maximum number of simultaneously connected clients allowed.
     Set to zero for no limit.
 
@@ -481,35 +574,47 @@ struct MSE_TransmitterInitParams {
 
     **Default**: 0
 */
-    qint64 dataBlockLength; /*!<
+    qint64 dataBlockLength = 16384; /*!<
     Number of bytes in each ShoutCast data block (icy-metaint).
 
     **Valid values**: any positive integer (preferably 2^N)
 
     **Default**: 16384
 */
-    quint8 bufferLength; /*!<
+    quint8 bufferLength = 15; /*!<
     Internal output buffer in seconds.
 
     **Valid values**: 1..255
 
     **Default**: 15
 */
-    QString name; /*!<
+    quint8 burstLength = 5; /*!<
+    Number of seconds of the buffered stream sent to a new listener at once,
+    so its player can start without waiting for the buffer to fill.
+    Can't be more than MSE_TransmitterInitParams::bufferLength.
+
+    **Default**: 5
+*/
+    QString contentType = QStringLiteral("audio/mpeg"); /*!<
+    MIME type of the encoded stream. This will appear in Content-Type header.
+
+    **Default**: audio/mpeg
+*/
+    QString name = QStringLiteral("Unnamed"); /*!<
     Station name. This will appear in icy-name header.
 
     **Valid values**: any non-empty string
 
     **Default**: Unnamed
 */
-    QString genre; /*!<
+    QString genre = QStringLiteral("Unknown"); /*!<
     Station music genre. This will appear in icy-genre header.
 
     **Valid values**: any string
 
     **Default**: Unknown
 */
-    bool isPublic; /*!<
+    bool isPublic = true; /*!<
     This will appear in icy-pub response (1 if true, 0 otherwise).
     This param doesn't mean anything special in the current server implementation.
 
@@ -547,7 +652,7 @@ struct MSE_TransmitterInitParams {
     **Default**: \<empty\>
 
 */
-    bool useAccurateSendIntervals; /*!<
+    bool useAccurateSendIntervals = false; /*!<
     By default, MSE_Transmitter sends data to clients using approximate intervals of time
     based on bitrate and other parameters.
     In other words, the tranmission speed from server not exactly equals
@@ -559,15 +664,16 @@ struct MSE_TransmitterInitParams {
     When MSE_TransmitterInitParams::useAccurateSendIntervals = true, then MSE_Transmitter will use upload speed
     that exactly matches the playback speed of the audio stream,
     minimizing chances of above mentioned client-side problems.
-
-    To use this option, you must set initialize MSE_Engine with
-    non-zero MSE_EngineInitParams::device value.
+    Every listener gets MSE_TransmitterInitParams::burstLength seconds at once
+    and then exactly the real-time rate, measured by the sample clock of the encoded stream.
+    No sound card is involved, but a decode-only mixer
+    must be paced with MSE_EncoderInitParams::realTime.
 
     **Default**: false
 
-    \sa MSE_Transmitter, MSE_EngineInitParams
+    \sa MSE_Transmitter, MSE_EncoderInitParams
 */
-    QString titleFormat; /*!<
+    QString titleFormat = QStringLiteral("%full_title%"); /*!<
     Title format for a current track.
 
     \li **%artist%** will be replaced with an artist's name;
@@ -583,16 +689,78 @@ struct MSE_TransmitterInitParams {
 */
     QString controlPassword; /*!<
     If set, then you can control the station via HTTP requests.
+    SHOUTcast-style title updates are supported:
+    <tt>/admin.cgi?pass=PASSWORD&mode=updinfo&song=TITLE</tt>.
+    To control the playback itself use MSE_ControlServer.
 
     **Default**: \<empty\>
 */
-    bool enableMixing; /*!<
+    bool enableMixing = false; /*!<
     To be documented. Do not use!
 
     **Default**: false
 */
 };
 
+/*!
+ * Parameters for MSE_ControlServer initialization.
+ */
+struct MSE_ControlServerInitParams {
+    QString address = QStringLiteral("127.0.0.1"); /*!<
+    Address to listen on. Use 0.0.0.0 to accept the clients from any interface
+    (in this case set MSE_ControlServerInitParams::password as well).
+
+    **Default**: 127.0.0.1
+*/
+    quint16 port = 8010; /*!<
+    Port to listen on.
+
+    **Valid values**: 1..65535
+
+    **Default**: 8010
+*/
+    QString password; /*!<
+    If set, every request must have either <tt>Authorization: Bearer PASSWORD</tt> header
+    or <tt>pass=PASSWORD</tt> parameter (browsers can't send headers with EventSource).
+
+    **Default**: \<empty\> (no authorization)
+*/
+    quint16 maxClients = 0; /*!<
+    Maximum number of simultaneously connected clients, including the event subscribers.
+    Set to zero for no limit.
+
+    **Default**: 0
+*/
+    int pageSize = 100; /*!<
+    Number of playlist entries returned when the request doesn't specify the limit.
+
+    **Valid values**: 1..MSE_ControlServer::maxPageSize
+
+    **Default**: 100
+*/
+    quint8 pollTimeout = 30; /*!<
+    Number of seconds a long-poll request waits for a change before it returns the unchanged status.
+
+    **Valid values**: 1..255
+
+    **Default**: 30
+*/
+    quint8 keepAliveInterval = 15; /*!<
+    Number of seconds between the keep-alive comments sent to the event subscribers,
+    so the proxies don't close the idle connections.
+
+    **Valid values**: 1..255
+
+    **Default**: 15
+*/
+    QString allowedOrigin; /*!<
+    If set, it's sent in Access-Control-Allow-Origin header,
+    so the dashboards from this origin (or any origin for "*") can use the API from a browser.
+
+    **Default**: \<empty\>
+*/
+};
+
 /*!
  * Playlist format
  */
@@ -701,3 +869,22 @@ struct MSE_TagInfoID3v22 {
 #ifndef BASS_TAG_WMA
     #define BASS_TAG_WMA 8
 #endif
+
+#ifndef BASS_TAG_FLAC_PICTURE
+    #define BASS_TAG_FLAC_PICTURE 0x12000 // + index #, FLAC picture : TAG_FLAC_PICTURE structure
+
+    /*!
+     * FLAC picture structure as returned by BASSFLAC plugin.
+     */
+    typedef struct {
+        DWORD apic; // ID3v2 "APIC" picture type
+        const char *mime; // mime type
+        const char *desc; // description
+        DWORD width;
+        DWORD height;
+        DWORD depth;
+        DWORD colors;
+        DWORD length; // data length
+        const void *data;
+    } TAG_FLAC_PICTURE;
+#endif
@@ -0,0 +1,213 @@
+#include "mse/utils/buffer_tuner.h"
+
+#include <QDateTime>
+
+const int MSE_BufferTuner::sampleInterval = 50; // ms, often enough to catch an empty buffer between the updates
+const int MSE_BufferTuner::maxHistory = 100; // adjustments
+const int MSE_BufferTuner::minUpdatePeriod = 5; // ms, the lowest BASS_CONFIG_UPDATEPERIOD
+const int MSE_BufferTuner::maxUpdatePeriod = 100; // ms, the highest BASS_CONFIG_UPDATEPERIOD
+
+MSE_BufferTuner::MSE_BufferTuner(QObject *parent) : MSE_Object(parent)
+  ,bufferLength(0)
+  ,updatePeriod(0)
+  ,periodRatio(0)
+  ,windowSamples(1)
+  ,samples(0)
+  ,windowUnderruns(0)
+  ,windowMinFill(-1)
+  ,calmWindows(0)
+{
+    connect(&sampleTimer, &QTimer::timeout, this, &MSE_BufferTuner::sample);
+}
+
+/*!
+ * Starts tuning from the current *bufferLength* and *updatePeriod* (in milliseconds),
+ * i.e. the values that BASS has been configured with.
+ * If *bufferLength* is out of the bounds, the buffer is adjusted right away.
+ */
+bool MSE_BufferTuner::start(int bufferLength, int updatePeriod, const MSE_BufferTuningParams &params)
+{
+    CHECK(!isRunning(), Err::invalidState);
+    CHECK((params.minBufferLength >= 10) && (params.maxBufferLength <= 5000), Err::outOfRange);
+    CHECK(params.minBufferLength <= params.maxBufferLength, Err::outOfRange);
+    CHECK((params.window >= sampleInterval) && (params.shrinkDelay > 0), Err::outOfRange);
+    CHECK((bufferLength > 0) && (updatePeriod > 0), Err::outOfRange);
+
+    this->params = params;
+    this->bufferLength = bufferLength;
+    this->updatePeriod = updatePeriod;
+    periodRatio = static_cast<double>(updatePeriod) / bufferLength;
+    windowSamples = params.window / sampleInterval;
+    samples = 0;
+    windowUnderruns = 0;
+    windowMinFill = -1;
+    calmWindows = 0;
+
+    // the channels are created with the room to grow
+    BASS_SetConfig(BASS_CONFIG_BUFFER, params.maxBufferLength);
+    int clamped = qBound(params.minBufferLength, bufferLength, params.maxBufferLength);
+    if(clamped != bufferLength)
+        apply(clamped);
+
+    sampleTimer.start(sampleInterval);
+    return true;
+}
+
+/*!
+ * Stops tuning. The current settings stay as they are,
+ * and the channels created afterwards get the current buffer length.
+ */
+void MSE_BufferTuner::stop()
+{
+    if(!isRunning())
+        return;
+    sampleTimer.stop();
+    BASS_SetConfig(BASS_CONFIG_BUFFER, bufferLength);
+}
+
+/*!
+ * Adds a playing (i.e. not decoding) channel to the telemetry.
+ * The channel is removed automatically when it's freed.
+ */
+void MSE_BufferTuner::addChannel(DWORD handle)
+{
+    if(handle && !channels.contains(handle))
+    {
+        channels.insert(handle, MSE_BufferTunerChannelStats());
+        if(isRunning())
+            BASS_ChannelSetAttribute(handle, BASS_ATTRIB_BUFFER, bufferLength / 1000.0f);
+    }
+}
+
+/*!
+ * Removes a channel from the telemetry.
+ */
+void MSE_BufferTuner::removeChannel(DWORD handle)
+{
+    channels.remove(handle);
+}
+
+/*!
+ * Returns the telemetry of the channel.
+ * Returns the default stats if the channel is not watched.
+ */
+MSE_BufferTunerChannelStats MSE_BufferTuner::getChannelStats(DWORD handle) const
+{
+    return channels.value(handle);
+}
+
+void MSE_BufferTuner::sample()
+{
+    QList<DWORD> handles = channels.keys();
+    foreach(DWORD handle, handles)
+    {
+        DWORD active = BASS_ChannelIsActive(handle);
+        if((active == BASS_ACTIVE_STOPPED) && (BASS_ErrorGetCode() == BASS_ERROR_HANDLE))
+        {
+            channels.remove(handle);
+            continue;
+        }
+        if((active != BASS_ACTIVE_PLAYING) && (active != BASS_ACTIVE_STALLED))
+            continue;
+
+        int fill = 0;
+        if(active == BASS_ACTIVE_PLAYING)
+        {
+            DWORD available = BASS_ChannelGetData(handle, nullptr, BASS_DATA_AVAILABLE);
+            if(available == static_cast<DWORD>(-1))
+                continue;
+            fill = qRound(BASS_ChannelBytes2Seconds(handle, available) * 1000);
+        }
+        // BASS reports a starved channel as stalled,
+        // an empty buffer of a playing channel is caught here before BASS notices it
+        bool starving = (active == BASS_ACTIVE_STALLED) || (!fill && !isDecodingOver(handle));
+
+        MSE_BufferTunerChannelStats& stats = channels[handle];
+        // one underrun per starving episode no matter how many samples it lasts;
+        // the first sample only sets the state, so the initial buffering is not an underrun
+        if(starving && !stats.starving && (stats.fill >= 0))
+        {
+            stats.underruns++;
+            windowUnderruns++;
+        }
+        stats.starving = starving;
+        stats.fill = fill;
+        if((stats.minFill < 0) || (fill < stats.minFill))
+            stats.minFill = fill;
+        if((windowMinFill < 0) || (fill < windowMinFill))
+            windowMinFill = fill;
+    }
+
+    samples++;
+    if(samples >= windowSamples)
+        evaluate();
+}
+
+void MSE_BufferTuner::evaluate()
+{
+    if(windowUnderruns)
+    {
+        calmWindows = 0;
+        if(bufferLength < params.maxBufferLength)
+            apply(qMin(params.maxBufferLength, bufferLength * 3 / 2));
+    }
+    else if(windowMinFill >= 0)
+    {
+        // a buffer that got below a half is neither grown nor shrunk,
+        // this gap keeps the tuner from flapping
+        if(windowMinFill * 2 >= bufferLength)
+        {
+            calmWindows++;
+            if((calmWindows >= params.shrinkDelay) && (bufferLength > params.minBufferLength))
+            {
+                calmWindows = 0;
+                apply(qMax(params.minBufferLength, bufferLength * 3 / 4));
+            }
+        }
+        else
+        {
+            calmWindows = 0;
+        }
+    }
+
+    samples = 0;
+    windowUnderruns = 0;
+    windowMinFill = -1;
+    QMutableHashIterator<DWORD, MSE_BufferTunerChannelStats> i(channels);
+    while(i.hasNext())
+        i.next().value().minFill = -1;
+}
+
+void MSE_BufferTuner::apply(int newBufferLength)
+{
+    MSE_BufferAdjustment adjustment;
+    adjustment.timestamp = QDateTime::currentMSecsSinceEpoch();
+    adjustment.underruns = windowUnderruns;
+    adjustment.minFill = qMax(windowMinFill, 0);
+
+    bufferLength = newBufferLength;
+    updatePeriod = qBound(minUpdatePeriod, qRound(bufferLength * periodRatio), qMin(maxUpdatePeriod, bufferLength));
+    BASS_SetConfig(BASS_CONFIG_UPDATEPERIOD, updatePeriod);
+    foreach(DWORD handle, channels.keys())
+        BASS_ChannelSetAttribute(handle, BASS_ATTRIB_BUFFER, bufferLength / 1000.0f);
+
+    adjustment.bufferLength = bufferLength;
+    adjustment.updatePeriod = updatePeriod;
+    history.append(adjustment);
+    while(history.size() > maxHistory)
+        history.removeFirst();
+    emit onAdjusted(adjustment);
+}
+
+/*!
+ * Returns true if the whole channel has been decoded,
+ * i.e. its buffer is emptied by the end of the track rather than by an underrun.
+ */
+bool MSE_BufferTuner::isDecodingOver(DWORD handle)
+{
+    QWORD length = BASS_ChannelGetLength(handle, BASS_POS_BYTE);
+    if(length == static_cast<QWORD>(-1))
+        return false;
+    QWORD pos = BASS_ChannelGetPosition(handle, BASS_POS_BYTE | BASS_POS_DECODE);
+    return (pos != static_cast<QWORD>(-1)) && (pos >= length);
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "mse/object.h"
+
+#include <QHash>
+#include <QList>
+#include <QTimer>
+
+/*!
+ * Parameters of MSE_BufferTuner.
+ */
+struct MSE_BufferTuningParams {
+    int minBufferLength = 100; /*!<
+    The playback buffer is never shrunk below this length (in milliseconds).
+
+    **Valid values**: 10..5000
+
+    **Default**: 100
+*/
+    int maxBufferLength = 2000; /*!<
+    The playback buffer is never grown above this length (in milliseconds).
+
+    **Valid values**: 10..5000, but not lower than MSE_BufferTuningParams::minBufferLength.
+
+    **Default**: 2000
+*/
+    int window = 5000; /*!<
+    Length of one telemetry window in milliseconds.
+    The decision to change the buffer is made at the end of each window.
+
+    **Default**: 5000
+*/
+    int shrinkDelay = 6; /*!<
+    Number of consecutive windows without underruns and with a well filled buffer
+    that are needed before the buffer is shrunk.
+    Growing happens right after a window with an underrun.
+
+    **Default**: 6
+*/
+};
+
+/*!
+ * Telemetry of one channel watched by MSE_BufferTuner.
+ */
+struct MSE_BufferTunerChannelStats {
+    quint64 underruns = 0; /*!< Number of underruns since the channel was added. */
+    int fill = -1; /*!< Amount of buffered data (in milliseconds) at the last sample, -1 if not sampled yet. */
+    int minFill = -1; /*!< The lowest amount of buffered data (in milliseconds) in the current window. */
+    bool starving = false; /*!< The channel was stalled or out of data at the last sample. */
+};
+
+/*!
+ * One change of the buffer settings made by MSE_BufferTuner.
+ */
+struct MSE_BufferAdjustment {
+    qint64 timestamp = 0; /*!< Milliseconds since the epoch. */
+    int bufferLength = 0; /*!< The new playback buffer length in milliseconds. */
+    int updatePeriod = 0; /*!< The new update period in milliseconds. */
+    int underruns = 0; /*!< Underruns in the window that has triggered the change. */
+    int minFill = 0; /*!< The lowest fill (in milliseconds) of all channels in that window. */
+};
+
+/*!
+ * Adapts the playback buffer length and BASS_CONFIG_UPDATEPERIOD to the underrun telemetry.
+ *
+ * The fill of the playback buffers of the added channels is sampled every sampleInterval milliseconds.
+ * A channel that becomes stalled, or a playing channel with an empty buffer that hasn't been fully decoded yet,
+ * is counted as an underrun.
+ * After a window with an underrun the buffer is grown by a half,
+ * and after MSE_BufferTuningParams::shrinkDelay calm windows it's shrunk by a quarter,
+ * so the settings don't flap around the edge.
+ * The update period keeps the ratio to the buffer length it had initially.
+ *
+ * BASS_ATTRIB_BUFFER can't make the buffer of a channel longer than BASS_CONFIG_BUFFER was at its creation.
+ * So while the tuner is running, BASS_CONFIG_BUFFER stays at MSE_BufferTuningParams::maxBufferLength
+ * and the added channels (including a long-lived MSE_Mixer output) are tuned with BASS_ATTRIB_BUFFER only.
+ * Playback channels that are not added get the maximum buffer length.
+ * After stop() BASS_CONFIG_BUFFER is set to the current length.
+ *
+ * \sa MSE_EngineInitParams::adaptiveBuffer
+ */
+class MSE_BufferTuner : public MSE_Object
+{
+    Q_OBJECT
+
+public:
+    explicit MSE_BufferTuner(QObject* parent = nullptr);
+
+    bool start(int bufferLength, int updatePeriod, const MSE_BufferTuningParams& params = MSE_BufferTuningParams());
+    void stop();
+
+    /*!
+     * Returns true if the tuner is running.
+     */
+    inline bool isRunning() const {return sampleTimer.isActive();}
+
+    /*!
+     * Returns the current parameters.
+     */
+    inline const MSE_BufferTuningParams& getParams() const {return params;}
+
+    void addChannel(DWORD handle);
+    void removeChannel(DWORD handle);
+    MSE_BufferTunerChannelStats getChannelStats(DWORD handle) const;
+
+    /*!
+     * Returns the current playback buffer length in milliseconds.
+     */
+    inline int getBufferLength() const {return bufferLength;}
+
+    /*!
+     * Returns the current update period in milliseconds.
+     */
+    inline int getUpdatePeriod() const {return updatePeriod;}
+
+    /*!
+     * Returns the latest changes of the buffer settings, the oldest first.
+     * Only maxHistory changes are kept.
+     */
+    inline const QList<MSE_BufferAdjustment>& getHistory() const {return history;}
+
+    static const int sampleInterval;
+    static const int maxHistory;
+    static const int minUpdatePeriod;
+    static const int maxUpdatePeriod;
+
+signals:
+    /*!
+     * Emitted when the buffer settings have been changed.
+     */
+    void onAdjusted(const MSE_BufferAdjustment& adjustment);
+
+protected:
+    MSE_BufferTuningParams params;
+    QTimer sampleTimer;
+    QHash<DWORD, MSE_BufferTunerChannelStats> channels;
+    QList<MSE_BufferAdjustment> history;
+    int bufferLength;
+    int updatePeriod;
+    double periodRatio;
+    int windowSamples;
+    int samples;
+    int windowUnderruns;
+    int windowMinFill;
+    int calmWindows;
+
+    void sample();
+    void evaluate();
+    void apply(int newBufferLength);
+    static bool isDecodingOver(DWORD handle);
+};
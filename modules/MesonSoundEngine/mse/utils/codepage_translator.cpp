@@ -23,6 +23,20 @@ void MSE_CodepageTranslator::addEntry(const char* strData, int dataLen, const Ca
     entries.push_back(entry);
 }
 
+/*!
+ * Same as addEntry(), but does not copy the data.
+ * *strData* must stay valid until processEntries() is called.
+ */
+void MSE_CodepageTranslator::addRawEntry(const char* strData, int dataLen, const Callback &callback)
+{
+    Entry entry {
+        .callback = callback,
+        .strData = QByteArray::fromRawData(strData, dataLen),
+        .result = QString()
+    };
+    entries.push_back(entry);
+}
+
 void MSE_CodepageTranslator::processEntries(const QString& reference)
 {
     QMutableListIterator<Entry> i(entries);
@@ -37,6 +37,7 @@ class MSE_CodepageTranslator {
 public:
     MSE_CodepageTranslator(bool useICU, int minConfidence = 0);
     void addEntry(const char* strData, int dataLen, const Callback &callback);
+    void addRawEntry(const char* strData, int dataLen, const Callback &callback);
     void processEntries(const QString& reference);
     void clearEntries();
 };
@@ -0,0 +1,700 @@
+#include "mse/utils/control_server.h"
+#include "mse/playlist.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QUrlQuery>
+
+const int MSE_ControlServer::maxPageSize = 1000; // playlist entries per request
+const int MSE_ControlServer::maxRequestLength = 8192; // bytes, headers and body
+const int MSE_ControlServer::maxPendingBytes = 64*1024; // per subscriber, the one that doesn't read is dropped
+const int MSE_ControlServer::requestTimeout = 10000; // ms, drop the clients that don't send the whole request
+const int MSE_ControlServer::housekeepingInterval = 1000; // ms, request timeouts, long-poll timeouts and keep-alives
+
+static QByteArray errorBody(const QString& error)
+{
+    QJsonObject obj;
+    obj.insert(QStringLiteral("error"), error);
+    return QJsonDocument(obj).toJson(QJsonDocument::Compact);
+}
+
+static QByteArray jsonBody(const QJsonObject& obj)
+{
+    return QJsonDocument(obj).toJson(QJsonDocument::Compact);
+}
+
+class MSE_ControlServer::Client : public QObject
+{
+public:
+    enum State {
+        reading,
+        handling,
+        polling,
+        subscribed,
+        done
+    };
+
+    Client(MSE_ControlServer* server, QTcpSocket* socket) : QObject(server)
+      ,server(server)
+      ,socket(socket)
+      ,timestamp(server->clock.elapsed())
+    {
+        socket->setParent(this);
+        // the client is the context, so abort() can cut these off with socket->disconnect(this)
+        connect(socket, &QTcpSocket::readyRead, this, [this](){onReadyRead();});
+        connect(socket, &QTcpSocket::disconnected, this, [this](){finish();});
+    }
+
+    void abort()
+    {
+        socket->disconnect(this);
+        socket->abort();
+        finish();
+    }
+
+    void finish()
+    {
+        if(finished)
+            return;
+        finished = true;
+        state = done;
+        server->subscribers.remove(this);
+        server->pollers.remove(this);
+        server->clients.removeOne(this);
+        deleteLater();
+    }
+
+    /*!
+     * Sends a complete response and closes the connection.
+     * The client may be finished when the function returns.
+     */
+    void send(const QByteArray& response)
+    {
+        state = done;
+        timestamp = server->clock.elapsed();
+        socket->write(response);
+        socket->disconnectFromHost();
+    }
+
+    void respond(const QByteArray& status, const QByteArray& body)
+    {
+        send(server->makeResponse(status, body));
+    }
+
+    void respondError(const QByteArray& status, const QString& error)
+    {
+        respond(status, errorBody(error));
+    }
+
+    /*!
+     * Writes to the open event stream.
+     * A subscriber that has too much unsent data is dropped.
+     */
+    void sendEvent(const QByteArray& data)
+    {
+        if(socket->bytesToWrite() > maxPendingBytes)
+        {
+            abort();
+            return;
+        }
+        socket->write(data);
+    }
+
+    bool hasParam(const QString& name) const
+    {
+        return params.hasQueryItem(name);
+    }
+
+    QString param(const QString& name) const
+    {
+        return params.queryItemValue(name, QUrl::FullyDecoded);
+    }
+
+    /*!
+     * Reads an integer parameter. Responds with an error if it's missing or malformed.
+     */
+    bool intParam(const QString& name, int& value)
+    {
+        bool ok;
+        value = param(name).toInt(&ok);
+        if(!ok)
+            respondError("400 Bad Request", QStringLiteral("Invalid parameter: ") + name);
+        return ok;
+    }
+
+    bool doubleParam(const QString& name, double& value)
+    {
+        bool ok;
+        value = param(name).toDouble(&ok);
+        if(!ok)
+            respondError("400 Bad Request", QStringLiteral("Invalid parameter: ") + name);
+        return ok;
+    }
+
+    MSE_ControlServer* server;
+    QTcpSocket* socket;
+    qint64 timestamp; // when the current state has started
+    State state = reading;
+    bool finished = false;
+    QByteArray request;
+    int headerLength = -1;
+    int contentLength = 0;
+
+    QByteArray method;
+    QByteArray path;
+    QByteArray query;
+    QUrlQuery params;
+    QString password;
+
+protected:
+    bool parseHeader()
+    {
+        QList<QByteArray> lines = request.left(headerLength - 4).split('\n');
+        QList<QByteArray> requestLine = lines.takeFirst().trimmed().split(' ');
+        if(requestLine.size() < 2)
+            return false;
+        method = requestLine.at(0);
+        QByteArray target = requestLine.at(1);
+        path = target;
+        int q = target.indexOf('?');
+        if(q >= 0)
+        {
+            path = target.left(q);
+            query = target.mid(q + 1);
+        }
+
+        foreach(const QByteArray& line, lines)
+        {
+            int c = line.indexOf(':');
+            if(c <= 0)
+                continue;
+            QByteArray name = line.left(c).trimmed().toLower();
+            QByteArray value = line.mid(c + 1).trimmed();
+            if(name == "content-length")
+            {
+                bool ok;
+                contentLength = value.toInt(&ok);
+                if(!ok || (contentLength < 0))
+                    return false;
+            }
+            else if(name == "authorization")
+            {
+                if(value.startsWith("Bearer "))
+                    password = QString::fromUtf8(value.mid(7).trimmed());
+            }
+        }
+
+        return true;
+    }
+
+    void parseParams()
+    {
+        if(contentLength)
+        {
+            if(!query.isEmpty())
+                query.append('&');
+            query.append(request.mid(headerLength, contentLength));
+        }
+        query.replace('+', ' ');
+        params.setQuery(QString::fromUtf8(query));
+        if(password.isEmpty())
+            password = param(QStringLiteral("pass"));
+    }
+
+    void onReadyRead()
+    {
+        if(state != reading)
+        {
+            socket->readAll();
+            return;
+        }
+
+        request.append(socket->readAll());
+        if(headerLength < 0)
+        {
+            int p = request.indexOf("\r\n\r\n");
+            if(p < 0)
+            {
+                if(request.size() > maxRequestLength)
+                    abort();
+                return;
+            }
+            headerLength = p + 4;
+            if(!parseHeader())
+            {
+                respondError("400 Bad Request", QStringLiteral("Bad request"));
+                return;
+            }
+            if(headerLength + contentLength > maxRequestLength)
+            {
+                respondError("413 Payload Too Large", QStringLiteral("Request is too large"));
+                return;
+            }
+        }
+
+        if(request.size() < headerLength + contentLength)
+            return;
+        parseParams();
+        request.clear();
+        state = handling;
+        server->handle(this);
+    }
+};
+
+MSE_ControlServer::MSE_ControlServer(MSE_Sound *sound, QObject *parent) : MSE_Object(parent)
+  ,sound(sound)
+  ,lastKeepAlive(0)
+  ,statusId(1)
+  ,pendingEvents(0)
+{
+    connect(&server, &QTcpServer::newConnection, this, &MSE_ControlServer::onNewConnection);
+    flushTimer.setSingleShot(true);
+    flushTimer.setInterval(0);
+    connect(&flushTimer, &QTimer::timeout, this, &MSE_ControlServer::flush);
+    connect(&housekeepingTimer, &QTimer::timeout, this, &MSE_ControlServer::housekeeping);
+
+    connect(sound, &MSE_Sound::onStateChange, this, [this](){notify(evState);});
+    connect(sound, &MSE_Sound::onInfoChange, this, [this](){notify(evInfo);});
+    connect(sound, &MSE_Sound::onVolumeChange, this, [this](){notify(evVolume);});
+    connect(sound->getPlaylist(), &MSE_Playlist::onPlaybackModeChange, this, [this](){notify(evState);});
+}
+
+MSE_ControlServer::~MSE_ControlServer()
+{
+    stop();
+}
+
+/*!
+ * Initializes the control server.
+ */
+bool MSE_ControlServer::init(const MSE_ControlServerInitParams &params)
+{
+    CHECK(!isRunning(), Err::invalidState);
+    CHECK(!QHostAddress(params.address).isNull(), Err::outOfRange);
+    CHECK(params.port, Err::outOfRange);
+    CHECK((params.pageSize > 0) && (params.pageSize <= maxPageSize), Err::outOfRange);
+    CHECK(params.pollTimeout, Err::outOfRange);
+    CHECK(params.keepAliveInterval, Err::outOfRange);
+
+    initParams = params;
+    return true;
+}
+
+/*!
+ * Starts accepting the clients on MSE_ControlServerInitParams::address and MSE_ControlServerInitParams::port.
+ */
+bool MSE_ControlServer::start()
+{
+    CHECK(!isRunning(), Err::invalidState);
+    CHECK(server.listen(QHostAddress(initParams.address), initParams.port), Err::cannotBindAddress, server.errorString());
+    clock.start();
+    lastKeepAlive = 0;
+    housekeepingTimer.start(housekeepingInterval);
+    return true;
+}
+
+/*!
+ * Stops listening and drops all clients.
+ */
+void MSE_ControlServer::stop()
+{
+    housekeepingTimer.stop();
+    flushTimer.stop();
+    server.close();
+    QList<Client*> list = clients;
+    foreach(Client* client, list)
+    {
+        client->abort();
+        delete client;
+    }
+    clients.clear();
+    subscribers.clear();
+    pollers.clear();
+}
+
+/*!
+ * Returns the current status of the sound object, as sent by /api/status.
+ * The position is not followed by the events, it's up to the client to advance it while playing.
+ */
+QJsonObject MSE_ControlServer::getStatus() const
+{
+    const MSE_Playlist* playlist = sound->getPlaylist();
+    QJsonObject status;
+    status.insert(QStringLiteral("id"), static_cast<qint64>(statusId));
+    status.insert(QStringLiteral("state"), MSE_Sound::channelStateToString(sound->getState()));
+    status.insert(QStringLiteral("position"), sound->isOpen() ? sound->getPosition() : 0.0);
+    status.insert(QStringLiteral("duration"), sound->getTrackDuration());
+    status.insert(QStringLiteral("volume"), sound->getVolume());
+    status.insert(QStringLiteral("index"), playlist->getIndex());
+    status.insert(QStringLiteral("artist"), sound->getTrackArtist());
+    status.insert(QStringLiteral("title"), sound->getTrackTitle());
+    status.insert(QStringLiteral("formattedTitle"), sound->getTrackFormattedTitle());
+    status.insert(QStringLiteral("filename"), sound->getTrackFilename());
+    status.insert(QStringLiteral("playbackMode"), MSE_Playlist::playbackModeToString(playlist->getPlaybackMode()));
+    status.insert(QStringLiteral("playlistSize"), playlist->getList()->size());
+    status.insert(QStringLiteral("queueSize"), playlist->getQueue()->size());
+    return status;
+}
+
+/*!
+ * Marks the *event* as happened.
+ * All events that happen until the control returns to the event loop are sent at once.
+ */
+void MSE_ControlServer::notify(int event)
+{
+    pendingEvents |= event;
+    if(!flushTimer.isActive())
+        flushTimer.start();
+}
+
+void MSE_ControlServer::flush()
+{
+    int events = pendingEvents;
+    pendingEvents = 0;
+    if(!events)
+        return;
+
+    statusId++;
+    if(subscribers.isEmpty() && pollers.isEmpty())
+        return;
+
+    QByteArray data = jsonBody(getStatus());
+
+    if(!pollers.isEmpty())
+    {
+        QByteArray response = makeResponse("200 OK", data);
+        QSet<Client*> due;
+        due.swap(pollers);
+        foreach(Client* client, due)
+            client->send(response);
+    }
+
+    if(!subscribers.isEmpty())
+    {
+        static const struct {
+            int event;
+            const char* name;
+        } names[] = {
+            {evState, "state"},
+            {evInfo, "info"},
+            {evVolume, "volume"},
+            {evQueue, "queue"}
+        };
+
+        QByteArray frames;
+        QByteArray id = QByteArray::number(statusId);
+        for(const auto& name : names)
+        {
+            if(events & name.event)
+                frames.append("id: " + id + "\nevent: " + name.name + "\ndata: " + data + "\n\n");
+        }
+
+        QList<Client*> list = subscribers.values();
+        foreach(Client* client, list)
+            client->sendEvent(frames);
+    }
+}
+
+/*!
+ * Drops the clients that are too slow to send the request or to read the response,
+ * answers the expired long-polls and sends the keep-alives to the subscribers.
+ */
+void MSE_ControlServer::housekeeping()
+{
+    qint64 now = clock.elapsed();
+    bool keepAlive = now - lastKeepAlive >= initParams.keepAliveInterval * 1000;
+    if(keepAlive)
+        lastKeepAlive = now;
+    qint64 pollTimeout = initParams.pollTimeout * 1000;
+    QByteArray pollResponse;
+
+    QList<Client*> list = clients;
+    foreach(Client* client, list)
+    {
+        switch(client->state)
+        {
+            case Client::reading:
+            case Client::done:
+                // the request is never finished or the response is never read
+                if(now - client->timestamp > requestTimeout)
+                    client->abort();
+                break;
+
+            case Client::polling:
+                if(now - client->timestamp >= pollTimeout)
+                {
+                    if(pollResponse.isEmpty())
+                        pollResponse = makeResponse("200 OK", jsonBody(getStatus()));
+                    pollers.remove(client);
+                    client->send(pollResponse);
+                }
+                break;
+
+            case Client::subscribed:
+                if(keepAlive)
+                    client->sendEvent(QByteArrayLiteral(":\n\n"));
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+/*!
+ * Returns the status line and the common headers, without the terminating empty line.
+ */
+QByteArray MSE_ControlServer::makeHead(const QByteArray &status) const
+{
+    QByteArray head = "HTTP/1.0 " + status + "\r\n";
+    head.append("Cache-Control: no-cache\r\n");
+    if(!initParams.allowedOrigin.isEmpty())
+    {
+        head.append("Access-Control-Allow-Origin: " + initParams.allowedOrigin.toUtf8() + "\r\n");
+        head.append("Access-Control-Allow-Methods: GET, POST\r\n");
+        head.append("Access-Control-Allow-Headers: Authorization, Content-Type\r\n");
+    }
+    return head;
+}
+
+QByteArray MSE_ControlServer::makeResponse(const QByteArray &status, const QByteArray &body) const
+{
+    QByteArray response = makeHead(status);
+    if(!body.isEmpty())
+        response.append("Content-Type: application/json\r\n");
+    response.append("Content-Length: " + QByteArray::number(body.size()) + "\r\n");
+    response.append("Connection: close\r\n\r\n");
+    response.append(body);
+    return response;
+}
+
+QJsonObject MSE_ControlServer::sourceToJson(const MSE_Source *source) const
+{
+    QJsonObject item;
+    item.insert(QStringLiteral("index"), source->index);
+    item.insert(QStringLiteral("uri"), source->getPlaylistUri());
+    if(source->entry.tags)
+    {
+        item.insert(QStringLiteral("artist"), source->entry.tags->trackArtist);
+        item.insert(QStringLiteral("title"), source->entry.tags->trackTitle);
+    }
+    return item;
+}
+
+/*!
+ * Executes the request of the *client*.
+ * The client may be finished when the function returns.
+ */
+void MSE_ControlServer::handle(Client *client)
+{
+    if(client->method == "OPTIONS")
+    {
+        client->respond("204 No Content", QByteArray());
+        return;
+    }
+
+    if(!initParams.password.isEmpty() && (client->password != initParams.password))
+    {
+        client->respondError("403 Forbidden", QStringLiteral("Forbidden"));
+        return;
+    }
+
+    bool isGet = client->method == "GET";
+    bool isPost = client->method == "POST";
+    const QByteArray& path = client->path;
+    MSE_Playlist* playlist = sound->getPlaylist();
+    int index;
+    int pos;
+    double value;
+
+    if(isGet)
+    {
+        if(path == "/api/status")
+        {
+            if(client->param(QStringLiteral("wait")) == QStringLiteral("1"))
+            {
+                bool ok;
+                quint64 since = client->param(QStringLiteral("since")).toULongLong(&ok);
+                if(!ok)
+                    since = statusId;
+                if(since >= statusId)
+                {
+                    client->state = Client::polling;
+                    client->timestamp = clock.elapsed();
+                    pollers.insert(client);
+                    return;
+                }
+            }
+            client->respond("200 OK", jsonBody(getStatus()));
+            return;
+        }
+
+        if(path == "/api/playlist")
+        {
+            int offset = 0;
+            int limit = initParams.pageSize;
+            if(client->hasParam(QStringLiteral("offset")) && !client->intParam(QStringLiteral("offset"), offset))
+                return;
+            if(client->hasParam(QStringLiteral("limit")) && !client->intParam(QStringLiteral("limit"), limit))
+                return;
+            if((offset < 0) || (limit <= 0) || (limit > maxPageSize))
+            {
+                client->respondError("400 Bad Request", QStringLiteral("Invalid page"));
+                return;
+            }
+
+            const MSE_Sources* list = playlist->getList();
+            QJsonArray items;
+            int end = static_cast<int>(qMin(static_cast<qint64>(list->size()), static_cast<qint64>(offset) + limit));
+            for(int a = offset; a < end; a++)
+                items.append(sourceToJson(list->at(a)));
+
+            QJsonObject result;
+            result.insert(QStringLiteral("total"), list->size());
+            result.insert(QStringLiteral("offset"), offset);
+            result.insert(QStringLiteral("items"), items);
+            client->respond("200 OK", jsonBody(result));
+            return;
+        }
+
+        if(path == "/api/queue")
+        {
+            QJsonArray items;
+            foreach(const MSE_Source* source, *playlist->getQueue())
+                items.append(sourceToJson(source));
+
+            QJsonObject result;
+            result.insert(QStringLiteral("total"), items.size());
+            result.insert(QStringLiteral("items"), items);
+            client->respond("200 OK", jsonBody(result));
+            return;
+        }
+
+        if(path == "/api/events")
+        {
+            QByteArray head = makeHead("200 OK");
+            head.append("Content-Type: text/event-stream\r\n\r\n");
+            head.append("retry: 3000\n\n");
+            head.append("id: " + QByteArray::number(statusId) + "\nevent: status\ndata: " + jsonBody(getStatus()) + "\n\n");
+            client->state = Client::subscribed;
+            client->socket->write(head);
+            subscribers.insert(client);
+            return;
+        }
+    }
+
+    if(isPost)
+    {
+        bool result;
+        int events = 0;
+
+        if(path == "/api/play")
+        {
+            if(client->hasParam(QStringLiteral("index")))
+            {
+                if(!client->intParam(QStringLiteral("index"), index))
+                    return;
+                result = sound->playFromList(index);
+            }
+            else
+            {
+                result = sound->playOrUnpause();
+            }
+        }
+        else if(path == "/api/pause")
+        {
+            result = sound->pause();
+        }
+        else if(path == "/api/stop")
+        {
+            result = sound->stop();
+        }
+        else if(path == "/api/next")
+        {
+            result = sound->playNextValid();
+        }
+        else if(path == "/api/prev")
+        {
+            result = sound->playPrevValid();
+        }
+        else if(path == "/api/position")
+        {
+            if(!client->doubleParam(QStringLiteral("secs"), value))
+                return;
+            result = sound->setPosition(value);
+        }
+        else if(path == "/api/volume")
+        {
+            if(!client->doubleParam(QStringLiteral("value"), value))
+                return;
+            result = sound->setVolume(static_cast<float>(value));
+        }
+        else if(path == "/api/queue/append")
+        {
+            if(!client->intParam(QStringLiteral("index"), index))
+                return;
+            result = playlist->appendToQueue(index);
+            events = evQueue;
+        }
+        else if(path == "/api/queue/insert")
+        {
+            if(!client->intParam(QStringLiteral("index"), index))
+                return;
+            pos = 0;
+            if(client->hasParam(QStringLiteral("pos")) && !client->intParam(QStringLiteral("pos"), pos))
+                return;
+            result = playlist->insertIntoQueue(index, pos);
+            events = evQueue;
+        }
+        else if(path == "/api/queue/remove")
+        {
+            if(!client->intParam(QStringLiteral("pos"), pos))
+                return;
+            result = playlist->removeFromQueue(pos);
+            events = evQueue;
+        }
+        else if(path == "/api/queue/clear")
+        {
+            playlist->clearQueue();
+            result = true;
+            events = evQueue;
+        }
+        else
+        {
+            client->respondError("404 Not Found", QStringLiteral("Not found"));
+            return;
+        }
+
+        if(!result)
+        {
+            client->respondError("409 Conflict", QStringLiteral("Command has failed"));
+            return;
+        }
+        if(events)
+            notify(events);
+        client->respond("200 OK", jsonBody(getStatus()));
+        return;
+    }
+
+    if(!isGet)
+    {
+        client->respondError("405 Method Not Allowed", QStringLiteral("Method not allowed"));
+        return;
+    }
+    client->respondError("404 Not Found", QStringLiteral("Not found"));
+}
+
+void MSE_ControlServer::onNewConnection()
+{
+    while(QTcpSocket* socket = server.nextPendingConnection())
+    {
+        if(initParams.maxClients && (clients.size() >= initParams.maxClients))
+        {
+            connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            socket->write(makeResponse("503 Service Unavailable", errorBody(QStringLiteral("Too many clients"))));
+            socket->disconnectFromHost();
+            continue;
+        }
+        clients.append(new Client(this, socket));
+    }
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "mse/object.h"
+#include "mse/sound.h"
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QList>
+#include <QSet>
+#include <QTimer>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+
+/*!
+ * Embedded HTTP server for the remote control of MSE_Sound.
+ *
+ * All responses are JSON objects; an error is returned as <tt>{"error": "..."}</tt>
+ * with a corresponding HTTP status.
+ * The parameters are passed in the query string
+ * or, for POST, in a <tt>application/x-www-form-urlencoded</tt> body.
+ *
+ * method | path                | parameters        | action
+ * -------|---------------------|-------------------|-------
+ * GET    | /api/status         | wait, since       | current status (see below)
+ * GET    | /api/playlist       | offset, limit     | a page of MSE_Playlist::getList
+ * GET    | /api/queue          |                   | MSE_Playlist::getQueue
+ * GET    | /api/events         |                   | server-sent events
+ * POST   | /api/play           | index (optional)  | MSE_Sound::playFromList or MSE_Sound::playOrUnpause
+ * POST   | /api/pause          |                   | MSE_Sound::pause
+ * POST   | /api/stop           |                   | MSE_Sound::stop
+ * POST   | /api/next           |                   | MSE_Sound::playNextValid
+ * POST   | /api/prev           |                   | MSE_Sound::playPrevValid
+ * POST   | /api/position       | secs              | MSE_Sound::setPosition
+ * POST   | /api/volume         | value (0..1)      | MSE_Sound::setVolume
+ * POST   | /api/queue/append   | index             | MSE_Playlist::appendToQueue
+ * POST   | /api/queue/insert   | index, pos        | MSE_Playlist::insertIntoQueue
+ * POST   | /api/queue/remove   | pos               | MSE_Playlist::removeFromQueue
+ * POST   | /api/queue/clear    |                   | MSE_Playlist::clearQueue
+ *
+ * The status has an "id" that grows with every change.
+ * <tt>/api/status?wait=1&since=ID</tt> is a long-poll:
+ * it returns as soon as the status id is greater than ID
+ * or after MSE_ControlServerInitParams::pollTimeout seconds.
+ * <tt>/api/events</tt> is a text/event-stream that starts with the "status" event
+ * and then sends "state", "info", "volume" and "queue" events, each with the full status.
+ *
+ * The changes are coalesced until the control returns to the event loop,
+ * so a command that changes the state several times produces one event.
+ * The event is serialized once and the same bytes are written to all subscribers,
+ * and the subscribers and long-polls are serviced by one shared timer,
+ * so hundreds of idle dashboards cost next to nothing.
+ * A subscriber that doesn't read its events is dropped.
+ */
+class MSE_ControlServer : public MSE_Object
+{
+    Q_OBJECT
+
+public:
+    explicit MSE_ControlServer(MSE_Sound* sound, QObject* parent = nullptr);
+    ~MSE_ControlServer();
+
+    bool init(const MSE_ControlServerInitParams& params = MSE_ControlServerInitParams());
+
+    /*!
+     * Get current initialization parameters.
+     */
+    inline const MSE_ControlServerInitParams& getInitParams() const {return initParams;}
+
+    /*!
+     * Returns the sound object that is controlled.
+     */
+    inline MSE_Sound* getSound() const {return sound;}
+
+    bool start();
+    void stop();
+
+    /*!
+     * Returns true if the server is listening.
+     */
+    inline bool isRunning() const {return server.isListening();}
+
+    /*!
+     * Returns the number of connected clients, including the event subscribers.
+     */
+    inline int getClientsCount() const {return clients.size();}
+
+    /*!
+     * Returns the number of clients subscribed to the events.
+     */
+    inline int getSubscribersCount() const {return subscribers.size();}
+
+    QJsonObject getStatus() const;
+
+    static const int maxPageSize;
+    static const int maxRequestLength;
+    static const int maxPendingBytes;
+    static const int requestTimeout;
+    static const int housekeepingInterval;
+
+protected:
+    class Client;
+
+    enum Event {
+        evState = 1,
+        evInfo = 2,
+        evVolume = 4,
+        evQueue = 8
+    };
+
+    MSE_Sound* sound;
+    MSE_ControlServerInitParams initParams;
+    QTcpServer server;
+    QTimer flushTimer;
+    QTimer housekeepingTimer;
+    QElapsedTimer clock;
+    qint64 lastKeepAlive;
+    QList<Client*> clients;
+    QSet<Client*> subscribers;
+    QSet<Client*> pollers;
+    quint64 statusId;
+    int pendingEvents;
+
+    void notify(int event);
+    void flush();
+    void housekeeping();
+    void handle(Client* client);
+    QJsonObject sourceToJson(const MSE_Source* source) const;
+    QByteArray makeHead(const QByteArray& status) const;
+    QByteArray makeResponse(const QByteArray& status, const QByteArray& body) const;
+
+protected slots:
+    void onNewConnection();
+};
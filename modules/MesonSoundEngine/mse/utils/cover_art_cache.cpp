@@ -0,0 +1,149 @@
+#include "mse/utils/cover_art_cache.h"
+
+#include <QCryptographicHash>
+#include <QImage>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+class MSE_CoverArtCacheJob : public QRunnable
+{
+public:
+    MSE_CoverArtCacheJob(MSE_CoverArtCache* cache, const QByteArray& hash, const QByteArray& data, const QString& filename, int size):
+        cache(cache),
+        hash(hash),
+        data(data),
+        filename(filename),
+        size(size)
+    {
+    }
+
+    void run()
+    {
+        bool ok = process();
+        QMetaObject::invokeMethod(cache, "onJobFinished", Qt::QueuedConnection,
+            Q_ARG(QByteArray, hash), Q_ARG(bool, ok));
+    }
+
+protected:
+    bool process()
+    {
+        QImage img;
+        if(!img.loadFromData(data))
+            return false;
+        data.clear();
+
+        if((img.width() > size) || (img.height() > size))
+            img = img.scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+        QSaveFile f(filename);
+        if(!f.open(QIODevice::WriteOnly))
+            return false;
+        if(!img.save(&f, "PNG"))
+        {
+            f.cancelWriting();
+            return false;
+        }
+        return f.commit();
+    }
+
+    MSE_CoverArtCache* cache;
+    QByteArray hash;
+    QByteArray data;
+    QString filename;
+    int size;
+};
+
+MSE_CoverArtCache::MSE_CoverArtCache(QObject *parent) : MSE_Object(parent)
+{
+}
+
+MSE_CoverArtCache::~MSE_CoverArtCache()
+{
+    pool.clear();
+    pool.waitForDone();
+}
+
+/*!
+ * Initializes the cache and creates the cache directory.
+ *
+ * Refer to MSE_CoverArtCacheInitParams for the information about initialization parameters.
+ */
+bool MSE_CoverArtCache::init(const MSE_CoverArtCacheInitParams &params)
+{
+    initParams = params;
+    if(initParams.cacheDir.isEmpty())
+        initParams.cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation)+"/covers";
+    if(initParams.thumbnailSize <= 0)
+        initParams.thumbnailSize = MSE_CoverArtCacheInitParams().thumbnailSize;
+    if(initParams.maxThreads <= 0)
+        initParams.maxThreads = 1;
+
+    QDir dir;
+    CHECK(dir.mkpath(initParams.cacheDir), MSE_Object::Err::pathNotFound, initParams.cacheDir);
+    initParams.cacheDir = QDir(initParams.cacheDir).absolutePath();
+
+    pool.setMaxThreadCount(initParams.maxThreads);
+    return true;
+}
+
+QByteArray MSE_CoverArtCache::imageHash(const QByteArray &data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex();
+}
+
+/*!
+ * Returns the full path to the thumbnail of the image with the specified hash.
+ * The file may not exist yet.
+ */
+QString MSE_CoverArtCache::thumbnailFilename(const QByteArray &imageHash) const
+{
+    return initParams.cacheDir + "/" + QString::fromLatin1(imageHash) + "-"
+        + QString::number(initParams.thumbnailSize) + ".png";
+}
+
+/*!
+ * Requests a thumbnail for the cover art.
+ * *key* is an arbitrary string that is passed back to onThumbnailReady() or onThumbnailFailed().
+ *
+ * If the thumbnail already exists then onThumbnailReady() is emitted
+ * after returning to the event loop.
+ * If the same image is already being processed then no new job is started.
+ */
+bool MSE_CoverArtCache::requestThumbnail(const QString &key, const MSE_SourceCoverArt &coverArt)
+{
+    CHECK(!initParams.cacheDir.isEmpty(), MSE_Object::Err::invalidState);
+    CHECK(!coverArt.isEmpty(), MSE_Object::Err::invalidFormat, key);
+
+    QByteArray hash = imageHash(coverArt.data);
+    auto i = pendingKeys.find(hash);
+    if(i != pendingKeys.end())
+    {
+        i->append(key);
+        return true;
+    }
+
+    pendingKeys.insert(hash, QStringList(key));
+    QString filename = thumbnailFilename(hash);
+    if(QFileInfo::exists(filename))
+    {
+        QMetaObject::invokeMethod(this, "onJobFinished", Qt::QueuedConnection,
+            Q_ARG(QByteArray, hash), Q_ARG(bool, true));
+        return true;
+    }
+
+    pool.start(new MSE_CoverArtCacheJob(this, hash, coverArt.data, filename, initParams.thumbnailSize));
+    return true;
+}
+
+void MSE_CoverArtCache::onJobFinished(const QByteArray &hash, bool ok)
+{
+    QStringList keys = pendingKeys.take(hash);
+    QString filename = thumbnailFilename(hash);
+    foreach(const QString& key, keys)
+    {
+        if(ok)
+            emit onThumbnailReady(key, filename);
+        else
+            emit onThumbnailFailed(key);
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "mse/object.h"
+#include "mse/sources/types/source_cover_art.h"
+
+#include <QThreadPool>
+
+/*!
+ * Parameters for MSE_CoverArtCache initialization.
+ */
+struct MSE_CoverArtCacheInitParams {
+    QString cacheDir; /*!<
+    The directory to store the thumbnails in.
+    The thumbnails are named after the SHA-1 hash of the original image,
+    so the same picture that is embedded in several files (e.g. all tracks of an album)
+    is stored only once.
+
+    **Default**: &lt;empty&gt; (i.e. "covers" subdirectory inside QStandardPaths::CacheLocation)
+*/
+    int thumbnailSize = 256; /*!<
+    Maximum width and height of a thumbnail in pixels.
+    The aspect ratio is preserved.
+
+    **Default**: 256
+*/
+    int maxThreads = 1; /*!<
+    Maximum number of worker threads that decode and scale the images.
+
+    **Default**: 1
+*/
+};
+
+/*!
+ * Produces downscaled cover art thumbnails in the background.
+ *
+ * Usage:
+ *
+ *     MSE_SourceCoverArt coverArt;
+ *     if(sound->getCoverArt(coverArt))
+ *         cache->requestThumbnail(sound->getTrackFilename(), coverArt);
+ *
+ * Then wait for onThumbnailReady() or onThumbnailFailed() with the same key.
+ */
+class MSE_CoverArtCache : public MSE_Object
+{
+    Q_OBJECT
+public:
+    explicit MSE_CoverArtCache(QObject *parent = nullptr);
+    ~MSE_CoverArtCache();
+
+    bool init(const MSE_CoverArtCacheInitParams& params = MSE_CoverArtCacheInitParams());
+
+    /*!
+     * Returns parameters the cache was initialized with.
+     *
+     * \note These parameters can be slightly different to those passed to init() function.
+     */
+    inline const MSE_CoverArtCacheInitParams& getInitParams() const {return initParams;}
+
+    bool requestThumbnail(const QString& key, const MSE_SourceCoverArt& coverArt);
+    QString thumbnailFilename(const QByteArray& imageHash) const;
+
+protected:
+    static QByteArray imageHash(const QByteArray& data);
+
+    MSE_CoverArtCacheInitParams initParams;
+    QThreadPool pool;
+    QHash<QByteArray, QStringList> pendingKeys;
+
+protected slots:
+    void onJobFinished(const QByteArray& hash, bool ok);
+
+signals:
+    /*!
+     * Emitted when a thumbnail for the *key* is available at *filename*.
+     */
+    void onThumbnailReady(const QString& key, const QString& filename);
+
+    /*!
+     * Emitted when a thumbnail for the *key* cannot be created.
+     */
+    void onThumbnailFailed(const QString& key);
+};
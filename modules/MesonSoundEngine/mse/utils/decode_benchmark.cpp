@@ -0,0 +1,427 @@
+#include "mse/utils/decode_benchmark.h"
+#include "mse/engine.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QPair>
+
+#include <ctime>
+
+const int MSE_DecodeBenchmark::blockSize = 64*1024; // bytes pulled at once, about the size of a BASS update
+
+QJsonObject MSE_DecodeBenchmarkCase::toJson() const
+{
+    QJsonObject obj;
+    obj.insert("suite", suite);
+    obj.insert("file", file);
+    obj.insert("variant", variant);
+    obj.insert("audioDuration", audioDuration);
+    obj.insert("wallTime", wallTime);
+    obj.insert("cpuTime", cpuTime);
+    obj.insert("realtime", realtime);
+    obj.insert("trackSwitches", trackSwitches);
+    return obj;
+}
+
+MSE_DecodeBenchmarkCase MSE_DecodeBenchmarkCase::fromJson(const QJsonObject &obj)
+{
+    MSE_DecodeBenchmarkCase c;
+    c.suite = obj.value("suite").toString();
+    c.file = obj.value("file").toString();
+    c.variant = obj.value("variant").toString();
+    c.audioDuration = obj.value("audioDuration").toDouble();
+    c.wallTime = obj.value("wallTime").toDouble(-1);
+    c.cpuTime = obj.value("cpuTime").toDouble(-1);
+    c.realtime = obj.value("realtime").toDouble(-1);
+    c.trackSwitches = obj.value("trackSwitches").toInt();
+    return c;
+}
+
+QJsonObject MSE_DecodeBenchmarkResult::toJson() const
+{
+    QJsonArray list;
+    foreach(const MSE_DecodeBenchmarkCase& c, cases)
+        list.append(c.toJson());
+    QJsonObject obj;
+    obj.insert("libVersion", libVersion);
+    obj.insert("timestamp", static_cast<double>(timestamp));
+    obj.insert("cases", list);
+    return obj;
+}
+
+MSE_DecodeBenchmarkResult MSE_DecodeBenchmarkResult::fromJson(const QJsonObject &obj)
+{
+    MSE_DecodeBenchmarkResult r;
+    r.libVersion = obj.value("libVersion").toString();
+    r.timestamp = static_cast<qint64>(obj.value("timestamp").toDouble());
+    foreach(const QJsonValue& c, obj.value("cases").toArray())
+        r.cases.append(MSE_DecodeBenchmarkCase::fromJson(c.toObject()));
+    return r;
+}
+
+MSE_DecodeBenchmark::Pipeline::~Pipeline()
+{
+    // the mixer must let go of its inputs first
+    delete mixer;
+    qDeleteAll(sounds);
+}
+
+MSE_DecodeBenchmark::MSE_DecodeBenchmark(QObject *parent) : MSE_Object(parent)
+{
+}
+
+/*!
+ * Runs all cases for all MSE_DecodeBenchmarkParams::files.
+ * Returns false if any file could not be decoded,
+ * the cases that were measured before that are still in getResult().
+ */
+bool MSE_DecodeBenchmark::run(const MSE_DecodeBenchmarkParams &params)
+{
+    CHECK(params.duration > 0, MSE_Object::Err::outOfRange);
+    CHECK(params.trackDuration > 0, MSE_Object::Err::outOfRange);
+    CHECK(params.repeats > 0, MSE_Object::Err::outOfRange);
+    CHECK(params.conversionFrequency > 0, MSE_Object::Err::outOfRange);
+
+    this->params = params;
+    result = MSE_DecodeBenchmarkResult();
+    result.libVersion = MSE_Engine::getInstance()->getLibVersion().asString();
+    result.timestamp = QDateTime::currentMSecsSinceEpoch();
+    buffer.resize(blockSize);
+
+    bool mixerDone = false;
+    foreach(const QString& filename, params.files)
+    {
+        bool isCue;
+        MSE_Playlist::hasSupportedExtension(filename, isCue);
+        if(isCue)
+        {
+            if(!runCue(filename))
+                return false;
+            continue;
+        }
+
+        if(MSE_Engine::getInstance()->typeByUri(filename) == mse_sctModule)
+        {
+            if(!runModule(filename))
+                return false;
+            continue;
+        }
+
+        if(!runCodec(filename) || !runConversion(filename) || !runDsp(filename))
+            return false;
+        if(!mixerDone)
+        {
+            if(!runMixer(filename))
+                return false;
+            mixerDone = true;
+        }
+    }
+    return true;
+}
+
+/*!
+ * Builds the pipeline MSE_DecodeBenchmarkParams::repeats times,
+ * pulls the audio out of it and adds the fastest run to the result.
+ */
+bool MSE_DecodeBenchmark::measure(const QString &suite, const QString &filename, const QString &variant, const PipelineBuilder &build)
+{
+    MSE_DecodeBenchmarkCase c;
+    c.suite = suite;
+    c.file = QFileInfo(filename).fileName();
+    c.variant = variant;
+
+    for(int a=0; a<params.repeats; a++)
+    {
+        Pipeline pipeline;
+        if(!build(pipeline))
+            return false;
+        CHECK(pipeline.bytesPerSecond > 0, MSE_Object::Err::cannotLoadSound, filename);
+
+        double duration = params.duration;
+        if(pipeline.duration > 0)
+            duration = pipeline.fullDuration ? pipeline.duration : qMin(duration, pipeline.duration);
+        qint64 limit = static_cast<qint64>(duration * pipeline.bytesPerSecond);
+
+        qint64 bytes = 0;
+        QElapsedTimer timer;
+        std::clock_t cpuStart = std::clock();
+        timer.start();
+        while(bytes < limit)
+        {
+            int n = pipeline.read(buffer.data(), static_cast<int>(qMin<qint64>(blockSize, limit - bytes)));
+            if(n <= 0)
+                break;
+            bytes += n;
+        }
+        double wallTime = timer.nsecsElapsed() / 1e9;
+        double cpuTime = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+
+        if((c.wallTime < 0) || (wallTime < c.wallTime))
+        {
+            c.wallTime = wallTime;
+            c.cpuTime = cpuTime;
+            c.audioDuration = bytes / pipeline.bytesPerSecond;
+            c.trackSwitches = pipeline.trackSwitches;
+        }
+    }
+
+    if(c.wallTime > 0)
+        c.realtime = c.audioDuration / c.wallTime;
+    result.cases.append(c);
+    emit onCaseFinished(c);
+    return true;
+}
+
+MSE_SoundInitParams MSE_DecodeBenchmark::getSoundParams()
+{
+    MSE_SoundInitParams soundParams;
+    soundParams.decodeOnly = true;
+    soundParams.sampleType = mse_sstFloat32;
+    return soundParams;
+}
+
+/*!
+ * Opens the *index*-th track of the file (a CUE sheet gives one track per entry)
+ * and starts decoding it. Returns nullptr on error.
+ */
+MSE_Sound* MSE_DecodeBenchmark::openSound(const QString &filename, const MSE_SoundInitParams &soundParams, int index)
+{
+    MSE_Sound* sound = new MSE_Sound();
+    bool isCue;
+    MSE_Playlist::hasSupportedExtension(filename, isCue);
+    bool ok = sound->init(soundParams);
+    if(ok)
+    {
+        ok = isCue
+            ? (sound->getPlaylist()->addFromPlaylist(filename) > 0)
+            : sound->getPlaylist()->addFile(MSE_PlaylistEntry(filename));
+    }
+    if(!ok || !sound->openFromList(index) || !sound->play())
+    {
+        delete sound;
+        SETERROR(MSE_Object::Err::cannotLoadSound, filename);
+        return nullptr;
+    }
+    return sound;
+}
+
+bool MSE_DecodeBenchmark::readSound(Pipeline &pipeline, const QString &filename, const MSE_SoundInitParams &soundParams)
+{
+    MSE_Sound* sound = openSound(filename, soundParams);
+    if(!sound)
+        return false;
+    pipeline.sounds.append(sound);
+    pipeline.bytesPerSecond = static_cast<double>(sound->getFrequency()) * sound->getChannelsCount() * sizeof(float);
+    pipeline.duration = sound->getTrackDuration();
+    pipeline.read = [sound](char* buffer, int length){
+        return sound->getData(buffer, length);
+    };
+    return true;
+}
+
+/*!
+ * The mixer never ends on its own, so it's only pulled for the duration of the file.
+ */
+bool MSE_DecodeBenchmark::readMixer(Pipeline &pipeline, const QString &filename, const MSE_SoundInitParams &soundParams, int nInputs, quint32 frequency)
+{
+    for(int a=0; a<nInputs; a++)
+    {
+        MSE_Sound* sound = openSound(filename, soundParams);
+        if(!sound)
+            return false;
+        pipeline.sounds.append(sound);
+    }
+    MSE_Sound* first = pipeline.sounds.first();
+    if(!frequency)
+        frequency = static_cast<quint32>(first->getFrequency());
+
+    MSE_MixerInitParams mixerParams;
+    mixerParams.decodeOnly = true;
+    mixerParams.sampleType = mse_sstFloat32;
+    mixerParams.outputFrequency = frequency;
+    pipeline.mixer = new MSE_Mixer();
+    CHECK(pipeline.mixer->init(mixerParams), MSE_Object::Err::initFail);
+    foreach(MSE_Sound* sound, pipeline.sounds)
+        CHECK(pipeline.mixer->addInput(sound), MSE_Object::Err::initFail);
+
+    MSE_Mixer* mixer = pipeline.mixer;
+    pipeline.bytesPerSecond = static_cast<double>(frequency) * mixerParams.nChannels * sizeof(float);
+    pipeline.duration = first->getTrackDuration();
+    pipeline.read = [mixer](char* buffer, int length){
+        return mixer->getData(buffer, length);
+    };
+    return true;
+}
+
+bool MSE_DecodeBenchmark::runCodec(const QString &filename)
+{
+    QString codec = QFileInfo(filename).suffix().toLower();
+    return measure("codec", filename, codec, [&](Pipeline& pipeline){
+        return readSound(pipeline, filename, getSoundParams());
+    });
+}
+
+bool MSE_DecodeBenchmark::runConversion(const QString &filename)
+{
+    foreach(int points, params.sincPoints)
+    {
+        MSE_SoundInitParams soundParams = getSoundParams();
+        soundParams.sincPoints = points;
+        QString variant = points ? QStringLiteral("sinc%1").arg(points) : QStringLiteral("linear");
+        if(!measure("conversion", filename, variant, [&](Pipeline& pipeline){
+            return readMixer(pipeline, filename, soundParams, 1, params.conversionFrequency);
+        }))
+            return false;
+    }
+    return true;
+}
+
+bool MSE_DecodeBenchmark::runModule(const QString &filename)
+{
+    static const QList<QPair<MSE_SoundSampleInterpolation, QString>> interpolations = {
+        {mse_ssiNone, "none"},
+        {mse_ssiLinear, "linear"},
+        {mse_ssiSinc, "sinc"}
+    };
+    static const QList<QPair<MSE_SoundSampleRamping, QString>> rampings = {
+        {mse_ssrNone, "none"},
+        {mse_ssrNormal, "normal"},
+        {mse_ssrSensitive, "sensitive"}
+    };
+
+    foreach(const auto& interpolation, interpolations)
+    {
+        foreach(const auto& ramping, rampings)
+        {
+            MSE_SoundInitParams soundParams = getSoundParams();
+            soundParams.sampleInterpolation = interpolation.first;
+            soundParams.sampleRamping = ramping.first;
+            if(!measure("module", filename, interpolation.second+"/"+ramping.second, [&](Pipeline& pipeline){
+                return readSound(pipeline, filename, soundParams);
+            }))
+                return false;
+        }
+    }
+    return true;
+}
+
+/*!
+ * "split" goes through all tracks of the sheet like a player does (i.e. with the seeks and the end syncs),
+ * but takes only MSE_DecodeBenchmarkParams::trackDuration seconds of each track,
+ * so the time is spent on the track changes rather than on decoding one long track.
+ * "whole" decodes the same audio file without the sheet.
+ */
+bool MSE_DecodeBenchmark::runCue(const QString &filename)
+{
+    bool ok = measure("cue", filename, "split", [&](Pipeline& pipeline){
+        MSE_Sound* sound = openSound(filename, getSoundParams());
+        if(!sound)
+            return false;
+        pipeline.sounds.append(sound);
+        pipeline.bytesPerSecond = static_cast<double>(sound->getFrequency()) * sound->getChannelsCount() * sizeof(float);
+        pipeline.duration = sound->getFullTrackDuration();
+        pipeline.fullDuration = true;
+        qint64 frameSize = sound->getChannelsCount() * static_cast<qint64>(sizeof(float));
+        qint64 trackLimit = static_cast<qint64>(params.trackDuration * sound->getFrequency()) * frameSize;
+        qint64 trackBytes = 0;
+        Pipeline* p = &pipeline;
+        pipeline.read = [sound, p, trackLimit, trackBytes](char* buffer, int length) mutable {
+            forever
+            {
+                if(trackBytes < trackLimit)
+                {
+                    int n = sound->getData(buffer, static_cast<int>(qMin<qint64>(length, trackLimit - trackBytes)));
+                    if(n > 0)
+                    {
+                        trackBytes += n;
+                        return n;
+                    }
+                }
+                MSE_Playlist* playlist = sound->getPlaylist();
+                int next = playlist->getIndex() + 1;
+                if(next >= playlist->getList()->size())
+                    return 0;
+                if(!sound->openFromList(next) || !sound->play())
+                    return -1;
+                trackBytes = 0;
+                p->trackSwitches++;
+            }
+        };
+        return true;
+    });
+    if(!ok)
+        return false;
+
+    MSE_Sound probe;
+    probe.init(getSoundParams());
+    MSE_CueSheet* sheet = probe.getPlaylist()->getCueSheet(filename);
+    CHECK(sheet && sheet->isValid, MSE_Object::Err::cannotLoadSound, filename);
+    QString dataFilename = sheet->dataSourceFilename;
+    return measure("cue", filename, "whole", [&](Pipeline& pipeline){
+        return readSound(pipeline, dataFilename, getSoundParams());
+    });
+}
+
+bool MSE_DecodeBenchmark::runMixer(const QString &filename)
+{
+    foreach(int nInputs, params.mixerInputs)
+    {
+        if(nInputs <= 0)
+            continue;
+        if(!measure("mixer", filename, QStringLiteral("inputs=%1").arg(nInputs), [&](Pipeline& pipeline){
+            return readMixer(pipeline, filename, getSoundParams(), nInputs, 0);
+        }))
+            return false;
+    }
+    return true;
+}
+
+/*!
+ * The slot does nothing, so only the cost of the DSP callback and the signal is measured.
+ */
+bool MSE_DecodeBenchmark::runDsp(const QString &filename)
+{
+    bool ok = measure("dsp", filename, "off", [&](Pipeline& pipeline){
+        return readSound(pipeline, filename, getSoundParams());
+    });
+    if(!ok)
+        return false;
+
+    MSE_SoundInitParams soundParams = getSoundParams();
+    soundParams.enableDSP = true;
+    return measure("dsp", filename, "on", [&](Pipeline& pipeline){
+        if(!readSound(pipeline, filename, soundParams))
+            return false;
+        connect(pipeline.sounds.first(), &MSE_Sound::onDSP, pipeline.sounds.first(), [](void*, quint32){}, Qt::DirectConnection);
+        return true;
+    });
+}
+
+/*!
+ * Compares two results and returns the keys (see MSE_DecodeBenchmarkCase::key)
+ * of the cases that got slower by more than *tolerance* (e.g. 0.1 means 10%)
+ * or are missing in *current*.
+ */
+QStringList MSE_DecodeBenchmark::findRegressions(
+    const MSE_DecodeBenchmarkResult &baseline,
+    const MSE_DecodeBenchmarkResult &current,
+    double tolerance)
+{
+    QHash<QString, double> speeds;
+    foreach(const MSE_DecodeBenchmarkCase& c, current.cases)
+        speeds.insert(c.key(), c.realtime);
+
+    QStringList list;
+    foreach(const MSE_DecodeBenchmarkCase& c, baseline.cases)
+    {
+        if(c.realtime < 0)
+            continue;
+        double speed = speeds.value(c.key(), -1);
+        if((speed < 0) || (speed < c.realtime * (1 - tolerance)))
+            list.append(c.key());
+    }
+    return list;
+}
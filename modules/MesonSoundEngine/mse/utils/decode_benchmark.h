@@ -0,0 +1,175 @@
+#pragma once
+
+#include "mse/object.h"
+#include "mse/sound.h"
+#include "mse/utils/mixer.h"
+
+#include <QJsonObject>
+#include <QList>
+#include <QStringList>
+
+#include <functional>
+
+/*!
+ * Parameters for MSE_DecodeBenchmark.
+ */
+struct MSE_DecodeBenchmarkParams {
+    QStringList files; /*!<
+    Files to decode. Tracker modules and CUE sheets are recognized
+    and get their own cases, all other files are measured as codecs.
+    Use one file per codec and the sample rate other than MSE_DecodeBenchmarkParams::conversionFrequency,
+    so the sample rate conversion has some work to do.
+*/
+    double duration = 30; /*!<
+    Maximum amount of audio (in seconds) produced in one case.
+    Shorter files are decoded to the end.
+
+    **Default**: 30
+*/
+    double trackDuration = 5; /*!<
+    Amount of audio (in seconds) taken from each track of a CUE sheet in the "split" case,
+    so every track change is measured. The whole sheet is gone through regardless of MSE_DecodeBenchmarkParams::duration.
+
+    **Default**: 5
+*/
+    int repeats = 3; /*!<
+    Every case is run this many times and the fastest run is taken.
+
+    **Default**: 3
+*/
+    QList<int> sincPoints = {0, 8, 16, 32}; /*!<
+    Values of MSE_SoundInitParams::sincPoints to measure the sample rate conversion with.
+
+    **Default**: 0, 8, 16, 32
+*/
+    quint32 conversionFrequency = 48000; /*!<
+    The mixer output rate the files are converted to in the sample rate conversion cases.
+
+    **Default**: 48000
+*/
+    QList<int> mixerInputs = {1, 2, 4, 8}; /*!<
+    Numbers of simultaneous inputs to measure MSE_Mixer with.
+    Only the first codec file is used for the mixer cases.
+
+    **Default**: 1, 2, 4, 8
+*/
+};
+
+/*!
+ * Result of one case of MSE_DecodeBenchmark.
+ * Times are in seconds. Negative values mean that nothing was measured.
+ */
+struct MSE_DecodeBenchmarkCase {
+    QString suite; /*!< "codec", "conversion", "module", "cue", "mixer" or "dsp". */
+    QString file; /*!< File name without the path. */
+    QString variant; /*!< The setting that was measured, e.g. "sinc16", "sinc/normal", "split", "inputs=4" or "on". */
+    double audioDuration = 0; /*!< Amount of audio produced. */
+    double wallTime = -1; /*!< Time spent producing it. */
+    double cpuTime = -1; /*!< CPU time of the process in the same run. */
+    double realtime = -1; /*!< Decoding speed as a multiple of the real time, i.e. audioDuration / wallTime. */
+    int trackSwitches = 0; /*!< Number of track changes in one run (only the "split" case of a CUE sheet has them). */
+
+    /*!
+     * Returns the identifier of the case that stays the same across the runs.
+     */
+    inline QString key() const {return suite+"/"+file+"/"+variant;}
+
+    QJsonObject toJson() const;
+    static MSE_DecodeBenchmarkCase fromJson(const QJsonObject& obj);
+};
+
+/*!
+ * Results of MSE_DecodeBenchmark.
+ */
+struct MSE_DecodeBenchmarkResult {
+    QString libVersion; /*!< BASS version the results were measured with. */
+    qint64 timestamp = 0; /*!< Start of the run in milliseconds since the epoch. */
+    QList<MSE_DecodeBenchmarkCase> cases; /*!< All cases in the order they were run. */
+
+    QJsonObject toJson() const;
+    static MSE_DecodeBenchmarkResult fromJson(const QJsonObject& obj);
+};
+
+/*!
+ * Measures the decoding throughput without an output device.
+ *
+ * Everything is pulled as fast as possible with decode-only MSE_Sound and MSE_Mixer objects:
+ *   - "codec" - plain decoding of every file;
+ *   - "conversion" - the file through a mixer at MSE_DecodeBenchmarkParams::conversionFrequency
+ *     for each of MSE_DecodeBenchmarkParams::sincPoints;
+ *   - "module" - rendering of the tracker modules for every MSE_SoundSampleInterpolation
+ *     and MSE_SoundSampleRamping combination;
+ *   - "cue" - the first MSE_DecodeBenchmarkParams::trackDuration seconds of every track of a CUE sheet
+ *     one after another ("split") vs the whole audio file ("whole");
+ *   - "mixer" - a mixer with MSE_DecodeBenchmarkParams::mixerInputs copies of the file;
+ *   - "dsp" - the file with and without MSE_Sound::onDSP.
+ *
+ * The run is synchronous. The engine should be initialized with the "no sound" device:
+ * \code
+ * MSE_EngineInitParams engineParams;
+ * engineParams.device = 0;
+ * MSE_Engine::getInstance()->init(engineParams);
+ * MSE_DecodeBenchmark benchmark;
+ * benchmark.run(params);
+ * QJsonDocument(benchmark.getResult().toJson()).toJson();
+ * \endcode
+ *
+ * Store the JSON of a release and compare the later builds against it with findRegressions().
+ */
+class MSE_DecodeBenchmark : public MSE_Object
+{
+    Q_OBJECT
+public:
+    explicit MSE_DecodeBenchmark(QObject* parent = nullptr);
+
+    bool run(const MSE_DecodeBenchmarkParams& params);
+
+    /*!
+     * Returns the result of the last run.
+     */
+    inline const MSE_DecodeBenchmarkResult& getResult() const {return result;}
+
+    static QStringList findRegressions(
+        const MSE_DecodeBenchmarkResult& baseline,
+        const MSE_DecodeBenchmarkResult& current,
+        double tolerance = 0.1);
+
+    static const int blockSize;
+
+signals:
+    /*!
+     * Emitted after each case.
+     */
+    void onCaseFinished(const MSE_DecodeBenchmarkCase& benchmarkCase);
+
+protected:
+    struct Pipeline {
+        QList<MSE_Sound*> sounds;
+        MSE_Mixer* mixer = nullptr;
+        std::function<int(char* buffer, int length)> read;
+        double bytesPerSecond = 0;
+        double duration = 0;
+        bool fullDuration = false;
+        int trackSwitches = 0;
+
+        ~Pipeline();
+    };
+    typedef std::function<bool(Pipeline& pipeline)> PipelineBuilder;
+
+    MSE_DecodeBenchmarkParams params;
+    MSE_DecodeBenchmarkResult result;
+    QByteArray buffer;
+
+    bool measure(const QString& suite, const QString& filename, const QString& variant, const PipelineBuilder& build);
+    bool runCodec(const QString& filename);
+    bool runConversion(const QString& filename);
+    bool runModule(const QString& filename);
+    bool runCue(const QString& filename);
+    bool runMixer(const QString& filename);
+    bool runDsp(const QString& filename);
+
+    MSE_Sound* openSound(const QString& filename, const MSE_SoundInitParams& soundParams, int index = 0);
+    bool readSound(Pipeline& pipeline, const QString& filename, const MSE_SoundInitParams& soundParams);
+    bool readMixer(Pipeline& pipeline, const QString& filename, const MSE_SoundInitParams& soundParams, int nInputs, quint32 frequency);
+    static MSE_SoundInitParams getSoundParams();
+};
@@ -0,0 +1,429 @@
+#include "mse/utils/encoder.h"
+#include "mse/engine.h"
+#include "mse/utils/scheduling.h"
+
+const int MSE_Encoder::tapPollInterval = 100; // ms, how often the mixing thread checks for stop() while waiting for the tap
+const int MSE_Encoder::realTimeLead = 1000; // ms, how far a real-time decode-only mixer may run ahead of the clock
+static const qint64 mixerReadSize = 1024 * 1024; // bytes, BASS_ChannelGetData treats the high bits of the length as flags
+
+class MSE_EncoderThread : public QThread
+{
+public:
+    explicit MSE_EncoderThread(const std::function<void()>& func) : func(func)
+      ,cpus(MSE_Engine::getInstance()->getInitParams().workerThreadsCpus)
+    {
+    }
+
+protected:
+    std::function<void()> func;
+    QList<int> cpus;
+
+    void run() override
+    {
+        if(!cpus.isEmpty())
+            MSE_Scheduling::setThreadAffinity(0, cpus);
+        func();
+    }
+};
+
+MSE_EncoderBackend::~MSE_EncoderBackend()
+{
+}
+
+/*!
+ * Writes the encoded data to the file with the specified name.
+ * Must be called before MSE_Encoder::start().
+ */
+void MSE_EncoderBackend::setOutputFile(const QString &filename)
+{
+    outputFilename = filename;
+    outputCallback = nullptr;
+}
+
+/*!
+ * Passes the encoded data to the *callback*.
+ * The callback is called on the encoding thread and must return false on error.
+ * Must be called before MSE_Encoder::start().
+ */
+void MSE_EncoderBackend::setOutputCallback(const MSE_EncoderOutputCallback &callback)
+{
+    outputCallback = callback;
+    outputFilename.clear();
+}
+
+bool MSE_EncoderBackend::openOutput()
+{
+    if(outputCallback)
+        return true;
+    if(outputFilename.isEmpty())
+        return fail(QStringLiteral("No output is set"));
+
+    outputFile.setFileName(outputFilename);
+    if(!outputFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return fail(outputFile.errorString());
+    return true;
+}
+
+bool MSE_EncoderBackend::output(const char *data, qint64 len)
+{
+    if(len <= 0)
+        return true;
+
+    if(outputCallback)
+    {
+        if(!outputCallback(data, len))
+            return fail(QStringLiteral("Output callback has failed"));
+        return true;
+    }
+
+    if(outputFile.write(data, len) != len)
+        return fail(outputFile.errorString());
+    return true;
+}
+
+/*!
+ * Overwrites the already written data at *pos* (e.g. to finalize the headers).
+ * Does nothing if the data goes to a callback.
+ */
+bool MSE_EncoderBackend::patchOutput(qint64 pos, const QByteArray &data)
+{
+    if(!outputFile.isOpen())
+        return true;
+
+    qint64 endPos = outputFile.pos();
+    if(!outputFile.seek(pos) || (outputFile.write(data) != data.size()) || !outputFile.seek(endPos))
+        return fail(outputFile.errorString());
+    return true;
+}
+
+bool MSE_EncoderBackend::closeOutput()
+{
+    if(!outputFile.isOpen())
+        return true;
+
+    bool result = outputFile.flush();
+    if(!result)
+        fail(outputFile.errorString());
+    outputFile.close();
+    return result;
+}
+
+bool MSE_EncoderBackend::fail(const QString &error)
+{
+    errorString = error;
+    return false;
+}
+
+MSE_Encoder::MSE_Encoder(MSE_Mixer *mixer, QObject *parent) : MSE_Object(parent)
+  ,mixer(mixer)
+  ,tap(nullptr)
+  ,chunkSize(0)
+  ,mixingDone(false)
+  ,encodingFailed(false)
+  ,stopRequested(false)
+  ,running(false)
+  ,mixedBytes(0)
+{
+}
+
+MSE_Encoder::~MSE_Encoder()
+{
+    stop();
+}
+
+/*!
+ * Initializes the encoder.
+ * The mixer must be initialized beforehand.
+ * Both chunk buffers are allocated here, so the encoding itself doesn't allocate any memory.
+ */
+bool MSE_Encoder::init(const MSE_EncoderInitParams &params)
+{
+    CHECK(!isRunning(), Err::invalidState);
+    CHECK(params.chunkDuration, Err::outOfRange);
+    CHECK(params.outputQuality <= 100, Err::outOfRange);
+
+    initParams = params;
+    const MSE_MixerInitParams& mixerParams = mixer->getInitParams();
+    if(!initParams.outputFrequency)
+        initParams.outputFrequency = mixerParams.outputFrequency;
+
+    format.frequency = mixerParams.outputFrequency;
+    format.nChannels = mixerParams.nChannels;
+    format.sampleType = mixerParams.sampleType;
+
+    chunkSize = static_cast<qint64>(format.frequency) * format.getBlockAlign() * initParams.chunkDuration;
+    for(Chunk& chunk : chunks)
+    {
+        chunk.data.reset(new (std::nothrow) char[chunkSize]);
+        if(!chunk.data)
+        {
+            chunkSize = 0;
+            SETERROR(Err::memoryError);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * Starts encoding the mixer output with the *backend*.
+ * The encoder takes the ownership of the backend, even if the function fails.
+ * The previous backend (if any) is deleted.
+ */
+bool MSE_Encoder::start(MSE_EncoderBackend *backend)
+{
+    QScopedPointer<MSE_EncoderBackend> newBackend(backend);
+    CHECK(backend, Err::invalidState);
+    CHECK(chunkSize, Err::invalidState);
+    CHECK(!isRunning(), Err::invalidState);
+
+    join();
+
+    if(!mixer->getInitParams().decodeOnly)
+    {
+        tap = mixer->addTap(mse_mtoDropOldest);
+        if(!tap)
+            return false;
+    }
+
+    freeChunks.clear();
+    filledChunks.clear();
+    for(Chunk& chunk : chunks)
+        freeChunks.enqueue(&chunk);
+    mixingDone = false;
+    encodingFailed = false;
+    stopRequested.store(false);
+    {
+        QMutexLocker locker(&statsMutex);
+        stats = MSE_EncoderStats();
+        backendError.clear();
+    }
+
+    this->backend.reset(newBackend.take());
+    running.store(true, std::memory_order_release);
+    mixedBytes = 0;
+    mixClock.start();
+
+    QThread::Priority priority = threadPriority(initParams.processPriority);
+    encodingThread.reset(new MSE_EncoderThread([this]{encode();}));
+    encodingThread->start(priority);
+    mixingThread.reset(new MSE_EncoderThread([this]{mix();}));
+    mixingThread->start(priority);
+
+    return true;
+}
+
+/*!
+ * Stops the encoding and waits for the threads to finish.
+ * The data that is already mixed is still encoded, and the backend is finalized and deleted.
+ */
+void MSE_Encoder::stop()
+{
+    {
+        QMutexLocker locker(&queueMutex);
+        stopRequested.store(true);
+        queueCondition.wakeAll();
+    }
+    join();
+}
+
+void MSE_Encoder::join()
+{
+    if(mixingThread)
+    {
+        mixingThread->wait();
+        mixingThread.reset();
+    }
+    if(encodingThread)
+    {
+        encodingThread->wait();
+        encodingThread.reset();
+    }
+    if(tap)
+    {
+        mixer->removeTap(tap);
+        tap = nullptr;
+    }
+    backend.reset();
+}
+
+/*!
+ * Returns the statistics of the current (or the last) encoding.
+ */
+MSE_EncoderStats MSE_Encoder::getStats() const
+{
+    QMutexLocker locker(&statsMutex);
+    MSE_EncoderStats result = stats;
+    if(tap)
+        result.droppedBytes = tap->getStats().droppedBytes;
+    return result;
+}
+
+/*!
+ * Returns the error of the backend if the last encoding has failed.
+ */
+QString MSE_Encoder::getBackendError() const
+{
+    QMutexLocker locker(&statsMutex);
+    return backendError;
+}
+
+MSE_Encoder::Chunk *MSE_Encoder::takeChunk(QQueue<Chunk *> &queue)
+{
+    QMutexLocker locker(&queueMutex);
+    bool isFree = &queue == &freeChunks;
+    forever
+    {
+        if(encodingFailed)
+            return nullptr;
+        // the mixing stops right away, but the encoding goes on until all mixed data is processed
+        if(isFree && stopRequested.load())
+            return nullptr;
+        if(!queue.isEmpty())
+            return queue.dequeue();
+        if(!isFree && mixingDone)
+            return nullptr;
+        queueCondition.wait(&queueMutex);
+    }
+}
+
+void MSE_Encoder::putChunk(QQueue<Chunk *> &queue, Chunk *chunk)
+{
+    QMutexLocker locker(&queueMutex);
+    queue.enqueue(chunk);
+    queueCondition.wakeAll();
+}
+
+void MSE_Encoder::mix()
+{
+    forever
+    {
+        Chunk* chunk = takeChunk(freeChunks);
+        if(!chunk)
+            break;
+
+        chunk->len = 0;
+        bool more = tap ? fillFromTap(chunk) : fillFromMixer(chunk);
+        putChunk(chunk->len ? filledChunks : freeChunks, chunk);
+        if(!more)
+            break;
+    }
+
+    QMutexLocker locker(&queueMutex);
+    mixingDone = true;
+    queueCondition.wakeAll();
+}
+
+/*!
+ * Returns false if the mixer has ended or the encoder is stopping.
+ */
+bool MSE_Encoder::fillFromMixer(Chunk *chunk)
+{
+    qint64 readSize = mixerReadSize - mixerReadSize % format.getBlockAlign();
+    while(chunk->len < chunkSize)
+    {
+        if(initParams.realTime && !waitForRealTime())
+            return false;
+        if(stopRequested.load())
+            return false;
+        int n = mixer->getData(chunk->data.get() + chunk->len, static_cast<int>(qMin(readSize, chunkSize - chunk->len)));
+        if(n <= 0)
+            return false;
+        chunk->len += n;
+        mixedBytes += n;
+    }
+    return true;
+}
+
+/*!
+ * Sleeps while the mixed audio is ahead of the clock by more than realTimeLead.
+ * Returns false if the encoder is stopping.
+ */
+bool MSE_Encoder::waitForRealTime()
+{
+    qint64 byteRate = static_cast<qint64>(format.frequency) * format.getBlockAlign();
+    forever
+    {
+        if(stopRequested.load())
+            return false;
+        qint64 ahead = mixedBytes * 1000 / byteRate - mixClock.elapsed() - realTimeLead;
+        if(ahead <= 0)
+            return true;
+        QThread::msleep(static_cast<unsigned long>(qMin(ahead, static_cast<qint64>(tapPollInterval))));
+    }
+}
+
+/*!
+ * Returns false if the tap was closed or the encoder is stopping.
+ */
+bool MSE_Encoder::fillFromTap(Chunk *chunk)
+{
+    while(chunk->len < chunkSize)
+    {
+        if(stopRequested.load())
+        {
+            // keep what was played before stop()
+            chunk->len += tap->read(chunk->data.get() + chunk->len, chunkSize - chunk->len);
+            return false;
+        }
+        if(!tap->waitForData(chunkSize - chunk->len, tapPollInterval) && tap->isClosed())
+            return false;
+        chunk->len += tap->read(chunk->data.get() + chunk->len, chunkSize - chunk->len);
+    }
+    return true;
+}
+
+void MSE_Encoder::encode()
+{
+    bool result = backend->start(format, initParams);
+    while(result)
+    {
+        Chunk* chunk = takeChunk(filledChunks);
+        if(!chunk)
+            break;
+
+        QElapsedTimer timer;
+        timer.start();
+        result = backend->write(chunk->data.get(), chunk->len);
+        qint64 elapsed = timer.elapsed();
+        if(result)
+        {
+            QMutexLocker locker(&statsMutex);
+            stats.chunks++;
+            stats.bytes += chunk->len;
+            stats.maxChunkTime = qMax(stats.maxChunkTime, elapsed);
+        }
+        putChunk(freeChunks, chunk);
+    }
+
+    if(!backend->finish())
+        result = false;
+
+    if(!result)
+    {
+        {
+            QMutexLocker locker(&statsMutex);
+            backendError = backend->getErrorString();
+        }
+        QMutexLocker locker(&queueMutex);
+        encodingFailed = true;
+        stopRequested.store(true);
+        queueCondition.wakeAll();
+    }
+
+    running.store(false, std::memory_order_release);
+    emit onFinished(result);
+}
+
+QThread::Priority MSE_Encoder::threadPriority(MSE_EncoderProcessPriority priority)
+{
+    switch(priority)
+    {
+        case mse_eppLowest: return QThread::LowestPriority;
+        case mse_eppLower: return QThread::LowPriority;
+        case mse_eppHigher: return QThread::HighPriority;
+        case mse_eppHighest: return QThread::HighestPriority;
+        default: return QThread::NormalPriority;
+    }
+}
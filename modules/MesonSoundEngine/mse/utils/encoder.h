@@ -0,0 +1,202 @@
+#pragma once
+
+#include "mse/object.h"
+#include "mse/utils/mixer.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QQueue>
+#include <QScopedPointer>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+/*!
+ * Format of the PCM data that MSE_EncoderBackend receives.
+ */
+struct MSE_EncoderFormat {
+    quint32 frequency = 44100; /*!< Sample rate in Hz. */
+    int nChannels = 2; /*!< Number of channels. */
+    MSE_SoundSampleType sampleType = mse_sstFloat32; /*!< Type of the samples. */
+
+    /*!
+     * Returns the size of one sample of one channel in bytes.
+     */
+    inline int getSampleSize() const
+    {
+        return (sampleType == mse_sstFloat32) ? 4 : ((sampleType == mse_sst8Bits) ? 1 : 2);
+    }
+
+    /*!
+     * Returns the size of one sample frame (all channels) in bytes.
+     */
+    inline int getBlockAlign() const {return getSampleSize() * nChannels;}
+};
+
+/*!
+ * Receives the encoded data of MSE_EncoderBackend.
+ */
+typedef std::function<bool(const char* data, qint64 len)> MSE_EncoderOutputCallback;
+
+/*!
+ * Backend of MSE_Encoder that turns the mixed PCM data into the encoded stream.
+ *
+ * All functions except the output setters are called on the encoding thread of MSE_Encoder:
+ * start() once, then write() for every chunk, then finish() once
+ * (even if write() has failed).
+ *
+ * The encoded data goes either to a file (setOutputFile)
+ * or to a callback (setOutputCallback), e.g. to a network server.
+ * The headers of a file are finalized in finish(),
+ * while the callback receives them as is, like for the live streams.
+ */
+class MSE_EncoderBackend
+{
+public:
+    virtual ~MSE_EncoderBackend();
+
+    virtual bool start(const MSE_EncoderFormat& format, const MSE_EncoderInitParams& params) = 0;
+    virtual bool write(const char* data, qint64 len) = 0;
+    virtual bool finish() = 0;
+
+    void setOutputFile(const QString& filename);
+    void setOutputCallback(const MSE_EncoderOutputCallback& callback);
+
+    /*!
+     * Returns the description of the last error.
+     */
+    inline const QString& getErrorString() const {return errorString;}
+
+protected:
+    QString errorString;
+    QString outputFilename;
+    MSE_EncoderOutputCallback outputCallback;
+    QFile outputFile;
+
+    bool openOutput();
+    bool output(const char* data, qint64 len);
+    bool output(const QByteArray& data) {return output(data.constData(), data.size());}
+    bool patchOutput(qint64 pos, const QByteArray& data);
+    bool closeOutput();
+    bool fail(const QString& error);
+};
+
+/*!
+ * Statistics of MSE_Encoder.
+ */
+struct MSE_EncoderStats {
+    quint64 chunks = 0; /*!< Number of chunks passed to the backend. */
+    quint64 bytes = 0; /*!< Number of PCM bytes passed to the backend. */
+    quint64 droppedBytes = 0; /*!<
+    Number of PCM bytes lost, because the encoder couldn't keep up with the playing mixer.
+*/
+    qint64 maxChunkTime = 0; /*!< The longest time (in milliseconds) the backend spent on one chunk. */
+};
+
+/*!
+ * Encodes the output of MSE_Mixer.
+ *
+ * The PCM data is pulled from the mixer in the chunks of MSE_EncoderInitParams::chunkDuration seconds
+ * and passed to MSE_EncoderBackend.
+ * Mixing and encoding run on separate threads and share two chunk buffers,
+ * so the next chunk is mixed while the previous one is being encoded.
+ *
+ * If the mixer is created with MSE_MixerInitParams::decodeOnly,
+ * the encoder drives it with MSE_Mixer::getData() as fast as the backend can go
+ * (or at the real-time rate, see MSE_EncoderInitParams::realTime).
+ * Otherwise the encoder reads the played audio from a mixer tap (see MSE_Mixer::addTap).
+ */
+class MSE_Encoder : public MSE_Object
+{
+    Q_OBJECT
+
+public:
+    explicit MSE_Encoder(MSE_Mixer* mixer, QObject* parent = nullptr);
+    ~MSE_Encoder();
+
+    bool init(const MSE_EncoderInitParams& params = MSE_EncoderInitParams());
+
+    /*!
+     * Get current initialization parameters.
+     */
+    inline const MSE_EncoderInitParams& getInitParams() const {return initParams;}
+
+    /*!
+     * Returns the mixer which output is encoded.
+     */
+    inline MSE_Mixer* getMixer() const {return mixer;}
+
+    /*!
+     * Returns the format of the PCM data passed to the backend.
+     */
+    inline const MSE_EncoderFormat& getFormat() const {return format;}
+
+    bool start(MSE_EncoderBackend* backend);
+    void stop();
+
+    /*!
+     * Returns true between start() and the end of the encoding.
+     */
+    inline bool isRunning() const {return running.load(std::memory_order_acquire);}
+
+    MSE_EncoderStats getStats() const;
+    QString getBackendError() const;
+
+    static const int tapPollInterval;
+    static const int realTimeLead;
+
+signals:
+    /*!
+     * Emitted from the encoding thread when the encoding is over:
+     * either stop() was called, the decoding mixer has ended or the backend has failed.
+     *
+     * \sa getBackendError
+     */
+    void onFinished(bool success);
+
+protected:
+    struct Chunk {
+        std::unique_ptr<char[]> data;
+        qint64 len = 0;
+    };
+
+    MSE_Mixer* mixer;
+    MSE_EncoderInitParams initParams;
+    MSE_EncoderFormat format;
+    QScopedPointer<MSE_EncoderBackend> backend;
+    MSE_MixerTap* tap;
+    QScopedPointer<QThread> mixingThread;
+    QScopedPointer<QThread> encodingThread;
+
+    Chunk chunks[2];
+    qint64 chunkSize;
+    QMutex queueMutex;
+    QWaitCondition queueCondition;
+    QQueue<Chunk*> freeChunks;
+    QQueue<Chunk*> filledChunks;
+    bool mixingDone;
+    bool encodingFailed;
+    std::atomic<bool> stopRequested;
+    std::atomic<bool> running;
+    QElapsedTimer mixClock;
+    qint64 mixedBytes;
+
+    mutable QMutex statsMutex;
+    MSE_EncoderStats stats;
+    QString backendError;
+
+    void mix();
+    void encode();
+    bool fillFromMixer(Chunk* chunk);
+    bool fillFromTap(Chunk* chunk);
+    bool waitForRealTime();
+    Chunk* takeChunk(QQueue<Chunk*>& queue);
+    void putChunk(QQueue<Chunk*>& queue, Chunk* chunk);
+    void join();
+
+    static QThread::Priority threadPriority(MSE_EncoderProcessPriority priority);
+};
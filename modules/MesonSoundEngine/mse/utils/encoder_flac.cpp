@@ -0,0 +1,378 @@
+#include "mse/utils/encoder_flac.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+const int MSE_EncoderFlac::blockSize = 4096; // frames per FLAC block, the common choice of the reference encoder
+const int MSE_EncoderFlac::maxChannels = 8;
+static const int maxFixedOrder = 4;
+static const int maxRiceParam = 14; // 4-bit parameters, 15 is the escape code
+static const int maxRice2Param = 30; // 5-bit parameters, 31 is the escape code
+static const int streamInfoOffset = 8; // "fLaC" + metadata block header
+static const int streamInfoSize = 34;
+
+/*!
+ * MSB-first bit writer. Only used internally.
+ */
+class MSE_FlacBitWriter
+{
+public:
+    explicit MSE_FlacBitWriter(QByteArray& buffer) : buffer(buffer), acc(0), nBits(0){}
+
+    inline void write(quint32 value, int bits)
+    {
+        if(bits < 32)
+            value &= (1u << bits) - 1;
+        acc = (acc << bits) | value;
+        nBits += bits;
+        while(nBits >= 8)
+        {
+            nBits -= 8;
+            buffer.append(static_cast<char>(acc >> nBits));
+        }
+        acc &= (1u << nBits) - 1;
+    }
+
+    inline void writeSigned(qint32 value, int bits)
+    {
+        write(static_cast<quint32>(value), bits);
+    }
+
+    inline void writeUnary(quint32 zeros)
+    {
+        while(zeros >= 32)
+        {
+            write(0, 32);
+            zeros -= 32;
+        }
+        write(1, zeros + 1);
+    }
+
+    inline void writeUtf8(quint64 value)
+    {
+        if(value < 0x80)
+        {
+            write(static_cast<quint32>(value), 8);
+            return;
+        }
+        int nBytes = (value < 0x800) ? 2 : ((value < 0x10000) ? 3 : ((value < 0x200000) ? 4 : ((value < 0x4000000) ? 5 : 6)));
+        int shift = (nBytes - 1) * 6;
+        write(((0xFF00 >> nBytes) & 0xFF) | static_cast<quint32>(value >> shift), 8);
+        for(shift -= 6; shift >= 0; shift -= 6)
+            write(0x80 | static_cast<quint32>((value >> shift) & 0x3F), 8);
+    }
+
+    inline void alignToByte()
+    {
+        if(nBits)
+            write(0, 8 - nBits);
+    }
+
+protected:
+    QByteArray& buffer;
+    quint64 acc;
+    int nBits;
+};
+
+static quint8 crc8(const QByteArray& data)
+{
+    quint8 crc = 0;
+    foreach(char c, data)
+    {
+        crc ^= static_cast<quint8>(c);
+        for(int a=0; a<8; a++)
+            crc = (crc & 0x80) ? static_cast<quint8>((crc << 1) ^ 0x07) : static_cast<quint8>(crc << 1);
+    }
+    return crc;
+}
+
+static quint16 crc16(const QByteArray& data)
+{
+    quint16 crc = 0;
+    foreach(char c, data)
+    {
+        crc ^= static_cast<quint16>(static_cast<quint8>(c) << 8);
+        for(int a=0; a<8; a++)
+            crc = (crc & 0x8000) ? static_cast<quint16>((crc << 1) ^ 0x8005) : static_cast<quint16>(crc << 1);
+    }
+    return crc;
+}
+
+static quint32 sampleRateCode(quint32 frequency)
+{
+    switch(frequency)
+    {
+        case 88200: return 1;
+        case 176400: return 2;
+        case 192000: return 3;
+        case 8000: return 4;
+        case 16000: return 5;
+        case 22050: return 6;
+        case 24000: return 7;
+        case 32000: return 8;
+        case 44100: return 9;
+        case 48000: return 10;
+        case 96000: return 11;
+        default: return 0; // from STREAMINFO
+    }
+}
+
+static inline qint32 fixedResidual(const qint32* s, int i, int order)
+{
+    switch(order)
+    {
+        case 0: return s[i];
+        case 1: return s[i] - s[i-1];
+        case 2: return s[i] - 2 * s[i-1] + s[i-2];
+        case 3: return s[i] - 3 * s[i-1] + 3 * s[i-2] - s[i-3];
+        default: return s[i] - 4 * s[i-1] + 6 * s[i-2] - 4 * s[i-3] + s[i-4];
+    }
+}
+
+/*!
+ * Writes the stream header.
+ */
+bool MSE_EncoderFlac::start(const MSE_EncoderFormat &format, const MSE_EncoderInitParams &params)
+{
+    Q_UNUSED(params);
+    if((format.nChannels < 1) || (format.nChannels > maxChannels))
+        return fail(QStringLiteral("FLAC supports up to %1 channels").arg(maxChannels));
+
+    this->format = format;
+    switch(format.sampleType)
+    {
+        case mse_sst8Bits:
+            bitsPerSample = 8;
+            break;
+        case mse_sstFloat32:
+            bitsPerSample = 24;
+            break;
+        default:
+            bitsPerSample = 16;
+            break;
+    }
+
+    channels.resize(format.nChannels);
+    for(QVector<qint32>& samples : channels)
+        samples.resize(blockSize);
+    residuals.resize(blockSize);
+    nPending = 0;
+    frameNumber = 0;
+    totalSamples = 0;
+    minFrameSize = 0;
+    maxFrameSize = 0;
+
+    if(!openOutput())
+        return false;
+
+    QByteArray header("fLaC");
+    header.append(static_cast<char>(0x80)); // last metadata block, STREAMINFO
+    header.append(static_cast<char>(0));
+    header.append(static_cast<char>(0));
+    header.append(static_cast<char>(streamInfoSize));
+    header.append(streamInfo());
+    return output(header);
+}
+
+bool MSE_EncoderFlac::write(const char *data, qint64 len)
+{
+    int blockAlign = format.getBlockAlign();
+    qint64 nFrames = len / blockAlign;
+    for(qint64 f=0; f<nFrames; f++)
+    {
+        const char* frameData = data + f * blockAlign;
+        for(int c=0; c<format.nChannels; c++)
+        {
+            qint32 v;
+            switch(format.sampleType)
+            {
+                case mse_sst8Bits:
+                    v = static_cast<quint8>(frameData[c]) - 128;
+                    break;
+
+                case mse_sstFloat32:
+                {
+                    float sample;
+                    memcpy(&sample, frameData + c * sizeof(float), sizeof(float));
+                    v = qBound(-8388608, static_cast<qint32>(std::lround(sample * 8388608.0f)), 8388607);
+                    break;
+                }
+
+                default:
+                {
+                    qint16 sample;
+                    memcpy(&sample, frameData + c * sizeof(qint16), sizeof(qint16));
+                    v = sample;
+                    break;
+                }
+            }
+            channels[c][nPending] = v;
+        }
+
+        nPending++;
+        if(nPending == blockSize)
+        {
+            if(!encodeFrame())
+                return false;
+        }
+    }
+    return true;
+}
+
+/*!
+ * Encodes the last (partial) block and completes STREAMINFO.
+ */
+bool MSE_EncoderFlac::finish()
+{
+    bool result = encodeFrame();
+    if(result)
+        result = patchOutput(streamInfoOffset, streamInfo());
+    if(!closeOutput())
+        result = false;
+    return result;
+}
+
+bool MSE_EncoderFlac::encodeFrame()
+{
+    int n = nPending;
+    if(!n)
+        return true;
+
+    frame.clear();
+    MSE_FlacBitWriter writer(frame);
+
+    writer.write(0xFFF8, 16); // sync code, fixed block size
+    writer.write((n == blockSize) ? 12 : 7, 4); // 12 = 4096 samples, 7 = 16-bit size at the end of the header
+    quint32 rateCode = sampleRateCode(format.frequency);
+    writer.write(rateCode, 4);
+    writer.write(static_cast<quint32>(format.nChannels - 1), 4); // independent channels
+    writer.write((bitsPerSample == 8) ? 1 : ((bitsPerSample == 24) ? 6 : 4), 3);
+    writer.write(0, 1);
+    writer.writeUtf8(frameNumber);
+    if(n != blockSize)
+        writer.write(static_cast<quint32>(n - 1), 16);
+    frame.append(static_cast<char>(crc8(frame)));
+
+    for(int c=0; c<format.nChannels; c++)
+        encodeSubframe(writer, channels[c].constData(), n);
+    writer.alignToByte();
+
+    quint16 crc = crc16(frame);
+    frame.append(static_cast<char>(crc >> 8));
+    frame.append(static_cast<char>(crc & 0xFF));
+
+    quint32 frameSize = static_cast<quint32>(frame.size());
+    minFrameSize = minFrameSize ? qMin(minFrameSize, frameSize) : frameSize;
+    maxFrameSize = qMax(maxFrameSize, frameSize);
+    frameNumber++;
+    totalSamples += n;
+    nPending = 0;
+
+    return output(frame);
+}
+
+void MSE_EncoderFlac::encodeSubframe(MSE_FlacBitWriter &writer, const qint32 *samples, int n)
+{
+    bool isConstant = true;
+    for(int i=1; i<n; i++)
+    {
+        if(samples[i] != samples[0])
+        {
+            isConstant = false;
+            break;
+        }
+    }
+    if(isConstant)
+    {
+        writer.write(0, 8);
+        writer.writeSigned(samples[0], bitsPerSample);
+        return;
+    }
+
+    // pick the fixed predictor with the smallest residual
+    int order = 0;
+    quint64 bestSum = std::numeric_limits<quint64>::max();
+    for(int o=0; o<=qMin(maxFixedOrder, n-1); o++)
+    {
+        quint64 sum = 0;
+        for(int i=o; i<n; i++)
+            sum += static_cast<quint64>(qAbs(static_cast<qint64>(fixedResidual(samples, i, o))));
+        if(sum < bestSum)
+        {
+            bestSum = sum;
+            order = o;
+        }
+    }
+
+    int m = n - order;
+    quint64 foldedSum = 0;
+    for(int i=order; i<n; i++)
+    {
+        qint32 r = fixedResidual(samples, i, order);
+        quint32 u = (r >= 0) ? (static_cast<quint32>(r) << 1) : ((static_cast<quint32>(-(r + 1)) << 1) | 1);
+        residuals[i - order] = u;
+        foldedSum += u;
+    }
+
+    // the estimate is refined by the exact cost of the neighbouring parameters
+    int estimate = 0;
+    while((estimate < maxRice2Param) && ((static_cast<quint64>(m) << (estimate + 1)) < foldedSum))
+        estimate++;
+    int param = estimate;
+    quint64 bestBits = std::numeric_limits<quint64>::max();
+    for(int k=qMax(0, estimate-1); k<=qMin(maxRice2Param, estimate+1); k++)
+    {
+        quint64 bits = static_cast<quint64>(m) * (k + 1);
+        for(int i=0; i<m; i++)
+            bits += residuals[i] >> k;
+        if(bits < bestBits)
+        {
+            bestBits = bits;
+            param = k;
+        }
+    }
+    int paramBits = (param > maxRiceParam) ? 5 : 4;
+    bestBits += static_cast<quint64>(order) * bitsPerSample + 6 + paramBits;
+
+    if(bestBits >= static_cast<quint64>(n) * bitsPerSample)
+    {
+        writer.write(0x02, 8); // verbatim
+        for(int i=0; i<n; i++)
+            writer.writeSigned(samples[i], bitsPerSample);
+        return;
+    }
+
+    writer.write(0x10 | (order << 1), 8); // fixed predictor
+    for(int i=0; i<order; i++)
+        writer.writeSigned(samples[i], bitsPerSample);
+    writer.write((paramBits == 5) ? 1 : 0, 2); // RICE or RICE2
+    writer.write(0, 4); // one partition
+    writer.write(static_cast<quint32>(param), paramBits);
+    for(int i=0; i<m; i++)
+    {
+        quint32 u = residuals[i];
+        writer.writeUnary(u >> param);
+        if(param)
+            writer.write(u, param);
+    }
+}
+
+QByteArray MSE_EncoderFlac::streamInfo() const
+{
+    QByteArray info;
+    info.reserve(streamInfoSize);
+    MSE_FlacBitWriter writer(info);
+    writer.write(static_cast<quint32>(blockSize), 16);
+    writer.write(static_cast<quint32>(blockSize), 16);
+    writer.write(minFrameSize, 24);
+    writer.write(maxFrameSize, 24);
+    writer.write(format.frequency, 20);
+    writer.write(static_cast<quint32>(format.nChannels - 1), 3);
+    writer.write(static_cast<quint32>(bitsPerSample - 1), 5);
+    writer.write(static_cast<quint32>(totalSamples >> 32), 4);
+    writer.write(static_cast<quint32>(totalSamples), 32);
+    for(int a=0; a<4; a++)
+        writer.write(0, 32); // no MD5
+    return info;
+}
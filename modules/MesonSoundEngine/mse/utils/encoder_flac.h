@@ -0,0 +1,48 @@
+#pragma once
+
+#include "mse/utils/encoder.h"
+
+#include <QVector>
+
+class MSE_FlacBitWriter;
+
+/*!
+ * MSE_EncoderBackend that compresses the PCM data into a FLAC stream in-process.
+ *
+ * This is a lightweight encoder that needs no external libraries:
+ * every channel is coded independently with the best of the fixed predictors (orders 0..4)
+ * and a single Rice partition, falling back to the verbatim or constant subframes.
+ * 8-bit and 16-bit samples are stored as is, float samples are converted to 24 bits.
+ *
+ * STREAMINFO is completed when the encoding is finished,
+ * the callback output (see setOutputCallback) gets the "unknown length" STREAMINFO of a live stream instead.
+ * The MD5 signature is not calculated.
+ *
+ * The bitrate, quality and output frequency are ignored.
+ */
+class MSE_EncoderFlac : public MSE_EncoderBackend
+{
+public:
+    bool start(const MSE_EncoderFormat& format, const MSE_EncoderInitParams& params) override;
+    bool write(const char* data, qint64 len) override;
+    bool finish() override;
+
+    static const int blockSize;
+    static const int maxChannels;
+
+protected:
+    MSE_EncoderFormat format;
+    int bitsPerSample = 16;
+    QVector<QVector<qint32>> channels;
+    QVector<quint32> residuals;
+    int nPending = 0;
+    quint64 frameNumber = 0;
+    quint64 totalSamples = 0;
+    quint32 minFrameSize = 0;
+    quint32 maxFrameSize = 0;
+    QByteArray frame;
+
+    bool encodeFrame();
+    void encodeSubframe(MSE_FlacBitWriter& writer, const qint32* samples, int n);
+    QByteArray streamInfo() const;
+};
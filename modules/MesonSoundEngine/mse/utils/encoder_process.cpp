@@ -0,0 +1,165 @@
+#include "mse/utils/encoder_process.h"
+
+#ifndef Q_OS_WIN
+    #include <sys/resource.h>
+#endif
+
+const int MSE_EncoderProcess::processTimeout = 30000; // ms, the process is considered hung if it doesn't consume or produce anything for this long
+
+MSE_EncoderProcess::MSE_EncoderProcess(const QString &program, const QStringList &args)
+    :program(program)
+    ,args(args)
+{
+}
+
+/*!
+ * Starts the process.
+ * The QProcess object is created here, so it belongs to the encoding thread.
+ */
+bool MSE_EncoderProcess::start(const MSE_EncoderFormat &format, const MSE_EncoderInitParams &params)
+{
+    QString sampleFormat;
+    switch(format.sampleType)
+    {
+        case mse_sst8Bits:
+            sampleFormat = QStringLiteral("u8");
+            break;
+        case mse_sstFloat32:
+            sampleFormat = QStringLiteral("f32le");
+            break;
+        default:
+            sampleFormat = QStringLiteral("s16le");
+            break;
+    }
+
+    QStringList processArgs;
+    foreach(QString arg, args)
+    {
+        arg.replace(QStringLiteral("%bitrate%"), QString::number(params.outputBitrate));
+        arg.replace(QStringLiteral("%frequency%"), QString::number(params.outputFrequency));
+        arg.replace(QStringLiteral("%quality%"), QString::number(params.outputQuality));
+        arg.replace(QStringLiteral("%input_frequency%"), QString::number(format.frequency));
+        arg.replace(QStringLiteral("%channels%"), QString::number(format.nChannels));
+        arg.replace(QStringLiteral("%bits%"), QString::number(format.getSampleSize() * 8));
+        arg.replace(QStringLiteral("%format%"), sampleFormat);
+        processArgs.append(arg);
+    }
+
+    bool hasOutput = outputCallback || !outputFilename.isEmpty();
+    if(hasOutput && !openOutput())
+        return false;
+
+    process.reset(new QProcess());
+    if(!hasOutput)
+        process->setStandardOutputFile(QProcess::nullDevice());
+    process->setStandardErrorFile(QProcess::nullDevice());
+    process->start(program, processArgs);
+    if(!process->waitForStarted(processTimeout))
+        return fail(process->errorString());
+
+    setPriority(params.processPriority);
+    return true;
+}
+
+/*!
+ * Writes the PCM data to the standard input of the process.
+ * Blocks until the process has consumed all data,
+ * so a slow encoder holds back the mixing thread instead of growing the pipe buffer.
+ */
+bool MSE_EncoderProcess::write(const char *data, qint64 len)
+{
+    if(process->write(data, len) != len)
+        return fail(process->errorString());
+
+    while(process->bytesToWrite() > 0)
+    {
+        if(process->state() != QProcess::Running)
+            return fail(QStringLiteral("Encoder process has exited"));
+        if(!process->waitForBytesWritten(processTimeout))
+            return fail(process->errorString());
+        // QProcess keeps reading the standard output while waiting, pass it on as soon as possible
+        if(!readOutput())
+            return false;
+    }
+
+    return readOutput();
+}
+
+/*!
+ * Closes the standard input of the process and waits for it to finish.
+ */
+bool MSE_EncoderProcess::finish()
+{
+    if(!process)
+        return closeOutput();
+
+    bool result = true;
+    if(process->state() == QProcess::Running)
+    {
+        process->closeWriteChannel();
+        while(process->state() == QProcess::Running)
+        {
+            if(!process->waitForFinished(processTimeout))
+            {
+                result = fail(QStringLiteral("Encoder process is not responding"));
+                process->kill();
+                process->waitForFinished(processTimeout);
+                break;
+            }
+        }
+    }
+
+    if(result)
+    {
+        result = readOutput();
+        if(result && ((process->exitStatus() != QProcess::NormalExit) || process->exitCode()))
+            result = fail(QStringLiteral("Encoder process has exited with code %1").arg(process->exitCode()));
+    }
+
+    process.reset();
+    if(!closeOutput())
+        result = false;
+    return result;
+}
+
+bool MSE_EncoderProcess::readOutput()
+{
+    if(!outputCallback && outputFilename.isEmpty())
+        return true;
+    QByteArray data = process->readAllStandardOutput();
+    return output(data);
+}
+
+void MSE_EncoderProcess::setPriority(MSE_EncoderProcessPriority priority)
+{
+#ifdef Q_OS_WIN
+    DWORD priorityClass;
+    switch(priority)
+    {
+        case mse_eppLowest: priorityClass = IDLE_PRIORITY_CLASS; break;
+        case mse_eppLower: priorityClass = BELOW_NORMAL_PRIORITY_CLASS; break;
+        case mse_eppHigher: priorityClass = ABOVE_NORMAL_PRIORITY_CLASS; break;
+        case mse_eppHighest: priorityClass = HIGH_PRIORITY_CLASS; break;
+        default: priorityClass = NORMAL_PRIORITY_CLASS; break;
+    }
+    HANDLE h = OpenProcess(PROCESS_SET_INFORMATION, FALSE, static_cast<DWORD>(process->processId()));
+    if(h)
+    {
+        SetPriorityClass(h, priorityClass);
+        CloseHandle(h);
+    }
+#else
+    int niceValue;
+    switch(priority)
+    {
+        case mse_eppLowest: niceValue = 19; break;
+        case mse_eppLower: niceValue = 10; break;
+        case mse_eppHigher: niceValue = -5; break;
+        case mse_eppHighest: niceValue = -10; break;
+        default: niceValue = 0; break;
+    }
+    // raising the priority needs privileges, the encoder just runs with the normal one otherwise
+    if(niceValue)
+        setpriority(PRIO_PROCESS, static_cast<id_t>(process->processId()), niceValue);
+#endif
+}
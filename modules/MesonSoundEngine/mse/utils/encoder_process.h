@@ -0,0 +1,44 @@
+#pragma once
+
+#include "mse/utils/encoder.h"
+
+#include <QProcess>
+#include <QStringList>
+
+/*!
+ * MSE_EncoderBackend that pipes the PCM data to an external encoder (e.g. lame, oggenc, ffmpeg).
+ *
+ * The raw PCM data is written to the standard input of the process.
+ * If an output is set, the standard output of the process is passed to it,
+ * otherwise the process is expected to write the result by itself.
+ *
+ * The following placeholders in the arguments are replaced with the actual values:
+ * \li **%bitrate%** - MSE_EncoderInitParams::outputBitrate;
+ * \li **%frequency%** - MSE_EncoderInitParams::outputFrequency;
+ * \li **%quality%** - MSE_EncoderInitParams::outputQuality;
+ * \li **%input_frequency%** - sample rate of the PCM data;
+ * \li **%channels%** - number of channels of the PCM data;
+ * \li **%bits%** - bits per sample of the PCM data;
+ * \li **%format%** - sample format of the PCM data as named by ffmpeg (u8, s16le or f32le).
+ *
+ * The process runs with MSE_EncoderInitParams::processPriority.
+ */
+class MSE_EncoderProcess : public MSE_EncoderBackend
+{
+public:
+    explicit MSE_EncoderProcess(const QString& program, const QStringList& args);
+
+    bool start(const MSE_EncoderFormat& format, const MSE_EncoderInitParams& params) override;
+    bool write(const char* data, qint64 len) override;
+    bool finish() override;
+
+    static const int processTimeout;
+
+protected:
+    QString program;
+    QStringList args;
+    QScopedPointer<QProcess> process;
+
+    bool readOutput();
+    void setPriority(MSE_EncoderProcessPriority priority);
+};
@@ -0,0 +1,67 @@
+#include "mse/utils/encoder_wav.h"
+
+#include <QtEndian>
+
+#include <cstring>
+
+static const quint16 wavFormatPcm = 1;
+static const quint16 wavFormatFloat = 3;
+static const int wavHeaderSize = 44; // bytes, RIFF header + "fmt " chunk + "data" chunk header
+static const quint32 wavUnknownSize = 0xFFFFFFFF; // the size of a live stream or a file over 4GB
+
+/*!
+ * Writes the header.
+ */
+bool MSE_EncoderWav::start(const MSE_EncoderFormat &format, const MSE_EncoderInitParams &params)
+{
+    Q_UNUSED(params);
+    this->format = format;
+    dataLen = 0;
+    if(!openOutput())
+        return false;
+    return output(header(wavUnknownSize));
+}
+
+bool MSE_EncoderWav::write(const char *data, qint64 len)
+{
+    if(!output(data, len))
+        return false;
+    dataLen += len;
+    return true;
+}
+
+/*!
+ * Sets the actual sizes in the header of the file.
+ */
+bool MSE_EncoderWav::finish()
+{
+    bool result = true;
+    if(dataLen <= wavUnknownSize - wavHeaderSize)
+        result = patchOutput(0, header(static_cast<quint32>(dataLen)));
+    if(!closeOutput())
+        result = false;
+    return result;
+}
+
+QByteArray MSE_EncoderWav::header(quint32 dataSize) const
+{
+    QByteArray h(wavHeaderSize, 0);
+    char* p = h.data();
+    int sampleSize = format.getSampleSize();
+    quint32 riffSize = (dataSize == wavUnknownSize) ? wavUnknownSize : (dataSize + wavHeaderSize - 8);
+
+    memcpy(p, "RIFF", 4);
+    qToLittleEndian<quint32>(riffSize, p + 4);
+    memcpy(p + 8, "WAVEfmt ", 8);
+    qToLittleEndian<quint32>(16, p + 16);
+    qToLittleEndian<quint16>((format.sampleType == mse_sstFloat32) ? wavFormatFloat : wavFormatPcm, p + 20);
+    qToLittleEndian<quint16>(static_cast<quint16>(format.nChannels), p + 22);
+    qToLittleEndian<quint32>(format.frequency, p + 24);
+    qToLittleEndian<quint32>(format.frequency * format.getBlockAlign(), p + 28);
+    qToLittleEndian<quint16>(static_cast<quint16>(format.getBlockAlign()), p + 32);
+    qToLittleEndian<quint16>(static_cast<quint16>(sampleSize * 8), p + 34);
+    memcpy(p + 36, "data", 4);
+    qToLittleEndian<quint32>(dataSize, p + 40);
+
+    return h;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "mse/utils/encoder.h"
+
+/*!
+ * MSE_EncoderBackend that writes the PCM data into a RIFF WAVE container as is.
+ *
+ * Float samples are stored as IEEE float, the rest as integer PCM.
+ * The sizes in the header are set when the encoding is finished,
+ * the callback output (see setOutputCallback) gets the "unknown size" header of a live stream instead.
+ *
+ * The bitrate, quality and output frequency are ignored.
+ */
+class MSE_EncoderWav : public MSE_EncoderBackend
+{
+public:
+    bool start(const MSE_EncoderFormat& format, const MSE_EncoderInitParams& params) override;
+    bool write(const char* data, qint64 len) override;
+    bool finish() override;
+
+protected:
+    MSE_EncoderFormat format;
+    quint64 dataLen = 0;
+
+    QByteArray header(quint32 dataSize) const;
+};
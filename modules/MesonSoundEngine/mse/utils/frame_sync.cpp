@@ -0,0 +1,276 @@
+#include "mse/utils/frame_sync.h"
+
+const int MSE_FrameSync::maxSyncSearch = 64*1024; // give up looking for a frame after this many bytes
+
+// bitrates (kbit/s) by [MPEG-1 or not][layer I, II, III][bitrate index]
+static const int mpegBitrates[2][3][15] = {
+    {
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}
+    },
+    {
+        {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320}
+    }
+};
+
+// sample rates by [version: 2.5, reserved, 2, 1][sample rate index]
+static const int mpegSampleRates[4][3] = {
+    {11025, 12000, 8000},
+    {0, 0, 0},
+    {22050, 24000, 16000},
+    {44100, 48000, 32000}
+};
+
+MSE_FrameSync::MSE_FrameSync()
+{
+    reset();
+}
+
+/*!
+ * Prepares the object for a new stream of any format.
+ */
+void MSE_FrameSync::reset()
+{
+    format = mse_ffUnknown;
+    fixedBits = 0;
+    isSynced = false;
+    isPassThrough = false;
+    nSkipped = 0;
+    pending.clear();
+}
+
+/*!
+ * Drops the held back data and waits for the next frame of the detected format.
+ * Call it when the stream is interrupted and continued from another position
+ * (e.g. after a reconnect).
+ */
+void MSE_FrameSync::resync()
+{
+    if(isPassThrough)
+        return;
+    pending.clear();
+    isSynced = false;
+    nSkipped = 0;
+}
+
+/*!
+ * Finds the frames in the pending data.
+ * *nFrames* receives the length of the complete frames at the start of the data.
+ */
+bool MSE_FrameSync::process(qint64 &nFrames)
+{
+    nFrames = 0;
+    const uchar* data = reinterpret_cast<const uchar*>(pending.constData());
+    qint64 size = pending.size();
+
+    if(!isSynced)
+    {
+        // while the format is unknown, all data is kept in case it has to be passed through
+        bool keepData = (format == mse_ffUnknown);
+        qint64 pos = keepData ? nSkipped : 0;
+        qint64 start = pos;
+        MSE_FrameFormat foundFormat = mse_ffUnknown;
+        quint32 foundBits = 0;
+        int r = 0;
+        while(pos < size)
+        {
+            r = checkSync(data + pos, size - pos, foundFormat, foundBits);
+            if(r)
+                break;
+            pos++;
+        }
+        nSkipped += pos - start;
+
+        if(r <= 0)
+        {
+            if(!keepData)
+                pending.remove(0, pos);
+            if(nSkipped <= maxSyncSearch)
+                return true;
+
+            nSkipped = 0;
+            if(keepData)
+            {
+                isPassThrough = true;
+                return true;
+            }
+            pending.clear();
+            return false;
+        }
+
+        format = foundFormat;
+        fixedBits = foundBits;
+        isSynced = true;
+        nSkipped = 0;
+        pending.remove(0, pos);
+        data = reinterpret_cast<const uchar*>(pending.constData());
+        size = pending.size();
+    }
+
+    qint64 pos = 0;
+    while(pos < size)
+    {
+        quint32 bits;
+        qint64 len = frameLength(format, data + pos, size - pos, bits);
+        if(!len)
+            break;
+        if((len < 0) || (bits != fixedBits))
+        {
+            // garbage in the stream, look for the next frame on the next call
+            isSynced = false;
+            break;
+        }
+        if(pos + len > size)
+            break;
+        pos += len;
+    }
+    nFrames = pos;
+    return true;
+}
+
+/*!
+ * Checks whether a frame starts at *data*.
+ * Returns 1 if it does, 0 if it doesn't and -1 if more data is needed to tell.
+ */
+int MSE_FrameSync::checkSync(const uchar *data, qint64 len, MSE_FrameFormat &foundFormat, quint32 &foundBits) const
+{
+    static const MSE_FrameFormat formats[] = {mse_ffMpeg, mse_ffAdts, mse_ffOgg};
+
+    bool needMore = false;
+    for(int a=0; a<3; a++)
+    {
+        MSE_FrameFormat f = formats[a];
+        if((format != mse_ffUnknown) && (f != format))
+            continue;
+
+        quint32 bits;
+        qint64 frameLen = frameLength(f, data, len, bits);
+        if(!frameLen)
+        {
+            needMore = true;
+            continue;
+        }
+        if(frameLen < 0)
+            continue;
+        if((format != mse_ffUnknown) && (bits != fixedBits))
+            continue;
+
+        if(f != mse_ffOgg)
+        {
+            // MPEG and ADTS sync words may appear inside the frame data by chance,
+            // so the next frame must follow right after this one
+            if(len <= frameLen)
+            {
+                needMore = true;
+                continue;
+            }
+            quint32 nextBits;
+            qint64 nextLen = frameLength(f, data + frameLen, len - frameLen, nextBits);
+            if(!nextLen)
+            {
+                needMore = true;
+                continue;
+            }
+            if((nextLen < 0) || (nextBits != bits))
+                continue;
+        }
+
+        foundFormat = f;
+        foundBits = bits;
+        return 1;
+    }
+    return needMore ? -1 : 0;
+}
+
+/*!
+ * Returns the length of the frame that starts at *data*,
+ * zero if more data is needed or -1 if it's not a valid frame.
+ * *bits* receives the header fields that must stay the same for the whole stream.
+ */
+qint64 MSE_FrameSync::frameLength(MSE_FrameFormat format, const uchar *data, qint64 len, quint32 &bits)
+{
+    switch(format)
+    {
+        case mse_ffMpeg:
+            return mpegFrameLength(data, len, bits);
+
+        case mse_ffAdts:
+            return adtsFrameLength(data, len, bits);
+
+        case mse_ffOgg:
+            return oggPageLength(data, len, bits);
+
+        default:
+            return -1;
+    }
+}
+
+qint64 MSE_FrameSync::mpegFrameLength(const uchar *data, qint64 len, quint32 &bits)
+{
+    if(len < 4)
+        return 0;
+    if((data[0] != 0xFF) || ((data[1] & 0xE0) != 0xE0))
+        return -1;
+
+    int version = (data[1] >> 3) & 3;
+    int layer = (data[1] >> 1) & 3;
+    int bitrateIndex = data[2] >> 4;
+    int sampleRateIndex = (data[2] >> 2) & 3;
+    int padding = (data[2] >> 1) & 1;
+    if((version == 1) || !layer || !bitrateIndex || (bitrateIndex == 15) || (sampleRateIndex == 3))
+        return -1;
+
+    bool isMpeg1 = version == 3;
+    int layerIndex = 3 - layer; // 0 - layer I, 1 - layer II, 2 - layer III
+    qint64 bitrate = mpegBitrates[isMpeg1 ? 1 : 0][layerIndex][bitrateIndex] * 1000;
+    int sampleRate = mpegSampleRates[version][sampleRateIndex];
+
+    bits = (static_cast<quint32>(data[1] & 0xFE) << 8) | (data[2] & 0x0C);
+
+    if(layerIndex == 0)
+        return (12 * bitrate / sampleRate + padding) * 4;
+    if((layerIndex == 2) && !isMpeg1)
+        return 72 * bitrate / sampleRate + padding;
+    return 144 * bitrate / sampleRate + padding;
+}
+
+qint64 MSE_FrameSync::adtsFrameLength(const uchar *data, qint64 len, quint32 &bits)
+{
+    if(len < 7)
+        return 0;
+    if((data[0] != 0xFF) || ((data[1] & 0xF6) != 0xF0))
+        return -1;
+    if(((data[2] >> 2) & 0x0F) > 12)
+        return -1;
+
+    qint64 frameLen = ((data[3] & 0x03) << 11) | (data[4] << 3) | (data[5] >> 5);
+    if(frameLen < 7)
+        return -1;
+
+    bits = (static_cast<quint32>(data[1] & 0xF8) << 8) | (data[2] & 0xFC);
+    return frameLen;
+}
+
+qint64 MSE_FrameSync::oggPageLength(const uchar *data, qint64 len, quint32 &bits)
+{
+    if(len < 27)
+        return 0;
+    if((data[0] != 'O') || (data[1] != 'g') || (data[2] != 'g') || (data[3] != 'S') || data[4])
+        return -1;
+    if(data[5] & 0xF8)
+        return -1;
+
+    int nSegments = data[26];
+    if(len < 27 + nSegments)
+        return 0;
+    qint64 pageLen = 27 + nSegments;
+    for(int a=0; a<nSegments; a++)
+        pageLen += data[27 + a];
+
+    // a new logical stream may start at any page, so nothing else has to match
+    bits = 0;
+    return pageLen;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <QByteArray>
+
+/*!
+ * Compressed stream formats recognized by MSE_FrameSync.
+ */
+enum MSE_FrameFormat {
+    mse_ffUnknown, /*!< The format is not (yet) known; the data is passed as is. */
+    mse_ffMpeg, /*!< MPEG audio (MP1/MP2/MP3) frames. */
+    mse_ffAdts, /*!< AAC in ADTS frames. */
+    mse_ffOgg /*!< Ogg pages (Vorbis, Opus, FLAC, ...). */
+};
+
+/*!
+ * Splits a compressed audio stream into whole frames.
+ *
+ * The data may be fed in chunks of any size.
+ * Only complete frames are passed on; the incomplete frame at the end is held back
+ * until the rest of it arrives. The format is detected from the first valid frame
+ * that is followed by another valid frame of the same kind.
+ * If nothing is found within ::maxSyncSearch bytes, then the data is passed through unchanged.
+ *
+ * After resync() the held back frame is dropped and the data is skipped
+ * up to the next frame of the same format and parameters,
+ * so the data of another connection can continue the same decoder input.
+ */
+class MSE_FrameSync
+{
+public:
+    MSE_FrameSync();
+
+    void reset();
+    void resync();
+
+    /*!
+     * Returns the detected format.
+     */
+    inline MSE_FrameFormat getFormat() const {return format;}
+
+    /*!
+     * Returns the number of bytes that are held back.
+     */
+    inline qint64 getPendingBytes() const {return pending.size();}
+
+    template<typename FramesFunc>
+    bool feed(const char* data, qint64 len, FramesFunc onFrames);
+
+    static const int maxSyncSearch;
+
+protected:
+    MSE_FrameFormat format;
+    quint32 fixedBits;
+    bool isSynced;
+    bool isPassThrough;
+    qint64 nSkipped;
+    QByteArray pending;
+
+    bool process(qint64& nFrames);
+    int checkSync(const uchar* data, qint64 len, MSE_FrameFormat& foundFormat, quint32& foundBits) const;
+
+    static qint64 frameLength(MSE_FrameFormat format, const uchar* data, qint64 len, quint32& bits);
+    static qint64 mpegFrameLength(const uchar* data, qint64 len, quint32& bits);
+    static qint64 adtsFrameLength(const uchar* data, qint64 len, quint32& bits);
+    static qint64 oggPageLength(const uchar* data, qint64 len, quint32& bits);
+};
+
+/*!
+ * Parses the next chunk of the stream.
+ * *onFrames(const char* data, qint64 len)* is called with the complete frames.
+ * Returns false if the sync was lost and no matching frame was found
+ * within ::maxSyncSearch bytes; the data is dropped in this case.
+ */
+template<typename FramesFunc>
+bool MSE_FrameSync::feed(const char *data, qint64 len, FramesFunc onFrames)
+{
+    if(isPassThrough)
+    {
+        if(len > 0)
+            onFrames(data, len);
+        return true;
+    }
+
+    pending.append(data, len);
+    qint64 nFrames;
+    bool ok = process(nFrames);
+    if(nFrames)
+    {
+        onFrames(pending.constData(), nFrames);
+        pending.remove(0, nFrames);
+    }
+    if(isPassThrough && !pending.isEmpty())
+    {
+        onFrames(pending.constData(), pending.size());
+        pending.clear();
+    }
+    return ok;
+}
@@ -0,0 +1,50 @@
+#include "mse/utils/icy_parser.h"
+
+#include <QRegularExpression>
+
+MSE_IcyParser::MSE_IcyParser(int metaInt)
+{
+    reset(metaInt);
+}
+
+/*!
+ * Prepares the parser for a new stream with the specified metadata interval.
+ */
+void MSE_IcyParser::reset(int metaInt)
+{
+    this->metaInt = qMax(0, metaInt);
+    chunkPos = 0;
+    metaLen = -1;
+    meta.clear();
+}
+
+/*!
+ * Extracts the artist and the title from the StreamTitle field of the ICY metadata.
+ * The value is split on the first " - ". If there's no separator, then the whole value is the title.
+ * Returns false if there's no StreamTitle field; *artist* and *title* are cleared in this case.
+ */
+bool MSE_IcyParser::parseStreamTitle(const QString &icyString, QString &artist, QString &title)
+{
+    static QRegularExpression rx(
+        "StreamTitle\\=\\'(.*?)\\'\\;",
+        QRegularExpression::CaseInsensitiveOption);
+
+    artist.clear();
+    title.clear();
+    QRegularExpressionMatch match = rx.match(icyString);
+    if(!match.hasMatch())
+        return false;
+
+    const QString& cap = match.captured(1);
+    int p = cap.indexOf(QStringLiteral(" - "));
+    if(p >= 0)
+    {
+        artist = cap.left(p).trimmed();
+        title = cap.mid(p+3).trimmed();
+    }
+    else
+    {
+        title = cap.trimmed();
+    }
+    return true;
+}
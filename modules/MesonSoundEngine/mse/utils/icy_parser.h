@@ -0,0 +1,88 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+/*!
+ * Splits an ICY stream into the audio data and the metadata blocks.
+ *
+ * The data may be fed in chunks of any size.
+ */
+class MSE_IcyParser
+{
+public:
+    explicit MSE_IcyParser(int metaInt = 0);
+
+    void reset(int metaInt);
+
+    /*!
+     * Returns the metadata interval in bytes. Zero means there's no metadata in the stream.
+     */
+    inline int getMetaInt() const {return metaInt;}
+
+    template<typename AudioFunc, typename MetaFunc>
+    void feed(const char* data, qint64 len, AudioFunc onAudio, MetaFunc onMeta);
+
+    static bool parseStreamTitle(const QString& icyString, QString& artist, QString& title);
+
+protected:
+    int metaInt;
+    int chunkPos;
+    int metaLen;
+    QByteArray meta;
+};
+
+/*!
+ * Parses the next chunk of the stream.
+ * *onAudio(const char* data, qint64 len)* is called for every piece of the audio data,
+ * *onMeta(const char* data, int len)* is called for every complete non-empty metadata block.
+ */
+template<typename AudioFunc, typename MetaFunc>
+void MSE_IcyParser::feed(const char *data, qint64 len, AudioFunc onAudio, MetaFunc onMeta)
+{
+    if(metaInt <= 0)
+    {
+        if(len > 0)
+            onAudio(data, len);
+        return;
+    }
+
+    while(len > 0)
+    {
+        if(metaLen < 0)
+        {
+            qint64 n = qMin(len, static_cast<qint64>(metaInt - chunkPos));
+            onAudio(data, n);
+            data += n;
+            len -= n;
+            chunkPos += n;
+            if(chunkPos == metaInt)
+            {
+                chunkPos = 0;
+                metaLen = 0;
+            }
+            continue;
+        }
+
+        if(metaLen == 0)
+        {
+            metaLen = 16 * static_cast<quint8>(*data);
+            data++;
+            len--;
+            meta.clear();
+            if(!metaLen)
+                metaLen = -1;
+            continue;
+        }
+
+        int n = static_cast<int>(qMin(len, static_cast<qint64>(metaLen - meta.size())));
+        meta.append(data, n);
+        data += n;
+        len -= n;
+        if(meta.size() == metaLen)
+        {
+            onMeta(meta.constData(), metaLen);
+            metaLen = -1;
+        }
+    }
+}
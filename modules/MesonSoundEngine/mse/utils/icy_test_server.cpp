@@ -0,0 +1,524 @@
+#include "mse/utils/icy_test_server.h"
+
+#include <QTimer>
+#include <QtEndian>
+
+#include <cmath>
+
+const int MSE_IcyTestServer::tickInterval = 20; // send the throttled data this often
+const int MSE_IcyTestServer::maxPendingBytes = 1024*1024; // don't queue more if the client doesn't read
+
+static const QByteArray fileEtag("\"mse-test-file\"");
+static const QByteArray fileLastModified("Mon, 01 Jan 2018 00:00:00 GMT");
+
+class MSE_IcyTestServer::Connection : public QObject
+{
+public:
+    Connection(MSE_IcyTestServer* server, QTcpSocket* socket, int id) : QObject(server)
+      ,server(server)
+      ,socket(socket)
+      ,id(id)
+    {
+        socket->setParent(this);
+        // the connection is the context, so abort() can cut these off with socket->disconnect(this)
+        connect(socket, &QTcpSocket::readyRead, this, [this](){onReadyRead();});
+        connect(socket, &QTcpSocket::disconnected, this, [this](){finish();});
+        timer.setInterval(tickInterval);
+        connect(&timer, &QTimer::timeout, this, [this](){onTick();});
+    }
+
+    void abort()
+    {
+        timer.stop();
+        socket->disconnect(this);
+        socket->abort();
+    }
+
+protected:
+    MSE_IcyTestServer* server;
+    QTcpSocket* socket;
+    int id;
+    QByteArray request;
+    bool isParsed = false;
+
+    QTimer timer;
+    QElapsedTimer streamClock;
+    bool isFile = false;
+    qint64 pos = 0;
+    qint64 end = 0;
+    qint64 audioSent = 0;
+    double rate = 0;
+    int metaInt = 0;
+    int chunkPos = 0;
+    QByteArray lastTitle;
+
+    void finish()
+    {
+        timer.stop();
+        server->connections.removeOne(this);
+        deleteLater();
+    }
+
+    void write(const QByteArray& data)
+    {
+        socket->write(data);
+        server->bytesSent += data.size();
+    }
+
+    void writeHead(const QByteArray& status, const QList<QByteArray>& headers)
+    {
+        QByteArray head = "HTTP/1.1 " + status + "\r\n";
+        foreach(const QByteArray& header, headers)
+            head.append(header).append("\r\n");
+        head.append("Connection: close\r\n\r\n");
+        write(head);
+    }
+
+    void writeResponse(const QByteArray& status, const QByteArray& contentType, const QByteArray& body, bool withBody = true)
+    {
+        QList<QByteArray> headers;
+        headers << "Content-Type: " + contentType;
+        headers << "Content-Length: " + QByteArray::number(body.size());
+        writeHead(status, headers);
+        if(withBody)
+            write(body);
+        socket->disconnectFromHost();
+    }
+
+    void onReadyRead()
+    {
+        if(isParsed)
+        {
+            socket->readAll();
+            return;
+        }
+
+        request.append(socket->readAll());
+        int p = request.indexOf("\r\n\r\n");
+        if(p < 0)
+        {
+            if(request.size() > 64*1024)
+                abort();
+            return;
+        }
+        isParsed = true;
+
+        QList<QByteArray> lines = request.left(p).split('\n');
+        QList<QByteArray> requestLine = lines.takeFirst().trimmed().split(' ');
+        if(requestLine.size() < 2)
+        {
+            writeResponse("400 Bad Request", "text/plain", "Bad Request");
+            return;
+        }
+        QByteArray method = requestLine.at(0);
+        QString path = QString::fromUtf8(requestLine.at(1));
+        int q = path.indexOf('?');
+        if(q >= 0)
+            path = path.left(q);
+
+        QHash<QByteArray, QByteArray> headers;
+        foreach(const QByteArray& line, lines)
+        {
+            int c = line.indexOf(':');
+            if(c > 0)
+                headers.insert(line.left(c).trimmed().toLower(), line.mid(c+1).trimmed());
+        }
+
+        emit server->onRequest(id, path);
+        respond(method, path, headers);
+    }
+
+    void respond(const QByteArray& method, const QString& path, const QHash<QByteArray, QByteArray>& headers)
+    {
+        bool withBody = method != "HEAD";
+        if((method != "GET") && withBody)
+        {
+            writeResponse("405 Method Not Allowed", "text/plain", "Method Not Allowed");
+            return;
+        }
+
+        if(path == QStringLiteral("/stream"))
+        {
+            startStream(headers.value("icy-metadata") == "1", withBody);
+            return;
+        }
+
+        if(path == QStringLiteral("/file"))
+        {
+            startFile(headers, withBody);
+            return;
+        }
+
+        if(path.startsWith(QStringLiteral("/redirect/")))
+        {
+            bool ok;
+            int n = path.mid(10).toInt(&ok);
+            if(ok && (n >= 0))
+            {
+                QUrl url = n ? server->getRedirectUrl(n-1) : server->getStreamUrl();
+                QList<QByteArray> responseHeaders;
+                responseHeaders << "Location: " + url.toEncoded();
+                responseHeaders << "Content-Length: 0";
+                writeHead("302 Found", responseHeaders);
+                socket->disconnectFromHost();
+                return;
+            }
+        }
+
+        if(path == QStringLiteral("/playlist.m3u"))
+        {
+            QByteArray body = "#EXTM3U\n#EXTINF:-1,MSE Test Server\n" + server->getStreamUrl().toEncoded() + "\n";
+            writeResponse("200 OK", "audio/x-mpegurl", body, withBody);
+            return;
+        }
+
+        if(path == QStringLiteral("/playlist.pls"))
+        {
+            QByteArray body = "[playlist]\nNumberOfEntries=1\nFile1=" + server->getStreamUrl().toEncoded()
+                + "\nTitle1=MSE Test Server\nLength1=-1\nVersion=2\n";
+            writeResponse("200 OK", "audio/x-scpls", body, withBody);
+            return;
+        }
+
+        writeResponse("404 Not Found", "text/plain", "Not Found", withBody);
+    }
+
+    void startStream(bool withMeta, bool withBody)
+    {
+        int bitrate = server->getBitrate();
+        metaInt = withMeta ? server->params.metaInt : 0;
+
+        QList<QByteArray> headers;
+        headers << "Content-Type: " + server->params.contentType;
+        headers << "icy-name: MSE Test Server";
+        if(bitrate > 0)
+            headers << "icy-br: " + QByteArray::number(bitrate);
+        if(metaInt > 0)
+            headers << "icy-metaint: " + QByteArray::number(metaInt);
+        writeHead("200 OK", headers);
+        if(!withBody)
+        {
+            socket->disconnectFromHost();
+            return;
+        }
+
+        isFile = false;
+        pos = 0;
+        end = -1;
+        startSending(bitrate);
+    }
+
+    void startFile(const QHash<QByteArray, QByteArray>& headers, bool withBody)
+    {
+        qint64 length = server->getFileLength();
+        if(headers.value("if-none-match") == fileEtag)
+        {
+            QList<QByteArray> responseHeaders;
+            responseHeaders << "ETag: " + fileEtag;
+            writeHead("304 Not Modified", responseHeaders);
+            socket->disconnectFromHost();
+            return;
+        }
+
+        qint64 from = 0;
+        qint64 to = length - 1;
+        bool isRange = false;
+        QByteArray range = headers.value("range");
+        if(range.startsWith("bytes="))
+        {
+            QList<QByteArray> bounds = range.mid(6).split('-');
+            bool ok = bounds.size() == 2;
+            if(ok)
+                from = bounds.at(0).toLongLong(&ok);
+            if(ok && !bounds.at(1).isEmpty())
+                to = qMin(to, bounds.at(1).toLongLong(&ok));
+            if(!ok || (from > to) || (from >= length))
+            {
+                QList<QByteArray> responseHeaders;
+                responseHeaders << "Content-Range: bytes */" + QByteArray::number(length);
+                responseHeaders << "Content-Length: 0";
+                writeHead("416 Range Not Satisfiable", responseHeaders);
+                socket->disconnectFromHost();
+                return;
+            }
+            isRange = true;
+        }
+
+        QList<QByteArray> responseHeaders;
+        responseHeaders << "Content-Type: " + server->params.contentType;
+        responseHeaders << "Content-Length: " + QByteArray::number(to - from + 1);
+        responseHeaders << "Accept-Ranges: bytes";
+        responseHeaders << "ETag: " + fileEtag;
+        responseHeaders << "Last-Modified: " + fileLastModified;
+        if(isRange)
+            responseHeaders << "Content-Range: bytes " + QByteArray::number(from) + "-"
+                + QByteArray::number(to) + "/" + QByteArray::number(length);
+        writeHead(isRange ? "206 Partial Content" : "200 OK", responseHeaders);
+        if(!withBody)
+        {
+            socket->disconnectFromHost();
+            return;
+        }
+
+        isFile = true;
+        metaInt = 0;
+        pos = from;
+        end = to + 1;
+        startSending(server->getBitrate());
+    }
+
+    void startSending(int bitrate)
+    {
+        rate = bitrate > 0 ? bitrate * 125.0 : 0;
+        audioSent = 0;
+        chunkPos = 0;
+        lastTitle.clear();
+        streamClock.start();
+        emit server->onStreamStarted(id);
+        timer.start();
+        onTick();
+    }
+
+    QByteArray metaBlock()
+    {
+        QByteArray title = server->getTitle();
+        if(title == lastTitle)
+            return QByteArray(1, '\0');
+        lastTitle = title;
+
+        QByteArray meta = "StreamTitle='" + title + "';";
+        meta = meta.left(255*16);
+        int nBlocks = (meta.size() + 15) / 16;
+        meta.append(QByteArray(nBlocks*16 - meta.size(), '\0'));
+        meta.prepend(static_cast<char>(nBlocks));
+        return meta;
+    }
+
+    void onTick()
+    {
+        qint64 allowed = maxPendingBytes - socket->bytesToWrite();
+        if(rate > 0)
+            allowed = qMin(allowed, static_cast<qint64>(server->params.burstSize + rate * streamClock.elapsed() / 1000) - audioSent);
+
+        qint64 disconnectAfter = (!isFile && server->canDisconnect()) ? server->params.disconnectAfter : 0;
+        while(allowed > 0)
+        {
+            qint64 len = allowed;
+            if(metaInt > 0)
+                len = qMin(len, static_cast<qint64>(metaInt - chunkPos));
+            if(isFile)
+                len = qMin(len, end - pos);
+            if(disconnectAfter > 0)
+                len = qMin(len, disconnectAfter - audioSent);
+
+            if(len <= 0)
+                break;
+
+            write(server->readAudio(pos, len, isFile));
+            pos += len;
+            audioSent += len;
+            allowed -= len;
+            chunkPos += len;
+            if((metaInt > 0) && (chunkPos == metaInt))
+            {
+                write(metaBlock());
+                chunkPos = 0;
+            }
+        }
+
+        if(isFile && (pos >= end))
+        {
+            timer.stop();
+            socket->disconnectFromHost();
+            return;
+        }
+
+        if((disconnectAfter > 0) && (audioSent >= disconnectAfter))
+        {
+            server->disconnects++;
+            emit server->onClientDropped(id);
+            abort();
+            finish();
+        }
+    }
+};
+
+MSE_IcyTestServer::MSE_IcyTestServer(QObject *parent) : MSE_Object(parent)
+  ,bytesSent(0)
+  ,disconnects(0)
+  ,nextConnectionId(1)
+{
+    connect(&server, &QTcpServer::newConnection, this, &MSE_IcyTestServer::onNewConnection);
+}
+
+MSE_IcyTestServer::~MSE_IcyTestServer()
+{
+    stop();
+}
+
+/*!
+ * Starts listening on the loopback interface.
+ * If *port* is zero, then any free port is chosen.
+ */
+bool MSE_IcyTestServer::start(const MSE_IcyTestServerParams &params, quint16 port)
+{
+    stop();
+    CHECK((params.sampleRate > 0) && (params.nChannels > 0), MSE_Object::Err::outOfRange);
+    this->params = params;
+
+    int nFrames = params.sampleRate;
+    pcmLoop.resize(nFrames * params.nChannels * 2);
+    qint16* samples = reinterpret_cast<qint16*>(pcmLoop.data());
+    for(int a=0; a<nFrames; a++)
+    {
+        qint16 val = static_cast<qint16>(std::sin(2 * 3.14159265358979323846 * params.toneFrequency * a / params.sampleRate) * 8192);
+        for(int ch=0; ch<params.nChannels; ch++)
+            qToLittleEndian(val, reinterpret_cast<uchar*>(samples++));
+    }
+    streamHeader = makeWavHeader(0xFFFFFFFF - 36);
+    fileHeader = makeWavHeader(static_cast<quint32>(params.fileLength) * pcmLoop.size());
+
+    bytesSent = 0;
+    disconnects = 0;
+    clock.start();
+    CHECK(server.listen(QHostAddress::LocalHost, port), MSE_Object::Err::cannotBindAddress, server.errorString());
+    return true;
+}
+
+/*!
+ * Stops listening and drops all clients.
+ */
+void MSE_IcyTestServer::stop()
+{
+    server.close();
+    QList<Connection*> list = connections;
+    connections.clear();
+    foreach(Connection* connection, list)
+    {
+        connection->abort();
+        delete connection;
+    }
+}
+
+QByteArray MSE_IcyTestServer::makeWavHeader(quint32 dataLength) const
+{
+    QByteArray header(44, '\0');
+    uchar* p = reinterpret_cast<uchar*>(header.data());
+    quint16 blockAlign = params.nChannels * 2;
+    memcpy(p, "RIFF", 4);
+    qToLittleEndian<quint32>(dataLength + 36, p + 4);
+    memcpy(p + 8, "WAVEfmt ", 8);
+    qToLittleEndian<quint32>(16, p + 16);
+    qToLittleEndian<quint16>(1, p + 20); // PCM
+    qToLittleEndian<quint16>(params.nChannels, p + 22);
+    qToLittleEndian<quint32>(params.sampleRate, p + 24);
+    qToLittleEndian<quint32>(params.sampleRate * blockAlign, p + 28);
+    qToLittleEndian<quint16>(blockAlign, p + 32);
+    qToLittleEndian<quint16>(16, p + 34);
+    memcpy(p + 36, "data", 4);
+    qToLittleEndian<quint32>(dataLength, p + 40);
+    return header;
+}
+
+/*!
+ * Returns *len* bytes of the audio starting at *pos*.
+ * The stream audio is endless, the file audio is getFileLength() bytes long.
+ */
+QByteArray MSE_IcyTestServer::readAudio(qint64 pos, qint64 len, bool isFile) const
+{
+    const QByteArray& header = params.audioData.isEmpty() ? (isFile ? fileHeader : streamHeader) : QByteArray();
+    const QByteArray& loop = params.audioData.isEmpty() ? pcmLoop : params.audioData;
+
+    QByteArray data;
+    data.reserve(len);
+    while(len > 0)
+    {
+        qint64 n;
+        if(pos < header.size())
+        {
+            n = qMin(len, header.size() - pos);
+            data.append(header.constData() + pos, n);
+        }
+        else
+        {
+            if(isFile && !params.audioData.isEmpty() && (pos >= loop.size()))
+                break;
+            qint64 loopPos = (pos - header.size()) % loop.size();
+            n = qMin(len, loop.size() - loopPos);
+            data.append(loop.constData() + loopPos, n);
+        }
+        pos += n;
+        len -= n;
+    }
+    return data;
+}
+
+/*!
+ * Returns the length of the file served at /file.
+ */
+qint64 MSE_IcyTestServer::getFileLength() const
+{
+    if(!params.audioData.isEmpty())
+        return params.audioData.size();
+    return fileHeader.size() + static_cast<qint64>(params.fileLength) * pcmLoop.size();
+}
+
+/*!
+ * Returns the bitrate (in kbit/s) the audio is sent with. Zero means no throttling.
+ */
+int MSE_IcyTestServer::getBitrate() const
+{
+    if(params.bitrate >= 0)
+        return params.bitrate;
+    if(!params.audioData.isEmpty())
+        return 0;
+    return params.sampleRate * params.nChannels * 16 / 1000;
+}
+
+/*!
+ * Returns the current stream title.
+ */
+QByteArray MSE_IcyTestServer::getTitle() const
+{
+    qint64 n = params.titleInterval > 0 ? clock.elapsed() / params.titleInterval : 0;
+    return "MSE Test Artist - Track " + QByteArray::number(n + 1);
+}
+
+bool MSE_IcyTestServer::canDisconnect() const
+{
+    return (params.maxDisconnects < 0) || (disconnects < params.maxDisconnects);
+}
+
+QUrl MSE_IcyTestServer::getUrl(const QString &path) const
+{
+    return QUrl("http://127.0.0.1:" + QString::number(server.serverPort()) + path);
+}
+
+QUrl MSE_IcyTestServer::getStreamUrl() const
+{
+    return getUrl(QStringLiteral("/stream"));
+}
+
+QUrl MSE_IcyTestServer::getFileUrl() const
+{
+    return getUrl(QStringLiteral("/file"));
+}
+
+/*!
+ * Returns the URL that redirects *nRedirects* times before /stream.
+ */
+QUrl MSE_IcyTestServer::getRedirectUrl(int nRedirects) const
+{
+    return getUrl("/redirect/" + QString::number(nRedirects));
+}
+
+QUrl MSE_IcyTestServer::getPlaylistUrl(bool pls) const
+{
+    return getUrl(pls ? QStringLiteral("/playlist.pls") : QStringLiteral("/playlist.m3u"));
+}
+
+void MSE_IcyTestServer::onNewConnection()
+{
+    while(QTcpSocket* socket = server.nextPendingConnection())
+        connections.append(new Connection(this, socket, nextConnectionId++));
+}
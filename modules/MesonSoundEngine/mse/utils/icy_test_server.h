@@ -0,0 +1,176 @@
+#pragma once
+
+#include "mse/object.h"
+
+#include <QElapsedTimer>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+
+/*!
+ * Parameters for MSE_IcyTestServer.
+ */
+struct MSE_IcyTestServerParams {
+    int sampleRate = 44100; /*!<
+    Sample rate of the synthetic audio.
+
+    **Default**: 44100
+*/
+    int nChannels = 2; /*!<
+    Number of channels of the synthetic audio.
+
+    **Default**: 2
+*/
+    int toneFrequency = 441; /*!<
+    Frequency (in Hz) of the sine wave.
+
+    **Default**: 441
+*/
+    QByteArray audioData; /*!<
+    Serve these bytes (e.g. the contents of an MP3 file) in a loop
+    instead of the synthetic WAV audio.
+
+    **Default**: &lt;empty&gt;
+*/
+    QByteArray contentType = "audio/wav"; /*!<
+    Content-Type of the audio. Set it along with ::audioData.
+
+    **Default**: audio/wav
+*/
+    int bitrate = -1; /*!<
+    Throttle the audio to this bitrate in kbit/s.
+
+    **Valid values**: any positive integer, 0 - no throttling, -1 - the real bitrate of the synthetic audio.
+
+    **Default**: -1
+*/
+    int burstSize = 64*1024; /*!<
+    Number of bytes sent right after the connection is established, before the throttling takes effect.
+
+    **Default**: 64 KB
+*/
+    int metaInt = 16000; /*!<
+    ICY metadata interval in bytes. Metadata is only sent if the client asks for it.
+    Set to zero to never send metadata.
+
+    **Default**: 16000
+*/
+    int titleInterval = 5000; /*!<
+    Change the stream title this often (in milliseconds). Set to zero to keep the same title.
+
+    **Default**: 5000
+*/
+    qint64 disconnectAfter = 0; /*!<
+    Drop the stream connection after sending this many bytes of audio. Zero means never.
+
+    **Default**: 0
+*/
+    int maxDisconnects = -1; /*!<
+    Stop dropping the connections after this many drops. -1 means no limit.
+
+    **Default**: -1
+*/
+    int fileLength = 10; /*!<
+    Duration (in seconds) of the finite synthetic file served at /file.
+
+    **Default**: 10
+*/
+};
+
+/*!
+ * Loopback HTTP/ICY server for testing and benchmarking MSE_SourceUrl
+ * without real Internet stations.
+ *
+ * Paths:
+ *
+ * path | response
+ * -----|---------
+ * /stream | endless audio with ICY headers and metadata (if requested by the client)
+ * /file | finite audio with Content-Length, ETag and Range support
+ * /redirect/N | a chain of N+1 redirects to /stream
+ * /playlist.m3u | M3U playlist pointing to /stream
+ * /playlist.pls | PLS playlist pointing to /stream
+ *
+ * The server runs in the thread the object lives in.
+ */
+class MSE_IcyTestServer : public MSE_Object
+{
+    Q_OBJECT
+public:
+    explicit MSE_IcyTestServer(QObject* parent = nullptr);
+    ~MSE_IcyTestServer();
+
+    bool start(const MSE_IcyTestServerParams& params = MSE_IcyTestServerParams(), quint16 port = 0);
+    void stop();
+
+    /*!
+     * Returns the parameters the server was started with.
+     */
+    inline const MSE_IcyTestServerParams& getParams() const {return params;}
+
+    /*!
+     * Returns the total number of bytes (including headers and metadata) sent to all clients.
+     */
+    inline qint64 getBytesSent() const {return bytesSent;}
+
+    /*!
+     * Returns the number of connections dropped by the server so far.
+     */
+    inline int getDisconnectsCount() const {return disconnects;}
+
+    /*!
+     * Returns the number of currently open connections.
+     */
+    inline int getConnectionsCount() const {return connections.size();}
+
+    QUrl getUrl(const QString& path) const;
+    QUrl getStreamUrl() const;
+    QUrl getFileUrl() const;
+    QUrl getRedirectUrl(int nRedirects) const;
+    QUrl getPlaylistUrl(bool pls = false) const;
+
+    QByteArray readAudio(qint64 pos, qint64 len, bool isFile) const;
+    qint64 getFileLength() const;
+    int getBitrate() const;
+    QByteArray getTitle() const;
+
+    static const int tickInterval;
+    static const int maxPendingBytes;
+
+protected:
+    class Connection;
+
+    MSE_IcyTestServerParams params;
+    QTcpServer server;
+    QByteArray pcmLoop;
+    QByteArray streamHeader;
+    QByteArray fileHeader;
+    qint64 bytesSent;
+    int disconnects;
+    QElapsedTimer clock;
+    QList<Connection*> connections;
+    int nextConnectionId;
+
+    QByteArray makeWavHeader(quint32 dataLength) const;
+    bool canDisconnect() const;
+
+    friend class Connection;
+
+protected slots:
+    void onNewConnection();
+
+signals:
+    /*!
+     * Emitted when a client requests a path.
+     */
+    void onRequest(int connectionId, const QString& path);
+
+    /*!
+     * Emitted when the audio starts flowing to a client.
+     */
+    void onStreamStarted(int connectionId);
+
+    /*!
+     * Emitted when the server drops a stream connection on purpose (see MSE_IcyTestServerParams::disconnectAfter).
+     */
+    void onClientDropped(int connectionId);
+};
@@ -18,6 +18,9 @@
 
 #include "mse/utils/mixer.h"
 
+const int MSE_Mixer::tapDSPPriority = -1000000; // after all other DSP/FX, so the taps get the final mix
+const int MSE_Mixer::busRampTime = 20; // gain and mute changes are faded in this many milliseconds
+
 static DWORD CALLBACK streamProc(HSTREAM handle, void *buffer, DWORD length, void *user)
 {
     Q_UNUSED(handle);
@@ -28,17 +31,36 @@ static DWORD CALLBACK streamProc(HSTREAM handle, void *buffer, DWORD length, voi
     return res;
 }
 
+void CALLBACK MSE_Mixer::tapDSPProc(HDSP handle, DWORD channel, void *buffer, DWORD length, void *user)
+{
+    Q_UNUSED(handle);
+    Q_UNUSED(channel);
+    static_cast<MSE_MixerTapBuffer*>(user)->write(static_cast<const char*>(buffer), length);
+}
+
 MSE_Mixer::MSE_Mixer() : MSE_Object()
 {
     engine = MSE_Engine::getInstance();
     handle = 0;
     defaultBridgeFlags = 0;
+    tapDsp = 0;
+    muted = false;
+    volume = 1;
 }
 
 MSE_Mixer::~MSE_Mixer()
 {
+    for(int a=taps.size()-1; a>=0; a--)
+        removeTap(taps.at(a));
+    for(int a=duckers.size()-1; a>=0; a--)
+        removeDucker(duckers.at(a));
     for(int a=inputs.size()-1; a>=0; a--)
         removeInput(a);
+    foreach(MSE_MixerBus* bus, buses)
+    {
+        BASS_StreamFree(bus->handle);
+        delete bus;
+    }
 }
 
 /*!
@@ -81,6 +103,8 @@ bool MSE_Mixer::init(const MSE_MixerInitParams &params)
     //flags |= BASS_MIXER_BUFFER;
 
     CHECK(handle = BASS_Mixer_StreamCreate(initParams.outputFrequency, initParams.nChannels, flags), MSE_Object::Err::initFail);
+    if(!initParams.decodeOnly)
+        engine->getBufferTuner()->addChannel(handle);
 
     defaultBridgeFlags |= BASS_STREAM_DECODE;
     return true;
@@ -88,30 +112,30 @@ bool MSE_Mixer::init(const MSE_MixerInitParams &params)
 
 /**
  * Adds a MSE_Sound instance as one of the inputs for the mixer.
+ * The input is removed automatically when the MSE_Sound instance is destroyed.
  *
  * Returns true on success.
+ * Also returns true if the specified MSE_Sound is already amongst this mixer's inputs.
  */
 bool MSE_Mixer::addInput(MSE_Sound *sound)
 {
+    if(inputMap.contains(sound))
+        return true;
+
     MSE_MixerInput* input = new MSE_MixerInput(sound);
+    inputs.append(input);
+    inputMap.insert(sound, input);
 
     connect(sound, SIGNAL(onOpen()), SLOT(onSoundOpen()));
-    if(input->sound->isOpen())
-        onSoundOpen();
-
-    connect(sound, &MSE_Sound::onVolumeChange, [this, sound]{
-        foreach(MSE_MixerInput* input, inputs)
-        {
-            if(input->sound == sound)
-            {
-                if(input->bridge)
-                    BASS_ChannelSetAttribute(input->bridge, BASS_ATTRIB_VOL, sound->getVolume());
-                break;
-            }
-        }
+    connect(sound, SIGNAL(destroyed(QObject*)), SLOT(onSoundDestroyed(QObject*)));
+    connect(sound, &MSE_Sound::onVolumeChange, this, [this, sound]{
+        MSE_MixerInput* input = inputMap.value(sound);
+        if(input && input->bridge)
+            BASS_ChannelSetAttribute(input->bridge, BASS_ATTRIB_VOL, sound->getVolume());
     });
 
-    inputs.append(input);
+    if(sound->isOpen())
+        updateBridge(input);
     return true;
 }
 
@@ -123,11 +147,12 @@ bool MSE_Mixer::addInput(MSE_Sound *sound)
 bool MSE_Mixer::removeInput(int index)
 {
     CHECK((index >= 0) && (index < inputs.size()), MSE_Object::Err::outOfRange);
-    const MSE_MixerInput* input = inputs.at(index);
-    BASS_Mixer_ChannelRemove(input->bridge);
-    BASS_StreamFree(input->bridge);
-    input->sound->disconnect(this, SLOT(onSoundOpen()));
-    delete inputs.takeAt(index);
+    MSE_MixerInput* input = inputs.takeAt(index);
+    inputMap.remove(input->sound);
+    freeBridge(input);
+    detachDuckerLinks(input->sound, QString(), true);
+    input->sound->disconnect(this);
+    delete input;
     return true;
 }
 
@@ -139,38 +164,571 @@ bool MSE_Mixer::removeInput(int index)
  */
 bool MSE_Mixer::removeInput(MSE_Sound *sound)
 {
-    for(int a=inputs.size()-1; a>=0; a--)
-        if(inputs.at(a)->sound == sound)
-            return removeInput(a);
+    MSE_MixerInput* input = inputMap.value(sound);
+    if(!input)
+        return true;
+    return removeInput(inputs.indexOf(input));
+}
+
+/*!
+ * Decode the next chunk of data of length bytes to buffer.
+ * If the mixer is currently paused or stopped then this function returns silence.
+ */
+int MSE_Mixer::getData(char *buffer, int length)
+{
+    return BASS_ChannelGetData(handle, buffer, length);
+}
+
+
+/*!
+ * Adds a consumer of the mixer output.
+ *
+ * Every block the mixer produces (either for the playback or for getData())
+ * is written once into a buffer that is shared by all taps,
+ * and every tap reads it at its own pace from its own position.
+ * The mixer never waits for the taps; a tap that falls behind by more than
+ * MSE_MixerInitParams::tapBufferLength loses data according to *overflow*.
+ * A new tap starts with the next mixed block.
+ *
+ * The tap is owned by the mixer. Returns nullptr on error.
+ */
+MSE_MixerTap *MSE_Mixer::addTap(MSE_MixerTapOverflow overflow)
+{
+    if(!handle)
+    {
+        SETERROR(MSE_Object::Err::invalidState);
+        return nullptr;
+    }
+
+    if(!tapBuffer)
+    {
+        int sampleSize;
+        switch(initParams.sampleType)
+        {
+            case mse_sst8Bits:
+                sampleSize = 1;
+                break;
+            case mse_sstFloat32:
+                sampleSize = 4;
+                break;
+            default:
+                sampleSize = 2;
+                break;
+        }
+        int blockAlign = initParams.nChannels * sampleSize;
+        qint64 capacity = static_cast<qint64>(initParams.outputFrequency) * qMax(1, initParams.tapBufferLength) / 1000 * blockAlign;
+        tapBuffer.reset(new MSE_MixerTapBuffer(capacity, blockAlign));
+        if(!tapBuffer->getCapacity())
+        {
+            tapBuffer.reset();
+            SETERROR(MSE_Object::Err::memoryError);
+            return nullptr;
+        }
+    }
+
+    if(!tapDsp)
+    {
+        tapDsp = BASS_ChannelSetDSP(handle, &MSE_Mixer::tapDSPProc, tapBuffer.data(), tapDSPPriority);
+        if(!tapDsp)
+        {
+            SETERROR(MSE_Object::Err::operationFailed);
+            return nullptr;
+        }
+    }
+
+    MSE_MixerTap* tap = new MSE_MixerTap(tapBuffer.data(), overflow);
+    taps.append(tap);
+    return tap;
+}
+
+/*!
+ * Closes and deletes the tap.
+ * The thread that reads the tap must stop using it before this call.
+ *
+ * Returns true on success.
+ */
+bool MSE_Mixer::removeTap(MSE_MixerTap *tap)
+{
+    CHECK(taps.removeOne(tap), MSE_Object::Err::outOfRange);
+    tap->close();
+    delete tap;
+
+    if(taps.isEmpty() && tapDsp)
+    {
+        BASS_ChannelRemoveDSP(handle, tapDsp);
+        tapDsp = 0;
+    }
     return true;
 }
 
-/**
- * Returns MSE_MixerInput object that corresponds to the specified MSE_Sound object
- * (which should be one of the current inputs).
+/*!
+ * Creates a submix bus with the specified *name*
+ * and routes it to the *parent* bus (or to the master output if *parent* is empty).
  *
- * Returns nullptr if the specified MSE_Sound object is not amongst this mixer's inputs.
+ * Returns true on success.
  */
-MSE_MixerInput *MSE_Mixer::getInput(MSE_Sound *sound) const
+bool MSE_Mixer::addBus(const QString &name, const QString &parent)
 {
-    for(int a=inputs.size()-1; a>=0; a--)
+    CHECK(handle, MSE_Object::Err::invalidState);
+    CHECK(!name.isEmpty() && !buses.contains(name), MSE_Object::Err::invalidState, name);
+    CHECK(busHandle(parent), MSE_Object::Err::outOfRange, parent);
+
+    // the buses always mix in floating-point, so nothing is clipped before the master output
+    MSE_MixerBus* bus = new MSE_MixerBus(name, parent);
+    bus->handle = BASS_Mixer_StreamCreate(
+        initParams.outputFrequency,
+        initParams.nChannels,
+        BASS_SAMPLE_FLOAT | BASS_STREAM_DECODE | BASS_MIXER_NONSTOP);
+    if(!bus->handle)
+    {
+        delete bus;
+        SETERROR(MSE_Object::Err::initFail, name);
+        return false;
+    }
+    if(!BASS_Mixer_StreamAddChannel(busHandle(parent), bus->handle, BASS_MIXER_DOWNMIX))
     {
-        MSE_MixerInput* input = inputs.at(a);
-        if(input->sound == sound)
-            return input;
+        BASS_StreamFree(bus->handle);
+        delete bus;
+        SETERROR(MSE_Object::Err::cannotAddBridge, name);
+        return false;
     }
-    return nullptr;
+
+    buses.insert(name, bus);
+    return true;
 }
 
 /*!
- * Decode the next chunk of data of length bytes to buffer.
- * If the mixer is currently paused or stopped then this function returns silence.
+ * Removes the bus.
+ * Its inputs and buses are routed to its parent.
+ *
+ * Returns true on success.
  */
-int MSE_Mixer::getData(char *buffer, int length)
+bool MSE_Mixer::removeBus(const QString &name)
 {
-    return BASS_ChannelGetData(handle, buffer, length);
+    MSE_MixerBus* bus = buses.value(name);
+    CHECK(bus, MSE_Object::Err::outOfRange, name);
+
+    foreach(MSE_MixerInput* input, inputs)
+    {
+        if(input->bus == name)
+        {
+            input->bus = bus->parent;
+            if(input->bridge)
+                moveChannel(input->bridge, bus->parent);
+        }
+    }
+    foreach(MSE_MixerBus* child, buses)
+    {
+        if(child->parent == name)
+        {
+            child->parent = bus->parent;
+            moveChannel(child->handle, bus->parent);
+        }
+    }
+
+    detachDuckerLinks(nullptr, name, true);
+    buses.remove(name);
+    BASS_StreamFree(bus->handle);
+    delete bus;
+    return true;
+}
+
+/*!
+ * Routes the bus to the *parent* bus (or to the master output if *parent* is empty).
+ * A bus can't be routed to itself or to any of the buses inside it.
+ *
+ * Returns true on success.
+ */
+bool MSE_Mixer::setBusParent(const QString &name, const QString &parent)
+{
+    MSE_MixerBus* bus = buses.value(name);
+    CHECK(bus, MSE_Object::Err::outOfRange, name);
+    CHECK(busHandle(parent), MSE_Object::Err::outOfRange, parent);
+    CHECK(!isBusInside(parent, name), MSE_Object::Err::invalidState, parent);
+
+    if(bus->parent == parent)
+        return true;
+    bus->parent = parent;
+    return moveChannel(bus->handle, parent);
+}
+
+/*!
+ * Routes the input to the *bus* (or to the master output if *bus* is empty).
+ *
+ * Returns true on success.
+ */
+bool MSE_Mixer::setInputBus(MSE_Sound *sound, const QString &bus)
+{
+    MSE_MixerInput* input = inputMap.value(sound);
+    CHECK(input, MSE_Object::Err::mixerInputNotFound);
+    CHECK(busHandle(bus), MSE_Object::Err::outOfRange, bus);
+
+    if(input->bus == bus)
+        return true;
+    input->bus = bus;
+    if(!input->bridge)
+        return true;
+    return moveChannel(input->bridge, bus);
+}
+
+/*!
+ * Sets the volume (0..1) of the bus.
+ * An empty *name* means the master output, i.e. it's the same as setVolume().
+ *
+ * Returns true on success.
+ */
+bool MSE_Mixer::setBusGain(const QString &name, float gain)
+{
+    if(name.isEmpty())
+        return setVolume(gain);
+
+    MSE_MixerBus* bus = buses.value(name);
+    CHECK(bus, MSE_Object::Err::outOfRange, name);
+    bus->gain = qBound(0.0f, gain, 1.0f);
+    applyBusVolume(bus);
+    return true;
+}
+
+/*!
+ * Mutes or unmutes the bus. The muted bus is still mixed,
+ * so its inputs keep playing, and they are heard again right after unmuting.
+ * An empty *name* means the master output.
+ *
+ * Returns true on success.
+ */
+bool MSE_Mixer::setBusMuted(const QString &name, bool muted)
+{
+    if(name.isEmpty())
+    {
+        this->muted = muted;
+        if(handle)
+            return BASS_ChannelSlideAttribute(handle, BASS_ATTRIB_VOL, muted ? 0 : volume, busRampTime);
+        return true;
+    }
+
+    MSE_MixerBus* bus = buses.value(name);
+    CHECK(bus, MSE_Object::Err::outOfRange, name);
+    bus->muted = muted;
+    applyBusVolume(bus);
+    return true;
 }
 
+/*!
+ * Adds a DSP function to the bus (or to the master output if *name* is empty).
+ * The DSP functions of a bus are called in the order of their *priority*
+ * (see BASS_ChannelSetDSP), before the bus is mixed into its parent.
+ *
+ * Returns the DSP handle or 0 on error.
+ */
+HDSP MSE_Mixer::addBusDSP(const QString &name, DSPPROC *proc, void *user, int priority)
+{
+    HSTREAM busStream = busHandle(name);
+    if(!busStream)
+    {
+        SETERROR(MSE_Object::Err::outOfRange, name);
+        return 0;
+    }
+    HDSP dsp = BASS_ChannelSetDSP(busStream, proc, user, priority);
+    if(!dsp)
+        SETERROR(MSE_Object::Err::operationFailed, name);
+    return dsp;
+}
+
+/*!
+ * Removes the DSP function that was added with addBusDSP().
+ *
+ * Returns true on success.
+ */
+bool MSE_Mixer::removeBusDSP(const QString &name, HDSP dsp)
+{
+    HSTREAM busStream = busHandle(name);
+    CHECK(busStream, MSE_Object::Err::outOfRange, name);
+    CHECK(BASS_ChannelRemoveDSP(busStream, dsp), MSE_Object::Err::operationFailed, name);
+    return true;
+}
+
+/*!
+ * Returns the mixer stream of the bus, the master output if *name* is empty,
+ * or 0 if there's no such bus.
+ */
+HSTREAM MSE_Mixer::busHandle(const QString &name) const
+{
+    if(name.isEmpty())
+        return handle;
+    MSE_MixerBus* bus = buses.value(name);
+    return bus ? bus->handle : 0;
+}
+
+/*!
+ * Returns true if the bus *name* is *ancestor* itself or is routed into it at any level.
+ */
+bool MSE_Mixer::isBusInside(const QString &name, const QString &ancestor) const
+{
+    QString cur = name;
+    while(!cur.isEmpty())
+    {
+        if(cur == ancestor)
+            return true;
+        cur = buses.value(cur)->parent;
+    }
+    return false;
+}
+
+/*!
+ * Moves the channel into another bus without a gap.
+ */
+bool MSE_Mixer::moveChannel(HSTREAM channel, const QString &bus)
+{
+    // all buses are rendered by the master output,
+    // so while it's locked none of them can miss a block
+    BASS_ChannelLock(handle, true);
+    BASS_Mixer_ChannelRemove(channel);
+    bool result = BASS_Mixer_StreamAddChannel(busHandle(bus), channel, BASS_MIXER_DOWNMIX | BASS_MIXER_NORAMPIN);
+    BASS_ChannelLock(handle, false);
+    CHECK(result, MSE_Object::Err::cannotAddBridge, bus);
+    return true;
+}
+
+void MSE_Mixer::applyBusVolume(const MSE_MixerBus *bus)
+{
+    BASS_ChannelSlideAttribute(bus->handle, BASS_ATTRIB_VOL, bus->muted ? 0 : bus->gain, busRampTime);
+}
+
+/*!
+ * Creates a sidechain ducker.
+ * Add the triggers and the targets to it with addDuckerTrigger(), addDuckerTarget(), etc.
+ * A mixer may have any number of duckers, and a channel may be a part of several duckers.
+ *
+ * The ducker is owned by the mixer.
+ */
+MSE_MixerDucker *MSE_Mixer::addDucker(const MSE_MixerDuckingParams &params)
+{
+    MSE_MixerDucker* ducker = new MSE_MixerDucker(params);
+    duckers.append(ducker);
+    return ducker;
+}
+
+/*!
+ * Removes and deletes the ducker. The targets return to their normal volume immediately.
+ *
+ * Returns true on success.
+ */
+bool MSE_Mixer::removeDucker(MSE_MixerDucker *ducker)
+{
+    CHECK(duckers.contains(ducker), MSE_Object::Err::outOfRange);
+    for(int a=duckerLinks.size()-1; a>=0; a--)
+    {
+        MSE_MixerDuckerLink* link = duckerLinks.at(a);
+        if(link->ducker == ducker)
+        {
+            detachDuckerLink(link);
+            delete duckerLinks.takeAt(a);
+        }
+    }
+    duckers.removeOne(ducker);
+    delete ducker;
+    return true;
+}
+
+/*!
+ * Changes the parameters of the ducker.
+ *
+ * Returns true on success.
+ */
+bool MSE_Mixer::setDuckerParams(MSE_MixerDucker *ducker, const MSE_MixerDuckingParams &params)
+{
+    CHECK(duckers.contains(ducker), MSE_Object::Err::outOfRange);
+    BASS_ChannelLock(handle, true);
+    ducker->setParams(params);
+    BASS_ChannelLock(handle, false);
+    return true;
+}
+
+/*!
+ * Makes the input one of the triggers of the ducker:
+ * while its level is above MSE_MixerDuckingParams::threshold, the targets are ducked.
+ *
+ * Returns true on success.
+ */
+bool MSE_Mixer::addDuckerTrigger(MSE_MixerDucker *ducker, MSE_Sound *sound)
+{
+    CHECK(inputMap.contains(sound), MSE_Object::Err::mixerInputNotFound);
+    return addDuckerLink(ducker, sound, QString(), true);
+}
+
+/*!
+ * Makes the bus one of the triggers of the ducker.
+ *
+ * Returns true on success.
+ */
+bool MSE_Mixer::addDuckerTriggerBus(MSE_MixerDucker *ducker, const QString &bus)
+{
+    CHECK(buses.contains(bus), MSE_Object::Err::outOfRange, bus);
+    return addDuckerLink(ducker, nullptr, bus, true);
+}
+
+/*!
+ * Makes the input one of the targets of the ducker.
+ *
+ * Returns true on success.
+ */
+bool MSE_Mixer::addDuckerTarget(MSE_MixerDucker *ducker, MSE_Sound *sound)
+{
+    CHECK(inputMap.contains(sound), MSE_Object::Err::mixerInputNotFound);
+    return addDuckerLink(ducker, sound, QString(), false);
+}
+
+/*!
+ * Makes the bus one of the targets of the ducker.
+ *
+ * Returns true on success.
+ */
+bool MSE_Mixer::addDuckerTargetBus(MSE_MixerDucker *ducker, const QString &bus)
+{
+    CHECK(buses.contains(bus), MSE_Object::Err::outOfRange, bus);
+    return addDuckerLink(ducker, nullptr, bus, false);
+}
+
+/*!
+ * Removes the input from the triggers and the targets of the ducker.
+ *
+ * Returns true on success.
+ */
+bool MSE_Mixer::removeDuckerInput(MSE_MixerDucker *ducker, MSE_Sound *sound)
+{
+    CHECK(duckers.contains(ducker), MSE_Object::Err::outOfRange);
+    for(int a=duckerLinks.size()-1; a>=0; a--)
+    {
+        MSE_MixerDuckerLink* link = duckerLinks.at(a);
+        if((link->ducker == ducker) && (link->sound == sound))
+        {
+            detachDuckerLink(link);
+            delete duckerLinks.takeAt(a);
+        }
+    }
+    return true;
+}
+
+/*!
+ * Removes the bus from the triggers and the targets of the ducker.
+ *
+ * Returns true on success.
+ */
+bool MSE_Mixer::removeDuckerBus(MSE_MixerDucker *ducker, const QString &bus)
+{
+    CHECK(duckers.contains(ducker), MSE_Object::Err::outOfRange);
+    for(int a=duckerLinks.size()-1; a>=0; a--)
+    {
+        MSE_MixerDuckerLink* link = duckerLinks.at(a);
+        if((link->ducker == ducker) && !link->sound && (link->bus == bus))
+        {
+            detachDuckerLink(link);
+            delete duckerLinks.takeAt(a);
+        }
+    }
+    return true;
+}
+
+bool MSE_Mixer::addDuckerLink(MSE_MixerDucker *ducker, MSE_Sound *sound, const QString &bus, bool isTrigger)
+{
+    CHECK(duckers.contains(ducker), MSE_Object::Err::outOfRange);
+    foreach(const MSE_MixerDuckerLink* link, duckerLinks)
+    {
+        if((link->ducker == ducker) && (link->sound == sound) && (link->bus == bus))
+        {
+            CHECK(link->isTrigger == isTrigger, MSE_Object::Err::invalidState);
+            return true;
+        }
+    }
+
+    MSE_MixerDuckerLink* link = new MSE_MixerDuckerLink(ducker, sound, bus, isTrigger);
+    duckerLinks.append(link);
+    attachDuckerLink(link);
+    return true;
+}
+
+/*!
+ * Installs the ducker's DSP on the channel of the link, if the channel exists.
+ * Inputs that are not open yet get it once their bridge is created.
+ */
+void MSE_Mixer::attachDuckerLink(MSE_MixerDuckerLink *link)
+{
+    if(link->dsp)
+        return;
+
+    HSTREAM channel;
+    if(link->sound)
+    {
+        MSE_MixerInput* input = inputMap.value(link->sound);
+        channel = input ? input->bridge : 0;
+    }
+    else
+    {
+        channel = busHandle(link->bus);
+    }
+    if(!channel)
+        return;
+
+    BASS_ChannelLock(handle, true);
+    link->node = link->ducker->createNode(link->isTrigger, channel);
+    if(link->node)
+    {
+        link->dsp = BASS_ChannelSetDSP(
+            channel,
+            link->isTrigger ? &MSE_MixerDucker::triggerDSPProc : &MSE_MixerDucker::targetDSPProc,
+            link->node,
+            MSE_MixerDucker::dspPriority);
+        if(!link->dsp)
+        {
+            link->ducker->deleteNode(link->node);
+            link->node = nullptr;
+        }
+    }
+    BASS_ChannelLock(handle, false);
+
+    if(link->dsp)
+        link->channel = channel;
+    else
+        SETERROR(MSE_Object::Err::operationFailed);
+}
+
+void MSE_Mixer::detachDuckerLink(MSE_MixerDuckerLink *link)
+{
+    if(!link->dsp)
+        return;
+    BASS_ChannelLock(handle, true);
+    BASS_ChannelRemoveDSP(link->channel, link->dsp);
+    link->ducker->deleteNode(link->node);
+    BASS_ChannelLock(handle, false);
+    link->dsp = 0;
+    link->channel = 0;
+    link->node = nullptr;
+}
+
+void MSE_Mixer::attachDuckerLinks(MSE_Sound *sound, const QString &bus)
+{
+    foreach(MSE_MixerDuckerLink* link, duckerLinks)
+        if((link->sound == sound) && (link->bus == bus))
+            attachDuckerLink(link);
+}
+
+/*!
+ * Detaches the links of the input or the bus from its channel.
+ * If *drop* is true, the links are deleted too.
+ */
+void MSE_Mixer::detachDuckerLinks(MSE_Sound *sound, const QString &bus, bool drop)
+{
+    for(int a=duckerLinks.size()-1; a>=0; a--)
+    {
+        MSE_MixerDuckerLink* link = duckerLinks.at(a);
+        if((link->sound == sound) && (link->bus == bus))
+        {
+            detachDuckerLink(link);
+            if(drop)
+                delete duckerLinks.takeAt(a);
+        }
+    }
+}
 
 /*!
  * Starts mixing.
@@ -213,7 +771,8 @@ bool MSE_Mixer::stop()
  */
 void MSE_Mixer::refreshVolume()
 {
-    if(handle)
+    // the attribute is zero while muted, but the volume is kept
+    if(handle && !muted)
     {
         if(!BASS_ChannelGetAttribute(handle, BASS_ATTRIB_VOL, &volume))
             volume = 0;
@@ -237,7 +796,7 @@ bool MSE_Mixer::setVolume(float value)
     }
     volume = value;
     if(handle)
-        return BASS_ChannelSetAttribute(handle, BASS_ATTRIB_VOL, volume);
+        return BASS_ChannelSetAttribute(handle, BASS_ATTRIB_VOL, muted ? 0 : volume);
     else
         return true;
 }
@@ -260,58 +819,76 @@ bool MSE_Mixer::changeVolume(float diff, bool snapToGrid)
 
 void MSE_Mixer::onSoundDestroyed(QObject *obj)
 {
-    MSE_Sound* sound = qobject_cast<MSE_Sound*>(obj);
-    if(!sound)
-        return;
-    removeInput(sound);
+    // the object is half-destroyed already, so qobject_cast won't work,
+    // but the pointer is still good as a key
+    removeInput(static_cast<MSE_Sound*>(obj));
 }
 
 void MSE_Mixer::onSoundOpen()
 {
-    MSE_Sound* sound = qobject_cast<MSE_Sound*>(sender());
-    if(!sound)
-        return;
-    foreach(MSE_MixerInput* input, inputs)
-    {
-        if(input->sound == sound)
-        {
-            if(input->bridge)
-            {
-                BASS_Mixer_ChannelRemove(input->bridge);
-                BASS_StreamFree(input->bridge);
-            }
-
-            DWORD flags = defaultBridgeFlags;
-
-            switch(sound->getInitParams().sampleType)
-            {
-                case mse_sst8Bits:
-                    flags |= BASS_SAMPLE_8BITS;
-                    break;
-                case mse_sstFloat32:
-                    flags |= BASS_SAMPLE_FLOAT;
-                    break;
-                default:
-                    break;
-            }
-
-            input->bridge = BASS_StreamCreate(
-                        input->sound->getFrequency(),
-                        input->sound->getChannelsCount(),
-                        flags, &streamProc, input);
-            CHECKV(input->bridge, MSE_Object::Err::bridgeCreationFail);
-
-            BASS_ChannelSetAttribute(input->bridge, BASS_ATTRIB_SRC, input->sound->getSampleRateConversion());
-
-            if(!BASS_Mixer_StreamAddChannel(handle, input->bridge, BASS_MIXER_DOWNMIX | BASS_MIXER_NORAMPIN))
-            {
-                SETERROR(MSE_Object::Err::cannotAddBridge);
-                BASS_StreamFree(input->bridge);
-                return;
-            }
+    MSE_MixerInput* input = inputMap.value(qobject_cast<MSE_Sound*>(sender()));
+    if(input)
+        updateBridge(input);
+}
 
-            BASS_ChannelSetAttribute(input->bridge, BASS_ATTRIB_VOL, sound->getVolume());
+/*!
+ * Connects the input to the mixer according to the current format of its sound.
+ * The existing bridge is kept if the sample rate, the number of channels and the sample type
+ * are still the same, so most track changes don't touch the mixer at all.
+ */
+void MSE_Mixer::updateBridge(MSE_MixerInput *input)
+{
+    MSE_Sound* sound = input->sound;
+    DWORD flags = defaultBridgeFlags;
+    switch(sound->getInitParams().sampleType)
+    {
+        case mse_sst8Bits:
+            flags |= BASS_SAMPLE_8BITS;
             break;
-        }
+        case mse_sstFloat32:
+            flags |= BASS_SAMPLE_FLOAT;
+            break;
+        default:
+            break;
+    }
+    DWORD frequency = sound->getFrequency();
+    DWORD nChannels = sound->getChannelsCount();
+
+    if(input->bridge
+        && (input->bridgeFrequency == frequency)
+        && (input->bridgeChannels == nChannels)
+        && (input->bridgeFlags == flags))
+    {
+        BASS_ChannelSetAttribute(input->bridge, BASS_ATTRIB_SRC, sound->getSampleRateConversion());
+        return;
+    }
+
+    freeBridge(input);
+    input->bridge = BASS_StreamCreate(frequency, nChannels, flags, &streamProc, input);
+    CHECKV(input->bridge, MSE_Object::Err::bridgeCreationFail);
+    input->bridgeFrequency = frequency;
+    input->bridgeChannels = nChannels;
+    input->bridgeFlags = flags;
+
+    BASS_ChannelSetAttribute(input->bridge, BASS_ATTRIB_SRC, sound->getSampleRateConversion());
+
+    if(!BASS_Mixer_StreamAddChannel(busHandle(input->bus), input->bridge, BASS_MIXER_DOWNMIX | BASS_MIXER_NORAMPIN))
+    {
+        SETERROR(MSE_Object::Err::cannotAddBridge);
+        freeBridge(input);
+        return;
     }
+
+    BASS_ChannelSetAttribute(input->bridge, BASS_ATTRIB_VOL, sound->getVolume());
+    attachDuckerLinks(sound, QString());
+}
+
+void MSE_Mixer::freeBridge(MSE_MixerInput *input)
+{
+    if(!input->bridge)
+        return;
+    detachDuckerLinks(input->sound, QString(), false);
+    BASS_Mixer_ChannelRemove(input->bridge);
+    BASS_StreamFree(input->bridge);
+    input->bridge = 0;
 }
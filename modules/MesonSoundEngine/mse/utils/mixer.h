@@ -19,9 +19,13 @@
 
 #include "mse/types.h"
 #include "mse/sound.h"
+#include "mse/utils/mixer_tap.h"
+#include "mse/utils/mixer_ducker.h"
 
 #include "mse/bass/bassmix.h"
 
+#include <QHash>
+
 /*!
  * Parameters for MSE_Mixer initialization.
  */
@@ -81,6 +85,15 @@ struct MSE_MixerInitParams {
     **Valid values**: 192000, 96000, 48000, 44100, 22050, 16000, 11025, 8000
 
     **Default**: 44100
+*/
+    int tapBufferLength = 2000; /*!<
+    Length (in milliseconds) of the buffer that is shared by all output taps.
+    A tap that falls behind the mixer by more than this
+    loses data according to its MSE_MixerTapOverflow policy.
+
+    **Default**: 2000
+
+    \sa MSE_Mixer::addTap
 */
 };
 
@@ -94,10 +107,50 @@ struct MSE_MixerInput {
     HSTREAM bridge; /*!<
     A bridge stream between the MSE_MixerInput::sound and the mixer. Only used internally. Must not be changed by user.
 */
+    DWORD bridgeFrequency; /*!<
+    Sample rate of the MSE_MixerInput::bridge. Only used internally.
+*/
+    DWORD bridgeChannels; /*!<
+    Number of channels of the MSE_MixerInput::bridge. Only used internally.
+*/
+    DWORD bridgeFlags; /*!<
+    Creation flags of the MSE_MixerInput::bridge. Only used internally.
+*/
+    QString bus; /*!<
+    Name of the MSE_MixerBus the input is routed to. Empty for the master output.
+
+    \sa MSE_Mixer::setInputBus
+*/
 
     MSE_MixerInput(MSE_Sound* sound):
         sound(sound),
-        bridge(0){}
+        bridge(0),
+        bridgeFrequency(0),
+        bridgeChannels(0),
+        bridgeFlags(0){}
+};
+
+/*!
+ * A submix bus of MSE_Mixer.
+ *
+ * The inputs and other buses are mixed into the bus,
+ * and the result is mixed into its parent bus or into the master output.
+ */
+struct MSE_MixerBus {
+    QString name; /*!< Unique name of the bus. */
+    QString parent; /*!< Name of the parent bus. Empty for the master output. */
+    HSTREAM handle; /*!<
+    The mixer stream of the bus. Only used internally. Must not be changed by user.
+*/
+    float gain; /*!< Volume of the bus (0..1). */
+    bool muted; /*!< True if the bus is muted. */
+
+    MSE_MixerBus(const QString& name, const QString& parent):
+        name(name),
+        parent(parent),
+        handle(0),
+        gain(1),
+        muted(false){}
 };
 
 /*!
@@ -130,10 +183,63 @@ public:
     bool removeInput(MSE_Sound* sound);
     inline int getInputsCount() const {return inputs.size();}
     inline MSE_MixerInput* getInput(int index) const {return inputs.at(index);}
-    MSE_MixerInput *getInput(MSE_Sound* sound) const;
+
+    /*!
+     * Returns MSE_MixerInput object that corresponds to the specified MSE_Sound object
+     * or nullptr if the specified MSE_Sound object is not amongst this mixer's inputs.
+     */
+    inline MSE_MixerInput *getInput(MSE_Sound* sound) const {return inputMap.value(sound);}
 
     int getData(char *buffer, int length);
 
+    MSE_MixerTap* addTap(MSE_MixerTapOverflow overflow = mse_mtoDropOldest);
+    bool removeTap(MSE_MixerTap* tap);
+
+    /*!
+     * Returns the number of output taps.
+     */
+    inline int getTapsCount() const {return taps.size();}
+
+    static const int tapDSPPriority;
+
+    bool addBus(const QString& name, const QString& parent = QString());
+    bool removeBus(const QString& name);
+    bool setBusParent(const QString& name, const QString& parent);
+    bool setInputBus(MSE_Sound* sound, const QString& bus);
+
+    /*!
+     * Returns the bus with the specified name or nullptr if there's no such bus.
+     */
+    inline const MSE_MixerBus* getBus(const QString& name) const {return buses.value(name);}
+
+    /*!
+     * Returns the names of all buses.
+     */
+    inline QStringList getBusNames() const {return buses.keys();}
+
+    bool setBusGain(const QString& name, float gain);
+    bool setBusMuted(const QString& name, bool muted);
+
+    /*!
+     * Returns true if the master output is muted.
+     */
+    inline bool isMuted() const {return muted;}
+
+    HDSP addBusDSP(const QString& name, DSPPROC* proc, void* user, int priority = 0);
+    bool removeBusDSP(const QString& name, HDSP dsp);
+
+    static const int busRampTime;
+
+    MSE_MixerDucker* addDucker(const MSE_MixerDuckingParams& params = MSE_MixerDuckingParams());
+    bool removeDucker(MSE_MixerDucker* ducker);
+    bool setDuckerParams(MSE_MixerDucker* ducker, const MSE_MixerDuckingParams& params);
+    bool addDuckerTrigger(MSE_MixerDucker* ducker, MSE_Sound* sound);
+    bool addDuckerTriggerBus(MSE_MixerDucker* ducker, const QString& bus);
+    bool addDuckerTarget(MSE_MixerDucker* ducker, MSE_Sound* sound);
+    bool addDuckerTargetBus(MSE_MixerDucker* ducker, const QString& bus);
+    bool removeDuckerInput(MSE_MixerDucker* ducker, MSE_Sound* sound);
+    bool removeDuckerBus(MSE_MixerDucker* ducker, const QString& bus);
+
     bool play();
     bool pause();
     bool unpause();
@@ -148,11 +254,32 @@ protected:
     MSE_Engine* engine;
     HSTREAM handle;
     MSE_MixerInputs inputs;
+    QHash<MSE_Sound*, MSE_MixerInput*> inputMap;
+    QHash<QString, MSE_MixerBus*> buses;
+    bool muted;
+    QList<MSE_MixerDucker*> duckers;
+    QList<MSE_MixerDuckerLink*> duckerLinks;
     MSE_MixerInitParams initParams;
     DWORD defaultBridgeFlags;
     float volume;
+    QScopedPointer<MSE_MixerTapBuffer> tapBuffer;
+    QList<MSE_MixerTap*> taps;
+    HDSP tapDsp;
 
     int getFrequency(MSE_Sound* sound);
+    void updateBridge(MSE_MixerInput* input);
+    void freeBridge(MSE_MixerInput* input);
+    HSTREAM busHandle(const QString& name) const;
+    bool isBusInside(const QString& name, const QString& ancestor) const;
+    bool moveChannel(HSTREAM channel, const QString& bus);
+    void applyBusVolume(const MSE_MixerBus* bus);
+    bool addDuckerLink(MSE_MixerDucker* ducker, MSE_Sound* sound, const QString& bus, bool isTrigger);
+    void attachDuckerLink(MSE_MixerDuckerLink* link);
+    void detachDuckerLink(MSE_MixerDuckerLink* link);
+    void attachDuckerLinks(MSE_Sound* sound, const QString& bus);
+    void detachDuckerLinks(MSE_Sound* sound, const QString& bus, bool drop);
+
+    static void CALLBACK tapDSPProc(HDSP handle, DWORD channel, void *buffer, DWORD length, void *user);
 
 protected slots:
     void onSoundDestroyed(QObject* obj);
@@ -0,0 +1,193 @@
+#include "mse/utils/mixer_ducker.h"
+
+#include <cmath>
+
+const int MSE_MixerDucker::dspPriority = -100000; // after the user's DSP, before the output taps
+const int MSE_MixerDucker::staleLevelTime = 250; // ms, a trigger that hasn't played for this long is silent
+
+MSE_MixerDucker::MSE_MixerDucker(const MSE_MixerDuckingParams &params):
+    gain(1)
+{
+    clock.start();
+    setParams(params);
+}
+
+MSE_MixerDucker::~MSE_MixerDucker()
+{
+    qDeleteAll(nodes);
+}
+
+/*!
+ * Must be called while the mixer is locked.
+ */
+void MSE_MixerDucker::setParams(const MSE_MixerDuckingParams &params)
+{
+    this->params = params;
+    this->params.attack = qMax(0, params.attack);
+    this->params.release = qMax(0, params.release);
+    this->params.hold = qMax(0, params.hold);
+    thresholdLevel = std::pow(10.0f, params.threshold / 20);
+    depthGain = qMin(1.0f, std::pow(10.0f, params.depth / 20));
+}
+
+/*!
+ * Must be called while the mixer is locked.
+ */
+MSE_MixerDucker::Node *MSE_MixerDucker::createNode(bool isTrigger, HSTREAM channel)
+{
+    BASS_CHANNELINFO info;
+    if(!BASS_ChannelGetInfo(channel, &info) || !info.chans || !info.freq)
+        return nullptr;
+
+    Node* node = new Node;
+    node->ducker = this;
+    node->isTrigger = isTrigger;
+    if(info.flags & BASS_SAMPLE_FLOAT)
+        node->sampleType = mse_sstFloat32;
+    else if(info.flags & BASS_SAMPLE_8BITS)
+        node->sampleType = mse_sst8Bits;
+    else
+        node->sampleType = mse_sstNormal;
+    node->nChannels = info.chans;
+    node->frequency = info.freq;
+    node->level = 0;
+    node->levelTime = 0;
+    node->gain = 1;
+    node->holdLeft = 0;
+    nodes.append(node);
+    return node;
+}
+
+/*!
+ * Must be called while the mixer is locked, after the DSP of the node is removed.
+ */
+void MSE_MixerDucker::deleteNode(Node *node)
+{
+    nodes.removeOne(node);
+    delete node;
+}
+
+void MSE_MixerDucker::triggerDSPProc(HDSP handle, DWORD channel, void *buffer, DWORD length, void *user)
+{
+    Q_UNUSED(handle);
+    Q_UNUSED(channel);
+    Node* node = static_cast<Node*>(user);
+    node->ducker->processTrigger(node, buffer, length);
+}
+
+void MSE_MixerDucker::targetDSPProc(HDSP handle, DWORD channel, void *buffer, DWORD length, void *user)
+{
+    Q_UNUSED(handle);
+    Q_UNUSED(channel);
+    Node* node = static_cast<Node*>(user);
+    node->ducker->processTarget(node, buffer, length);
+}
+
+void MSE_MixerDucker::processTrigger(Node *node, const void *buffer, DWORD length)
+{
+    double sum = 0;
+    int n = 0;
+    switch(node->sampleType)
+    {
+        case mse_sstFloat32:
+        {
+            const float* p = static_cast<const float*>(buffer);
+            n = length / sizeof(float);
+            for(int a=0; a<n; a++)
+                sum += p[a] * p[a];
+            break;
+        }
+
+        case mse_sst8Bits:
+        {
+            const quint8* p = static_cast<const quint8*>(buffer);
+            n = length;
+            for(int a=0; a<n; a++)
+            {
+                float v = (p[a] - 128) / 128.0f;
+                sum += v * v;
+            }
+            break;
+        }
+
+        default:
+        {
+            const qint16* p = static_cast<const qint16*>(buffer);
+            n = length / sizeof(qint16);
+            for(int a=0; a<n; a++)
+            {
+                float v = p[a] / 32768.0f;
+                sum += v * v;
+            }
+            break;
+        }
+    }
+    node->level = n ? std::sqrt(sum / n) : 0;
+    node->levelTime = clock.elapsed();
+}
+
+void MSE_MixerDucker::processTarget(Node *node, void *buffer, DWORD length)
+{
+    // a stopped or paused trigger is not pulled by the mixer anymore,
+    // so its DSP isn't called and the last level would stay forever
+    qint64 now = clock.elapsed();
+    float level = 0;
+    foreach(const Node* trigger, nodes)
+        if(trigger->isTrigger && (now - trigger->levelTime < staleLevelTime))
+            level = qMax(level, trigger->level);
+
+    int sampleSize = (node->sampleType == mse_sstFloat32) ? 4 : ((node->sampleType == mse_sst8Bits) ? 1 : 2);
+    int nFrames = length / (sampleSize * node->nChannels);
+
+    if(level >= thresholdLevel)
+        node->holdLeft = static_cast<qint64>(params.hold * node->frequency / 1000);
+    float target = (node->holdLeft > 0) ? depthGain : 1;
+    node->holdLeft = qMax(static_cast<qint64>(0), node->holdLeft - nFrames);
+
+    if((node->gain == 1) && (target == 1))
+    {
+        gain.store(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // one-pole smoothing per frame
+    float attackCoef = params.attack ? std::exp(-1000.0f / (params.attack * node->frequency)) : 0;
+    float releaseCoef = params.release ? std::exp(-1000.0f / (params.release * node->frequency)) : 0;
+    float coef = (target < node->gain) ? attackCoef : releaseCoef;
+    float g = node->gain;
+
+    for(int f=0; f<nFrames; f++)
+    {
+        g = target + (g - target) * coef;
+        for(int c=0; c<node->nChannels; c++)
+        {
+            int i = f * node->nChannels + c;
+            switch(node->sampleType)
+            {
+                case mse_sstFloat32:
+                    static_cast<float*>(buffer)[i] *= g;
+                    break;
+
+                case mse_sst8Bits:
+                {
+                    quint8* p = static_cast<quint8*>(buffer) + i;
+                    *p = static_cast<quint8>(qBound(0, qRound((*p - 128) * g) + 128, 255));
+                    break;
+                }
+
+                default:
+                {
+                    qint16* p = static_cast<qint16*>(buffer) + i;
+                    *p = static_cast<qint16>(qRound(*p * g));
+                    break;
+                }
+            }
+        }
+    }
+
+    // snap to unity once the release is practically over
+    if((target == 1) && (g > 0.9999f))
+        g = 1;
+    node->gain = g;
+    gain.store(g, std::memory_order_relaxed);
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "mse/types.h"
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QString>
+
+#include <atomic>
+
+/*!
+ * Parameters of MSE_MixerDucker.
+ */
+struct MSE_MixerDuckingParams {
+    float threshold = -30; /*!<
+    RMS level of the triggers (in dBFS) above which the targets are ducked.
+
+    **Default**: -30
+*/
+    float depth = -12; /*!<
+    Gain (in dB) applied to the targets while they are ducked.
+
+    **Default**: -12
+*/
+    int attack = 50; /*!<
+    Time constant (in milliseconds) of the gain going down.
+
+    **Default**: 50
+*/
+    int release = 500; /*!<
+    Time constant (in milliseconds) of the gain going back up.
+
+    **Default**: 500
+*/
+    int hold = 300; /*!<
+    The targets stay ducked for this many milliseconds after the triggers fall below the threshold,
+    so short pauses (e.g. between words) don't pump the targets.
+
+    **Default**: 300
+*/
+};
+
+/*!
+ * Sidechain ducker of MSE_Mixer.
+ *
+ * The signal of the trigger channels lowers the volume of the target channels.
+ * Everything is computed in the DSP functions of the channels on the mixing thread,
+ * and the gain is ramped per sample, so there are no zipper noises.
+ *
+ * \sa MSE_Mixer::addDucker
+ */
+class MSE_MixerDucker
+{
+public:
+    /*!
+     * State of one trigger or target channel. Only used internally.
+     */
+    struct Node {
+        MSE_MixerDucker* ducker;
+        bool isTrigger;
+        MSE_SoundSampleType sampleType;
+        int nChannels;
+        float frequency;
+        float level; // last block RMS of a trigger
+        qint64 levelTime; // when the level was measured, see MSE_MixerDucker::clock
+        float gain; // current gain of a target
+        qint64 holdLeft; // frames until a target may be released
+    };
+
+    explicit MSE_MixerDucker(const MSE_MixerDuckingParams& params);
+    ~MSE_MixerDucker();
+
+    /*!
+     * Returns the current parameters.
+     */
+    inline const MSE_MixerDuckingParams& getParams() const {return params;}
+
+    /*!
+     * Returns the gain (0..1) that was last applied to the targets.
+     * May be called from any thread.
+     */
+    inline float getGain() const {return gain.load(std::memory_order_relaxed);}
+
+    static const int dspPriority;
+    static const int staleLevelTime;
+
+protected:
+    MSE_MixerDuckingParams params;
+    float thresholdLevel;
+    float depthGain;
+    QList<Node*> nodes;
+    std::atomic<float> gain;
+    QElapsedTimer clock;
+
+    void setParams(const MSE_MixerDuckingParams& params);
+    Node* createNode(bool isTrigger, HSTREAM channel);
+    void deleteNode(Node* node);
+
+    void processTrigger(Node* node, const void* buffer, DWORD length);
+    void processTarget(Node* node, void* buffer, DWORD length);
+
+    static void CALLBACK triggerDSPProc(HDSP handle, DWORD channel, void *buffer, DWORD length, void *user);
+    static void CALLBACK targetDSPProc(HDSP handle, DWORD channel, void *buffer, DWORD length, void *user);
+
+    friend class MSE_Mixer;
+};
+
+/*!
+ * Connection between MSE_MixerDucker and a mixer input or bus. Only used internally.
+ */
+struct MSE_MixerDuckerLink {
+    MSE_MixerDucker* ducker;
+    MSE_Sound* sound; // nullptr for a bus
+    QString bus;
+    bool isTrigger;
+    HSTREAM channel;
+    HDSP dsp;
+    MSE_MixerDucker::Node* node;
+
+    MSE_MixerDuckerLink(MSE_MixerDucker* ducker, MSE_Sound* sound, const QString& bus, bool isTrigger):
+        ducker(ducker),
+        sound(sound),
+        bus(bus),
+        isTrigger(isTrigger),
+        channel(0),
+        dsp(0),
+        node(nullptr){}
+};
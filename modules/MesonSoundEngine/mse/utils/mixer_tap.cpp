@@ -0,0 +1,254 @@
+#include "mse/utils/mixer_tap.h"
+
+#include <QElapsedTimer>
+
+#include <climits>
+#include <cstring>
+
+MSE_MixerTapBuffer::MSE_MixerTapBuffer(qint64 capacity, int blockAlign):
+    capacity(0),
+    blockAlign(qMax(1, blockAlign)),
+    head(0),
+    reserved(0),
+    nWaiting(0)
+{
+    // whole sample frames only, so the taps never get split samples
+    capacity -= capacity % this->blockAlign;
+    if(capacity > 0)
+    {
+        data.reset(new (std::nothrow) char[capacity]);
+        if(data)
+            this->capacity = capacity;
+    }
+}
+
+/*!
+ * Appends the mixed data. Never blocks; the data the taps haven't read yet may be overwritten.
+ */
+void MSE_MixerTapBuffer::write(const char *src, qint64 len)
+{
+    if((len <= 0) || !capacity)
+        return;
+
+    quint64 start = head.load(std::memory_order_relaxed);
+    if(len > capacity)
+    {
+        start += len - capacity;
+        src += len - capacity;
+        len = capacity;
+    }
+
+    // announce the region first, so the readers can tell that their data is being overwritten
+    reserved.store(start + len, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    qint64 pos = start % capacity;
+    qint64 firstLen = qMin(len, capacity - pos);
+    memcpy(data.get() + pos, src, firstLen);
+    if(firstLen < len)
+        memcpy(data.get(), src + firstLen, len - firstLen);
+
+    head.store(start + len, std::memory_order_release);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(nWaiting.load(std::memory_order_relaxed))
+        wakeAll();
+}
+
+/*!
+ * Wakes up all taps that are blocked in MSE_MixerTap::waitForData().
+ */
+void MSE_MixerTapBuffer::wakeAll()
+{
+    QMutexLocker locker(&waitMutex);
+    waitCondition.wakeAll();
+}
+
+MSE_MixerTap::MSE_MixerTap(MSE_MixerTapBuffer *buffer, MSE_MixerTapOverflow overflow):
+    buffer(buffer),
+    overflow(overflow),
+    cursor(buffer->getTotalWritten()),
+    closed(false),
+    totalRead(0),
+    overruns(0),
+    droppedBytes(0)
+{
+}
+
+/*!
+ * Returns true if the mixer has overwritten the data the tap hasn't read yet.
+ * The read position is moved according to the overflow policy in this case.
+ */
+bool MSE_MixerTap::checkOverrun()
+{
+    if(buffer->reserved.load(std::memory_order_acquire) - cursor <= static_cast<quint64>(buffer->capacity))
+        return false;
+    recover();
+    return true;
+}
+
+void MSE_MixerTap::recover()
+{
+    quint64 h = buffer->head.load(std::memory_order_acquire);
+    quint64 newCursor = h;
+    switch(overflow)
+    {
+        case mse_mtoDropOldest:
+        {
+            quint64 keep = buffer->capacity / 2;
+            keep -= keep % buffer->blockAlign;
+            newCursor = qMax(cursor, h - keep);
+            break;
+        }
+
+        case mse_mtoClose:
+            closed.store(true, std::memory_order_release);
+            break;
+
+        default:
+            break;
+    }
+
+    overruns.fetch_add(1, std::memory_order_relaxed);
+    droppedBytes.fetch_add(newCursor - cursor, std::memory_order_relaxed);
+    cursor = newCursor;
+}
+
+/*!
+ * Returns the number of bytes that can be read.
+ */
+qint64 MSE_MixerTap::bytesAvailable()
+{
+    if(isClosed())
+        return 0;
+    checkOverrun();
+    if(isClosed())
+        return 0;
+    return buffer->head.load(std::memory_order_acquire) - cursor;
+}
+
+/*!
+ * Returns the pointer to the first unread byte in the shared buffer.
+ * *len* receives the number of bytes that can be read contiguously starting from that pointer.
+ * Call commitRead() after processing the data.
+ */
+const char *MSE_MixerTap::readSpan(qint64 &len)
+{
+    len = bytesAvailable();
+    if(!len)
+        return nullptr;
+    qint64 pos = cursor % buffer->capacity;
+    len = qMin(len, buffer->capacity - pos);
+    return buffer->data.get() + pos;
+}
+
+/*!
+ * Marks *len* bytes as read.
+ * Returns false if the mixer has overwritten the span while it was being processed.
+ * The processed data must be thrown away in this case,
+ * and the read position is moved according to the overflow policy.
+ */
+bool MSE_MixerTap::commitRead(qint64 len)
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(checkOverrun())
+        return false;
+    cursor += len;
+    totalRead.fetch_add(len, std::memory_order_relaxed);
+    return true;
+}
+
+/*!
+ * Copies up to *maxSize* bytes into *dest*.
+ * Returns the number of bytes copied.
+ */
+qint64 MSE_MixerTap::read(char *dest, qint64 maxSize)
+{
+    qint64 n = 0;
+    while(n < maxSize)
+    {
+        qint64 len;
+        const char* span = readSpan(len);
+        if(!span)
+            break;
+        len = qMin(len, maxSize - n);
+        memcpy(dest + n, span, len);
+        if(!commitRead(len))
+            break;
+        n += len;
+    }
+    return n;
+}
+
+/*!
+ * Blocks until at least *minBytes* bytes are available.
+ * *timeout* is in milliseconds, negative value means no timeout.
+ * Returns false if the time is out or the tap was closed.
+ */
+bool MSE_MixerTap::waitForData(qint64 minBytes, int timeout)
+{
+    minBytes = qMin(minBytes, buffer->capacity / 2);
+    if(bytesAvailable() >= minBytes)
+        return true;
+    if(isClosed() || !timeout)
+        return false;
+
+    QElapsedTimer timer;
+    timer.start();
+    QMutexLocker locker(&buffer->waitMutex);
+    buffer->nWaiting.fetch_add(1, std::memory_order_relaxed);
+    bool result;
+    forever
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if(isClosed())
+        {
+            result = false;
+            break;
+        }
+        if(bytesAvailable() >= minBytes)
+        {
+            result = true;
+            break;
+        }
+
+        if(timeout < 0)
+        {
+            buffer->waitCondition.wait(&buffer->waitMutex, ULONG_MAX);
+        }
+        else
+        {
+            qint64 remaining = timeout - timer.elapsed();
+            if(remaining <= 0)
+            {
+                result = false;
+                break;
+            }
+            buffer->waitCondition.wait(&buffer->waitMutex, static_cast<unsigned long>(remaining));
+        }
+    }
+    buffer->nWaiting.fetch_sub(1, std::memory_order_relaxed);
+    return result;
+}
+
+/*!
+ * Closes the tap and wakes up the thread that waits for its data.
+ */
+void MSE_MixerTap::close()
+{
+    closed.store(true, std::memory_order_release);
+    buffer->wakeAll();
+}
+
+/*!
+ * Returns the statistics of the tap.
+ */
+MSE_MixerTapStats MSE_MixerTap::getStats() const
+{
+    MSE_MixerTapStats stats;
+    stats.totalRead = totalRead.load(std::memory_order_relaxed);
+    stats.overruns = overruns.load(std::memory_order_relaxed);
+    stats.droppedBytes = droppedBytes.load(std::memory_order_relaxed);
+    return stats;
+}
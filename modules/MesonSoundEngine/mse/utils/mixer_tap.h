@@ -0,0 +1,124 @@
+#pragma once
+
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <memory>
+
+/*!
+ * What happens when a MSE_MixerTap falls behind by more than the size of the shared buffer.
+ * The mixer never waits for the taps, so the data that the tap hasn't read is overwritten.
+ */
+enum MSE_MixerTapOverflow {
+    mse_mtoDropOldest, /*!<
+    Skip the oldest data, so the tap continues from the middle of the buffer.
+    Suits recorders: as much data as possible is kept.
+*/
+    mse_mtoSkipToLatest, /*!<
+    Skip all buffered data, so the tap continues with the next mixed block.
+    Suits analyzers and meters that only need the latest audio.
+*/
+    mse_mtoClose /*!<
+    Close the tap. All further reads return nothing.
+    Suits sinks that can't tolerate any gaps.
+*/
+};
+
+/*!
+ * Mixed audio shared between all taps of MSE_Mixer.
+ *
+ * It's written by the mixer thread only. The writer never blocks,
+ * and every tap has its own read position.
+ */
+class MSE_MixerTapBuffer
+{
+public:
+    explicit MSE_MixerTapBuffer(qint64 capacity, int blockAlign);
+
+    void write(const char* src, qint64 len);
+
+    /*!
+     * Returns the capacity in bytes.
+     */
+    inline qint64 getCapacity() const {return capacity;}
+
+    /*!
+     * Returns the size of one sample frame (all channels) in bytes.
+     */
+    inline int getBlockAlign() const {return blockAlign;}
+
+    /*!
+     * Returns the number of bytes written since the buffer was created.
+     */
+    inline quint64 getTotalWritten() const {return head.load(std::memory_order_acquire);}
+
+    void wakeAll();
+
+protected:
+    std::unique_ptr<char[]> data;
+    qint64 capacity;
+    int blockAlign;
+
+    std::atomic<quint64> head; // end of the completely written data
+    std::atomic<quint64> reserved; // end of the data that is being written
+    std::atomic<int> nWaiting;
+    QMutex waitMutex;
+    QWaitCondition waitCondition;
+
+    friend class MSE_MixerTap;
+};
+
+/*!
+ * Statistics of MSE_MixerTap.
+ */
+struct MSE_MixerTapStats {
+    quint64 totalRead = 0; /*!< Number of bytes read by the tap. */
+    quint64 overruns = 0; /*!< Number of times the tap has fallen behind the mixer. */
+    quint64 droppedBytes = 0; /*!< Number of bytes the tap has missed because of the overruns. */
+};
+
+/*!
+ * One consumer of the mixer output, see MSE_Mixer::addTap().
+ *
+ * The data can be processed in place with readSpan()/commitRead(),
+ * the span points directly into the buffer shared by all taps.
+ * Each tap must be read from one thread at a time.
+ */
+class MSE_MixerTap
+{
+public:
+    explicit MSE_MixerTap(MSE_MixerTapBuffer* buffer, MSE_MixerTapOverflow overflow);
+
+    qint64 bytesAvailable();
+    const char* readSpan(qint64& len);
+    bool commitRead(qint64 len);
+    qint64 read(char* dest, qint64 maxSize);
+    bool waitForData(qint64 minBytes, int timeout = -1);
+
+    void close();
+
+    /*!
+     * Returns true if the tap was closed by close() or by the ::mse_mtoClose policy.
+     */
+    inline bool isClosed() const {return closed.load(std::memory_order_acquire);}
+
+    /*!
+     * Returns the overflow policy of the tap.
+     */
+    inline MSE_MixerTapOverflow getOverflow() const {return overflow;}
+
+    MSE_MixerTapStats getStats() const;
+
+protected:
+    MSE_MixerTapBuffer* buffer;
+    MSE_MixerTapOverflow overflow;
+    quint64 cursor;
+    std::atomic<bool> closed;
+    std::atomic<quint64> totalRead;
+    std::atomic<quint64> overruns;
+    std::atomic<quint64> droppedBytes;
+
+    bool checkOverrun();
+    void recover();
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <QList>
+#include <QVector>
+
+/*!
+ * Token bucket that limits a data flow to a fixed rate after an initial burst.
+ * The time is in nanoseconds of a monotonic clock (e.g. QElapsedTimer::nsecsElapsed()).
+ */
+struct MSE_TokenBucket {
+    double tokens = 0; /*!< Number of bytes that can be sent right now. */
+    double capacity = 0; /*!< Maximum number of tokens, i.e. the largest burst. */
+    qint64 lastRefill = 0; /*!< Time of the last refill. */
+
+    /*!
+     * Starts with *tokens* available (the initial burst).
+     */
+    inline void reset(double tokens, double capacity, qint64 now)
+    {
+        this->tokens = tokens;
+        this->capacity = capacity;
+        lastRefill = now;
+    }
+
+    /*!
+     * Adds the tokens accumulated since the last refill at *rate* bytes per second.
+     */
+    inline void refill(double rate, qint64 now)
+    {
+        if(now > lastRefill)
+            tokens = qMin(capacity, tokens + rate * (now - lastRefill) / 1e9);
+        lastRefill = now;
+    }
+
+    /*!
+     * Returns the number of whole bytes that can be sent.
+     */
+    inline qint64 available() const {return tokens > 0 ? static_cast<qint64>(tokens) : 0;}
+
+    inline void consume(qint64 n) {tokens -= n;}
+
+    /*!
+     * Returns the time (in nanoseconds) until *amount* tokens are available at *rate* bytes per second.
+     */
+    inline qint64 timeUntil(double amount, double rate) const
+    {
+        if((tokens >= amount) || (rate <= 0))
+            return 0;
+        return static_cast<qint64>((amount - tokens) * 1e9 / rate);
+    }
+};
+
+/*!
+ * Hashed timer wheel.
+ *
+ * The items are put into the slots by their due time,
+ * so every tick only touches the items that are due, no matter how many are waiting.
+ * The items are never fired early; they can be late by up to one resolution step.
+ * The delays longer than the wheel span fire after the span, so the item must reschedule itself.
+ */
+template<typename T>
+class MSE_TimerWheel
+{
+public:
+    MSE_TimerWheel(int nSlots, qint64 resolution) :
+        slots(qMax(2, nSlots)),
+        resolution(resolution),
+        current(0),
+        currentTime(0){}
+
+    inline qint64 getResolution() const {return resolution;}
+
+    /*!
+     * Drops all items and sets the current time.
+     */
+    void reset(qint64 now)
+    {
+        for(QList<T>& slot : slots)
+            slot.clear();
+        current = 0;
+        currentTime = now;
+    }
+
+    /*!
+     * Schedules the *item* at *when*. Returns the slot to pass to cancel().
+     */
+    int schedule(const T& item, qint64 when)
+    {
+        qint64 ticks = (when - currentTime + resolution - 1) / resolution;
+        ticks = qBound(static_cast<qint64>(1), ticks, static_cast<qint64>(slots.size() - 1));
+        int slot = static_cast<int>((current + ticks) % slots.size());
+        slots[slot].append(item);
+        return slot;
+    }
+
+    void cancel(const T& item, int slot)
+    {
+        slots[slot].removeOne(item);
+    }
+
+    /*!
+     * Moves the wheel to *now* and calls *onDue* for every item that is due.
+     * *onDue* may schedule the items again.
+     */
+    template<typename F>
+    void advance(qint64 now, F onDue)
+    {
+        // after a long stall there's no point to turn the wheel more than once
+        qint64 span = resolution * slots.size();
+        if(now - currentTime > span)
+            currentTime = now - span;
+
+        while(currentTime + resolution <= now)
+        {
+            currentTime += resolution;
+            current = (current + 1) % slots.size();
+            QList<T> due;
+            due.swap(slots[current]);
+            for(const T& item : due)
+                onDue(item);
+        }
+    }
+
+protected:
+    QVector<QList<T>> slots;
+    qint64 resolution;
+    int current;
+    qint64 currentTime;
+};
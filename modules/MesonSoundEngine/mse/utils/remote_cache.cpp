@@ -0,0 +1,403 @@
+#include "mse/utils/remote_cache.h"
+
+#include <QCryptographicHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPointer>
+#include <QSaveFile>
+#include <QScopedPointer>
+#include <QSet>
+
+const QString MSE_RemoteCache::indexFilename("index.json");
+const int MSE_RemoteCache::indexSaveDelay = 10000; // ms, the access times are not worth a write on every lookup
+
+MSE_RemoteCache::MSE_RemoteCache(QObject *parent) : MSE_Object(parent)
+  ,maxSize(0)
+  ,totalSize(0)
+  ,pool(nullptr)
+  ,netMan(nullptr)
+  ,indexDirty(false)
+{
+    indexSaveTimer.setSingleShot(true);
+    connect(&indexSaveTimer, &QTimer::timeout, this, &MSE_RemoteCache::saveIndex);
+}
+
+MSE_RemoteCache::~MSE_RemoteCache()
+{
+    if(indexDirty)
+        saveIndex();
+}
+
+/*!
+ * Creates the cache directory (if needed) and loads the index.
+ * The files that are not listed in the index (e.g. leftovers of interrupted downloads)
+ * are removed. If the cached files exceed *maxSize* then the least recently used ones
+ * are removed as well.
+ *
+ * *pool* is used for copying the downloaded files into the cache.
+ * *userAgent* is sent with the validation requests.
+ */
+bool MSE_RemoteCache::init(const QString &dir, qint64 maxSize, MSE_WorkerPool *pool, const QByteArray &userAgent)
+{
+    CHECK(maxSize > 0, MSE_Object::Err::outOfRange);
+    CHECK(!dir.isEmpty(), MSE_Object::Err::pathNotFound);
+    QDir d;
+    CHECK(d.mkpath(dir), MSE_Object::Err::pathNotFound, dir);
+
+    this->dir = QDir(dir).absolutePath();
+    this->maxSize = maxSize;
+    this->pool = pool;
+    this->userAgent = userAgent;
+
+    loadIndex();
+    removeOrphans();
+    evict(QString());
+    saveIndex();
+    return true;
+}
+
+QString MSE_RemoteCache::entryFilename(const QString &url) const
+{
+    return dir + "/" + QString::fromLatin1(
+        QCryptographicHash::hash(url.toUtf8(), QCryptographicHash::Sha1).toHex()) + ".data";
+}
+
+/*!
+ * Creates and opens a file in the cache directory that may be used to download a resource
+ * before passing it to store(). The name is unique, so the downloads of the same URL don't collide.
+ * The file is not removed automatically. Returns nullptr on error.
+ */
+QTemporaryFile* MSE_RemoteCache::createPartFile() const
+{
+    if(dir.isEmpty())
+        return nullptr;
+    QTemporaryFile* f = new QTemporaryFile(dir + "/XXXXXX.part");
+    f->setAutoRemove(false);
+    if(!f->open())
+    {
+        delete f;
+        return nullptr;
+    }
+    return f;
+}
+
+bool MSE_RemoteCache::loadIndex()
+{
+    entries.clear();
+    totalSize = 0;
+
+    QFile f(dir + "/" + indexFilename);
+    if(!f.open(QIODevice::ReadOnly))
+        return false;
+    QJsonDocument doc = QJsonDocument::fromJson(f.readAll());
+    f.close();
+
+    foreach(const QJsonValue& val, doc.object().value("entries").toArray())
+    {
+        QJsonObject obj = val.toObject();
+        MSE_RemoteCacheEntry entry;
+        entry.url = obj.value("url").toString();
+        entry.size = static_cast<qint64>(obj.value("size").toDouble());
+        entry.etag = obj.value("etag").toString().toUtf8();
+        entry.lastModified = obj.value("lastModified").toString().toUtf8();
+        entry.lastAccess = QDateTime::fromMSecsSinceEpoch(static_cast<qint64>(obj.value("lastAccess").toDouble()));
+        if(entry.url.isEmpty() || (entry.size <= 0))
+            continue;
+        entry.filename = entryFilename(entry.url);
+        if(QFileInfo(entry.filename).size() != entry.size)
+            continue;
+        totalSize += entry.size;
+        entries.insert(entry.url, entry);
+    }
+
+    return true;
+}
+
+bool MSE_RemoteCache::saveIndex()
+{
+    indexSaveTimer.stop();
+    indexDirty = false;
+
+    QJsonArray arr;
+    foreach(const MSE_RemoteCacheEntry& entry, entries)
+    {
+        QJsonObject obj;
+        obj.insert("url", entry.url);
+        obj.insert("size", static_cast<double>(entry.size));
+        obj.insert("etag", QString::fromUtf8(entry.etag));
+        obj.insert("lastModified", QString::fromUtf8(entry.lastModified));
+        obj.insert("lastAccess", static_cast<double>(entry.lastAccess.toMSecsSinceEpoch()));
+        arr.append(obj);
+    }
+    QJsonObject root;
+    root.insert("entries", arr);
+
+    QSaveFile f(dir + "/" + indexFilename);
+    CHECK(f.open(QIODevice::WriteOnly), MSE_Object::Err::openWriteFail, f.fileName());
+    f.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    CHECK(f.commit(), MSE_Object::Err::writeError, f.fileName());
+    return true;
+}
+
+/*!
+ * Schedules saving of the index.
+ * Used for the changes that don't lose any data if they don't make it to the disk.
+ */
+void MSE_RemoteCache::markIndexDirty()
+{
+    indexDirty = true;
+    if(!indexSaveTimer.isActive())
+        indexSaveTimer.start(indexSaveDelay);
+}
+
+void MSE_RemoteCache::removeOrphans()
+{
+    QSet<QString> known;
+    foreach(const MSE_RemoteCacheEntry& entry, entries)
+        known.insert(QFileInfo(entry.filename).fileName());
+
+    QDir d(dir);
+    foreach(const QString& name, d.entryList(QDir::Files | QDir::Hidden))
+        if((name != indexFilename) && !known.contains(name))
+            d.remove(name);
+}
+
+/*!
+ * Removes the least recently used entries until the cache fits into the size limit.
+ * The entry for *keepUrl* is never removed.
+ */
+void MSE_RemoteCache::evict(const QString &keepUrl)
+{
+    while(totalSize > maxSize)
+    {
+        QString oldestUrl;
+        QDateTime oldestAccess;
+        foreach(const MSE_RemoteCacheEntry& entry, entries)
+        {
+            if(entry.url == keepUrl)
+                continue;
+            if(oldestUrl.isNull() || (entry.lastAccess < oldestAccess))
+            {
+                oldestUrl = entry.url;
+                oldestAccess = entry.lastAccess;
+            }
+        }
+        if(oldestUrl.isNull())
+            break;
+        removeEntry(oldestUrl);
+    }
+}
+
+void MSE_RemoteCache::removeEntry(const QString &url)
+{
+    auto i = entries.find(url);
+    if(i == entries.end())
+        return;
+    totalSize -= i->size;
+    // the file may still be open by a stream;
+    // if it can't be removed now then it will be removed on the next init()
+    QFile::remove(i->filename);
+    entries.erase(i);
+}
+
+/*!
+ * Finds a complete file for the *url* and marks it as recently used.
+ * Returns false if the resource is not cached.
+ */
+bool MSE_RemoteCache::lookup(const QString &url, MSE_RemoteCacheEntry &entry)
+{
+    auto i = entries.find(url);
+    if(i == entries.end())
+        return false;
+
+    if(QFileInfo(i->filename).size() != i->size)
+    {
+        removeEntry(url);
+        saveIndex();
+        return false;
+    }
+
+    i->lastAccess = QDateTime::currentDateTimeUtc();
+    entry = *i;
+    markIndexDirty();
+    return true;
+}
+
+/*!
+ * Returns true if the response is worth caching:
+ * it's a plain file (not an Internet-radio stream) of a known length
+ * that fits into the cache, and it can be validated later.
+ */
+bool MSE_RemoteCache::isCacheable(const QNetworkReply *reply) const
+{
+    if(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 200)
+        return false;
+    foreach(const QByteArray& header, reply->rawHeaderList())
+        if(header.startsWith("icy-") || header.startsWith("ice-"))
+            return false;
+    if(!reply->hasRawHeader("ETag") && !reply->hasRawHeader("Last-Modified"))
+        return false;
+    qint64 len = reply->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+    return (len > 0) && (len <= maxSize);
+}
+
+/*!
+ * Puts the complete file into the cache.
+ *
+ * If *move* is true then *srcFilename* must be located in the cache directory
+ * (see createPartFile()) and it's renamed right away.
+ * Otherwise the file is copied in the background and onStored() is emitted when it's done.
+ */
+void MSE_RemoteCache::store(const QString &url, const QString &srcFilename, const QByteArray &etag, const QByteArray &lastModified, bool move)
+{
+    if(dir.isEmpty())
+        return;
+
+    if(move)
+    {
+        commit(url, srcFilename, etag, lastModified);
+        return;
+    }
+
+    if(!pool)
+        return;
+    QScopedPointer<QTemporaryFile> partFile(createPartFile());
+    if(!partFile)
+        return;
+    QString dest = partFile->fileName();
+    partFile->close();
+    QPointer<MSE_RemoteCache> cache(this);
+    pool->start([cache, url, srcFilename, dest, etag, lastModified](const MSE_CancelToken&){
+        QFile::remove(dest);
+        if(!QFile::copy(srcFilename, dest))
+        {
+            QFile::remove(dest);
+            return;
+        }
+        if(cache)
+            QMetaObject::invokeMethod(cache, "commit", Qt::QueuedConnection,
+                Q_ARG(QString, url), Q_ARG(QString, dest),
+                Q_ARG(QByteArray, etag), Q_ARG(QByteArray, lastModified));
+    });
+}
+
+void MSE_RemoteCache::commit(const QString &url, const QString &partFilename, const QByteArray &etag, const QByteArray &lastModified)
+{
+    qint64 size = QFileInfo(partFilename).size();
+    if((size <= 0) || (size > maxSize))
+    {
+        QFile::remove(partFilename);
+        return;
+    }
+
+    removeEntry(url);
+
+    MSE_RemoteCacheEntry entry;
+    entry.url = url;
+    entry.filename = entryFilename(url);
+    entry.size = size;
+    entry.etag = etag;
+    entry.lastModified = lastModified;
+    entry.lastAccess = QDateTime::currentDateTimeUtc();
+
+    QFile::remove(entry.filename);
+    if(!QFile::rename(partFilename, entry.filename))
+    {
+        QFile::remove(partFilename);
+        SETERROR(MSE_Object::Err::writeError, entry.filename);
+        return;
+    }
+
+    entries.insert(url, entry);
+    totalSize += size;
+    evict(url);
+    saveIndex();
+    emit onStored(url);
+}
+
+/*!
+ * Checks in the background whether the cached resource has changed on the server.
+ * If it has changed then the entry is removed and onInvalidated() is emitted.
+ * If the server can't be reached then the entry is kept.
+ */
+void MSE_RemoteCache::revalidate(const QString &url)
+{
+    auto i = entries.constFind(url);
+    if(i == entries.constEnd())
+        return;
+    if(validations.contains(url))
+        return;
+
+    QNetworkRequest req{QUrl(url)};
+    req.setRawHeader("User-Agent", userAgent);
+    if(!i->etag.isEmpty())
+        req.setRawHeader("If-None-Match", i->etag);
+    if(!i->lastModified.isEmpty())
+        req.setRawHeader("If-Modified-Since", i->lastModified);
+    req.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+
+    if(!netMan)
+        netMan = new QNetworkAccessManager(this);
+    QNetworkReply* reply = netMan->head(req);
+    validations.insert(url, reply);
+    connect(reply, &QNetworkReply::finished, this, &MSE_RemoteCache::onValidationFinished);
+}
+
+void MSE_RemoteCache::onValidationFinished()
+{
+    QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender());
+    if(!reply)
+        return;
+    reply->deleteLater();
+    QString url = validations.key(reply);
+    if(url.isNull())
+        return;
+    validations.remove(url);
+
+    if(reply->error() != QNetworkReply::NoError)
+        return; // offline, keep serving the cached data
+
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if(status != 200)
+        return; // 304 - not modified
+
+    auto i = entries.find(url);
+    if(i == entries.end())
+        return;
+
+    QByteArray etag = reply->rawHeader("ETag");
+    QByteArray lastModified = reply->rawHeader("Last-Modified");
+    bool changed;
+    if(!i->etag.isEmpty() && !etag.isEmpty())
+        changed = etag != i->etag;
+    else
+        changed = lastModified != i->lastModified;
+    if(!changed)
+        return;
+
+    removeEntry(url);
+    saveIndex();
+    emit onInvalidated(url);
+}
+
+/*!
+ * Removes the cached resource.
+ */
+void MSE_RemoteCache::remove(const QString &url)
+{
+    if(!entries.contains(url))
+        return;
+    removeEntry(url);
+    saveIndex();
+}
+
+/*!
+ * Removes all cached resources.
+ */
+void MSE_RemoteCache::clear()
+{
+    foreach(const QString& url, entries.keys())
+        removeEntry(url);
+    saveIndex();
+}
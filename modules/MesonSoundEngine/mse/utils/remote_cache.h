@@ -0,0 +1,106 @@
+#pragma once
+
+#include "mse/object.h"
+#include "mse/utils/worker_pool.h"
+
+#include <QDateTime>
+#include <QHash>
+#include <QTemporaryFile>
+#include <QTimer>
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkReply>
+
+/*!
+ * A single complete file in MSE_RemoteCache.
+ */
+struct MSE_RemoteCacheEntry {
+    QString url; /*!< The URL of the resource as it was added to the playlist. */
+    QString filename; /*!< The full path to the cached data. */
+    qint64 size = 0; /*!< File size in bytes. */
+    QByteArray etag; /*!< ETag header of the response the data came from. */
+    QByteArray lastModified; /*!< Last-Modified header of the response the data came from. */
+    QDateTime lastAccess; /*!< The last time the entry was looked up. */
+};
+
+/*!
+ * Size-capped on-disk store for finite remote resources (e.g. podcasts).
+ *
+ * Only complete resources are stored. The least recently used entries are evicted
+ * when the total size exceeds the limit. The entries are validated in the background
+ * with conditional requests (If-None-Match/If-Modified-Since),
+ * and the entry is dropped if the resource has changed on the server.
+ * The index is kept in the index.json file inside the cache directory.
+ * Only one object may use a directory, see MSE_Engine::getRemoteCache.
+ *
+ * All functions must be called from the thread the object lives in.
+ */
+class MSE_RemoteCache : public MSE_Object
+{
+    Q_OBJECT
+public:
+    explicit MSE_RemoteCache(QObject* parent = nullptr);
+    ~MSE_RemoteCache();
+
+    bool init(const QString& dir, qint64 maxSize, MSE_WorkerPool* pool, const QByteArray& userAgent);
+
+    /*!
+     * Returns the cache directory.
+     */
+    inline const QString& getDir() const {return dir;}
+
+    /*!
+     * Returns the maximum total size of the cached files in bytes.
+     */
+    inline qint64 getMaxSize() const {return maxSize;}
+
+    /*!
+     * Returns the total size of the cached files in bytes.
+     */
+    inline qint64 getTotalSize() const {return totalSize;}
+
+    bool lookup(const QString& url, MSE_RemoteCacheEntry& entry);
+    bool isCacheable(const QNetworkReply* reply) const;
+    QTemporaryFile* createPartFile() const;
+    void store(const QString& url, const QString& srcFilename, const QByteArray& etag, const QByteArray& lastModified, bool move);
+    void revalidate(const QString& url);
+    void remove(const QString& url);
+    void clear();
+
+    static const QString indexFilename;
+    static const int indexSaveDelay;
+
+protected:
+    QString dir;
+    qint64 maxSize;
+    qint64 totalSize;
+    MSE_WorkerPool* pool;
+    QByteArray userAgent;
+    QHash<QString, MSE_RemoteCacheEntry> entries;
+    QNetworkAccessManager* netMan;
+    QHash<QString, QNetworkReply*> validations;
+    QTimer indexSaveTimer;
+    bool indexDirty;
+
+    QString entryFilename(const QString& url) const;
+    bool loadIndex();
+    bool saveIndex();
+    void markIndexDirty();
+    void removeOrphans();
+    void evict(const QString& keepUrl);
+    void removeEntry(const QString& url);
+
+protected slots:
+    void commit(const QString& url, const QString& partFilename, const QByteArray& etag, const QByteArray& lastModified);
+    void onValidationFinished();
+
+signals:
+    /*!
+     * Emitted when a resource has been stored in the cache.
+     */
+    void onStored(const QString& url);
+
+    /*!
+     * Emitted when an entry was dropped because the resource has changed on the server.
+     */
+    void onInvalidated(const QString& url);
+};
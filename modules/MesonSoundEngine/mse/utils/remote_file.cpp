@@ -0,0 +1,325 @@
+#include "mse/utils/remote_file.h"
+
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include <climits>
+
+const int MSE_RemoteFile::blockSize = 64*1024;
+const int MSE_RemoteFile::prefetchBlocks = 16; // keep this many blocks ahead of the read position
+const int MSE_RemoteFile::maxRetries = 5; // consecutive network errors before giving up
+const int MSE_RemoteFile::retryInterval = 1000;
+
+MSE_RemoteFile::MSE_RemoteFile(
+        const QUrl &url,
+        qint64 length,
+        const QByteArray &userAgent,
+        const MSE_RemoteFileCacheParams &cacheParams,
+        QObject *parent) : MSE_Object(parent)
+  ,url(url)
+  ,length(length)
+  ,userAgent(userAgent)
+  ,cacheParams(cacheParams)
+  ,nBlocks((length + blockSize - 1) / blockSize)
+  ,wantedBlock(0)
+  ,netMan(new QNetworkAccessManager(this))
+  ,reply(nullptr)
+  ,replyNextBlock(0)
+  ,replyEndBlock(0)
+  ,replyChecked(false)
+  ,retriesLeft(maxRetries)
+{
+    // the prefetch window and the block being read must fit, or the prefetch would evict the latter
+    memBlocks.setMaxCost(qMax(prefetchBlocks + 1, static_cast<int>(cacheParams.memoryCacheSize / blockSize)));
+    if(cacheParams.useDiskCache)
+    {
+        QString dir = cacheParams.diskCacheDir.isEmpty() ? QDir::tempPath() : cacheParams.diskCacheDir;
+        diskFile.setFileTemplate(dir + "/mse-remote-XXXXXX");
+        if(diskFile.open())
+            diskBlocks.resize(nBlocks);
+    }
+    requestSchedule();
+}
+
+MSE_RemoteFile::~MSE_RemoteFile()
+{
+    close();
+    abortReply();
+}
+
+/*!
+ * Wakes up all readers and stops all network activity.
+ * All subsequent reads return zero.
+ */
+void MSE_RemoteFile::close()
+{
+    isClosed = true;
+    QMutexLocker locker(&mutex);
+    blockArrived.wakeAll();
+}
+
+int MSE_RemoteFile::blockLength(int index) const
+{
+    if(index == nBlocks - 1)
+        return length - static_cast<qint64>(index) * blockSize;
+    return blockSize;
+}
+
+bool MSE_RemoteFile::isBlockCached(int index) const
+{
+    return memBlocks.contains(index) || (!diskBlocks.isEmpty() && diskBlocks.testBit(index));
+}
+
+/*!
+ * Copies the part of the cached block. Must be called with the mutex locked.
+ */
+bool MSE_RemoteFile::copyBlock(int index, qint64 offset, char *dest, qint64 size)
+{
+    QByteArray* block = memBlocks.object(index);
+    if(block)
+    {
+        memcpy(dest, block->constData() + offset, size);
+        return true;
+    }
+
+    if(diskBlocks.isEmpty() || !diskBlocks.testBit(index))
+        return false;
+
+    QByteArray* diskBlock = new QByteArray;
+    diskBlock->resize(blockLength(index));
+    if(!diskFile.seek(static_cast<qint64>(index) * blockSize)
+        || (diskFile.read(diskBlock->data(), diskBlock->size()) != diskBlock->size()))
+    {
+        delete diskBlock;
+        diskBlocks.clearBit(index);
+        nDiskBlocks--;
+        return false;
+    }
+    memcpy(dest, diskBlock->constData() + offset, size);
+    memBlocks.insert(index, diskBlock);
+    return true;
+}
+
+/*!
+ * Stores the downloaded block. Must be called with the mutex locked.
+ */
+void MSE_RemoteFile::storeBlock(int index, const QByteArray &data)
+{
+    if(!diskBlocks.isEmpty() && !diskBlocks.testBit(index))
+    {
+        if(diskFile.seek(static_cast<qint64>(index) * blockSize)
+            && (diskFile.write(data) == data.size()))
+        {
+            diskBlocks.setBit(index);
+            nDiskBlocks++;
+        }
+    }
+    memBlocks.insert(index, new QByteArray(data));
+}
+
+/*!
+ * Reads up to *maxSize* bytes starting at *pos*.
+ * Blocks until the data is downloaded, the object is closed
+ * or *timeout* milliseconds have passed (negative value means no timeout).
+ * Returns the number of bytes read. Returns zero at the end of file or on failure.
+ *
+ * Can be called from any thread.
+ */
+qint64 MSE_RemoteFile::read(qint64 pos, char *dest, qint64 maxSize, int timeout)
+{
+    if((pos < 0) || (pos >= length))
+        return 0;
+    maxSize = qMin(maxSize, length - pos);
+
+    QElapsedTimer timer;
+    timer.start();
+    qint64 done = 0;
+    QMutexLocker locker(&mutex);
+    while(done < maxSize)
+    {
+        qint64 p = pos + done;
+        int index = p / blockSize;
+        qint64 offset = p - static_cast<qint64>(index) * blockSize;
+        qint64 size = qMin(maxSize - done, blockLength(index) - offset);
+
+        if(copyBlock(index, offset, dest + done, size))
+        {
+            done += size;
+            continue;
+        }
+
+        // return what we have, the caller will ask for the rest
+        if(done)
+            break;
+
+        wantedBlock = index;
+        requestSchedule();
+        if(isClosed || isFailed)
+            return 0;
+        if(timeout < 0)
+        {
+            blockArrived.wait(&mutex, ULONG_MAX);
+        }
+        else
+        {
+            qint64 remaining = timeout - timer.elapsed();
+            if(remaining <= 0)
+                return 0;
+            blockArrived.wait(&mutex, static_cast<unsigned long>(remaining));
+        }
+    }
+
+    int lastIndex = (pos + done - 1) / blockSize;
+    if(wantedBlock != lastIndex)
+    {
+        // keep the prefetch window moving with the reader
+        wantedBlock = lastIndex;
+        requestSchedule();
+    }
+    return done;
+}
+
+void MSE_RemoteFile::requestSchedule()
+{
+    if(!scheduleQueued.exchange(true))
+        QMetaObject::invokeMethod(this, "schedule", Qt::QueuedConnection);
+}
+
+void MSE_RemoteFile::abortReply()
+{
+    if(!reply)
+        return;
+    reply->disconnect(this);
+    reply->abort();
+    reply->deleteLater();
+    reply = nullptr;
+    replyData.clear();
+}
+
+/*!
+ * Starts a new Range request if the blocks around the read position are missing
+ * and the current request doesn't bring them.
+ */
+void MSE_RemoteFile::schedule()
+{
+    scheduleQueued = false;
+    if(isClosed || isFailed)
+    {
+        abortReply();
+        return;
+    }
+
+    int firstMissing = -1;
+    int windowEnd;
+    {
+        QMutexLocker locker(&mutex);
+        windowEnd = qMin(nBlocks, wantedBlock + prefetchBlocks);
+        for(int a=wantedBlock; a<windowEnd; a++)
+        {
+            if(!isBlockCached(a))
+            {
+                firstMissing = a;
+                break;
+            }
+        }
+    }
+    if(firstMissing < 0)
+        return;
+
+    if(reply && (firstMissing >= replyNextBlock) && (firstMissing < replyEndBlock))
+        return; // it's on its way
+
+    abortReply();
+
+    replyNextBlock = firstMissing;
+    replyEndBlock = windowEnd;
+    qint64 from = static_cast<qint64>(replyNextBlock) * blockSize;
+    qint64 to = qMin(length, static_cast<qint64>(replyEndBlock) * blockSize) - 1;
+
+    QNetworkRequest req(url);
+    req.setRawHeader("Range", "bytes=" + QByteArray::number(from) + "-" + QByteArray::number(to));
+    req.setRawHeader("User-Agent", userAgent);
+    req.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+    reply = netMan->get(req);
+    replyChecked = false;
+    connect(reply, &QNetworkReply::readyRead, this, &MSE_RemoteFile::onReplyData);
+    connect(reply, &QNetworkReply::finished, this, &MSE_RemoteFile::onReplyFinished);
+}
+
+void MSE_RemoteFile::onReplyData()
+{
+    if(!replyChecked)
+    {
+        // a server may ignore the range only when the file is requested from the start
+        int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if((status != 206) && !((status == 200) && !replyNextBlock))
+        {
+            SETERROR(MSE_Object::Err::operationFailed, url.toString());
+            isFailed = true;
+            abortReply();
+            close();
+            return;
+        }
+        replyChecked = true;
+    }
+
+    replyData.append(reply->readAll());
+    retriesLeft = maxRetries;
+
+    bool stored = false;
+    {
+        QMutexLocker locker(&mutex);
+        while(replyNextBlock < replyEndBlock)
+        {
+            int len = blockLength(replyNextBlock);
+            if(replyData.size() < len)
+                break;
+            if(!isBlockCached(replyNextBlock))
+                storeBlock(replyNextBlock, replyData.left(len));
+            replyData.remove(0, len);
+            replyNextBlock++;
+            stored = true;
+        }
+        if(stored)
+            blockArrived.wakeAll();
+    }
+
+    if(stored && !diskCompleteEmitted && isDiskComplete() && diskFile.flush())
+    {
+        diskCompleteEmitted = true;
+        emit onDiskComplete();
+    }
+
+    if(replyNextBlock >= replyEndBlock)
+    {
+        // the server may send more than requested
+        abortReply();
+        requestSchedule();
+    }
+}
+
+void MSE_RemoteFile::onReplyFinished()
+{
+    bool isError = reply->error() != QNetworkReply::NoError;
+    bool isComplete = replyNextBlock >= replyEndBlock;
+    reply->disconnect(this);
+    reply->deleteLater();
+    reply = nullptr;
+    replyData.clear();
+
+    if(isError && !isComplete)
+    {
+        retriesLeft--;
+        if(retriesLeft <= 0)
+        {
+            SETERROR(MSE_Object::Err::noRetriesLeft, url.toString());
+            isFailed = true;
+            close();
+            return;
+        }
+        QTimer::singleShot(retryInterval, this, SLOT(schedule()));
+        return;
+    }
+
+    schedule();
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "mse/object.h"
+
+#include <QBitArray>
+#include <QCache>
+#include <QMutex>
+#include <QTemporaryFile>
+#include <QWaitCondition>
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkReply>
+
+#include <atomic>
+
+/*!
+ * Cache settings for MSE_RemoteFile.
+ */
+struct MSE_RemoteFileCacheParams {
+    qint64 memoryCacheSize = 8*1024*1024; /*!<
+    Maximum number of bytes kept in memory.
+    At least MSE_RemoteFile::prefetchBlocks + 1 blocks are kept anyway.
+
+    **Default**: 8 MB
+*/
+    bool useDiskCache = false; /*!<
+    Also store every downloaded block in a temporary file,
+    so the blocks evicted from memory don't have to be downloaded again.
+
+    **Default**: false
+*/
+    QString diskCacheDir; /*!<
+    Directory for the temporary file.
+
+    **Default**: &lt;empty&gt; (i.e. QDir::tempPath())
+*/
+};
+
+/*!
+ * Random access to an HTTP resource with a known length via Range requests.
+ *
+ * The file is split into fixed-size blocks that are cached in memory
+ * (and optionally on disk). The network requests are performed in the thread
+ * the object lives in, while read() may be called from any other thread
+ * (e.g. from a BASS file procedure) and blocks until the data arrives.
+ * The blocks ahead of the last read position are prefetched.
+ */
+class MSE_RemoteFile : public MSE_Object
+{
+    Q_OBJECT
+public:
+    MSE_RemoteFile(
+        const QUrl& url,
+        qint64 length,
+        const QByteArray& userAgent,
+        const MSE_RemoteFileCacheParams& cacheParams = MSE_RemoteFileCacheParams(),
+        QObject* parent = nullptr);
+    ~MSE_RemoteFile();
+
+    /*!
+     * Returns the file length in bytes.
+     */
+    inline qint64 getLength() const {return length;}
+
+    /*!
+     * Returns the URL of the file.
+     */
+    inline const QUrl& getUrl() const {return url;}
+
+    /*!
+     * Returns the path to the temporary file with the downloaded blocks.
+     * Returns an empty string if the disk cache is not used.
+     */
+    inline QString getDiskFilename() const {return diskBlocks.isEmpty() ? QString() : diskFile.fileName();}
+
+    /*!
+     * Returns true if all blocks have been stored in the temporary file.
+     */
+    inline bool isDiskComplete() const {return nDiskBlocks && (nDiskBlocks == nBlocks);}
+
+    qint64 read(qint64 pos, char* dest, qint64 maxSize, int timeout = -1);
+    void close();
+
+    static const int blockSize;
+    static const int prefetchBlocks;
+    static const int maxRetries;
+    static const int retryInterval;
+
+protected:
+    QUrl url;
+    qint64 length;
+    QByteArray userAgent;
+    MSE_RemoteFileCacheParams cacheParams;
+    int nBlocks;
+
+    mutable QMutex mutex;
+    QWaitCondition blockArrived;
+    QCache<int, QByteArray> memBlocks;
+    QBitArray diskBlocks;
+    QTemporaryFile diskFile;
+    std::atomic<int> nDiskBlocks {0};
+    bool diskCompleteEmitted = false;
+    std::atomic<bool> isClosed {false};
+    std::atomic<bool> isFailed {false};
+    std::atomic<bool> scheduleQueued {false};
+    int wantedBlock;
+
+    QNetworkAccessManager* netMan;
+    QNetworkReply* reply;
+    int replyNextBlock;
+    int replyEndBlock;
+    QByteArray replyData;
+    bool replyChecked;
+    int retriesLeft;
+
+    bool isBlockCached(int index) const;
+    bool copyBlock(int index, qint64 offset, char* dest, qint64 size);
+    void storeBlock(int index, const QByteArray& data);
+    int blockLength(int index) const;
+    void requestSchedule();
+    void abortReply();
+
+protected slots:
+    void schedule();
+    void onReplyData();
+    void onReplyFinished();
+
+signals:
+    /*!
+     * Emitted once all blocks of the file have been stored in the temporary file.
+     * Only emitted when the disk cache is used.
+     *
+     * \sa getDiskFilename
+     */
+    void onDiskComplete();
+};
@@ -0,0 +1,275 @@
+#include "mse/utils/ring_buffer.h"
+
+#include <QElapsedTimer>
+
+#include <climits>
+#include <cstring>
+
+MSE_RingBuffer::MSE_RingBuffer(qint64 capacity):
+    capacity(0),
+    head(0),
+    tail(0),
+    peakUsed(0),
+    fullCount(0),
+    consumerWaiting(false),
+    interrupted(false)
+{
+    setCapacity(capacity);
+}
+
+/*!
+ * Reallocates the buffer. All data is discarded.
+ * The memory is not touched until the data is written,
+ * so a big capacity does not take physical memory upfront.
+ */
+bool MSE_RingBuffer::setCapacity(qint64 newCapacity)
+{
+    if(newCapacity < 0)
+        return false;
+    if(newCapacity != capacity)
+    {
+        data.reset(newCapacity ? new (std::nothrow) char[newCapacity] : nullptr);
+        capacity = data ? newCapacity : 0;
+    }
+    clear();
+    return capacity == newCapacity;
+}
+
+/*!
+ * Discards all data and resets the statistics.
+ */
+void MSE_RingBuffer::clear()
+{
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+    peakUsed.store(0, std::memory_order_relaxed);
+    fullCount.store(0, std::memory_order_relaxed);
+    interrupted.store(false, std::memory_order_release);
+}
+
+/*!
+ * Blocks the consumer until at least *minBytes* bytes are available.
+ * *timeout* is in milliseconds, negative value means no timeout.
+ * Returns false if the time is out or the buffer was interrupted.
+ *
+ * \sa interrupt
+ */
+bool MSE_RingBuffer::waitForData(qint64 minBytes, int timeout)
+{
+    if(bytesAvailable() >= minBytes)
+        return true;
+    if(isInterrupted() || !timeout)
+        return false;
+
+    QElapsedTimer timer;
+    timer.start();
+    QMutexLocker locker(&waitMutex);
+    bool result;
+    forever
+    {
+        consumerWaiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if(isInterrupted())
+        {
+            result = false;
+            break;
+        }
+        if(bytesAvailable() >= minBytes)
+        {
+            result = true;
+            break;
+        }
+
+        if(timeout < 0)
+        {
+            waitCondition.wait(&waitMutex, ULONG_MAX);
+        }
+        else
+        {
+            qint64 remaining = timeout - timer.elapsed();
+            if(remaining <= 0)
+            {
+                result = false;
+                break;
+            }
+            waitCondition.wait(&waitMutex, static_cast<unsigned long>(remaining));
+        }
+    }
+    consumerWaiting.store(false, std::memory_order_relaxed);
+    return result;
+}
+
+/*!
+ * Wakes up the consumer that is blocked in waitForData()
+ * and makes all subsequent waitForData() calls return immediately until clear() is called.
+ */
+void MSE_RingBuffer::interrupt()
+{
+    interrupted.store(true, std::memory_order_release);
+    QMutexLocker locker(&waitMutex);
+    waitCondition.wakeAll();
+}
+
+void MSE_RingBuffer::wakeConsumer()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(!consumerWaiting.load(std::memory_order_relaxed))
+        return;
+    QMutexLocker locker(&waitMutex);
+    waitCondition.wakeAll();
+}
+
+/*!
+ * Returns the number of bytes that can be read.
+ */
+qint64 MSE_RingBuffer::bytesAvailable() const
+{
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed);
+}
+
+/*!
+ * Returns the pointer to the first unread byte.
+ * *len* receives the number of bytes that can be read contiguously starting from that pointer.
+ * Call commitRead() after processing the data.
+ */
+const char *MSE_RingBuffer::readSpan(qint64 &len) const
+{
+    quint64 t = tail.load(std::memory_order_relaxed);
+    qint64 avail = head.load(std::memory_order_acquire) - t;
+    if(!avail)
+    {
+        len = 0;
+        return data.get();
+    }
+    qint64 offset = t % capacity;
+    len = qMin(avail, capacity - offset);
+    return data.get() + offset;
+}
+
+/*!
+ * Returns the pointer to the first *len* unread bytes
+ * if they are available and stored contiguously.
+ * Otherwise returns nullptr and the data must be retrieved with peek() or read().
+ */
+const char *MSE_RingBuffer::peekSpan(qint64 len) const
+{
+    qint64 spanLen;
+    const char* p = readSpan(spanLen);
+    return spanLen >= len ? p : nullptr;
+}
+
+/*!
+ * Copies up to *maxSize* bytes without consuming them.
+ * Returns the number of bytes copied.
+ */
+qint64 MSE_RingBuffer::peek(char *dest, qint64 maxSize) const
+{
+    quint64 t = tail.load(std::memory_order_relaxed);
+    qint64 size = qMin(maxSize, static_cast<qint64>(head.load(std::memory_order_acquire) - t));
+    if(size <= 0)
+        return 0;
+    qint64 offset = t % capacity;
+    qint64 firstLen = qMin(size, capacity - offset);
+    memcpy(dest, data.get() + offset, firstLen);
+    if(size > firstLen)
+        memcpy(dest + firstLen, data.get(), size - firstLen);
+    return size;
+}
+
+/*!
+ * Marks *len* bytes as read, freeing the space for the producer.
+ */
+void MSE_RingBuffer::commitRead(qint64 len)
+{
+    tail.store(tail.load(std::memory_order_relaxed) + len, std::memory_order_release);
+}
+
+/*!
+ * Reads up to *maxSize* bytes.
+ * Returns the number of bytes read.
+ */
+qint64 MSE_RingBuffer::read(char *dest, qint64 maxSize)
+{
+    qint64 size = peek(dest, maxSize);
+    if(size)
+        commitRead(size);
+    return size;
+}
+
+/*!
+ * Returns the number of bytes that can be written.
+ */
+qint64 MSE_RingBuffer::bytesFree() const
+{
+    return capacity - static_cast<qint64>(head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire));
+}
+
+/*!
+ * Returns the pointer to the free space.
+ * *len* receives the number of bytes that can be written contiguously starting from that pointer.
+ * Call commitWrite() after writing the data.
+ */
+char *MSE_RingBuffer::writeSpan(qint64 &len)
+{
+    quint64 h = head.load(std::memory_order_relaxed);
+    qint64 free = capacity - static_cast<qint64>(h - tail.load(std::memory_order_acquire));
+    if(!free)
+    {
+        fullCount.fetch_add(1, std::memory_order_relaxed);
+        len = 0;
+        return data.get();
+    }
+    qint64 offset = h % capacity;
+    len = qMin(free, capacity - offset);
+    return data.get() + offset;
+}
+
+/*!
+ * Makes *len* written bytes available for the consumer.
+ */
+void MSE_RingBuffer::commitWrite(qint64 len)
+{
+    quint64 h = head.load(std::memory_order_relaxed) + len;
+    head.store(h, std::memory_order_release);
+
+    qint64 used = h - tail.load(std::memory_order_relaxed);
+    if(used > peakUsed.load(std::memory_order_relaxed))
+        peakUsed.store(used, std::memory_order_relaxed);
+
+    wakeConsumer();
+}
+
+/*!
+ * Writes up to *size* bytes.
+ * Returns the number of bytes written, which is less than *size* if the buffer is full.
+ */
+qint64 MSE_RingBuffer::write(const char *src, qint64 size)
+{
+    qint64 written = 0;
+    qint64 len;
+    char* p;
+    while(written < size)
+    {
+        p = writeSpan(len);
+        if(!len)
+            break;
+        len = qMin(len, size - written);
+        memcpy(p, src + written, len);
+        commitWrite(len);
+        written += len;
+    }
+    return written;
+}
+
+MSE_RingBuffer::Stats MSE_RingBuffer::getStats() const
+{
+    Stats stats;
+    stats.capacity = capacity;
+    stats.totalRead = tail.load(std::memory_order_acquire);
+    stats.totalWritten = head.load(std::memory_order_acquire);
+    stats.used = stats.totalWritten - stats.totalRead;
+    stats.peakUsed = peakUsed.load(std::memory_order_relaxed);
+    stats.fullCount = fullCount.load(std::memory_order_relaxed);
+    return stats;
+}
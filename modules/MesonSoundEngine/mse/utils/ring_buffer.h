@@ -0,0 +1,79 @@
+#pragma once
+
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <memory>
+
+/*!
+ * Fixed-capacity lock-free ring buffer for one producer thread and one consumer thread.
+ *
+ * The producer uses writeSpan()/commitWrite() (or write()),
+ * the consumer uses readSpan()/commitRead(), peek(), peekSpan() (or read()).
+ * The spans point directly into the buffer memory, so no intermediate copies are made.
+ *
+ * The consumer may block in waitForData() until the producer commits enough data
+ * or until interrupt() is called. The mutex is only touched when the consumer actually waits,
+ * so the producer stays lock-free while the consumer keeps up.
+ *
+ * setCapacity() and clear() are not thread-safe and must be called
+ * only when neither the producer nor the consumer is active.
+ */
+class MSE_RingBuffer
+{
+public:
+    /*!
+     * Occupancy statistics of the buffer.
+     */
+    struct Stats {
+        qint64 capacity; /*!< Total capacity in bytes. */
+        qint64 used; /*!< Number of bytes that are available for reading. */
+        qint64 peakUsed; /*!< Maximum number of bytes that were stored at once since the last clear(). */
+        quint64 totalWritten; /*!< Number of bytes written since the last clear(). */
+        quint64 totalRead; /*!< Number of bytes read since the last clear(). */
+        quint64 fullCount; /*!< How many times the producer found the buffer full. */
+    };
+
+    explicit MSE_RingBuffer(qint64 capacity = 0);
+
+    bool setCapacity(qint64 newCapacity);
+    inline qint64 getCapacity() const {return capacity;}
+    void clear();
+
+    bool waitForData(qint64 minBytes, int timeout = -1);
+    void interrupt();
+    inline bool isInterrupted() const {return interrupted.load(std::memory_order_acquire);}
+
+    // consumer side
+    qint64 bytesAvailable() const;
+    const char* readSpan(qint64& len) const;
+    const char* peekSpan(qint64 len) const;
+    qint64 peek(char* dest, qint64 maxSize) const;
+    void commitRead(qint64 len);
+    qint64 read(char* dest, qint64 maxSize);
+
+    // producer side
+    qint64 bytesFree() const;
+    char* writeSpan(qint64& len);
+    void commitWrite(qint64 len);
+    qint64 write(const char* src, qint64 size);
+
+    Stats getStats() const;
+
+protected:
+    void wakeConsumer();
+
+    std::unique_ptr<char[]> data;
+    qint64 capacity;
+
+    std::atomic<quint64> head; // total bytes written, modified by producer only
+    std::atomic<quint64> tail; // total bytes read, modified by consumer only
+    std::atomic<qint64> peakUsed;
+    std::atomic<quint64> fullCount;
+
+    std::atomic<bool> consumerWaiting;
+    std::atomic<bool> interrupted;
+    QMutex waitMutex;
+    QWaitCondition waitCondition;
+};
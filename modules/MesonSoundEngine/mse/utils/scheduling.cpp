@@ -0,0 +1,183 @@
+#include "mse/utils/scheduling.h"
+
+#include <QDir>
+#include <QFile>
+#include <QSet>
+
+#ifdef Q_OS_LINUX
+    #include <sched.h>
+    #include <sys/resource.h>
+    #include <cerrno>
+#endif
+
+#ifdef Q_OS_WIN
+    #include <windows.h>
+#endif
+
+namespace MSE_Scheduling
+{
+#ifdef Q_OS_LINUX
+    static bool fillCpuSet(const QList<int>& cpus, cpu_set_t& set)
+    {
+        CPU_ZERO(&set);
+        foreach(int cpu, cpus)
+        {
+            if((cpu < 0) || (cpu >= CPU_SETSIZE))
+                return false;
+            CPU_SET(cpu, &set);
+        }
+        return !cpus.isEmpty();
+    }
+#endif
+
+#ifdef Q_OS_WIN
+    static bool fillCpuMask(const QList<int>& cpus, DWORD_PTR& mask)
+    {
+        mask = 0;
+        foreach(int cpu, cpus)
+        {
+            if((cpu < 0) || (cpu >= static_cast<int>(sizeof(mask) * 8)))
+                return false;
+            mask |= static_cast<DWORD_PTR>(1) << cpu;
+        }
+        return mask != 0;
+    }
+#endif
+
+    /*!
+     * Returns the ids of all threads of the process.
+     * Only implemented for Linux, returns an empty list elsewhere.
+     */
+    QList<qint64> getThreadIds()
+    {
+        QList<qint64> ids;
+#ifdef Q_OS_LINUX
+        QDir dir(QStringLiteral("/proc/self/task"));
+        foreach(const QString& entry, dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+        {
+            bool ok;
+            qint64 id = entry.toLongLong(&ok);
+            if(ok)
+                ids.append(id);
+        }
+#endif
+        return ids;
+    }
+
+    /*!
+     * Returns the name of a thread as the kernel sees it, i.e. at most 15 characters.
+     * A thread that doesn't name itself has the name of the thread that started it.
+     * Only implemented for Linux, returns an empty string elsewhere or on error.
+     */
+    QString getThreadName(qint64 threadId)
+    {
+#ifdef Q_OS_LINUX
+        QString filename = threadId
+            ? QStringLiteral("/proc/self/task/%1/comm").arg(threadId)
+            : QStringLiteral("/proc/thread-self/comm");
+        QFile f(filename);
+        if(!f.open(QIODevice::ReadOnly))
+            return QString();
+        return QString::fromUtf8(f.readAll()).trimmed();
+#else
+        Q_UNUSED(threadId);
+        return QString();
+#endif
+    }
+
+    /*!
+     * Sets the scheduling *policy* of a thread.
+     * *priority* is a nice value (-20..19) for mse_tpNice
+     * and a real-time priority (1..99) for mse_tpFifo and mse_tpRoundRobin.
+     * Only implemented for Linux.
+     */
+    bool setThreadPolicy(qint64 threadId, MSE_ThreadPolicy policy, int priority)
+    {
+#ifdef Q_OS_LINUX
+        pid_t tid = static_cast<pid_t>(threadId);
+        switch(policy)
+        {
+            case mse_tpDefault:
+                return true;
+
+            case mse_tpNice:
+            {
+                // on Linux the nice value belongs to a thread, not to the whole process
+                if(setpriority(PRIO_PROCESS, static_cast<id_t>(tid), priority))
+                    return false;
+                errno = 0;
+                int result = getpriority(PRIO_PROCESS, static_cast<id_t>(tid));
+                return !errno && (result == priority);
+            }
+
+            case mse_tpFifo:
+            case mse_tpRoundRobin:
+            {
+                int schedPolicy = (policy == mse_tpFifo) ? SCHED_FIFO : SCHED_RR;
+                struct sched_param param;
+                param.sched_priority = priority;
+                if(sched_setscheduler(tid, schedPolicy, &param))
+                    return false;
+                return sched_getscheduler(tid) == schedPolicy;
+            }
+        }
+        return false;
+#else
+        Q_UNUSED(threadId);
+        Q_UNUSED(priority);
+        return policy == mse_tpDefault;
+#endif
+    }
+
+    /*!
+     * Pins a thread to the *cpus* (zero-based CPU numbers).
+     * On Windows only the calling thread (zero *threadId*) is supported.
+     */
+    bool setThreadAffinity(qint64 threadId, const QList<int>& cpus)
+    {
+#ifdef Q_OS_LINUX
+        cpu_set_t set;
+        if(!fillCpuSet(cpus, set))
+            return false;
+        return !sched_setaffinity(static_cast<pid_t>(threadId), sizeof(set), &set);
+#elif defined(Q_OS_WIN)
+        DWORD_PTR mask;
+        if(threadId || !fillCpuMask(cpus, mask))
+            return false;
+        return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+        Q_UNUSED(threadId);
+        Q_UNUSED(cpus);
+        return false;
+#endif
+    }
+
+    /*!
+     * Returns true if the process is allowed to run on all of the *cpus*,
+     * i.e. setThreadAffinity is expected to succeed.
+     */
+    bool isCpuSetAvailable(const QList<int>& cpus)
+    {
+#ifdef Q_OS_LINUX
+        cpu_set_t wanted;
+        cpu_set_t allowed;
+        if(!fillCpuSet(cpus, wanted) || sched_getaffinity(0, sizeof(allowed), &allowed))
+            return false;
+        CPU_AND(&wanted, &wanted, &allowed);
+        QSet<int> uniqueCpus;
+        foreach(int cpu, cpus)
+            uniqueCpus.insert(cpu);
+        return CPU_COUNT(&wanted) == uniqueCpus.size();
+#elif defined(Q_OS_WIN)
+        DWORD_PTR wanted;
+        DWORD_PTR processMask;
+        DWORD_PTR systemMask;
+        if(!fillCpuMask(cpus, wanted) || !GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+            return false;
+        return (wanted & processMask) == wanted;
+#else
+        Q_UNUSED(cpus);
+        return false;
+#endif
+    }
+};
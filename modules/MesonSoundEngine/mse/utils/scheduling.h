@@ -0,0 +1,23 @@
+#pragma once
+
+#include "mse/types.h"
+
+#include <QList>
+#include <QString>
+
+/*!
+ * Scheduling and CPU affinity of the threads.
+ *
+ * A thread is identified by its kernel thread id, zero means the calling thread.
+ * All functions return false if the change has not taken effect,
+ * e.g. when it needs privileges (see RLIMIT_RTPRIO, RLIMIT_NICE and CAP_SYS_NICE on Linux)
+ * or when the platform doesn't support it.
+ */
+namespace MSE_Scheduling
+{
+    QList<qint64> getThreadIds();
+    QString getThreadName(qint64 threadId);
+    bool setThreadPolicy(qint64 threadId, MSE_ThreadPolicy policy, int priority);
+    bool setThreadAffinity(qint64 threadId, const QList<int>& cpus);
+    bool isCpuSetAvailable(const QList<int>& cpus);
+};
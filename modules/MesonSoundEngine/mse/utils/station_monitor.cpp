@@ -0,0 +1,568 @@
+#include "mse/utils/station_monitor.h"
+#include "mse/engine.h"
+#include "mse/playlist.h"
+
+#include <QBuffer>
+
+#include <cmath>
+
+const int MSE_StationMonitor::statsInterval = 1000; // update the rates, levels and timeouts this often
+const int MSE_StationMonitor::timeoutInterval = 10*1000; // reconnect if no data arrives for this long
+const int MSE_StationMonitor::retryInterval = 10*1000; // wait for this amount of time before reconnect
+const int MSE_StationMonitor::maxRedirects = 5; // including redirects from playlists
+const int MSE_StationMonitor::silenceTime = 5000; // report no audio after this much silence
+const float MSE_StationMonitor::silenceLevel = 0.001f; // RMS level below this is silence
+const int MSE_StationMonitor::decodeHeaderSize = 16*1024; // collect this much audio before creating a decoder
+const int MSE_StationMonitor::maxDecodeBacklog = 1024*1024; // drop the audio if the decoder lags this much
+const int MSE_StationMonitor::maxHostConnections = 6; // QNetworkAccessManager doesn't open more HTTP/1.1 connections to one server
+
+struct MSE_StationMonitor::Station {
+    int id;
+    QString url;
+    QNetworkReply* reply = nullptr;
+    int netManager = -1;
+    QString hostKey;
+    int redirectsLeft = maxRedirects;
+    enum {
+        Idle,
+        WaitingHeader,
+        ReceivingPlaylist,
+        Streaming
+    } state = Idle;
+    MSE_IcyParser parser;
+    bool isConnected = false;
+    bool wasConnected = false;
+    bool hasAudio = false;
+    QString trackArtist;
+    QString trackTitle;
+    int bitrate = 0;
+    quint64 bytesReceived = 0;
+    quint64 lastBytes = 0;
+    double byteRate = 0;
+    int reconnects = 0;
+    qint64 connectTime = 0;
+    qint64 lastDataTime = 0;
+    qint64 reconnectAt = -1;
+    bool isRemoved = false;
+
+    bool wantDecode = false;
+    bool decodeFailed = false;
+    HSTREAM decoder = 0;
+    QByteArray decodeHeader;
+    int decodeHeaderPos = 0;
+    float peak = 0;
+    float rms = 0;
+    qint64 silentSince = -1;
+};
+
+MSE_StationMonitor::MSE_StationMonitor(QObject *parent) : MSE_Object(parent)
+  ,nextId(1)
+{
+    fileProcTable.close = fileCloseProc;
+    fileProcTable.length = fileLenProc;
+    fileProcTable.read = fileReadProc;
+    fileProcTable.seek = fileSeekProc;
+
+    clock.start();
+    statsTimer.setInterval(statsInterval);
+    connect(&statsTimer, &QTimer::timeout, this, &MSE_StationMonitor::onStatsTimer);
+}
+
+MSE_StationMonitor::~MSE_StationMonitor()
+{
+    removeAll();
+    deleteRemovedStations();
+}
+
+/*!
+ * Starts watching the station. The URL may point to a playlist.
+ * Returns the station ID or zero on failure.
+ */
+int MSE_StationMonitor::addStation(const QString &url)
+{
+    QUrl urlObj(url);
+    if(!urlObj.isValid())
+    {
+        SETERROR(MSE_Object::Err::urlInvalid, url);
+        return 0;
+    }
+
+    Station* station = new Station;
+    station->id = nextId++;
+    station->url = url;
+    stations.insert(station->id, station);
+    connectStation(station, urlObj);
+
+    if(!statsTimer.isActive())
+        statsTimer.start();
+    return station->id;
+}
+
+/*!
+ * Stops watching the station.
+ * It's safe to call from a slot connected to any signal of the monitor.
+ */
+bool MSE_StationMonitor::removeStation(int id)
+{
+    Station* station = stations.take(id);
+    CHECK(station, MSE_Object::Err::outOfRange, QString::number(id));
+    if(stations.isEmpty())
+        statsTimer.stop();
+    releaseStation(station);
+    return true;
+}
+
+/*!
+ * Stops watching all stations.
+ */
+void MSE_StationMonitor::removeAll()
+{
+    QList<Station*> list = stations.values();
+    stations.clear();
+    statsTimer.stop();
+    foreach(Station* station, list)
+        releaseStation(station);
+}
+
+/*!
+ * Disconnects the removed station.
+ * The station itself is deleted on return to the event loop,
+ * because the code that has emitted a signal may still be working with it.
+ */
+void MSE_StationMonitor::releaseStation(Station *station)
+{
+    station->isRemoved = true;
+    disconnectStation(station);
+    if(removedStations.isEmpty())
+        QTimer::singleShot(0, this, &MSE_StationMonitor::deleteRemovedStations);
+    removedStations.append(station);
+}
+
+void MSE_StationMonitor::deleteRemovedStations()
+{
+    qDeleteAll(removedStations);
+    removedStations.clear();
+}
+
+/*!
+ * Enables or disables the audio decoding for the station.
+ * Only the decoding stations report the audio levels with onLevels()
+ * and detect the silence.
+ */
+bool MSE_StationMonitor::setDecoding(int id, bool decode)
+{
+    Station* station = stations.value(id);
+    CHECK(station, MSE_Object::Err::outOfRange, QString::number(id));
+    station->wantDecode = decode;
+    station->decodeFailed = false;
+    if(!decode)
+        stopDecoder(station);
+    return true;
+}
+
+bool MSE_StationMonitor::getStats(int id, MSE_StationMonitorStats &stats) const
+{
+    const Station* station = stations.value(id);
+    if(!station)
+        return false;
+
+    stats.id = station->id;
+    stats.url = station->url;
+    stats.isConnected = station->isConnected;
+    stats.hasAudio = station->hasAudio;
+    stats.trackArtist = station->trackArtist;
+    stats.trackTitle = station->trackTitle;
+    stats.bitrate = station->bitrate;
+    stats.bytesReceived = station->bytesReceived;
+    stats.byteRate = station->byteRate;
+    stats.reconnects = station->reconnects;
+    stats.isDecoding = station->decoder != 0;
+    stats.peak = station->peak;
+    stats.rms = station->rms;
+    return true;
+}
+
+QList<MSE_StationMonitorStats> MSE_StationMonitor::getAllStats() const
+{
+    QList<MSE_StationMonitorStats> list;
+    foreach(int id, stations.keys())
+    {
+        MSE_StationMonitorStats stats;
+        getStats(id, stats);
+        list.append(stats);
+    }
+    return list;
+}
+
+/*!
+ * Returns the index of a network manager that has a free connection to the server,
+ * the server is identified by *hostKey*. A new manager is created if all of them are busy.
+ * The connection is counted as taken.
+ */
+int MSE_StationMonitor::acquireNetManager(const QString &hostKey)
+{
+    int n = netManagers.size();
+    for(int a=0; a<n; a++)
+    {
+        int& nConnections = netManagers[a].connections[hostKey];
+        if(nConnections < maxHostConnections)
+        {
+            nConnections++;
+            return a;
+        }
+    }
+
+    NetManager netManager;
+    netManager.manager = new QNetworkAccessManager(this);
+    netManager.connections.insert(hostKey, 1);
+    netManagers.append(netManager);
+    return n;
+}
+
+void MSE_StationMonitor::connectStation(Station *station, const QUrl &url)
+{
+    disconnectStation(station);
+    if(station->isRemoved)
+        return;
+
+    // an HTTP redirect stays with the manager of the original URL
+    station->hostKey = url.scheme().toLower()+"://"+url.host().toLower()+":"
+        +QString::number(url.port(url.scheme().compare("https", Qt::CaseInsensitive) ? 80 : 443));
+    station->netManager = acquireNetManager(station->hostKey);
+
+    QNetworkRequest req(url);
+    req.setRawHeader("icy-metadata", "1");
+    req.setRawHeader("Accept", "*/*");
+    req.setRawHeader("User-Agent", MSE_Engine::getInstance()->getInitParams().userAgent.toUtf8());
+    req.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+
+    station->reply = netManagers.at(station->netManager).manager->get(req);
+    station->reply->setReadBufferSize(64*1024);
+    station->state = Station::WaitingHeader;
+    station->connectTime = clock.elapsed();
+    station->reconnectAt = -1;
+    station->decodeFailed = false;
+
+    connect(station->reply, &QNetworkReply::metaDataChanged, this, [this, station](){
+        onStationHeaders(station);
+    });
+    connect(station->reply, &QNetworkReply::readyRead, this, [this, station](){
+        onStationData(station);
+    });
+    connect(station->reply, &QNetworkReply::finished, this, [this, station](){
+        onStationFinished(station);
+    });
+}
+
+void MSE_StationMonitor::disconnectStation(Station *station)
+{
+    if(station->reply)
+    {
+        station->reply->disconnect(this);
+        station->reply->abort();
+        station->reply->deleteLater();
+        station->reply = nullptr;
+    }
+    if(station->netManager >= 0)
+    {
+        netManagers[station->netManager].connections[station->hostKey]--;
+        station->netManager = -1;
+    }
+    station->state = Station::Idle;
+    stopDecoder(station);
+    setConnected(station, false);
+}
+
+void MSE_StationMonitor::scheduleReconnect(Station *station)
+{
+    disconnectStation(station);
+    station->reconnectAt = clock.elapsed() + retryInterval;
+}
+
+void MSE_StationMonitor::onStationHeaders(Station *station)
+{
+    bool ok;
+    int metaInt = QString::fromUtf8(station->reply->rawHeader("icy-metaint")).toInt(&ok);
+    station->parser.reset(ok ? metaInt : 0);
+    station->bitrate = QString::fromUtf8(station->reply->rawHeader("icy-br")).toInt(&ok);
+    if(!ok || (station->bitrate < 0))
+        station->bitrate = 0;
+}
+
+void MSE_StationMonitor::onStationData(Station *station)
+{
+    QNetworkReply* reply = station->reply;
+    station->lastDataTime = clock.elapsed();
+
+    if(station->state == Station::WaitingHeader)
+    {
+        if(reply->bytesAvailable() < MSE_Playlist::detectLength)
+            return;
+
+        if(MSE_Playlist::typeByHeader(reply) != mse_pftUnknown)
+        {
+            station->state = Station::ReceivingPlaylist;
+            return;
+        }
+
+        station->state = Station::Streaming;
+        if(station->wasConnected)
+            station->reconnects++;
+        station->wasConnected = true;
+        station->redirectsLeft = maxRedirects;
+        setConnected(station, true);
+        if(station->isRemoved)
+            return;
+    }
+
+    if(station->state != Station::Streaming)
+        return;
+
+    QByteArray data = reply->readAll();
+    station->parser.feed(data.constData(), data.size(),
+        [this, station](const char* audio, qint64 len){
+            onStationAudio(station, audio, len);
+        },
+        [this, station](const char* meta, int len){
+            onStationMeta(station, meta, len);
+        });
+}
+
+void MSE_StationMonitor::onStationFinished(Station *station)
+{
+    if(station->state == Station::ReceivingPlaylist)
+    {
+        QBuffer buf;
+        buf.setData(station->reply->readAll());
+        buf.open(QIODevice::ReadOnly);
+        QList<MSE_PlaylistEntry> list;
+        if(MSE_Playlist::parse(&buf, list) && !list.isEmpty() && (station->redirectsLeft > 0))
+        {
+            station->redirectsLeft--;
+            connectStation(station, QUrl(list.first().filename));
+            return;
+        }
+        SETERROR(MSE_Object::Err::invalidFormat, station->url);
+    }
+
+    // the stream has ended or failed, either way try again later
+    scheduleReconnect(station);
+}
+
+void MSE_StationMonitor::onStationMeta(Station *station, const char *data, int len)
+{
+    // a slot of the previous chunk has removed the station
+    if(station->isRemoved)
+        return;
+    QString icyString = QString::fromUtf8(data, qstrnlen(data, len));
+    QString trackArtist;
+    QString trackTitle;
+    MSE_IcyParser::parseStreamTitle(icyString, trackArtist, trackTitle);
+    if((trackArtist == station->trackArtist) && (trackTitle == station->trackTitle))
+        return;
+    station->trackArtist = trackArtist;
+    station->trackTitle = trackTitle;
+    emit onTitleChanged(station->id, trackArtist, trackTitle);
+}
+
+void MSE_StationMonitor::onStationAudio(Station *station, const char *data, qint64 len)
+{
+    if(station->isRemoved)
+        return;
+    station->bytesReceived += len;
+    if(!station->wantDecode || station->decodeFailed)
+        return;
+
+    if(!station->decoder)
+    {
+        station->decodeHeader.append(data, len);
+        if(station->decodeHeader.size() >= decodeHeaderSize)
+            startDecoder(station);
+        return;
+    }
+
+    QWORD backlog = BASS_StreamGetFilePosition(station->decoder, BASS_FILEPOS_BUFFER);
+    if((backlog != static_cast<QWORD>(-1)) && (backlog > static_cast<QWORD>(maxDecodeBacklog)))
+        return;
+    BASS_StreamPutFileData(station->decoder, data, len);
+}
+
+bool MSE_StationMonitor::startDecoder(Station *station)
+{
+    station->decodeHeaderPos = 0;
+    MSE_Engine::getInstance()->loadPendingPlugins();
+    station->decoder = BASS_StreamCreateFileUser(
+        STREAMFILE_BUFFERPUSH,
+        BASS_STREAM_DECODE | BASS_SAMPLE_FLOAT,
+        &fileProcTable,
+        station);
+
+    if(!station->decoder)
+    {
+        // unsupported format, don't try again on this connection
+        station->decodeFailed = true;
+        station->decodeHeader.clear();
+        SETERROR(MSE_Object::Err::cannotInitStream, station->url);
+        return false;
+    }
+
+    // the rest of the collected data goes after the part the decoder has already seen
+    int rest = station->decodeHeader.size() - station->decodeHeaderPos;
+    if(rest > 0)
+        BASS_StreamPutFileData(station->decoder, station->decodeHeader.constData() + station->decodeHeaderPos, rest);
+    station->decodeHeader.clear();
+    station->silentSince = -1;
+    return true;
+}
+
+void MSE_StationMonitor::stopDecoder(Station *station)
+{
+    if(station->decoder)
+    {
+        BASS_StreamFree(station->decoder);
+        station->decoder = 0;
+    }
+    station->decodeHeader.clear();
+    station->decodeHeaderPos = 0;
+    station->peak = 0;
+    station->rms = 0;
+    station->silentSince = -1;
+}
+
+/*!
+ * Decodes the audio that has been played out during *secs*
+ * and calculates its levels.
+ */
+void MSE_StationMonitor::measureLevels(Station *station, double secs)
+{
+    QWORD bytes = BASS_ChannelSeconds2Bytes(station->decoder, secs);
+    if((bytes == static_cast<QWORD>(-1)) || !bytes)
+        return;
+    if(levelBuffer.size() < static_cast<int>(bytes))
+        levelBuffer.resize(bytes);
+
+    DWORD n = BASS_ChannelGetData(station->decoder, levelBuffer.data(), bytes);
+    if(n == static_cast<DWORD>(-1))
+        n = 0;
+
+    const float* samples = reinterpret_cast<const float*>(levelBuffer.constData());
+    int count = n / sizeof(float);
+    float peak = 0;
+    double sum = 0;
+    for(int a=0; a<count; a++)
+    {
+        float v = qAbs(samples[a]);
+        if(v > peak)
+            peak = v;
+        sum += v * v;
+    }
+    station->peak = peak;
+    station->rms = count ? static_cast<float>(std::sqrt(sum / count)) : 0;
+    emit onLevels(station->id, station->peak, station->rms);
+}
+
+void MSE_StationMonitor::setConnected(Station *station, bool connected)
+{
+    if(station->isConnected == connected)
+        return;
+    station->isConnected = connected;
+    emit onConnectionChanged(station->id, connected);
+    if(!connected)
+        setHasAudio(station, false);
+}
+
+void MSE_StationMonitor::setHasAudio(Station *station, bool hasAudio)
+{
+    if(station->hasAudio == hasAudio)
+        return;
+    station->hasAudio = hasAudio;
+    emit onAudioPresenceChanged(station->id, hasAudio);
+}
+
+void MSE_StationMonitor::onStatsTimer()
+{
+    qint64 now = clock.elapsed();
+    double secs = statsInterval / 1000.0;
+
+    foreach(Station* station, stations.values())
+    {
+        // removed by a slot of the previous station
+        if(station->isRemoved)
+            continue;
+
+        if(station->reconnectAt >= 0)
+        {
+            if(now >= station->reconnectAt)
+            {
+                station->redirectsLeft = maxRedirects;
+                connectStation(station, QUrl(station->url));
+            }
+            continue;
+        }
+
+        qint64 lastActivity = qMax(station->connectTime, station->lastDataTime);
+        if((station->state != Station::Idle) && (now - lastActivity >= timeoutInterval))
+        {
+            scheduleReconnect(station);
+            continue;
+        }
+
+        static const double alpha = 0.3;
+        double rate = (station->bytesReceived - station->lastBytes) / secs;
+        station->lastBytes = station->bytesReceived;
+        station->byteRate = station->byteRate ? (station->byteRate + alpha * (rate - station->byteRate)) : rate;
+
+        bool isSilent = false;
+        if(station->decoder)
+        {
+            measureLevels(station, secs);
+            if(station->isRemoved)
+                continue;
+            if(station->rms < silenceLevel)
+            {
+                if(station->silentSince < 0)
+                    station->silentSince = now;
+                isSilent = now - station->silentSince >= silenceTime;
+            }
+            else
+            {
+                station->silentSince = -1;
+            }
+        }
+
+        bool isFlowing = station->isConnected && (now - station->lastDataTime < silenceTime);
+        setHasAudio(station, isFlowing && !isSilent);
+    }
+}
+
+void MSE_StationMonitor::fileCloseProc(void *user)
+{
+    Q_UNUSED(user);
+}
+
+QWORD MSE_StationMonitor::fileLenProc(void *user)
+{
+    Q_UNUSED(user);
+    return 0;
+}
+
+/*!
+ * Feeds the initial data to a push stream while it's being created.
+ */
+DWORD MSE_StationMonitor::fileReadProc(void *buffer, DWORD length, void *user)
+{
+    Station* station = static_cast<Station*>(user);
+    int n = qMin(static_cast<int>(length), station->decodeHeader.size() - station->decodeHeaderPos);
+    if(n <= 0)
+        return 0;
+    memcpy(buffer, station->decodeHeader.constData() + station->decodeHeaderPos, n);
+    station->decodeHeaderPos += n;
+    return n;
+}
+
+BOOL MSE_StationMonitor::fileSeekProc(QWORD offset, void *user)
+{
+    Q_UNUSED(offset);
+    Q_UNUSED(user);
+    return false;
+}
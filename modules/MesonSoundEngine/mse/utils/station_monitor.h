@@ -0,0 +1,146 @@
+#pragma once
+
+#include "mse/object.h"
+#include "mse/utils/icy_parser.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QTimer>
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkReply>
+
+/*!
+ * Current state of a station watched by MSE_StationMonitor.
+ */
+struct MSE_StationMonitorStats {
+    int id = 0; /*!< Station ID returned by MSE_StationMonitor::addStation(). */
+    QString url; /*!< The URL the station was added with. */
+    bool isConnected = false; /*!< True if the audio data is being received. */
+    bool hasAudio = false; /*!<
+    True if the data keeps arriving and (when decoding) it's not silent.
+
+    \sa MSE_StationMonitor::silenceTime
+*/
+    QString trackArtist; /*!< Artist from the last ICY StreamTitle. */
+    QString trackTitle; /*!< Title from the last ICY StreamTitle. */
+    int bitrate = 0; /*!< Bitrate (in kbit/s) announced by the server (icy-br) or 0. */
+    quint64 bytesReceived = 0; /*!< Number of audio bytes received since the station was added. */
+    double byteRate = 0; /*!< Average audio arrival rate in bytes per second. */
+    int reconnects = 0; /*!< Number of times the connection was re-established. */
+    bool isDecoding = false; /*!< True if the audio is being decoded. */
+    float peak = 0; /*!< Peak level (0..1) of the audio decoded during the last stats interval. */
+    float rms = 0; /*!< RMS level (0..1) of the audio decoded during the last stats interval. */
+};
+
+/*!
+ * Headless monitor for many Internet-radio stations at once.
+ *
+ * All stations share one timer and the event loop of the thread the object lives in.
+ * No mixer, sound object or thread is created per station.
+ * QNetworkAccessManager opens only maxHostConnections connections to one server,
+ * and a live stream never frees its connection, so the stations are spread over as many managers
+ * as it takes to connect to all mounts of the same server at once.
+ * The ICY metadata is parsed for every station and the title changes are reported,
+ * while the audio is only decoded for the stations that asked for it with setDecoding().
+ * The decoding uses BASS push streams that are fed from the network callbacks,
+ * so it doesn't need any extra threads either.
+ */
+class MSE_StationMonitor : public MSE_Object
+{
+    Q_OBJECT
+public:
+    explicit MSE_StationMonitor(QObject* parent = nullptr);
+    ~MSE_StationMonitor();
+
+    int addStation(const QString& url);
+    bool removeStation(int id);
+    void removeAll();
+
+    bool setDecoding(int id, bool decode);
+    bool getStats(int id, MSE_StationMonitorStats& stats) const;
+    QList<MSE_StationMonitorStats> getAllStats() const;
+
+    /*!
+     * Returns the IDs of all stations.
+     */
+    inline QList<int> getStationIds() const {return stations.keys();}
+
+    /*!
+     * Returns the number of stations.
+     */
+    inline int getStationsCount() const {return stations.size();}
+
+    static const int statsInterval;
+    static const int timeoutInterval;
+    static const int retryInterval;
+    static const int maxRedirects;
+    static const int silenceTime;
+    static const float silenceLevel;
+    static const int decodeHeaderSize;
+    static const int maxDecodeBacklog;
+    static const int maxHostConnections;
+
+protected:
+    struct Station;
+    struct NetManager {
+        QNetworkAccessManager* manager;
+        QHash<QString, int> connections; // per scheme, host and port
+    };
+
+    QList<NetManager> netManagers;
+    QHash<int, Station*> stations;
+    QList<Station*> removedStations;
+    QTimer statsTimer;
+    QElapsedTimer clock;
+    QByteArray levelBuffer;
+    BASS_FILEPROCS fileProcTable;
+    int nextId;
+
+    void releaseStation(Station* station);
+    int acquireNetManager(const QString& hostKey);
+    void connectStation(Station* station, const QUrl& url);
+    void disconnectStation(Station* station);
+    void scheduleReconnect(Station* station);
+    void onStationHeaders(Station* station);
+    void onStationData(Station* station);
+    void onStationFinished(Station* station);
+    void onStationMeta(Station* station, const char* data, int len);
+    void onStationAudio(Station* station, const char* data, qint64 len);
+    void setConnected(Station* station, bool connected);
+    void setHasAudio(Station* station, bool hasAudio);
+    bool startDecoder(Station* station);
+    void stopDecoder(Station* station);
+    void measureLevels(Station* station, double secs);
+
+    static void CALLBACK fileCloseProc(void *user);
+    static QWORD CALLBACK fileLenProc(void *user);
+    static DWORD CALLBACK fileReadProc(void *buffer, DWORD length, void *user);
+    static BOOL CALLBACK fileSeekProc(QWORD offset, void *user);
+
+protected slots:
+    void onStatsTimer();
+    void deleteRemovedStations();
+
+signals:
+    /*!
+     * Emitted when the ICY StreamTitle of a station changes.
+     */
+    void onTitleChanged(int id, const QString& trackArtist, const QString& trackTitle);
+
+    /*!
+     * Emitted when a station connects or disconnects.
+     */
+    void onConnectionChanged(int id, bool isConnected);
+
+    /*!
+     * Emitted when a station starts or stops delivering audio.
+     *
+     * \sa MSE_StationMonitorStats::hasAudio
+     */
+    void onAudioPresenceChanged(int id, bool hasAudio);
+
+    /*!
+     * Emitted every ::statsInterval milliseconds for each decoding station.
+     */
+    void onLevels(int id, float peak, float rms);
+};
@@ -0,0 +1,578 @@
+#include "mse/utils/transmitter.h"
+#include "mse/sound.h"
+
+#include <QFileInfo>
+#include <QUrlQuery>
+
+#include <cstring>
+
+const int MSE_Transmitter::maxPendingBytes = 64*1024; // per listener, the rest waits in the shared buffer
+const int MSE_Transmitter::requestTimeout = 10000; // ms, drop the clients that don't send the request
+const int MSE_Transmitter::pacingResolution = 10; // ms, a tick of the pacing timer wheel
+const int MSE_Transmitter::pacingSlots = 256; // the wheel spans 2.56 seconds
+const int MSE_Transmitter::sendQuantum = 50; // ms of audio, a paced listener is woken up when it can get at least this much
+const int MSE_Transmitter::minRateWindow = 10; // s of encoded audio before the measured stream rate is trusted
+static const qint64 minSendQuantum = 512; // bytes
+
+class MSE_Transmitter::Client : public QObject
+{
+public:
+    Client(MSE_Transmitter* transmitter, QTcpSocket* socket) : QObject(transmitter)
+      ,transmitter(transmitter)
+      ,socket(socket)
+      ,address(socket->peerAddress().toString())
+    {
+        socket->setParent(this);
+        // the client is the context, so abort() can cut these off with socket->disconnect(this)
+        connect(socket, &QTcpSocket::readyRead, this, [this](){onReadyRead();});
+        connect(socket, &QTcpSocket::bytesWritten, this, [this](){
+            if(isListener)
+                this->transmitter->feed(this);
+        });
+        connect(socket, &QTcpSocket::disconnected, this, [this](){finish();});
+        requestTimer.setSingleShot(true);
+        connect(&requestTimer, &QTimer::timeout, this, [this](){
+            abort();
+            finish();
+        });
+        requestTimer.start(requestTimeout);
+    }
+
+    void abort()
+    {
+        requestTimer.stop();
+        socket->disconnect(this);
+        socket->abort();
+    }
+
+    void write(const char* data, qint64 len)
+    {
+        socket->write(data, len);
+        transmitter->bytesSent += len;
+    }
+
+    void write(const QByteArray& data)
+    {
+        write(data.constData(), data.size());
+    }
+
+    MSE_Transmitter* transmitter;
+    QTcpSocket* socket;
+    QString address;
+    QByteArray request;
+    bool isParsed = false;
+    QTimer requestTimer;
+
+    bool isListener = false;
+    bool withMeta = false;
+    quint64 cursor = 0;
+    qint64 metaLeft = 0;
+    quint64 metaVersion = 0;
+    MSE_TokenBucket bucket;
+    int wheelSlot = -1;
+
+protected:
+    void finish()
+    {
+        requestTimer.stop();
+        if(wheelSlot >= 0)
+        {
+            transmitter->wheel.cancel(this, wheelSlot);
+            wheelSlot = -1;
+        }
+        if(isListener)
+        {
+            isListener = false;
+            transmitter->nListeners--;
+            emit transmitter->onListenerDisconnected(address);
+        }
+        transmitter->clients.removeOne(this);
+        deleteLater();
+    }
+
+    void writeResponse(const QByteArray& status, const QByteArray& body)
+    {
+        QByteArray head = "HTTP/1.0 " + status + "\r\n";
+        head.append("Content-Type: text/plain\r\n");
+        head.append("Content-Length: " + QByteArray::number(body.size()) + "\r\n");
+        head.append("Connection: close\r\n\r\n");
+        write(head);
+        write(body);
+        socket->disconnectFromHost();
+    }
+
+    void onReadyRead()
+    {
+        if(isParsed)
+        {
+            socket->readAll();
+            return;
+        }
+
+        request.append(socket->readAll());
+        int p = request.indexOf("\r\n\r\n");
+        if(p < 0)
+        {
+            if(request.size() > MSE_TRANSMITTER_MAXCLIENTREQUESTLENGTH)
+            {
+                abort();
+                finish();
+            }
+            return;
+        }
+        isParsed = true;
+        requestTimer.stop();
+
+        QList<QByteArray> lines = request.left(p).split('\n');
+        QList<QByteArray> requestLine = lines.takeFirst().trimmed().split(' ');
+        if(requestLine.size() < 2)
+        {
+            writeResponse("400 Bad Request", "Bad Request");
+            return;
+        }
+        QByteArray method = requestLine.at(0);
+        QByteArray target = requestLine.at(1);
+        QByteArray path = target;
+        QByteArray query;
+        int q = target.indexOf('?');
+        if(q >= 0)
+        {
+            path = target.left(q);
+            query = target.mid(q + 1);
+        }
+
+        bool withBody = method != "HEAD";
+        if((method != "GET") && withBody)
+        {
+            writeResponse("405 Method Not Allowed", "Method Not Allowed");
+            return;
+        }
+
+        if(path == "/admin.cgi")
+        {
+            respondAdmin(query);
+            return;
+        }
+
+        bool metaRequested = false;
+        foreach(const QByteArray& line, lines)
+        {
+            int c = line.indexOf(':');
+            if((c > 0) && (line.left(c).trimmed().toLower() == "icy-metadata"))
+                metaRequested = line.mid(c + 1).trimmed() == "1";
+        }
+
+        const MSE_TransmitterInitParams& params = transmitter->initParams;
+        if(params.maxListeners && (transmitter->nListeners >= params.maxListeners))
+        {
+            writeResponse("503 Service Unavailable", "Server Full");
+            return;
+        }
+
+        write(transmitter->makeHeaders(metaRequested));
+        if(!withBody)
+        {
+            socket->disconnectFromHost();
+            return;
+        }
+
+        // burst: start a bit in the past, so the player can fill its buffer right away
+        quint64 tail = transmitter->getRingTail();
+        quint64 head = transmitter->ringHead;
+        cursor = qMax(tail, head - qMin(head, static_cast<quint64>(transmitter->burstSize)));
+        withMeta = metaRequested;
+        metaLeft = params.dataBlockLength;
+        metaVersion = 0;
+        // the bucket must be able to hold a send quantum, otherwise a paced listener never gets any data
+        double capacity = qMax(static_cast<double>(transmitter->burstSize), transmitter->getSendQuantumBytes());
+        bucket.reset(transmitter->burstSize, capacity, transmitter->clock.nsecsElapsed());
+        isListener = true;
+        transmitter->nListeners++;
+        emit transmitter->onListenerConnected(address);
+        transmitter->feed(this);
+    }
+
+    void respondAdmin(QByteArray query)
+    {
+        const QString& password = transmitter->initParams.controlPassword;
+        query.replace('+', ' ');
+        QUrlQuery items(QString::fromUtf8(query));
+        if(password.isEmpty() || (items.queryItemValue(QStringLiteral("pass"), QUrl::FullyDecoded) != password))
+        {
+            writeResponse("403 Forbidden", "Forbidden");
+            return;
+        }
+
+        if(items.queryItemValue(QStringLiteral("mode")) == QStringLiteral("updinfo"))
+        {
+            transmitter->setStreamTitle(items.queryItemValue(QStringLiteral("song"), QUrl::FullyDecoded));
+            writeResponse("200 OK", "OK");
+            return;
+        }
+
+        writeResponse("400 Bad Request", "Unknown mode");
+    }
+};
+
+MSE_Transmitter::MSE_Transmitter(MSE_Encoder *encoder, QObject *parent) : MSE_Object(parent)
+  ,encoder(encoder)
+  ,wheel(pacingSlots, static_cast<qint64>(pacingResolution) * 1000000)
+  ,streamRate(0)
+  ,nListeners(0)
+  ,bytesSent(0)
+  ,ringCapacity(0)
+  ,ringHead(0)
+  ,burstSize(0)
+  ,hasPending(false)
+  ,metaVersion(1)
+{
+    connect(&server, &QTcpServer::newConnection, this, &MSE_Transmitter::onNewConnection);
+    connect(&publishTimer, &QTimer::timeout, this, &MSE_Transmitter::publish);
+    pacingTimer.setTimerType(Qt::PreciseTimer);
+    connect(&pacingTimer, &QTimer::timeout, this, &MSE_Transmitter::onPacingTick);
+    metaBlock = makeMetaBlock(QString());
+}
+
+MSE_Transmitter::~MSE_Transmitter()
+{
+    stop();
+}
+
+/*!
+ * Initializes the transmitter.
+ * The encoder must be initialized beforehand:
+ * the size of the shared buffer is calculated from MSE_EncoderInitParams::outputBitrate.
+ */
+bool MSE_Transmitter::init(const MSE_TransmitterInitParams &params)
+{
+    CHECK(!isRunning(), Err::invalidState);
+    CHECK(params.port, Err::outOfRange);
+    CHECK(params.dataBlockLength > 0, Err::outOfRange);
+    CHECK(params.bufferLength, Err::outOfRange);
+
+    const MSE_EncoderInitParams& encoderParams = encoder->getInitParams();
+    qint64 byteRate = static_cast<qint64>(encoderParams.outputBitrate) * 1000 / 8;
+    CHECK(byteRate > 0, Err::outOfRange);
+
+    initParams = params;
+    if(!initParams.pollInterval)
+        initParams.pollInterval = static_cast<quint8>(qMax(1, encoderParams.chunkDuration - 1));
+    initParams.burstLength = qMin(initParams.burstLength, initParams.bufferLength);
+
+    qint64 capacity = byteRate * initParams.bufferLength;
+    if(capacity != ringCapacity)
+    {
+        ring.reset(new (std::nothrow) char[capacity]);
+        if(!ring)
+        {
+            ringCapacity = 0;
+            SETERROR(Err::memoryError);
+            return false;
+        }
+        ringCapacity = capacity;
+    }
+    ringHead = 0;
+    burstSize = byteRate * initParams.burstLength;
+    streamRate = byteRate;
+
+    QMutexLocker locker(&pendingMutex);
+    pending.clear();
+    hasPending.store(false);
+    return true;
+}
+
+/*!
+ * Makes the *backend* send the encoded data to the transmitter.
+ * Must be called before MSE_Encoder::start().
+ */
+void MSE_Transmitter::attachBackend(MSE_EncoderBackend *backend)
+{
+    backend->setOutputCallback([this](const char* data, qint64 len){
+        return push(data, len);
+    });
+}
+
+/*!
+ * Queues the encoded data for the listeners.
+ * Can be called from any thread (usually it's the encoding thread of MSE_Encoder).
+ * The data is published to the listeners every MSE_TransmitterInitParams::pollInterval seconds
+ * or on every pacing tick if MSE_TransmitterInitParams::useAccurateSendIntervals is set.
+ */
+bool MSE_Transmitter::push(const char *data, qint64 len)
+{
+    QMutexLocker locker(&pendingMutex);
+    pending.append(data, static_cast<int>(len));
+    // nobody will ever see more than the shared buffer holds
+    if(ringCapacity && (pending.size() > ringCapacity))
+        pending.remove(0, static_cast<int>(pending.size() - ringCapacity));
+    hasPending.store(true, std::memory_order_release);
+    return true;
+}
+
+/*!
+ * Starts accepting the listeners on MSE_TransmitterInitParams::port.
+ */
+bool MSE_Transmitter::start()
+{
+    CHECK(ringCapacity, Err::invalidState);
+    CHECK(!isRunning(), Err::invalidState);
+    CHECK(server.listen(QHostAddress::Any, initParams.port), Err::cannotBindAddress, server.errorString());
+    clock.start();
+    wheel.reset(clock.nsecsElapsed());
+    if(initParams.useAccurateSendIntervals)
+        pacingTimer.start(pacingResolution);
+    else
+        publishTimer.start(initParams.pollInterval * 1000);
+    return true;
+}
+
+/*!
+ * Stops listening and drops all clients.
+ */
+void MSE_Transmitter::stop()
+{
+    publishTimer.stop();
+    pacingTimer.stop();
+    server.close();
+    QList<Client*> list = clients;
+    clients.clear();
+    foreach(Client* client, list)
+    {
+        client->abort();
+        delete client;
+    }
+    nListeners = 0;
+    wheel.reset(0);
+}
+
+/*!
+ * Sets the stream title according to MSE_TransmitterInitParams::titleFormat.
+ * If the *title* is empty, then the *filename* without an extension is used instead.
+ */
+void MSE_Transmitter::setTrack(const QString &artist, const QString &title, const QString &filename)
+{
+    QString trackTitle = title;
+    if(trackTitle.isEmpty() && !filename.isEmpty())
+        trackTitle = QFileInfo(filename).completeBaseName();
+    QString fullTitle = artist.isEmpty() ? trackTitle : (artist + QStringLiteral(" - ") + trackTitle);
+
+    QString result = initParams.titleFormat;
+    result.replace(QStringLiteral("%full_title%"), fullTitle);
+    result.replace(QStringLiteral("%artist%"), artist);
+    result.replace(QStringLiteral("%title%"), trackTitle);
+    setStreamTitle(result);
+}
+
+/*!
+ * Sets the stream title from the current track of the *sound*.
+ * Connect it to MSE_Sound::onInfoChange to follow the playback.
+ */
+void MSE_Transmitter::setTrack(MSE_Sound *sound)
+{
+    setTrack(sound->getTrackArtist(), sound->getTrackTitle(), sound->getTrackFilename());
+}
+
+/*!
+ * Sets the title that is sent to the listeners as is.
+ */
+void MSE_Transmitter::setStreamTitle(const QString &title)
+{
+    if(title == streamTitle)
+        return;
+    streamTitle = title;
+    metaBlock = makeMetaBlock(title);
+    metaVersion++;
+}
+
+/*!
+ * Moves the data pushed by the encoder into the shared buffer and sends it to the listeners.
+ */
+void MSE_Transmitter::publish()
+{
+    if(!hasPending.exchange(false, std::memory_order_acquire))
+        return;
+
+    QByteArray data;
+    {
+        QMutexLocker locker(&pendingMutex);
+        data.swap(pending);
+    }
+
+    const char* src = data.constData();
+    qint64 len = data.size();
+    if(len > ringCapacity)
+    {
+        src += len - ringCapacity;
+        ringHead += len - ringCapacity;
+        len = ringCapacity;
+    }
+    qint64 pos = ringHead % ringCapacity;
+    qint64 firstLen = qMin(len, ringCapacity - pos);
+    memcpy(ring.get() + pos, src, firstLen);
+    if(firstLen < len)
+        memcpy(ring.get(), src + firstLen, len - firstLen);
+    ringHead += len;
+    updateStreamRate();
+
+    foreach(Client* client, clients)
+    {
+        if(client->isListener)
+            feed(client);
+    }
+}
+
+/*!
+ * Measures the byte rate of the encoded stream against the duration of the PCM data the encoder has consumed,
+ * so the pacing follows the sample clock of the stream rather than the nominal bitrate or a sound card.
+ */
+void MSE_Transmitter::updateStreamRate()
+{
+    const MSE_EncoderFormat& format = encoder->getFormat();
+    double pcmRate = static_cast<double>(format.frequency) * format.getBlockAlign();
+    double duration = encoder->getStats().bytes / pcmRate;
+    if(duration >= minRateWindow)
+        streamRate = ringHead / duration;
+}
+
+void MSE_Transmitter::onPacingTick()
+{
+    publish();
+    wheel.advance(clock.nsecsElapsed(), [this](Client* client){
+        client->wheelSlot = -1;
+        feed(client);
+    });
+}
+
+/*!
+ * Returns the number of bytes a paced listener is woken up for.
+ */
+double MSE_Transmitter::getSendQuantumBytes() const
+{
+    return qMax(static_cast<double>(minSendQuantum), streamRate * sendQuantum / 1000);
+}
+
+/*!
+ * Returns the position of the oldest byte that is still in the shared buffer.
+ */
+quint64 MSE_Transmitter::getRingTail() const
+{
+    return (ringHead > static_cast<quint64>(ringCapacity)) ? (ringHead - ringCapacity) : 0;
+}
+
+/*!
+ * Sends the listener as much of the shared buffer as its socket can take.
+ */
+void MSE_Transmitter::feed(Client *client)
+{
+    static const char noMeta = 0;
+
+    quint64 tail = getRingTail();
+    if(client->cursor < tail)
+    {
+        // the listener is too slow, drop what it has missed
+        client->cursor = qMax(tail, ringHead - qMin(ringHead, static_cast<quint64>(burstSize)));
+    }
+
+    bool isPaced = initParams.useAccurateSendIntervals;
+    if(isPaced && (client->wheelSlot >= 0))
+        return; // the wheel will wake it up
+
+    qint64 room = maxPendingBytes - client->socket->bytesToWrite();
+    qint64 allowed = room;
+    if(isPaced)
+    {
+        client->bucket.refill(streamRate, clock.nsecsElapsed());
+        allowed = qMin(allowed, client->bucket.available());
+    }
+
+    qint64 sent = 0;
+    while((sent < allowed) && (client->cursor < ringHead))
+    {
+        qint64 pos = client->cursor % ringCapacity;
+        qint64 len = qMin(allowed - sent, static_cast<qint64>(ringHead - client->cursor));
+        len = qMin(len, ringCapacity - pos);
+        if(client->withMeta)
+            len = qMin(len, client->metaLeft);
+
+        client->write(ring.get() + pos, len);
+        client->cursor += len;
+        sent += len;
+
+        if(client->withMeta)
+        {
+            client->metaLeft -= len;
+            if(!client->metaLeft)
+            {
+                if(client->metaVersion == metaVersion)
+                {
+                    client->write(&noMeta, 1);
+                }
+                else
+                {
+                    client->write(metaBlock);
+                    client->metaVersion = metaVersion;
+                }
+                client->metaLeft = initParams.dataBlockLength;
+            }
+        }
+    }
+
+    if(isPaced)
+    {
+        client->bucket.consume(sent);
+        // out of tokens, but not out of data or socket room: sleep until the next quantum is earned
+        if((client->cursor < ringHead) && (sent < room))
+        {
+            double quantum = getSendQuantumBytes();
+            // the quantum follows the measured stream rate and may outgrow the bucket
+            client->bucket.capacity = qMax(client->bucket.capacity, quantum);
+            qint64 now = clock.nsecsElapsed();
+            client->wheelSlot = wheel.schedule(client, now + client->bucket.timeUntil(quantum, streamRate));
+        }
+    }
+}
+
+QByteArray MSE_Transmitter::makeHeaders(bool withMeta) const
+{
+    QByteArray head = "HTTP/1.0 200 OK\r\n";
+    head.append("Content-Type: " + initParams.contentType.toUtf8() + "\r\n");
+    head.append("icy-name: " + initParams.name.toUtf8() + "\r\n");
+    head.append("icy-genre: " + initParams.genre.toUtf8() + "\r\n");
+    head.append(initParams.isPublic ? "icy-pub: 1\r\n" : "icy-pub: 0\r\n");
+    head.append("icy-br: " + QByteArray::number(encoder->getInitParams().outputBitrate) + "\r\n");
+
+    QList<QPair<QByteArray, QString>> optional;
+    optional << qMakePair(QByteArray("icy-url"), initParams.url);
+    optional << qMakePair(QByteArray("icy-irc"), initParams.irc);
+    optional << qMakePair(QByteArray("icy-icq"), initParams.icq);
+    optional << qMakePair(QByteArray("icy-aim"), initParams.aim);
+    optional << qMakePair(QByteArray("icy-notice1"), initParams.notice1);
+    optional << qMakePair(QByteArray("icy-notice2"), initParams.notice2);
+    for(const QPair<QByteArray, QString>& header : optional)
+    {
+        if(!header.second.isEmpty())
+            head.append(header.first + ": " + header.second.toUtf8() + "\r\n");
+    }
+
+    if(withMeta)
+        head.append("icy-metaint: " + QByteArray::number(initParams.dataBlockLength) + "\r\n");
+    head.append("Cache-Control: no-cache\r\n");
+    head.append("Connection: close\r\n\r\n");
+    return head;
+}
+
+QByteArray MSE_Transmitter::makeMetaBlock(const QString &title) const
+{
+    QByteArray meta = "StreamTitle='" + title.toUtf8().left(MSE_TRANSMITTER_MAXTITLELENGTH) + "';";
+    meta = meta.left(MSE_TRANSMITTER_MAXMETALENGTH);
+    int nBlocks = (meta.size() + MSE_TRANSMITTER_METAMULTIPLIER - 1) / MSE_TRANSMITTER_METAMULTIPLIER;
+    meta.append(QByteArray(nBlocks * MSE_TRANSMITTER_METAMULTIPLIER - meta.size(), '\0'));
+    meta.prepend(static_cast<char>(nBlocks));
+    return meta;
+}
+
+void MSE_Transmitter::onNewConnection()
+{
+    while(QTcpSocket* socket = server.nextPendingConnection())
+        clients.append(new Client(this, socket));
+}
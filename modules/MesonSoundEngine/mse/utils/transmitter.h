@@ -0,0 +1,161 @@
+#pragma once
+
+#include "mse/object.h"
+#include "mse/utils/encoder.h"
+#include "mse/utils/pacing.h"
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QTimer>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+
+#include <atomic>
+#include <memory>
+
+/*!
+ * Built-in SHOUTcast/ICY streaming server fed by MSE_Encoder.
+ *
+ * The encoded stream is kept in one ring buffer shared by all listeners;
+ * every listener only has its own position in it, so a new block costs the same
+ * no matter how many listeners there are.
+ * The sockets are non-blocking and serviced by the event loop of the thread
+ * the object lives in: a listener is topped up only when its socket has drained,
+ * and a listener that falls behind by more than MSE_TransmitterInitParams::bufferLength
+ * skips to the latest data instead of holding back the others.
+ *
+ * The ICY metadata (icy-metaint) is inserted into the stream of the listeners that ask for it.
+ * The metadata block is built once per title change and shared by all listeners.
+ *
+ * With MSE_TransmitterInitParams::useAccurateSendIntervals every listener has a token bucket
+ * that is refilled at the byte rate of the encoded stream (see getStreamRate),
+ * and the listeners that have run out of tokens wait in a timer wheel driven by a monotonic clock,
+ * so each pacing tick only touches the listeners that are due.
+ *
+ * Usage:
+ * \code
+ * MSE_Transmitter transmitter(&encoder);
+ * transmitter.init(params);
+ * MSE_EncoderBackend* backend = new MSE_EncoderProcess("lame", args);
+ * transmitter.attachBackend(backend);
+ * encoder.start(backend);
+ * transmitter.start();
+ * \endcode
+ */
+class MSE_Transmitter : public MSE_Object
+{
+    Q_OBJECT
+
+public:
+    explicit MSE_Transmitter(MSE_Encoder* encoder, QObject* parent = nullptr);
+    ~MSE_Transmitter();
+
+    bool init(const MSE_TransmitterInitParams& params = MSE_TransmitterInitParams());
+
+    /*!
+     * Get current initialization parameters.
+     */
+    inline const MSE_TransmitterInitParams& getInitParams() const {return initParams;}
+
+    /*!
+     * Returns the encoder that feeds the transmitter.
+     */
+    inline MSE_Encoder* getEncoder() const {return encoder;}
+
+    void attachBackend(MSE_EncoderBackend* backend);
+    bool push(const char* data, qint64 len);
+
+    bool start();
+    void stop();
+
+    /*!
+     * Returns true if the server is listening.
+     */
+    inline bool isRunning() const {return server.isListening();}
+
+    void setTrack(const QString& artist, const QString& title, const QString& filename = QString());
+    void setTrack(MSE_Sound* sound);
+    void setStreamTitle(const QString& title);
+
+    /*!
+     * Returns the title that is sent to the listeners.
+     */
+    inline const QString& getStreamTitle() const {return streamTitle;}
+
+    /*!
+     * Returns the number of connected listeners.
+     */
+    inline int getListenersCount() const {return nListeners;}
+
+    /*!
+     * Returns the total number of bytes (including headers and metadata) sent to all listeners.
+     */
+    inline quint64 getBytesSent() const {return bytesSent;}
+
+    /*!
+     * Returns the byte rate of the encoded stream.
+     * It's measured against the sample clock of the encoder (i.e. the duration of the encoded PCM data),
+     * until there's enough data it's derived from MSE_EncoderInitParams::outputBitrate.
+     */
+    inline double getStreamRate() const {return streamRate;}
+
+    static const int maxPendingBytes;
+    static const int requestTimeout;
+    static const int pacingResolution;
+    static const int pacingSlots;
+    static const int sendQuantum;
+    static const int minRateWindow;
+
+signals:
+    /*!
+     * Emitted when a listener starts receiving the stream.
+     */
+    void onListenerConnected(const QString& address);
+
+    /*!
+     * Emitted when a listener has gone.
+     */
+    void onListenerDisconnected(const QString& address);
+
+protected:
+    class Client;
+
+    MSE_Encoder* encoder;
+    MSE_TransmitterInitParams initParams;
+    QTcpServer server;
+    QTimer publishTimer;
+    QTimer pacingTimer;
+    QElapsedTimer clock;
+    MSE_TimerWheel<Client*> wheel;
+    double streamRate;
+    QList<Client*> clients;
+    int nListeners;
+    quint64 bytesSent;
+
+    std::unique_ptr<char[]> ring;
+    qint64 ringCapacity;
+    quint64 ringHead; // total bytes published
+    qint64 burstSize;
+
+    QMutex pendingMutex;
+    QByteArray pending; // written by the encoding thread, published by the timer
+    std::atomic<bool> hasPending;
+
+    QString streamTitle;
+    QByteArray metaBlock;
+    quint64 metaVersion;
+
+    void publish();
+    void updateStreamRate();
+    void onPacingTick();
+    quint64 getRingTail() const;
+    double getSendQuantumBytes() const;
+    void feed(Client* client);
+    QByteArray makeHeaders(bool withMeta) const;
+    QByteArray makeMetaBlock(const QString& title) const;
+
+protected slots:
+    void onNewConnection();
+};
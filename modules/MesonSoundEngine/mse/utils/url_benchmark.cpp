@@ -0,0 +1,256 @@
+#include "mse/utils/url_benchmark.h"
+#include "mse/sources/source_url.h"
+
+#ifdef Q_OS_LINUX
+    #include <unistd.h>
+#endif
+
+QJsonObject MSE_UrlBenchmarkResult::toJson() const
+{
+    QJsonObject obj;
+    obj.insert("url", url);
+    obj.insert("nStreams", nStreams);
+    obj.insert("nStarted", nStarted);
+    obj.insert("timeToFirstAudio", timeToFirstAudio);
+    obj.insert("maxTimeToFirstAudio", maxTimeToFirstAudio);
+    obj.insert("reconnects", reconnects);
+    obj.insert("reconnectLatency", reconnectLatency);
+    obj.insert("maxReconnectLatency", maxReconnectLatency);
+    obj.insert("underruns", static_cast<double>(underruns));
+    obj.insert("cpuPerStream", cpuPerStream);
+    obj.insert("memoryPerStream", static_cast<double>(memoryPerStream));
+    return obj;
+}
+
+MSE_UrlBenchmarkResult MSE_UrlBenchmarkResult::fromJson(const QJsonObject &obj)
+{
+    MSE_UrlBenchmarkResult r;
+    r.url = obj.value("url").toString();
+    r.nStreams = obj.value("nStreams").toInt();
+    r.nStarted = obj.value("nStarted").toInt();
+    r.timeToFirstAudio = obj.value("timeToFirstAudio").toDouble(-1);
+    r.maxTimeToFirstAudio = obj.value("maxTimeToFirstAudio").toDouble(-1);
+    r.reconnects = obj.value("reconnects").toInt();
+    r.reconnectLatency = obj.value("reconnectLatency").toDouble(-1);
+    r.maxReconnectLatency = obj.value("maxReconnectLatency").toDouble(-1);
+    r.underruns = static_cast<quint64>(obj.value("underruns").toDouble());
+    r.cpuPerStream = obj.value("cpuPerStream").toDouble();
+    r.memoryPerStream = static_cast<qint64>(obj.value("memoryPerStream").toDouble());
+    return r;
+}
+
+MSE_UrlBenchmark::MSE_UrlBenchmark(QObject *parent) : MSE_Object(parent)
+  ,cpuStart(0)
+  ,memoryStart(0)
+{
+    connect(&pollTimer, &QTimer::timeout, this, &MSE_UrlBenchmark::onPoll);
+}
+
+MSE_UrlBenchmark::~MSE_UrlBenchmark()
+{
+    clearStreams();
+}
+
+/*!
+ * Opens the streams and starts measuring.
+ * onFinished() is emitted after MSE_UrlBenchmarkParams::duration milliseconds.
+ */
+bool MSE_UrlBenchmark::start(const MSE_UrlBenchmarkParams &params)
+{
+    CHECK(!isRunning(), MSE_Object::Err::invalidState);
+    CHECK(params.nStreams > 0, MSE_Object::Err::outOfRange);
+    CHECK(params.pollInterval > 0, MSE_Object::Err::outOfRange);
+
+    this->params = params;
+    result = MSE_UrlBenchmarkResult();
+    result.url = params.url;
+    result.nStreams = params.nStreams;
+    gaps.clear();
+
+    memoryStart = currentMemory();
+    cpuStart = std::clock();
+    clock.start();
+
+    MSE_SoundInitParams soundParams;
+    soundParams.decodeOnly = true;
+    soundParams.sampleType = mse_sstFloat32;
+    for(int a=0; a<params.nStreams; a++)
+    {
+        Stream stream;
+        stream.sound = new MSE_Sound();
+        streams.append(stream);
+        if(!stream.sound->init(soundParams)
+            || !stream.sound->getPlaylist()->addUrl(MSE_PlaylistEntry(params.url))
+            || !stream.sound->openFromList(0)
+            || !stream.sound->play())
+        {
+            clearStreams();
+            SETERROR(MSE_Object::Err::cannotLoadSound, params.url);
+            return false;
+        }
+    }
+
+    pollTimer.start(params.pollInterval);
+    return true;
+}
+
+/*!
+ * Stops the run without emitting onFinished().
+ */
+void MSE_UrlBenchmark::stop()
+{
+    pollTimer.stop();
+    clearStreams();
+}
+
+void MSE_UrlBenchmark::clearStreams()
+{
+    foreach(const Stream& stream, streams)
+        delete stream.sound;
+    streams.clear();
+}
+
+bool MSE_UrlBenchmark::isSilent(const float *samples, int count)
+{
+    for(int a=0; a<count; a++)
+        if(qAbs(samples[a]) > 0.0001f)
+            return false;
+    return true;
+}
+
+void MSE_UrlBenchmark::onPoll()
+{
+    qint64 now = clock.elapsed();
+
+    for(int a=0; a<streams.size(); a++)
+    {
+        Stream& stream = streams[a];
+        int freq = stream.sound->getFrequency();
+        int nChannels = stream.sound->getChannelsCount();
+        if(!freq || !nChannels)
+            continue;
+
+        int len = qMax(1, freq * params.pollInterval / 1000) * nChannels * static_cast<int>(sizeof(float));
+        if(pollBuffer.size() < len)
+            pollBuffer.resize(len);
+        int n = stream.sound->getData(pollBuffer.data(), len);
+        bool silent = (n <= 0)
+            || isSilent(reinterpret_cast<const float*>(pollBuffer.constData()), n / sizeof(float));
+
+        if(!silent)
+        {
+            if(stream.firstAudio < 0)
+                stream.firstAudio = now;
+            if(stream.gapStart >= 0)
+            {
+                qint64 gap = now - stream.gapStart;
+                if(gap >= params.minGap)
+                    gaps.append(gap);
+                stream.gapStart = -1;
+            }
+        }
+        else
+        {
+            if((stream.firstAudio >= 0) && (stream.gapStart < 0))
+                stream.gapStart = now;
+        }
+    }
+
+    if(now >= params.duration)
+        finish();
+}
+
+void MSE_UrlBenchmark::finish()
+{
+    pollTimer.stop();
+
+    double wallSecs = clock.elapsed() / 1000.0;
+    double cpuSecs = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    if(wallSecs > 0)
+        result.cpuPerStream = cpuSecs / wallSecs * 100 / params.nStreams;
+    qint64 memory = currentMemory();
+    if(memory && memoryStart)
+        result.memoryPerStream = (memory - memoryStart) / params.nStreams;
+
+    double ttfaSum = 0;
+    foreach(const Stream& stream, streams)
+    {
+        if(stream.firstAudio >= 0)
+        {
+            result.nStarted++;
+            ttfaSum += stream.firstAudio;
+            result.maxTimeToFirstAudio = qMax(result.maxTimeToFirstAudio, static_cast<double>(stream.firstAudio));
+        }
+
+        MSE_SourceUrl* source = qobject_cast<MSE_SourceUrl*>(stream.sound->getCurrentSource());
+        if(source)
+            result.underruns += source->getBufferHealth().underruns;
+    }
+    if(result.nStarted)
+        result.timeToFirstAudio = ttfaSum / result.nStarted;
+
+    result.reconnects = gaps.size();
+    if(!gaps.isEmpty())
+    {
+        double gapSum = 0;
+        foreach(double gap, gaps)
+        {
+            gapSum += gap;
+            result.maxReconnectLatency = qMax(result.maxReconnectLatency, gap);
+        }
+        result.reconnectLatency = gapSum / gaps.size();
+    }
+
+    clearStreams();
+    emit onFinished(result);
+}
+
+/*!
+ * Returns the resident memory of the process in bytes or zero if it's unknown.
+ */
+qint64 MSE_UrlBenchmark::currentMemory()
+{
+#ifdef Q_OS_LINUX
+    QFile f("/proc/self/statm");
+    if(!f.open(QIODevice::ReadOnly))
+        return 0;
+    QList<QByteArray> fields = f.readAll().split(' ');
+    if(fields.size() < 2)
+        return 0;
+    return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE);
+#else
+    return 0;
+#endif
+}
+
+/*!
+ * Compares two results of the same scenario and returns the names of the metrics
+ * that got worse by more than *tolerance* (e.g. 0.2 means 20%).
+ */
+QStringList MSE_UrlBenchmark::findRegressions(
+    const MSE_UrlBenchmarkResult &baseline,
+    const MSE_UrlBenchmarkResult &current,
+    double tolerance)
+{
+    QStringList list;
+    auto check = [&](const char* name, double base, double cur, double slack){
+        if((base < 0) || (cur < 0))
+            return;
+        if(cur > base * (1 + tolerance) + slack)
+            list.append(QString::fromLatin1(name));
+    };
+
+    if(current.nStarted < baseline.nStarted)
+        list.append(QStringLiteral("nStarted"));
+    if((baseline.timeToFirstAudio >= 0) && (current.timeToFirstAudio < 0))
+        list.append(QStringLiteral("timeToFirstAudio"));
+    check("timeToFirstAudio", baseline.timeToFirstAudio, current.timeToFirstAudio, 20);
+    check("maxTimeToFirstAudio", baseline.maxTimeToFirstAudio, current.maxTimeToFirstAudio, 20);
+    check("reconnects", baseline.reconnects, current.reconnects, 0);
+    check("reconnectLatency", baseline.reconnectLatency, current.reconnectLatency, 20);
+    check("maxReconnectLatency", baseline.maxReconnectLatency, current.maxReconnectLatency, 20);
+    check("underruns", baseline.underruns, current.underruns, 0);
+    check("cpuPerStream", baseline.cpuPerStream, current.cpuPerStream, 0.5);
+    check("memoryPerStream", baseline.memoryPerStream, current.memoryPerStream, 64*1024);
+    return list;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "mse/object.h"
+#include "mse/sound.h"
+
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QTimer>
+
+#include <ctime>
+
+/*!
+ * Parameters for MSE_UrlBenchmark.
+ */
+struct MSE_UrlBenchmarkParams {
+    QString url; /*!< The URL to open, e.g. MSE_IcyTestServer::getStreamUrl(). */
+    int nStreams = 1; /*!<
+    Number of streams that are opened simultaneously.
+
+    **Default**: 1
+*/
+    int duration = 10000; /*!<
+    Duration of the run in milliseconds.
+
+    **Default**: 10000
+*/
+    int pollInterval = 20; /*!<
+    The decoded audio is pulled from every stream this often (in milliseconds),
+    as fast as a real output device would pull it.
+
+    **Default**: 20
+*/
+    int minGap = 100; /*!<
+    A silence after the audio has started is counted as a reconnect
+    if it's at least this long (in milliseconds).
+
+    **Default**: 100
+*/
+};
+
+/*!
+ * Results of MSE_UrlBenchmark.
+ * Times are in milliseconds. Negative values mean that nothing was measured.
+ */
+struct MSE_UrlBenchmarkResult {
+    QString url; /*!< The URL that was opened. */
+    int nStreams = 0; /*!< Number of streams opened. */
+    int nStarted = 0; /*!< Number of streams that produced any audio. */
+    double timeToFirstAudio = -1; /*!< Average time from the start to the first non-silent audio. */
+    double maxTimeToFirstAudio = -1; /*!< Maximum time from the start to the first non-silent audio. */
+    int reconnects = 0; /*!< Number of silent gaps after the audio had started. */
+    double reconnectLatency = -1; /*!< Average length of a gap. */
+    double maxReconnectLatency = -1; /*!< Maximum length of a gap. */
+    quint64 underruns = 0; /*!< Total number of network buffer underruns (see MSE_SourceUrl::getBufferHealth()). */
+    double cpuPerStream = 0; /*!< CPU usage per stream in percents of one core. */
+    qint64 memoryPerStream = 0; /*!< Resident memory growth per stream in bytes. Only measured on Linux. */
+
+    QJsonObject toJson() const;
+    static MSE_UrlBenchmarkResult fromJson(const QJsonObject& obj);
+};
+
+/*!
+ * Measures how MSE_SourceUrl copes with a stream:
+ * time-to-first-audio, reconnect latency, CPU and memory per stream.
+ *
+ * The streams are opened with decode-only MSE_Sound objects,
+ * so no output device is needed. Use it together with MSE_IcyTestServer
+ * to get reproducible numbers, and compare the results of different builds
+ * with findRegressions().
+ */
+class MSE_UrlBenchmark : public MSE_Object
+{
+    Q_OBJECT
+public:
+    explicit MSE_UrlBenchmark(QObject* parent = nullptr);
+    ~MSE_UrlBenchmark();
+
+    bool start(const MSE_UrlBenchmarkParams& params);
+    void stop();
+
+    /*!
+     * Returns true if the benchmark is running.
+     */
+    inline bool isRunning() const {return pollTimer.isActive();}
+
+    /*!
+     * Returns the result of the last finished run.
+     */
+    inline const MSE_UrlBenchmarkResult& getResult() const {return result;}
+
+    static QStringList findRegressions(
+        const MSE_UrlBenchmarkResult& baseline,
+        const MSE_UrlBenchmarkResult& current,
+        double tolerance = 0.2);
+
+protected:
+    struct Stream {
+        MSE_Sound* sound = nullptr;
+        qint64 firstAudio = -1;
+        qint64 gapStart = -1;
+    };
+
+    MSE_UrlBenchmarkParams params;
+    MSE_UrlBenchmarkResult result;
+    QList<Stream> streams;
+    QTimer pollTimer;
+    QElapsedTimer clock;
+    std::clock_t cpuStart;
+    qint64 memoryStart;
+    QByteArray pollBuffer;
+    QList<double> gaps;
+
+    void clearStreams();
+    void finish();
+    static qint64 currentMemory();
+    static bool isSilent(const float* samples, int count);
+
+protected slots:
+    void onPoll();
+
+signals:
+    /*!
+     * Emitted when the run is finished.
+     */
+    void onFinished(const MSE_UrlBenchmarkResult& result);
+};
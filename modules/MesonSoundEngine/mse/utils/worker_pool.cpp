@@ -0,0 +1,87 @@
+#include "mse/utils/worker_pool.h"
+#include "mse/utils/scheduling.h"
+
+class MSE_WorkerPoolJob : public QRunnable
+{
+public:
+    MSE_WorkerPoolJob(const MSE_WorkerJob& job, const MSE_CancelTokenPtr& token, const QList<int>& cpus):
+        job(job),
+        token(token),
+        cpus(cpus)
+    {
+    }
+
+    void run()
+    {
+        if(token->isCancelled())
+            return;
+        // the pool threads are not ours to set up, so each job pins the thread it runs on
+        if(!cpus.isEmpty())
+            MSE_Scheduling::setThreadAffinity(0, cpus);
+        job(*token);
+    }
+
+protected:
+    MSE_WorkerJob job;
+    MSE_CancelTokenPtr token;
+    QList<int> cpus;
+};
+
+const int MSE_WorkerPool::shutdownTimeout = 3000; // ms, a job blocked in the network may never return
+
+MSE_WorkerPool::MSE_WorkerPool(QObject *parent) : MSE_Object(parent)
+  ,pool(new QThreadPool())
+{
+    // keep idle threads alive, so the jobs that come in bursts (e.g. reconnects) reuse them
+    pool->setExpiryTimeout(-1);
+}
+
+MSE_WorkerPool::~MSE_WorkerPool()
+{
+    pool->clear();
+    // QThreadPool waits for its threads without a limit when destroyed,
+    // so a pool with the stuck jobs is left to die with the process
+    if(pool->waitForDone(shutdownTimeout))
+        delete pool;
+}
+
+/*!
+ * Sets the maximum number of threads.
+ * Negative value means QThread::idealThreadCount().
+ */
+void MSE_WorkerPool::setMaxThreads(int maxThreads)
+{
+    if(maxThreads < 0)
+        maxThreads = QThread::idealThreadCount();
+    pool->setMaxThreadCount(qMax(1, maxThreads));
+}
+
+/*!
+ * Pins the threads to the *cpus* (zero-based CPU numbers) when they run the jobs.
+ * An empty list means no pinning, but the threads that are already pinned stay pinned.
+ */
+void MSE_WorkerPool::setThreadsCpus(const QList<int> &cpus)
+{
+    this->cpus = cpus;
+}
+
+/*!
+ * Queues the job and returns its cancellation token.
+ * The jobs with higher *priority* are started first.
+ */
+MSE_CancelTokenPtr MSE_WorkerPool::start(const MSE_WorkerJob &job, int priority)
+{
+    MSE_CancelTokenPtr token = MSE_CancelTokenPtr::create();
+    pool->start(new MSE_WorkerPoolJob(job, token, cpus), priority);
+    return token;
+}
+
+/*!
+ * Waits for all jobs to finish.
+ * *timeout* is in milliseconds, negative value means no timeout.
+ * Returns false if the time is out.
+ */
+bool MSE_WorkerPool::waitForDone(int timeout)
+{
+    return pool->waitForDone(timeout);
+}
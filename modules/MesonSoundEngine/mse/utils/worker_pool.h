@@ -0,0 +1,69 @@
+#pragma once
+
+#include "mse/object.h"
+
+#include <QThreadPool>
+#include <QSharedPointer>
+
+#include <atomic>
+#include <functional>
+
+/*!
+ * Cancellation flag shared between the job owner and the job.
+ * The job must check it after every blocking call
+ * and release its results if the job was cancelled.
+ */
+class MSE_CancelToken
+{
+public:
+    inline void cancel() {cancelled.store(true, std::memory_order_release);}
+    inline bool isCancelled() const {return cancelled.load(std::memory_order_acquire);}
+
+protected:
+    std::atomic<bool> cancelled {false};
+};
+
+typedef QSharedPointer<MSE_CancelToken> MSE_CancelTokenPtr;
+
+/*!
+ * The job function for MSE_WorkerPool.
+ */
+typedef std::function<void(const MSE_CancelToken& token)> MSE_WorkerJob;
+
+/*!
+ * A pool of persistent threads for blocking operations
+ * (e.g. BASS stream creation that waits for the network).
+ *
+ * The threads are reused between the jobs, so starting a job does not create a thread.
+ * A job that is cancelled before it starts is not run at all.
+ * A running job is never waited for by the owner; it should notice the cancellation
+ * and clean up after itself.
+ * The destruction waits for the running jobs at most shutdownTimeout milliseconds,
+ * the threads that are still blocked after that are abandoned.
+ */
+class MSE_WorkerPool : public MSE_Object
+{
+    Q_OBJECT
+public:
+    explicit MSE_WorkerPool(QObject *parent = nullptr);
+    ~MSE_WorkerPool();
+
+    void setMaxThreads(int maxThreads);
+    inline int getMaxThreads() const {return pool->maxThreadCount();}
+
+    void setThreadsCpus(const QList<int>& cpus);
+
+    /*!
+     * Returns the CPUs the worker threads are pinned to.
+     */
+    inline const QList<int>& getThreadsCpus() const {return cpus;}
+
+    MSE_CancelTokenPtr start(const MSE_WorkerJob& job, int priority = 0);
+    bool waitForDone(int timeout = -1);
+
+    static const int shutdownTimeout;
+
+protected:
+    QThreadPool* pool;
+    QList<int> cpus;
+};